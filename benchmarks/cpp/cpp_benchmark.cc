@@ -28,8 +28,10 @@
 // (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <mutex>
 #include "benchmark/benchmark.h"
 #include "benchmarks.pb.h"
 #include "datasets/google_message1/proto2/benchmark_message1_proto2.pb.h"
@@ -37,6 +39,11 @@
 #include "datasets/google_message2/benchmark_message2.pb.h"
 #include "datasets/google_message3/benchmark_message3.pb.h"
 #include "datasets/google_message4/benchmark_message4.pb.h"
+#include "google/protobuf/arena_impl.h"
+#include "google/protobuf/descriptor.pb.h"
+#include "google/protobuf/extension_set.h"
+#include "google/protobuf/parse_context.h"
+#include "google/protobuf/wire_format_lite.h"
 
 
 #define PREFIX "dataset."
@@ -48,6 +55,13 @@ using google::protobuf::Descriptor;
 using google::protobuf::DescriptorPool;
 using google::protobuf::Message;
 using google::protobuf::MessageFactory;
+using google::protobuf::RepeatedField;
+using google::protobuf::StringPiece;
+using google::protobuf::internal::ArenaImpl;
+using google::protobuf::internal::ExtensionSet;
+using google::protobuf::internal::InternalMetadata;
+using google::protobuf::internal::ParseContext;
+using google::protobuf::internal::WireFormatLite;
 
 class Fixture : public benchmark::Fixture {
  public:
@@ -191,6 +205,305 @@ class SerializeFixture : public Fixture {
   std::vector<T*> message_;
 };
 
+// Length delimited payload of a packed varint field holding count values
+// that each encode to bytes_per_value bytes.
+std::string PackedVarintPayload(int count, int bytes_per_value) {
+  std::string packed;
+  for (int i = 0; i < count; i++) {
+    uint64_t value = (uint64_t{1} << (7 * (bytes_per_value - 1))) + i % 64;
+    while (value >= 0x80) {
+      packed.push_back(static_cast<char>(value | 0x80));
+      value >>= 7;
+    }
+    packed.push_back(static_cast<char>(value));
+  }
+  std::string payload;
+  uint64_t size = packed.size();
+  while (size >= 0x80) {
+    payload.push_back(static_cast<char>(size | 0x80));
+    size >>= 7;
+  }
+  payload.push_back(static_cast<char>(size));
+  return payload + packed;
+}
+
+// Micro benchmark of the packed varint decoder, independent of the datasets.
+// The benchmark argument is the encoded size of each element in bytes.
+template <typename T,
+          const char* (*Parser)(void*, const char*, ParseContext*)>
+void BM_ParsePackedVarint(benchmark::State& state) {
+  const std::string payload = PackedVarintPayload(4096, state.range(0));
+  size_t total = 0;
+
+  while (state.KeepRunning()) {
+    RepeatedField<T> field;
+    const char* ptr;
+    ParseContext ctx(100, false, &ptr, StringPiece(payload));
+    ptr = Parser(&field, ptr, &ctx);
+    GOOGLE_CHECK(ptr != nullptr);
+    benchmark::DoNotOptimize(field.data());
+    total += payload.size();
+  }
+
+  state.SetBytesProcessed(total);
+}
+BENCHMARK_TEMPLATE(BM_ParsePackedVarint, int32_t,
+                   google::protobuf::internal::PackedInt32Parser)
+    ->DenseRange(1, 5);
+BENCHMARK_TEMPLATE(BM_ParsePackedVarint, uint64_t,
+                   google::protobuf::internal::PackedUInt64Parser)
+    ->DenseRange(1, 10);
+BENCHMARK_TEMPLATE(BM_ParsePackedVarint, int64_t,
+                   google::protobuf::internal::PackedSInt64Parser)
+    ->DenseRange(1, 10);
+
+void AppendVarint(uint64_t value, std::string* s) {
+  while (value >= 0x80) {
+    s->push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  s->push_back(static_cast<char>(value));
+}
+
+// int32 extensions 1..kMaxExtensions, registered on a type that has no
+// extensions of its own.
+const int kMaxExtensions = 1024;
+const google::protobuf::MessageLite* ExtendedType() {
+  static const google::protobuf::MessageLite* type = [] {
+    const google::protobuf::MessageLite* t =
+        &BenchmarkDataset::default_instance();
+    for (int i = 1; i <= kMaxExtensions; i++) {
+      ExtensionSet::RegisterExtension(t, i, WireFormatLite::TYPE_INT32, false,
+                                      false);
+    }
+    return t;
+  }();
+  return type;
+}
+
+// Parses a message holding the given number of extensions, which covers
+// looking up their registrations and inserting them into the ExtensionSet.
+void BM_ParseExtensions(benchmark::State& state) {
+  const google::protobuf::MessageLite* type = ExtendedType();
+  const int count = state.range(0);
+  std::string payload;
+  for (int i = 1; i <= count; i++) {
+    AppendVarint(WireFormatLite::MakeTag(
+                     i, WireFormatLite::WIRETYPE_VARINT), &payload);
+    AppendVarint(i, &payload);
+  }
+
+  while (state.KeepRunning()) {
+    ExtensionSet extensions;
+    InternalMetadata metadata;
+    const char* ptr;
+    ParseContext ctx(100, false, &ptr, StringPiece(payload));
+    while (!ctx.Done(&ptr)) {
+      google::protobuf::uint32 tag;
+      ptr = google::protobuf::internal::ReadTag(ptr, &tag);
+      GOOGLE_CHECK(ptr != nullptr);
+      ptr = extensions.ParseField(tag, ptr, type, &metadata, &ctx);
+      GOOGLE_CHECK(ptr != nullptr);
+    }
+    benchmark::DoNotOptimize(extensions.NumExtensions());
+  }
+
+  state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_ParseExtensions)->Arg(16)->Arg(256)->Arg(kMaxExtensions);
+
+// Reads every extension of a set holding the given number of extensions.
+void BM_GetExtensions(benchmark::State& state) {
+  const int count = state.range(0);
+  ExtensionSet extensions;
+  for (int i = 1; i <= count; i++) {
+    extensions.SetInt32(i, WireFormatLite::TYPE_INT32, i, nullptr);
+  }
+
+  while (state.KeepRunning()) {
+    int sum = 0;
+    for (int i = 1; i <= count; i++) sum += extensions.GetInt32(i, 0);
+    benchmark::DoNotOptimize(sum);
+  }
+
+  state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_GetExtensions)->Arg(16)->Arg(256)->Arg(kMaxExtensions);
+
+// A schema of the given number of files, in dependency order. Every file
+// imports the files stride and twice stride before it, and has messages whose
+// fields refer to them, so that groups of stride files are independent.
+std::vector<google::protobuf::FileDescriptorProto> MakeSchema(int file_count,
+                                                    int stride = 1) {
+  using google::protobuf::DescriptorProto;
+  using google::protobuf::FieldDescriptorProto;
+  const int kMessagesPerFile = 16;
+  const int kFieldsPerMessage = 32;
+  std::vector<google::protobuf::FileDescriptorProto> files(file_count);
+  for (int i = 0; i < file_count; i++) {
+    files[i].set_name("file" + std::to_string(i) + ".proto");
+    files[i].set_package("pkg" + std::to_string(i));
+    for (int dep = i - 2 * stride; dep < i; dep += stride) {
+      if (dep >= 0) files[i].add_dependency(files[dep].name());
+    }
+    for (int m = 0; m < kMessagesPerFile; m++) {
+      DescriptorProto* message = files[i].add_message_type();
+      message->set_name("Message" + std::to_string(m));
+      for (int f = 1; f <= kFieldsPerMessage; f++) {
+        FieldDescriptorProto* field = message->add_field();
+        field->set_name("field" + std::to_string(f));
+        field->set_number(f);
+        field->set_label(FieldDescriptorProto::LABEL_OPTIONAL);
+        if (i >= stride && f % 4 == 0) {
+          int dep = (f % 8 == 0 && i >= 2 * stride) ? i - 2 * stride
+                                                    : i - stride;
+          field->set_type(FieldDescriptorProto::TYPE_MESSAGE);
+          field->set_type_name(".pkg" + std::to_string(dep) + ".Message" +
+                               std::to_string(f % kMessagesPerFile));
+        } else {
+          field->set_type(FieldDescriptorProto::TYPE_INT32);
+        }
+      }
+    }
+  }
+  return files;
+}
+
+// Builds a schema into a new pool one file at a time.
+void BM_BuildFile(benchmark::State& state) {
+  const std::vector<google::protobuf::FileDescriptorProto> files =
+      MakeSchema(state.range(0));
+
+  while (state.KeepRunning()) {
+    DescriptorPool pool;
+    for (const auto& file : files) {
+      GOOGLE_CHECK(pool.BuildFile(file) != nullptr);
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * files.size());
+}
+BENCHMARK(BM_BuildFile)->Arg(64)->Arg(512);
+
+// Builds a schema of groups of 16 independent files, given in reverse
+// dependency order, as one batch on the given number of threads.
+void BM_BuildFiles(benchmark::State& state) {
+  std::vector<google::protobuf::FileDescriptorProto> files =
+      MakeSchema(state.range(0), 16);
+  std::reverse(files.begin(), files.end());
+
+  while (state.KeepRunning()) {
+    DescriptorPool pool;
+    GOOGLE_CHECK(pool.BuildFiles(files, state.range(1), nullptr));
+  }
+
+  state.SetItemsProcessed(state.iterations() * files.size());
+}
+BENCHMARK(BM_BuildFiles)
+    ->Args({64, 1})
+    ->Args({512, 1})
+    ->Args({512, 4})
+    ->Args({512, 16})
+    ->UseRealTime();
+
+namespace google {
+namespace protobuf {
+namespace internal {
+
+// Gives the arena benchmarks access to the SerialArena lookup of ArenaImpl.
+class ArenaBenchmark {
+ public:
+  // Allocates n bytes on arena. Returns false if the calling thread's
+  // SerialArena wasn't found in its thread cache.
+  static bool Allocate(ArenaImpl* arena, size_t n) {
+    ArenaImpl::SerialArena* serial;
+    bool cached = arena->GetSerialArenaFromThreadCache(&serial);
+    benchmark::DoNotOptimize(arena->AllocateAligned(n));
+    return cached;
+  }
+};
+
+}  // namespace internal
+}  // namespace protobuf
+}  // namespace google
+
+// Arenas shared by all threads of a benchmark run. The first thread to start
+// creates them and the last one to finish destroys them.
+class SharedArenas {
+ public:
+  static const std::vector<ArenaImpl*>& Acquire(int count) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (users_++ == 0) {
+      for (int i = 0; i < count; i++) {
+        arenas_.push_back(new ArenaImpl(google::protobuf::ArenaOptions()));
+      }
+    }
+    return arenas_;
+  }
+
+  static void Release() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--users_ == 0) {
+      for (ArenaImpl* arena : arenas_) delete arena;
+      arenas_.clear();
+    }
+  }
+
+ private:
+  static std::mutex mutex_;
+  static int users_;
+  static std::vector<ArenaImpl*> arenas_;
+};
+
+std::mutex SharedArenas::mutex_;
+int SharedArenas::users_ = 0;
+std::vector<ArenaImpl*> SharedArenas::arenas_;
+
+// Many threads allocating from the same arenas, e.g. workers filling in a
+// shared response. Every thread cycles through the number of arenas given as
+// the benchmark argument. cache_misses counts the allocations that had to
+// look up the thread's SerialArena in the arena's list of threads.
+void BM_ArenaSharedAllocate(benchmark::State& state) {
+  using google::protobuf::internal::ArenaBenchmark;
+  const std::vector<ArenaImpl*>& arenas = SharedArenas::Acquire(state.range(0));
+  size_t i = 0;
+  int64_t misses = 0;
+
+  while (state.KeepRunning()) {
+    if (!ArenaBenchmark::Allocate(arenas[i], 16)) misses++;
+    if (++i == arenas.size()) i = 0;
+  }
+
+  SharedArenas::Release();
+  state.counters["cache_misses"] = misses;
+}
+// The iteration count is fixed because nothing is freed until the run ends.
+BENCHMARK(BM_ArenaSharedAllocate)
+    ->Arg(1)
+    ->Arg(4)
+    ->ThreadRange(1, 32)
+    ->Iterations(1 << 18)
+    ->UseRealTime();
+
+// Teardown of an arena holding the strings of many string fields. The
+// benchmark argument is the length of the strings; beyond the small string
+// buffer each of them owns a heap allocation.
+void BM_ArenaResetStrings(benchmark::State& state) {
+  const int kNumStrings = 10000;
+  const std::string value(state.range(0), 'x');
+  Arena arena;
+
+  while (state.KeepRunning()) {
+    for (int i = 0; i < kNumStrings; i++) {
+      Arena::Create<std::string>(&arena, value);
+    }
+    arena.Reset();
+  }
+
+  state.SetItemsProcessed(state.iterations() * kNumStrings);
+}
+BENCHMARK(BM_ArenaResetStrings)->Arg(8)->Arg(64);
+
 std::string ReadFile(const std::string& name) {
   std::ifstream file(name.c_str());
   GOOGLE_CHECK(file.is_open()) << "Couldn't find file '" << name <<
@@ -243,7 +556,8 @@ int main(int argc, char *argv[]) {
     std::cerr << "Usage: ./cpp-benchmark <input data>" << std::endl;
     std::cerr << "input data is in the format of \"benchmarks.proto\""
         << std::endl;
-    return 1;
+    std::cerr << "Without input data only the micro benchmarks are run."
+        << std::endl;
   } else {
     for (int i = 1; i < argc; i++) {
       RegisterBenchmarks(ReadFile(argv[i]));
@@ -2,6 +2,7 @@ set(libprotobuf_files
   ${protobuf_source_dir}/src/google/protobuf/any.cc
   ${protobuf_source_dir}/src/google/protobuf/any.pb.cc
   ${protobuf_source_dir}/src/google/protobuf/api.pb.cc
+  ${protobuf_source_dir}/src/google/protobuf/arena_profile.cc
   ${protobuf_source_dir}/src/google/protobuf/compiler/importer.cc
   ${protobuf_source_dir}/src/google/protobuf/compiler/parser.cc
   ${protobuf_source_dir}/src/google/protobuf/descriptor.cc
@@ -42,6 +43,8 @@ set(libprotobuf_files
   ${protobuf_source_dir}/src/google/protobuf/util/internal/proto_writer.cc
   ${protobuf_source_dir}/src/google/protobuf/util/internal/protostream_objectsource.cc
   ${protobuf_source_dir}/src/google/protobuf/util/internal/protostream_objectwriter.cc
+  ${protobuf_source_dir}/src/google/protobuf/util/internal/reflection_objectsource.cc
+  ${protobuf_source_dir}/src/google/protobuf/util/internal/reflection_objectwriter.cc
   ${protobuf_source_dir}/src/google/protobuf/util/internal/type_info.cc
   ${protobuf_source_dir}/src/google/protobuf/util/internal/type_info_test_helper.cc
   ${protobuf_source_dir}/src/google/protobuf/util/internal/utility.cc
@@ -57,6 +60,7 @@ set(libprotobuf_includes
   ${protobuf_source_dir}/src/google/protobuf/any.h
   ${protobuf_source_dir}/src/google/protobuf/any.pb.h
   ${protobuf_source_dir}/src/google/protobuf/api.pb.h
+  ${protobuf_source_dir}/src/google/protobuf/arena_profile.h
   ${protobuf_source_dir}/src/google/protobuf/compiler/importer.h
   ${protobuf_source_dir}/src/google/protobuf/compiler/parser.h
   ${protobuf_source_dir}/src/google/protobuf/descriptor.h
@@ -95,6 +99,8 @@ set(libprotobuf_includes
   ${protobuf_source_dir}/src/google/protobuf/util/internal/proto_writer.h
   ${protobuf_source_dir}/src/google/protobuf/util/internal/protostream_objectsource.h
   ${protobuf_source_dir}/src/google/protobuf/util/internal/protostream_objectwriter.h
+  ${protobuf_source_dir}/src/google/protobuf/util/internal/reflection_objectsource.h
+  ${protobuf_source_dir}/src/google/protobuf/util/internal/reflection_objectwriter.h
   ${protobuf_source_dir}/src/google/protobuf/util/internal/type_info.h
   ${protobuf_source_dir}/src/google/protobuf/util/internal/type_info_test_helper.h
   ${protobuf_source_dir}/src/google/protobuf/util/internal/utility.h
@@ -127,6 +133,9 @@ if(MSVC AND protobuf_BUILD_SHARED_LIBS)
     PUBLIC  PROTOBUF_USE_DLLS
     PRIVATE LIBPROTOBUF_EXPORTS)
 endif()
+if(protobuf_MAP_SWISS_TABLE)
+  target_compile_definitions(libprotobuf PUBLIC PROTOBUF_MAP_SWISS_TABLE)
+endif()
 set_target_properties(libprotobuf PROPERTIES
     VERSION ${protobuf_VERSION}
     OUTPUT_NAME ${LIB_PREFIX}protobuf
@@ -82,15 +82,20 @@ set(tests_protos
   google/protobuf/util/message_differencer_unittest.proto
 )
 
+# An optional second argument is passed to the C++ generator as its options.
 macro(compile_proto_file filename)
   get_filename_component(dirname ${filename} PATH)
   get_filename_component(basename ${filename} NAME_WE)
+  set(cpp_out ${protobuf_source_dir}/src)
+  if(${ARGC} GREATER 1)
+    set(cpp_out ${ARGV1}:${protobuf_source_dir}/src)
+  endif()
   add_custom_command(
     OUTPUT ${protobuf_source_dir}/src/${dirname}/${basename}.pb.cc
     DEPENDS ${protobuf_PROTOC_EXE} ${protobuf_source_dir}/src/${dirname}/${basename}.proto
     COMMAND ${protobuf_PROTOC_EXE} ${protobuf_source_dir}/src/${dirname}/${basename}.proto
         --proto_path=${protobuf_source_dir}/src
-        --cpp_out=${protobuf_source_dir}/src
+        --cpp_out=${cpp_out}
         --experimental_allow_proto3_optional
   )
 endmacro(compile_proto_file)
@@ -111,6 +116,20 @@ foreach(proto_file ${tests_protos})
       ${protobuf_source_dir}/src/${pb_file})
 endforeach(proto_file)
 
+# Each google/protobuf/unittest_<option>.proto is generated with the C++
+# generator option it is named after.
+set(tests_cpp_options
+  inline_repeated_fields
+  lazy_fields
+  string_piece_fields
+)
+
+foreach(cpp_option ${tests_cpp_options})
+  compile_proto_file(google/protobuf/unittest_${cpp_option}.proto ${cpp_option})
+  set(tests_proto_files ${tests_proto_files}
+      ${protobuf_source_dir}/src/google/protobuf/unittest_${cpp_option}.pb.cc)
+endforeach(cpp_option)
+
 set(common_test_files
   ${protobuf_source_dir}/src/google/protobuf/arena_test_util.cc
   ${protobuf_source_dir}/src/google/protobuf/map_test_util.inc
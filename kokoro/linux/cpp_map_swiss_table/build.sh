@@ -0,0 +1,14 @@
+#!/bin/bash
+#
+# Build file to set up and run tests with the open addressing Map
+
+set -ex  # exit immediately on error
+
+# Change to repo root
+cd $(dirname $0)/../../..
+
+DOCKER_IMAGE_NAME=protobuf/protoc_$(sha1sum protoc-artifacts/Dockerfile | cut -f1 -d " ")
+until docker pull $DOCKER_IMAGE_NAME; do sleep 10; done
+
+docker run -v $(pwd):/var/local/protobuf --rm $DOCKER_IMAGE_NAME \
+  bash -l /var/local/protobuf/tests.sh cpp_map_swiss_table
@@ -117,7 +117,10 @@ def _proto_gen_impl(ctx):
         use_grpc_plugin = (ctx.attr.plugin_language == "grpc" and ctx.attr.plugin)
         path_tpl = "$(realpath %s)" if in_gen_dir else "%s"
         if ctx.attr.gen_cc:
-            args += [("--cpp_out=" + path_tpl) % gen_dir]
+            cc_outdir = path_tpl % gen_dir
+            if ctx.attr.gen_cc_options:
+                cc_outdir = ",".join(ctx.attr.gen_cc_options) + ":" + cc_outdir
+            args += ["--cpp_out=" + cc_outdir]
             outs.extend(_CcOuts([src.basename], use_grpc_plugin = use_grpc_plugin))
         if ctx.attr.gen_py:
             args += [("--python_out=" + path_tpl) % gen_dir]
@@ -203,6 +206,7 @@ proto_gen = rule(
         "plugin_language": attr.string(),
         "plugin_options": attr.string_list(),
         "gen_cc": attr.bool(),
+        "gen_cc_options": attr.string_list(),
         "gen_py": attr.bool(),
         "outs": attr.output_list(),
     },
@@ -226,6 +230,7 @@ Args:
   plugin_language: the language of the generated sources
   plugin_options: a list of options to be passed to the plugin
   gen_cc: generates C++ sources in addition to the ones from the plugin.
+  gen_cc_options: a list of options to be passed to the C++ generator.
   gen_py: generates Python sources in addition to the ones from the plugin.
   outs: a list of labels of the expected outputs from the protocol compiler.
 """
@@ -262,6 +267,7 @@ def cc_proto_library(
         protoc = "@com_google_protobuf//:protoc",
         use_grpc_plugin = False,
         default_runtime = "@com_google_protobuf//:protobuf",
+        cc_options = [],
         **kargs):
     """Bazel rule to create a C++ protobuf library from proto source files
 
@@ -281,6 +287,7 @@ def cc_proto_library(
           when processing the proto files.
       default_runtime: the implicitly default runtime which will be depended on by
           the generated cc_library target.
+      cc_options: a list of options to be passed to the C++ generator.
       **kargs: other keyword arguments that are passed to cc_library.
     """
 
@@ -305,6 +312,7 @@ def cc_proto_library(
         plugin = grpc_cpp_plugin,
         plugin_language = "grpc",
         gen_cc = 1,
+        gen_cc_options = cc_options,
         outs = outs,
         visibility = ["//visibility:public"],
     )
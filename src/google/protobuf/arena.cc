@@ -42,8 +42,9 @@
 
 #include <google/protobuf/port_def.inc>
 
-static const size_t kMinCleanupListElements = 8;
-static const size_t kMaxCleanupListElements = 64;  // 1kB on 64-bit.
+// Sizes of the cleanup chunks, which hold both cleanup nodes and strings.
+static const size_t kMinCleanupChunkBytes = 128;   // 8 nodes on 64-bit.
+static const size_t kMaxCleanupChunkBytes = 2048;  // 64 strings on libstdc++.
 
 namespace google {
 namespace protobuf {
@@ -59,17 +60,17 @@ ArenaImpl::ThreadCache& ArenaImpl::thread_cache() {
 }
 #elif defined(PROTOBUF_USE_DLLS)
 ArenaImpl::ThreadCache& ArenaImpl::thread_cache() {
-  static PROTOBUF_THREAD_LOCAL ThreadCache thread_cache_ = {-1, NULL};
+  static PROTOBUF_THREAD_LOCAL ThreadCache thread_cache_;
   return thread_cache_;
 }
 #else
-PROTOBUF_THREAD_LOCAL ArenaImpl::ThreadCache ArenaImpl::thread_cache_ = {-1,
-                                                                         NULL};
+PROTOBUF_THREAD_LOCAL ArenaImpl::ThreadCache ArenaImpl::thread_cache_;
 #endif
 
 void ArenaImpl::Init() {
+  // Ids start at 1 so they never match an empty ThreadCache entry.
   lifecycle_id_ =
-      lifecycle_id_generator_.fetch_add(1, std::memory_order_relaxed);
+      lifecycle_id_generator_.fetch_add(1, std::memory_order_relaxed) + 1;
   hint_.store(nullptr, std::memory_order_relaxed);
   threads_.store(nullptr, std::memory_order_relaxed);
 
@@ -91,6 +92,7 @@ void ArenaImpl::Init() {
 }
 
 ArenaImpl::~ArenaImpl() {
+  RecordSpaceUsed();
   // Have to do this in a first pass, because some of the destructors might
   // refer to memory in other blocks.
   CleanupList();
@@ -98,6 +100,7 @@ ArenaImpl::~ArenaImpl() {
 }
 
 uint64 ArenaImpl::Reset() {
+  RecordSpaceUsed();
   // Have to do this in a first pass, because some of the destructors might
   // refer to memory in other blocks.
   CleanupList();
@@ -114,6 +117,9 @@ ArenaImpl::Block* ArenaImpl::NewBlock(Block* last_block, size_t min_bytes) {
     size = std::min(2 * last_block->size(), options_.max_block_size);
   } else {
     size = options_.start_block_size;
+    if (options_.size_policy != NULL) {
+      size = std::max(size, options_.size_policy->StartBlockSize());
+    }
   }
   // Verify that min_bytes + kBlockHeaderSize won't overflow.
   GOOGLE_CHECK_LE(min_bytes, std::numeric_limits<size_t>::max() - kBlockHeaderSize);
@@ -128,20 +134,27 @@ ArenaImpl::Block* ArenaImpl::NewBlock(Block* last_block, size_t min_bytes) {
 ArenaImpl::Block::Block(size_t size, Block* next)
     : next_(next), pos_(kBlockHeaderSize), size_(size) {}
 
-PROTOBUF_NOINLINE
-void ArenaImpl::SerialArena::AddCleanupFallback(void* elem,
-                                                void (*cleanup)(void*)) {
-  size_t size = cleanup_ ? cleanup_->size * 2 : kMinCleanupListElements;
-  size = std::min(size, kMaxCleanupListElements);
-  size_t bytes = internal::AlignUpTo8(CleanupChunk::SizeOf(size));
-  CleanupChunk* list = reinterpret_cast<CleanupChunk*>(AllocateAligned(bytes));
+void ArenaImpl::SerialArena::AddCleanupChunk() {
+  size_t size = cleanup_ ? cleanup_->size * 2 : kMinCleanupChunkBytes;
+  size = std::min(size, kMaxCleanupChunkBytes);
+  CleanupChunk* list = reinterpret_cast<CleanupChunk*>(
+      AllocateAligned(internal::AlignUpTo8(CleanupChunk::SizeOf(size))));
+  if (cleanup_ != NULL) {
+    cleanup_->nodes_end = cleanup_ptr_;
+    cleanup_->strings_begin = cleanup_limit_;
+  }
   list->next = cleanup_;
   list->size = size;
 
   cleanup_ = list;
-  cleanup_ptr_ = &list->nodes[0];
-  cleanup_limit_ = &list->nodes[size];
+  cleanup_ptr_ = list->begin();
+  cleanup_limit_ = list->end();
+}
 
+PROTOBUF_NOINLINE
+void ArenaImpl::SerialArena::AddCleanupFallback(void* elem,
+                                                void (*cleanup)(void*)) {
+  AddCleanupChunk();
   AddCleanup(elem, cleanup);
 }
 
@@ -181,6 +194,17 @@ void ArenaImpl::AddCleanupFallback(void* elem, void (*cleanup)(void*)) {
   GetSerialArenaFallback(&thread_cache())->AddCleanup(elem, cleanup);
 }
 
+PROTOBUF_NOINLINE
+void* ArenaImpl::AllocateStringFallback() {
+  return GetSerialArenaFallback(&thread_cache())->AllocateString();
+}
+
+PROTOBUF_NOINLINE
+void* ArenaImpl::SerialArena::AllocateStringFallback() {
+  AddCleanupChunk();
+  return AllocateString();
+}
+
 PROTOBUF_NOINLINE
 void* ArenaImpl::SerialArena::AllocateAlignedFallback(size_t n) {
   // Sync back to current's pos.
@@ -210,6 +234,18 @@ uint64 ArenaImpl::SpaceUsed() const {
   return space_used;
 }
 
+void ArenaImpl::RecordSpaceUsed() {
+  if (options_.size_policy == NULL) return;
+  // Every thread starts its own first block, so size them after the busiest
+  // thread rather than after the arena as a whole.
+  uint64 max_space_used = 0;
+  SerialArena* serial = threads_.load(std::memory_order_relaxed);
+  for (; serial; serial = serial->next()) {
+    max_space_used = std::max(max_space_used, serial->SpaceUsed());
+  }
+  options_.size_policy->RecordSpaceUsed(max_space_used);
+}
+
 uint64 ArenaImpl::SerialArena::SpaceUsed() const {
   // Get current block's size from ptr_ (since we can't trust head_->pos().
   uint64 space_used = ptr_ - head_->Pointer(kBlockHeaderSize);
@@ -277,6 +313,12 @@ void ArenaImpl::CleanupList() {
   for (; serial; serial = serial->next()) {
     serial->CleanupList();
   }
+  // Strings don't refer to anything else on the arena, so they go last in case
+  // one of the destructors above looks at them.
+  serial = threads_.load(std::memory_order_relaxed);
+  for (; serial; serial = serial->next()) {
+    serial->DestroyStrings();
+  }
 }
 
 void ArenaImpl::SerialArena::CleanupList() {
@@ -286,22 +328,34 @@ void ArenaImpl::SerialArena::CleanupList() {
 }
 
 void ArenaImpl::SerialArena::CleanupListFallback() {
-  // The first chunk might be only partially full, so calculate its size
-  // from cleanup_ptr_. Subsequent chunks are always full, so use list->size.
-  size_t n = cleanup_ptr_ - &cleanup_->nodes[0];
-  CleanupChunk* list = cleanup_;
-  while (true) {
-    CleanupNode* node = &list->nodes[0];
+  cleanup_->nodes_end = cleanup_ptr_;
+  cleanup_->strings_begin = cleanup_limit_;
+  for (CleanupChunk* list = cleanup_; list != nullptr; list = list->next) {
+    CleanupNode* node = reinterpret_cast<CleanupNode*>(list->begin());
     // Cleanup newest elements first (allocated last).
-    for (size_t i = n; i > 0; i--) {
+    for (size_t i = (list->nodes_end - list->begin()) / sizeof(CleanupNode);
+         i > 0; i--) {
       node[i - 1].cleanup(node[i - 1].elem);
     }
-    list = list->next;
-    if (list == nullptr) {
-      break;
+  }
+}
+
+void ArenaImpl::SerialArena::DestroyStrings() {
+  if (cleanup_ != NULL) {
+    DestroyStringsFallback();
+  }
+}
+
+void ArenaImpl::SerialArena::DestroyStringsFallback() {
+  cleanup_->strings_begin = cleanup_limit_;
+  for (CleanupChunk* list = cleanup_; list != nullptr; list = list->next) {
+    // Unlike the cleanup nodes these are direct calls which get inlined, so a
+    // string that never spilled to the heap costs next to nothing.
+    std::string* strings = reinterpret_cast<std::string*>(list->strings_begin);
+    std::string* end = reinterpret_cast<std::string*>(list->end());
+    for (; strings != end; ++strings) {
+      strings->~basic_string();
     }
-    // All but the first chunk are always full.
-    n = list->size;
   }
 }
 
@@ -370,12 +424,300 @@ void Arena::CallDestructorHooks() {
   }
 }
 
-void Arena::OnArenaAllocation(const std::type_info* allocated_type,
-                              size_t n) const {
-  if (on_arena_allocation_ != NULL) {
+void Arena::OnArenaAllocation(const std::type_info* allocated_type, size_t n,
+                              const void* container) const {
+  if (container != NULL && on_arena_container_allocation_ != NULL) {
+    on_arena_container_allocation_(container, allocated_type, n, hooks_cookie_);
+  } else if (on_arena_allocation_ != NULL) {
     on_arena_allocation_(allocated_type, n, hooks_cookie_);
   }
 }
 
+void Arena::OnMessageCreation(const std::type_info* allocated_type,
+                              const void* object, size_t n,
+                              const Message* message) const {
+  if (on_arena_message_creation_ != NULL) {
+    on_arena_message_creation_(allocated_type, object, n, message,
+                               hooks_cookie_);
+  }
+}
+
+void ArenaSizePolicy::RecordSpaceUsed(uint64 space_used) {
+  uint64 mark = high_water_mark_.load(std::memory_order_relaxed);
+  uint64 new_mark;
+  do {
+    // Jump up to a new maximum, but move down by only an eighth of the gap.
+    new_mark = space_used >= mark ? space_used : mark - (mark - space_used) / 8;
+  } while (new_mark != mark &&
+           !high_water_mark_.compare_exchange_weak(mark, new_mark,
+                                                   std::memory_order_relaxed));
+}
+
+size_t ArenaSizePolicy::StartBlockSize() const {
+  uint64 mark = high_water_mark_.load(std::memory_order_relaxed);
+  if (mark == 0) return 0;
+  uint64 size = mark + internal::ArenaImpl::kBlockHeaderSize +
+                internal::ArenaImpl::kSerialArenaSize;
+  if (size >= max_start_block_size_) return max_start_block_size_;
+  // Round up to a power of two, which is also what ArenaBlockCache caches.
+  size = uint64{1} << (Bits::Log2FloorNonZero64(size - 1) + 1);
+  return static_cast<size_t>((std::min)(size, uint64{max_start_block_size_}));
+}
+
+namespace {
+
+const int kMinCachedBlockSizeLog2 = 8;
+const int kMaxCachedBlockSizeLog2 = 20;
+const int kNumBlockSizeClasses =
+    kMaxCachedBlockSizeLog2 - kMinCachedBlockSizeLog2 + 1;
+// A thread keeps up to this many bytes per size class in its own lists.
+const size_t kMaxThreadCachedBytes = 256 << 10;
+// The shared pool keeps up to this many times a thread's budget per class.
+const size_t kSharedPoolFactor = 16;
+
+static_assert(ArenaBlockCache::kMinBlockSize == 1 << kMinCachedBlockSizeLog2,
+              "kMinBlockSize must match kMinCachedBlockSizeLog2");
+static_assert(ArenaBlockCache::kMaxBlockSize == 1 << kMaxCachedBlockSizeLog2,
+              "kMaxBlockSize must match kMaxCachedBlockSizeLog2");
+
+// Returns the size class of a block of |size| bytes or -1 if the size isn't
+// cached.
+int BlockSizeClass(size_t size) {
+  if (size < ArenaBlockCache::kMinBlockSize ||
+      size > ArenaBlockCache::kMaxBlockSize || (size & (size - 1)) != 0) {
+    return -1;
+  }
+  return Bits::Log2FloorNonZero64(size) - kMinCachedBlockSizeLog2;
+}
+
+size_t BlockSize(int size_class) {
+  return size_t{1} << (size_class + kMinCachedBlockSizeLog2);
+}
+
+// Maximum number of blocks of a size class in a single thread's list.
+size_t MaxThreadBlocks(int size_class) {
+  return std::max<size_t>(2, kMaxThreadCachedBytes / BlockSize(size_class));
+}
+
+struct BlockCacheCounters {
+  std::atomic<uint64> hits{0};
+  std::atomic<uint64> misses{0};
+  std::atomic<uint64> uncached{0};
+  std::atomic<uint64> releases{0};
+  std::atomic<uint64> cached_bytes{0};
+};
+
+BlockCacheCounters* block_cache_counters() {
+  static BlockCacheCounters* counters = new BlockCacheCounters;
+  return counters;
+}
+
+// Intrusive singly linked list threaded through the free blocks themselves.
+struct BlockList {
+  struct Node {
+    Node* next;
+  };
+  Node* head = nullptr;
+  size_t count = 0;
+
+  void Push(void* block) {
+    Node* node = static_cast<Node*>(block);
+    node->next = head;
+    head = node;
+    count++;
+  }
+  void* Pop() {
+    Node* node = head;
+    if (node != nullptr) {
+      head = node->next;
+      count--;
+    }
+    return node;
+  }
+};
+
+// Frees all blocks in |list|, which must hold blocks of |size_class|.
+void FreeBlockList(int size_class, BlockList* list) {
+  size_t size = BlockSize(size_class);
+  block_cache_counters()->cached_bytes.fetch_sub(list->count * size,
+                                                 std::memory_order_relaxed);
+  while (void* block = list->Pop()) {
+    internal::arena_free(block, size);
+  }
+}
+
+class SharedBlockPool {
+ public:
+  // Moves up to |n| blocks of |size_class| from the pool to |list|.
+  void Take(int size_class, size_t n, BlockList* list) {
+    MutexLock lock(&mutex_);
+    BlockList* pool = &lists_[size_class];
+    while (n-- > 0 && pool->head != nullptr) list->Push(pool->Pop());
+  }
+
+  // Moves |n| blocks of |size_class| from |list| to the pool. Blocks that
+  // don't fit in the pool are freed.
+  void Give(int size_class, size_t n, BlockList* list) {
+    BlockList overflow;
+    {
+      MutexLock lock(&mutex_);
+      BlockList* pool = &lists_[size_class];
+      size_t capacity = MaxThreadBlocks(size_class) * kSharedPoolFactor;
+      while (n-- > 0 && list->head != nullptr) {
+        (pool->count < capacity ? pool : &overflow)->Push(list->Pop());
+      }
+    }
+    block_cache_counters()->releases.fetch_add(overflow.count,
+                                               std::memory_order_relaxed);
+    FreeBlockList(size_class, &overflow);
+  }
+
+  void Trim() {
+    BlockList lists[kNumBlockSizeClasses];
+    {
+      MutexLock lock(&mutex_);
+      std::swap(lists, lists_);
+    }
+    for (int i = 0; i < kNumBlockSizeClasses; i++) {
+      FreeBlockList(i, &lists[i]);
+    }
+  }
+
+ private:
+  Mutex mutex_;
+  BlockList lists_[kNumBlockSizeClasses];
+};
+
+SharedBlockPool* shared_block_pool() {
+  // Intentionally leaked, threads can return their blocks during shutdown.
+  static SharedBlockPool* pool = new SharedBlockPool;
+  return pool;
+}
+
+// A thread's lists. Trivially destructible so that it stays valid while the
+// thread's other thread locals are destroyed, some of which may hold arenas
+// that return their blocks.
+struct ThreadBlockCache {
+  enum State { kUnused, kInUse, kFlushed };
+
+  BlockList lists[kNumBlockSizeClasses];
+  State state = kUnused;
+
+  // Moves all blocks to the shared pool.
+  void Flush() {
+    for (int i = 0; i < kNumBlockSizeClasses; i++) {
+      shared_block_pool()->Give(i, lists[i].count, &lists[i]);
+    }
+  }
+};
+
+#if !defined(GOOGLE_PROTOBUF_NO_THREADLOCAL)
+// Flushes a thread's cache when the thread exits. Blocks returned after that
+// go to the shared pool directly.
+class ThreadBlockCacheFlusher {
+ public:
+  explicit ThreadBlockCacheFlusher(ThreadBlockCache* cache) : cache_(cache) {
+    cache_->state = ThreadBlockCache::kInUse;
+  }
+  ~ThreadBlockCacheFlusher() {
+    cache_->Flush();
+    cache_->state = ThreadBlockCache::kFlushed;
+  }
+
+ private:
+  ThreadBlockCache* cache_;
+};
+
+PROTOBUF_NOINLINE void RegisterThreadBlockCache(ThreadBlockCache* cache) {
+  static thread_local ThreadBlockCacheFlusher flusher(cache);
+}
+#endif  // !GOOGLE_PROTOBUF_NO_THREADLOCAL
+
+// Returns the calling thread's lists, or NULL if the platform has no usable
+// thread locals or the thread is exiting, in which case blocks go through the
+// shared pool.
+ThreadBlockCache* thread_block_cache() {
+#if defined(GOOGLE_PROTOBUF_NO_THREADLOCAL)
+  return NULL;
+#else
+  static PROTOBUF_THREAD_LOCAL ThreadBlockCache cache;
+  if (PROTOBUF_PREDICT_FALSE(cache.state != ThreadBlockCache::kInUse)) {
+    if (cache.state == ThreadBlockCache::kFlushed) return NULL;
+    RegisterThreadBlockCache(&cache);
+  }
+  return &cache;
+#endif
+}
+
+}  // namespace
+
+void* ArenaBlockCache::Allocate(size_t size) {
+  BlockCacheCounters* counters = block_cache_counters();
+  int size_class = BlockSizeClass(size);
+  if (size_class < 0) {
+    counters->uncached.fetch_add(1, std::memory_order_relaxed);
+    return ::operator new(size);
+  }
+  BlockList local;
+  ThreadBlockCache* cache = thread_block_cache();
+  BlockList* list = cache != NULL ? &cache->lists[size_class] : &local;
+  if (list->head == nullptr) {
+    // Refill with half a budget so the next allocations don't need the lock.
+    size_t n = cache != NULL ? MaxThreadBlocks(size_class) / 2 : 1;
+    shared_block_pool()->Take(size_class, n, list);
+  }
+  void* block = list->Pop();
+  if (block == nullptr) {
+    counters->misses.fetch_add(1, std::memory_order_relaxed);
+    return ::operator new(size);
+  }
+  counters->hits.fetch_add(1, std::memory_order_relaxed);
+  counters->cached_bytes.fetch_sub(size, std::memory_order_relaxed);
+  return block;
+}
+
+void ArenaBlockCache::Deallocate(void* block, size_t size) {
+  int size_class = BlockSizeClass(size);
+  if (size_class < 0) {
+    internal::arena_free(block, size);
+    return;
+  }
+  block_cache_counters()->cached_bytes.fetch_add(size,
+                                                 std::memory_order_relaxed);
+  ThreadBlockCache* cache = thread_block_cache();
+  if (cache == NULL) {
+    BlockList local;
+    local.Push(block);
+    shared_block_pool()->Give(size_class, 1, &local);
+    return;
+  }
+  BlockList* list = &cache->lists[size_class];
+  list->Push(block);
+  if (list->count > MaxThreadBlocks(size_class)) {
+    shared_block_pool()->Give(size_class, list->count / 2, list);
+  }
+}
+
+ArenaBlockCache::Stats ArenaBlockCache::GetStats() {
+  BlockCacheCounters* counters = block_cache_counters();
+  Stats stats;
+  stats.hits = counters->hits.load(std::memory_order_relaxed);
+  stats.misses = counters->misses.load(std::memory_order_relaxed);
+  stats.uncached = counters->uncached.load(std::memory_order_relaxed);
+  stats.releases = counters->releases.load(std::memory_order_relaxed);
+  stats.cached_bytes = counters->cached_bytes.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void ArenaBlockCache::Trim() {
+  ThreadBlockCache* cache = thread_block_cache();
+  if (cache != NULL) {
+    for (int i = 0; i < kNumBlockSizeClasses; i++) {
+      FreeBlockList(i, &cache->lists[i]);
+    }
+  }
+  shared_block_pool()->Trim();
+}
+
 }  // namespace protobuf
 }  // namespace google
@@ -77,11 +77,20 @@ class Message;  // defined in message.h
 class MessageLite;
 template <typename Key, typename T>
 class Map;
+template <typename Element>
+class RepeatedField;  // defined in repeated_field.h
 
 namespace arena_metrics {
 
+// Makes arenas created with |options| record their allocations in the
+// process-wide ArenaProfile, see arena_profile.h.
 void EnableArenaMetrics(ArenaOptions* options);
 
+// Like EnableArenaMetrics(), and also attributes the storage of containers to
+// the message fields holding them. This keeps track of every message created
+// on the arenas, see arena_profile.h.
+void EnableArenaFieldMetrics(ArenaOptions* options);
+
 }  // namespace arena_metrics
 
 namespace internal {
@@ -89,6 +98,8 @@ namespace internal {
 struct ArenaStringPtr;  // defined in arenastring.h
 class LazyField;        // defined in lazy_field.h
 class EpsCopyInputStream;  // defined in parse_context.h
+class MapNodePool;         // defined in map.h
+class RepeatedPtrFieldBase;  // defined in repeated_field.h
 
 template <typename Type>
 class GenericTypeHandler;  // defined in repeated_field.h
@@ -113,6 +124,47 @@ inline void arena_free(void* object, size_t size) {
 
 }  // namespace internal
 
+// ArenaSizePolicy sizes the first block of an arena after the arenas that came
+// before it. Servers typically create an arena per request, and requests of the
+// same kind tend to use a similar amount of memory. With the default options
+// such an arena starts at kDefaultStartBlockSize and doubles its way up, paying
+// for several block allocations per request. Arenas that share a policy, e.g.
+//
+//   static ArenaSizePolicy* policy = new ArenaSizePolicy;
+//   ArenaOptions options;
+//   options.size_policy = policy;
+//
+// report the space they used when they are reset or destroyed, and new arenas
+// start with a block large enough to hold that much. The policy tracks a
+// high-water mark: it follows increases immediately and decays slowly towards
+// lower usage, so an occasional small request doesn't shrink the blocks of the
+// following large ones. The start block size is rounded up to a power of two
+// and never exceeds max_start_block_size(). A policy is thread-safe and must
+// outlive all arenas that use it.
+class PROTOBUF_EXPORT ArenaSizePolicy {
+ public:
+  static const size_t kDefaultMaxStartBlockSize = 1 << 20;
+
+  ArenaSizePolicy() : ArenaSizePolicy(kDefaultMaxStartBlockSize) {}
+  explicit ArenaSizePolicy(size_t max_start_block_size)
+      : max_start_block_size_(max_start_block_size), high_water_mark_(0) {}
+
+  // Records that an arena, or one thread's part of it, used |space_used| bytes.
+  void RecordSpaceUsed(uint64 space_used);
+
+  // Returns the size of the first block that holds the high-water mark, or 0
+  // if nothing was recorded yet.
+  size_t StartBlockSize() const;
+
+  size_t max_start_block_size() const { return max_start_block_size_; }
+
+ private:
+  const size_t max_start_block_size_;
+  std::atomic<uint64> high_water_mark_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(ArenaSizePolicy);
+};
+
 // ArenaOptions provides optional additional parameters to arena construction
 // that control its block-allocation behavior.
 struct ArenaOptions {
@@ -146,6 +198,11 @@ struct ArenaOptions {
   // calls free.
   void (*block_dealloc)(void*, size_t);
 
+  // A policy that sizes the first block from the space used by earlier arenas
+  // sharing it, or NULL to always start with start_block_size. See
+  // ArenaSizePolicy above.
+  ArenaSizePolicy* size_policy;
+
   ArenaOptions()
       : start_block_size(kDefaultStartBlockSize),
         max_block_size(kDefaultMaxBlockSize),
@@ -153,10 +210,13 @@ struct ArenaOptions {
         initial_block_size(0),
         block_alloc(&::operator new),
         block_dealloc(&internal::arena_free),
+        size_policy(NULL),
         on_arena_init(NULL),
         on_arena_reset(NULL),
         on_arena_destruction(NULL),
-        on_arena_allocation(NULL) {}
+        on_arena_allocation(NULL),
+        on_arena_container_allocation(NULL),
+        on_arena_message_creation(NULL) {}
 
  private:
   // Hooks for adding external functionality such as user-specific metrics
@@ -181,16 +241,75 @@ struct ArenaOptions {
   void (*on_arena_allocation)(const std::type_info* allocated_type,
                               uint64 alloc_size, void* cookie);
 
+  // Replaces on_arena_allocation for the storage that a container
+  // (RepeatedField, RepeatedPtrField, Map or ArenaStringPtr) allocates for its
+  // contents. |container| is the address of the container itself, which lets
+  // the hook attribute the bytes to the message field holding it.
+  void (*on_arena_container_allocation)(const void* container,
+                                        const std::type_info* allocated_type,
+                                        uint64 alloc_size, void* cookie);
+
+  // Called after a message (or another arena-constructable object) has been
+  // constructed on the arena, with its address and size. |message| is the
+  // object as a Message if it is one, NULL otherwise.
+  void (*on_arena_message_creation)(const std::type_info* allocated_type,
+                                    const void* object, uint64 size,
+                                    const Message* message, void* cookie);
+
   // Constants define default starting block size and max block size for
   // arena allocator behavior -- see descriptions above.
   static const size_t kDefaultStartBlockSize = 256;
   static const size_t kDefaultMaxBlockSize = 8192;
 
   friend void arena_metrics::EnableArenaMetrics(ArenaOptions*);
+  friend void arena_metrics::EnableArenaFieldMetrics(ArenaOptions*);
   friend class Arena;
   friend class ArenaOptionsTestFriend;
 };
 
+// ArenaBlockCache is an opt-in, process-wide cache of arena blocks. Arenas
+// that are created and destroyed at a high rate, e.g. one per request, pay a
+// malloc/free round-trip for every block, even though a block of the same size
+// will be asked for again shortly after. Arenas that set
+//
+//   ArenaOptions options;
+//   options.block_alloc = &ArenaBlockCache::Allocate;
+//   options.block_dealloc = &ArenaBlockCache::Deallocate;
+//
+// recycle their blocks instead. Blocks are cached per power-of-two size class
+// between kMinBlockSize and kMaxBlockSize, which covers the block sizes arenas
+// use by default; other sizes go straight to operator new/delete. Every thread
+// keeps its own free lists which need no synchronization. A thread whose list
+// runs over its budget moves half of it to a shared pool, and a thread whose
+// list is empty refills from the shared pool before calling operator new. The
+// shared pool is bounded too; blocks beyond its capacity are freed.
+class PROTOBUF_EXPORT ArenaBlockCache {
+ public:
+  static const size_t kMinBlockSize = 256;
+  static const size_t kMaxBlockSize = 1 << 20;
+
+  struct Stats {
+    uint64 hits;          // Allocations served from a cache.
+    uint64 misses;        // Allocations of a cached size not served from one.
+    uint64 uncached;      // Allocations of a size that is never cached.
+    uint64 releases;      // Blocks freed because the shared pool was full.
+    uint64 cached_bytes;  // Bytes currently held by all the caches.
+  };
+
+  // Signatures match ArenaOptions::block_alloc and block_dealloc.
+  static void* Allocate(size_t size);
+  static void Deallocate(void* block, size_t size);
+
+  // Returns a snapshot of the counters since the start of the process.
+  static Stats GetStats();
+
+  // Frees all blocks in the shared pool and in the calling thread's lists.
+  static void Trim();
+
+ private:
+  ArenaBlockCache() = delete;
+};
+
 // Support for non-RTTI environments. (The metrics hooks API uses type
 // information.)
 #if PROTOBUF_RTTI
@@ -273,6 +392,8 @@ class PROTOBUF_EXPORT PROTOBUF_ALIGNAS(8) Arena final {
 
   void Init(const ArenaOptions& options) {
     on_arena_allocation_ = options.on_arena_allocation;
+    on_arena_container_allocation_ = options.on_arena_container_allocation;
+    on_arena_message_creation_ = options.on_arena_message_creation;
     on_arena_reset_ = options.on_arena_reset;
     on_arena_destruction_ = options.on_arena_destruction;
     // Call the initialization hook
@@ -516,24 +637,37 @@ class PROTOBUF_EXPORT PROTOBUF_ALIGNAS(8) Arena final {
   }
 
   void CallDestructorHooks();
-  void OnArenaAllocation(const std::type_info* allocated_type, size_t n) const;
-  inline void AllocHook(const std::type_info* allocated_type, size_t n) const {
+  void OnArenaAllocation(const std::type_info* allocated_type, size_t n,
+                         const void* container) const;
+  inline void AllocHook(const std::type_info* allocated_type, size_t n,
+                        const void* container = NULL) const {
     if (PROTOBUF_PREDICT_FALSE(hooks_cookie_ != NULL)) {
-      OnArenaAllocation(allocated_type, n);
+      OnArenaAllocation(allocated_type, n, container);
     }
   }
 
+  void OnMessageCreation(const std::type_info* allocated_type,
+                         const void* object, size_t n,
+                         const Message* message) const;
+  static const Message* AsMessage(const Message* message) { return message; }
+  static const Message* AsMessage(const void*) { return NULL; }
+
   // Allocate and also optionally call on_arena_allocation callback with the
   // allocated type info when the hooks are in place in ArenaOptions and
   // the cookie is not null.
   template <typename T>
-  PROTOBUF_ALWAYS_INLINE void* AllocateInternal(bool skip_explicit_ownership) {
+  PROTOBUF_ALWAYS_INLINE void* AllocateInternal(
+      bool skip_explicit_ownership, const void* container = NULL) {
     static_assert(alignof(T) <= 8, "T is overaligned, see b/151247138");
     const size_t n = internal::AlignUpTo8(sizeof(T));
-    AllocHook(RTTI_TYPE_ID(T), n);
+    AllocHook(RTTI_TYPE_ID(T), n, container);
     // Monitor allocation if needed.
     if (skip_explicit_ownership) {
       return AllocateAlignedNoHook(n);
+    } else if (std::is_same<T, std::string>::value) {
+      // Strings of string fields are the most common objects with a
+      // destructor, they are destroyed in bulk without a cleanup node each.
+      return impl_.AllocateString();
     } else {
       return impl_.AllocateAlignedAndAddCleanup(
           n, &internal::arena_destruct_object<T>);
@@ -588,15 +722,41 @@ class PROTOBUF_EXPORT PROTOBUF_ALIGNAS(8) Arena final {
   // Just allocate the required size for the given type assuming the
   // type has a trivial constructor.
   template <typename T>
-  PROTOBUF_ALWAYS_INLINE T* CreateInternalRawArray(size_t num_elements) {
+  PROTOBUF_ALWAYS_INLINE T* CreateInternalRawArray(
+      size_t num_elements, const void* container = NULL) {
     GOOGLE_CHECK_LE(num_elements, std::numeric_limits<size_t>::max() / sizeof(T))
         << "Requested size is too large to fit into size_t.";
     const size_t n = internal::AlignUpTo8(sizeof(T) * num_elements);
     // Monitor allocation if needed.
-    AllocHook(RTTI_TYPE_ID(T), n);
+    AllocHook(RTTI_TYPE_ID(T), n, container);
     return static_cast<T*>(AllocateAlignedNoHook(n));
   }
 
+  // Like Create() and CreateArray(), for the storage that the container at
+  // |container| allocates for its contents, so that the allocation hooks can
+  // attribute it to the field holding the container.
+  template <typename T, typename... Args>
+  PROTOBUF_ALWAYS_INLINE static T* CreateForContainer(Arena* arena,
+                                                      const void* container,
+                                                      Args&&... args) {
+    if (arena == NULL) {
+      return new T(std::forward<Args>(args)...);
+    } else {
+      return new (arena->AllocateInternal<T>(
+          std::is_trivially_destructible<T>::value, container))
+          T(std::forward<Args>(args)...);
+    }
+  }
+  template <typename T>
+  PROTOBUF_ALWAYS_INLINE static T* CreateArrayForContainer(
+      Arena* arena, const void* container, size_t num_elements) {
+    if (arena == NULL) {
+      return static_cast<T*>(::operator new[](num_elements * sizeof(T)));
+    } else {
+      return arena->CreateInternalRawArray<T>(num_elements, container);
+    }
+  }
+
   template <typename T, typename... Args>
   PROTOBUF_ALWAYS_INLINE T* DoCreate(bool skip_explicit_ownership,
                                      Args&&... args) {
@@ -605,9 +765,14 @@ class PROTOBUF_EXPORT PROTOBUF_ALIGNAS(8) Arena final {
   }
   template <typename T, typename... Args>
   PROTOBUF_ALWAYS_INLINE T* DoCreateMessage(Args&&... args) {
-    return InternalHelper<T>::Construct(
+    T* message = InternalHelper<T>::Construct(
         AllocateInternal<T>(InternalHelper<T>::is_destructor_skippable::value),
         this, std::forward<Args>(args)...);
+    if (PROTOBUF_PREDICT_FALSE(hooks_cookie_ != NULL)) {
+      OnMessageCreation(RTTI_TYPE_ID(T), message, sizeof(T),
+                        AsMessage(message));
+    }
+    return message;
   }
 
   // CreateInArenaStorage is used to implement map field. Without it,
@@ -708,6 +873,12 @@ class PROTOBUF_EXPORT PROTOBUF_ALIGNAS(8) Arena final {
 
   void (*on_arena_allocation_)(const std::type_info* allocated_type,
                                uint64 alloc_size, void* cookie);
+  void (*on_arena_container_allocation_)(const void* container,
+                                         const std::type_info* allocated_type,
+                                         uint64 alloc_size, void* cookie);
+  void (*on_arena_message_creation_)(const std::type_info* allocated_type,
+                                     const void* object, uint64 size,
+                                     const Message* message, void* cookie);
   void (*on_arena_reset_)(Arena* arena, void* cookie, uint64 space_used);
   void (*on_arena_destruction_)(Arena* arena, void* cookie, uint64 space_used);
 
@@ -723,6 +894,11 @@ class PROTOBUF_EXPORT PROTOBUF_ALIGNAS(8) Arena final {
   friend class MessageLite;
   template <typename Key, typename T>
   friend class Map;
+  // For CreateForContainer and CreateArrayForContainer.
+  template <typename Element>
+  friend class RepeatedField;
+  friend class internal::RepeatedPtrFieldBase;
+  friend class internal::MapNodePool;
 };
 
 // Defined above for supporting environments without RTTI.
@@ -35,6 +35,7 @@
 
 #include <atomic>
 #include <limits>
+#include <string>
 
 #include <google/protobuf/stubs/common.h>
 #include <google/protobuf/stubs/logging.h>
@@ -48,6 +49,9 @@
 
 namespace google {
 namespace protobuf {
+
+class ArenaSizePolicy;  // defined in arena.h
+
 namespace internal {
 
 inline size_t AlignUpTo8(size_t n) {
@@ -72,6 +76,7 @@ class PROTOBUF_EXPORT ArenaImpl {
     size_t initial_block_size;
     void* (*block_alloc)(size_t);
     void (*block_dealloc)(void*, size_t);
+    ArenaSizePolicy* size_policy;
 
     template <typename O>
     explicit Options(const O& options)
@@ -80,7 +85,8 @@ class PROTOBUF_EXPORT ArenaImpl {
           initial_block(options.initial_block),
           initial_block_size(options.initial_block_size),
           block_alloc(options.block_alloc),
-          block_dealloc(options.block_dealloc) {}
+          block_dealloc(options.block_dealloc),
+          size_policy(options.size_policy) {}
   };
 
   template <typename O>
@@ -134,12 +140,34 @@ class PROTOBUF_EXPORT ArenaImpl {
   // Add object pointer and cleanup function pointer to the list.
   void AddCleanup(void* elem, void (*cleanup)(void*));
 
+  // Allocates uninitialized space for a std::string that is destroyed when the
+  // arena is reset or destroyed. Strings are kept in arrays of their own and
+  // destroyed in bulk, without a cleanup node each.
+  //
+  // Only the std::string object is on the arena. Contents too long for its
+  // inline buffer are on the heap, as std::string cannot take its buffer from
+  // the arena without changing the type the generated accessors return, so
+  // every string still has to be destroyed. There is no reset that skips the
+  // cleanup: a SerialArena without cleanup nodes or strings has no cleanup
+  // chunk and is not walked at all, which is already the case for arenas
+  // holding only DestructorSkippable_ types, and skipping anything else would
+  // leak.
+  void* AllocateString() {
+    SerialArena* arena;
+    if (PROTOBUF_PREDICT_TRUE(GetSerialArenaFast(&arena))) {
+      return arena->AllocateString();
+    } else {
+      return AllocateStringFallback();
+    }
+  }
+
  private:
   friend class ArenaBenchmark;
 
   void* AllocateAlignedFallback(size_t n);
   void* AllocateAlignedAndAddCleanupFallback(size_t n, void (*cleanup)(void*));
   void AddCleanupFallback(void* elem, void (*cleanup)(void*));
+  void* AllocateStringFallback();
 
   // Node contains the ptr of the object to be cleaned up and the associated
   // cleanup function ptr.
@@ -148,14 +176,23 @@ class PROTOBUF_EXPORT ArenaImpl {
     void (*cleanup)(void*);  // Function pointer to the destructor or deleter.
   };
 
-  // Cleanup uses a chunked linked list, to reduce pointer chasing.
+  // Cleanup uses a chunked linked list, to reduce pointer chasing.  Cleanup
+  // nodes fill a chunk from its start, and the strings returned by
+  // AllocateString() fill it from its end, so that both share the same
+  // pointers in SerialArena.
   struct CleanupChunk {
-    static size_t SizeOf(size_t i) {
-      return sizeof(CleanupChunk) + (sizeof(CleanupNode) * (i - 1));
+    static size_t SizeOf(size_t bytes) {
+      return sizeof(CleanupChunk) + bytes;
     }
-    size_t size;           // Total elements in the list.
-    CleanupChunk* next;    // Next node in the list.
-    CleanupNode nodes[1];  // True length is |size|.
+    char* begin() { return reinterpret_cast<char*>(this + 1); }
+    char* end() { return begin() + size; }
+    size_t size;         // Total bytes in the chunk, after this header.
+    CleanupChunk* next;  // Next node in the list.
+    // Where the nodes end and the strings start, once this is not the current
+    // chunk of its SerialArena anymore.
+    char* nodes_end;
+    char* strings_begin;
+    // |size| bytes follow.
   };
 
   class Block;
@@ -175,7 +212,10 @@ class PROTOBUF_EXPORT ArenaImpl {
     static uint64 Free(SerialArena* serial, Block* initial_block,
                        void (*block_dealloc)(void*, size_t));
 
+    // Runs the cleanup functions added to this SerialArena.
     void CleanupList();
+    // Destroys the strings returned by AllocateString(), after CleanupList().
+    void DestroyStrings();
     uint64 SpaceUsed() const;
 
     bool HasSpace(size_t n) { return n <= static_cast<size_t>(limit_ - ptr_); }
@@ -209,13 +249,16 @@ class PROTOBUF_EXPORT ArenaImpl {
     }
 
     void AddCleanup(void* elem, void (*cleanup)(void*)) {
-      if (PROTOBUF_PREDICT_FALSE(cleanup_ptr_ == cleanup_limit_)) {
+      if (PROTOBUF_PREDICT_FALSE(static_cast<size_t>(cleanup_limit_ -
+                                                     cleanup_ptr_) <
+                                 sizeof(CleanupNode))) {
         AddCleanupFallback(elem, cleanup);
         return;
       }
-      cleanup_ptr_->elem = elem;
-      cleanup_ptr_->cleanup = cleanup;
-      cleanup_ptr_++;
+      CleanupNode* node = reinterpret_cast<CleanupNode*>(cleanup_ptr_);
+      node->elem = elem;
+      node->cleanup = cleanup;
+      cleanup_ptr_ += sizeof(CleanupNode);
     }
 
     void* AllocateAlignedAndAddCleanup(size_t n, void (*cleanup)(void*)) {
@@ -224,6 +267,16 @@ class PROTOBUF_EXPORT ArenaImpl {
       return ret;
     }
 
+    void* AllocateString() {
+      if (PROTOBUF_PREDICT_FALSE(static_cast<size_t>(cleanup_limit_ -
+                                                     cleanup_ptr_) <
+                                 sizeof(std::string))) {
+        return AllocateStringFallback();
+      }
+      cleanup_limit_ -= sizeof(std::string);
+      return cleanup_limit_;
+    }
+
     void* owner() const { return owner_; }
     SerialArena* next() const { return next_; }
     void set_next(SerialArena* next) { next_ = next; }
@@ -232,6 +285,10 @@ class PROTOBUF_EXPORT ArenaImpl {
     void* AllocateAlignedFallback(size_t n);
     void AddCleanupFallback(void* elem, void (*cleanup)(void*));
     void CleanupListFallback();
+    void* AllocateStringFallback();
+    void DestroyStringsFallback();
+    // Starts a new cleanup chunk, which becomes cleanup_.
+    void AddCleanupChunk();
 
     ArenaImpl* arena_;       // Containing arena.
     void* owner_;            // &ThreadCache of this thread;
@@ -245,9 +302,11 @@ class PROTOBUF_EXPORT ArenaImpl {
     char* ptr_;
     char* limit_;
 
-    // Next CleanupList members to append to.  These point inside cleanup_.
-    CleanupNode* cleanup_ptr_;
-    CleanupNode* cleanup_limit_;
+    // Free space of cleanup_: the next CleanupList member is appended at
+    // cleanup_ptr_, and the next string from AllocateString() ends at
+    // cleanup_limit_.
+    char* cleanup_ptr_;
+    char* cleanup_limit_;
   };
 
   // Blocks are variable length malloc-ed objects.  The following structure
@@ -273,18 +332,35 @@ class PROTOBUF_EXPORT ArenaImpl {
     // data follows
   };
 
+  // Number of arenas a thread can allocate from without going through
+  // GetSerialArenaFallback().
+  static const int kThreadCacheSize = 4;
+
   struct ThreadCache {
 #if defined(GOOGLE_PROTOBUF_NO_THREADLOCAL)
     // If we are using the ThreadLocalStorage class to store the ThreadCache,
     // then the ThreadCache's default constructor has to be responsible for
     // initializing it.
-    ThreadCache() : last_lifecycle_id_seen(-1), last_serial_arena(NULL) {}
+    ThreadCache() : entries() {}
 #endif
 
-    // The ThreadCache is considered valid as long as this matches the
-    // lifecycle_id of the arena being used.
-    LifecycleId last_lifecycle_id_seen;
-    SerialArena* last_serial_arena;
+    struct Entry {
+      // The entry is considered valid as long as this matches the
+      // lifecycle_id of the arena being used. Lifecycle ids start at 1, so a
+      // zero-initialized entry never matches.
+      LifecycleId lifecycle_id;
+      SerialArena* serial_arena;
+    };
+
+    // The SerialArena of an arena is cached in the entry indexed by the low
+    // bits of its lifecycle_id. Ids are handed out sequentially, so a thread
+    // working on a few arenas that were created around the same time, e.g. a
+    // worker filling in several responses, keeps all of them cached.
+    Entry entries[kThreadCacheSize];
+
+    Entry* entry(LifecycleId lifecycle_id) {
+      return &entries[lifecycle_id & (kThreadCacheSize - 1)];
+    }
   };
   static std::atomic<LifecycleId> lifecycle_id_generator_;
 #if defined(GOOGLE_PROTOBUF_NO_THREADLOCAL)
@@ -306,12 +382,15 @@ class PROTOBUF_EXPORT ArenaImpl {
   // Free all blocks and return the total space used which is the sums of sizes
   // of the all the allocated blocks.
   uint64 FreeBlocks();
+  // Reports the space used by the largest SerialArena to the size policy.
+  void RecordSpaceUsed();
   // Delete or Destruct all objects owned by the arena.
   void CleanupList();
 
   inline void CacheSerialArena(SerialArena* serial) {
-    thread_cache().last_serial_arena = serial;
-    thread_cache().last_lifecycle_id_seen = lifecycle_id_;
+    ThreadCache::Entry* entry = thread_cache().entry(lifecycle_id_);
+    entry->serial_arena = serial;
+    entry->lifecycle_id = lifecycle_id_;
     // TODO(haberman): evaluate whether we would gain efficiency by getting rid
     // of hint_.  It's the only write we do to ArenaImpl in the allocation path,
     // which will dirty the cache line.
@@ -348,9 +427,9 @@ class PROTOBUF_EXPORT ArenaImpl {
     // If this thread already owns a block in this arena then try to use that.
     // This fast path optimizes the case where multiple threads allocate from
     // the same arena.
-    ThreadCache* tc = &thread_cache();
-    if (PROTOBUF_PREDICT_TRUE(tc->last_lifecycle_id_seen == lifecycle_id_)) {
-      *arena = tc->last_serial_arena;
+    ThreadCache::Entry* entry = thread_cache().entry(lifecycle_id_);
+    if (PROTOBUF_PREDICT_TRUE(entry->lifecycle_id == lifecycle_id_)) {
+      *arena = entry->serial_arena;
       return true;
     }
     return false;
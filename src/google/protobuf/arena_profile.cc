@@ -0,0 +1,575 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include <google/protobuf/arena_profile.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <map>
+#include <typeinfo>
+#include <utility>
+
+#if defined(__GNUC__)
+#include <cxxabi.h>
+#include <cstdlib>
+#endif
+
+#include <google/protobuf/stubs/mutex.h>
+#include <google/protobuf/stubs/stringprintf.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/descriptor.pb.h>
+#include <google/protobuf/generated_message_reflection.h>
+#include <google/protobuf/message.h>
+#include <google/protobuf/wire_format_lite.h>
+
+#include <google/protobuf/port_def.inc>
+
+namespace google {
+namespace protobuf {
+namespace {
+
+struct TypeCounts {
+  // Sums of the weights of the samples, so fractions of allocations.
+  double allocations = 0;
+  double bytes = 0;
+};
+
+class Profile {
+ public:
+  void RecordAllocation(const std::type_info* type, const std::string& field,
+                        double weight, uint64 bytes) {
+    MutexLock lock(&mutex_);
+    TypeCounts* counts = &types_[std::make_pair(type, field)];
+    counts->allocations += weight;
+    counts->bytes += weight * bytes;
+  }
+
+  void RecordArena(uint64 space_allocated, uint64 space_used) {
+    arenas_.fetch_add(1, std::memory_order_relaxed);
+    space_allocated_.fetch_add(space_allocated, std::memory_order_relaxed);
+    space_used_.fetch_add(space_used, std::memory_order_relaxed);
+  }
+
+  std::atomic<uint64>* sample_interval() { return &sample_interval_; }
+
+  ArenaProfile::Summary GetSummary();
+  void Clear();
+
+ private:
+  Mutex mutex_;
+  // Keyed by type_info rather than by name to keep recording cheap. NULL
+  // collects the untyped allocations.
+  std::map<std::pair<const std::type_info*, std::string>, TypeCounts> types_;
+  std::atomic<uint64> sample_interval_{ArenaProfile::kDefaultSampleInterval};
+  std::atomic<uint64> arenas_{0};
+  std::atomic<uint64> space_allocated_{0};
+  std::atomic<uint64> space_used_{0};
+};
+
+Profile* profile() {
+  // Intentionally leaked, arenas can be destroyed during shutdown.
+  static Profile* profile = new Profile;
+  return profile;
+}
+
+std::string TypeName(const std::type_info* type) {
+  if (type == NULL) return "(untyped)";
+#if defined(__GNUC__)
+  int status;
+  char* demangled = abi::__cxa_demangle(type->name(), NULL, NULL, &status);
+  if (demangled != NULL) {
+    std::string name = demangled;
+    free(demangled);
+    return name;
+  }
+#endif
+  return type->name();
+}
+
+ArenaProfile::Summary Profile::GetSummary() {
+  ArenaProfile::Summary summary;
+  summary.sample_interval = sample_interval_.load(std::memory_order_relaxed);
+  summary.arenas = arenas_.load(std::memory_order_relaxed);
+  summary.space_allocated = space_allocated_.load(std::memory_order_relaxed);
+  summary.space_used = space_used_.load(std::memory_order_relaxed);
+
+  std::map<std::pair<const std::type_info*, std::string>, TypeCounts> types;
+  {
+    MutexLock lock(&mutex_);
+    types = types_;
+  }
+  // The same type can have several type_infos, e.g. one per shared library.
+  std::map<std::pair<std::string, std::string>, TypeCounts> by_name;
+  for (const auto& entry : types) {
+    TypeCounts* counts = &by_name[std::make_pair(TypeName(entry.first.first),
+                                                 entry.first.second)];
+    counts->allocations += entry.second.allocations;
+    counts->bytes += entry.second.bytes;
+  }
+  for (const auto& entry : by_name) {
+    ArenaProfile::TypeStats stats;
+    stats.type_name = entry.first.first;
+    stats.field = entry.first.second;
+    stats.allocations =
+        static_cast<uint64>(std::llround(entry.second.allocations));
+    stats.bytes = static_cast<uint64>(std::llround(entry.second.bytes));
+    summary.types.push_back(stats);
+  }
+  std::stable_sort(summary.types.begin(), summary.types.end(),
+                   [](const ArenaProfile::TypeStats& a,
+                      const ArenaProfile::TypeStats& b) {
+                     return a.bytes > b.bytes;
+                   });
+  return summary;
+}
+
+void Profile::Clear() {
+  {
+    MutexLock lock(&mutex_);
+    types_.clear();
+  }
+  arenas_.store(0, std::memory_order_relaxed);
+  space_allocated_.store(0, std::memory_order_relaxed);
+  space_used_.store(0, std::memory_order_relaxed);
+}
+
+// Decides which allocations of a thread are sampled. The thread counts down
+// the bytes it allocates and samples the allocation that reaches zero. The
+// distances between samples, starting with the first one, are drawn from an
+// exponential distribution whose mean is the sample interval, so that every
+// byte has the same chance to be sampled whatever the allocation pattern.
+class Sampler {
+ public:
+  // Returns the inverse of the probability to sample an allocation of |size|
+  // bytes if this allocation is sampled, 0 otherwise.
+  double Sample(uint64 size, uint64 interval) {
+    if (interval == 1) return 1;
+    if (PROTOBUF_PREDICT_FALSE(rng_ == 0)) {
+      Seed();
+      bytes_until_sample_ = NextDistance(interval);
+    }
+    bytes_until_sample_ -= static_cast<int64>(size);
+    if (PROTOBUF_PREDICT_TRUE(bytes_until_sample_ > 0)) return 0;
+    bytes_until_sample_ = NextDistance(interval);
+    return -1 / std::expm1(-static_cast<double>(size) / interval);
+  }
+
+ private:
+  void Seed() {
+    static std::atomic<uint64> seed{0};
+    rng_ = (reinterpret_cast<uintptr_t>(this) ^
+            seed.fetch_add(0x9E3779B97F4A7C15ULL, std::memory_order_relaxed)) |
+           1;
+  }
+
+  int64 NextDistance(uint64 interval) {
+    // 64-bit linear congruential generator with Knuth's MMIX constants.
+    rng_ = rng_ * 6364136223846793005ULL + 1442695040888963407ULL;
+    // The top 53 bits as a uniform value in (0, 1].
+    double uniform = (static_cast<double>(rng_ >> 11) + 1) / 9007199254740992.0;
+    return static_cast<int64>(-std::log(uniform) * interval) + 1;
+  }
+
+  int64 bytes_until_sample_ = 0;
+  uint64 rng_ = 0;  // 0 until the thread draws its first distance.
+};
+
+// Returns the weight of an allocation of |size| bytes by the calling thread if
+// it is sampled, 0 otherwise.
+double SampleWeight(uint64 size) {
+#if defined(GOOGLE_PROTOBUF_NO_THREADLOCAL)
+  static internal::ThreadLocalStorage<Sampler>* samplers =
+      new internal::ThreadLocalStorage<Sampler>();
+  Sampler* sampler = samplers->Get();
+#else
+  static thread_local Sampler sampler_storage;
+  Sampler* sampler = &sampler_storage;
+#endif
+  return sampler->Sample(
+      size, profile()->sample_interval()->load(std::memory_order_relaxed));
+}
+
+// Builds a profile.proto message of pprof, see
+// https://github.com/google/pprof/blob/master/proto/profile.proto.
+class PprofBuilder {
+ public:
+  PprofBuilder() { StringId(""); }  // The string table starts with "".
+
+  void AddSampleType(const std::string& type, const std::string& unit) {
+    AppendMessage(&profile_, 1, ValueType(type, unit));
+  }
+
+  // Adds a sample whose stack goes from |stack[0]|, the leaf, to the root.
+  void AddSample(const std::vector<std::string>& stack,
+                 const std::vector<int64>& values) {
+    std::string sample;
+    {
+      io::StringOutputStream stream(&sample);
+      io::CodedOutputStream out(&stream);
+      for (const std::string& name : stack) {
+        internal::WireFormatLite::WriteUInt64(1, LocationId(name), &out);
+      }
+      for (int64 value : values) {
+        internal::WireFormatLite::WriteInt64(2, value, &out);
+      }
+    }
+    AppendMessage(&profile_, 2, sample);
+  }
+
+  void AddComment(const std::string& comment) {
+    AppendInt64(&profile_, 13, StringId(comment));
+  }
+
+  std::string Finish(const std::string& period_type,
+                     const std::string& period_unit, int64 period) {
+    AppendMessage(&profile_, 11, ValueType(period_type, period_unit));
+    AppendInt64(&profile_, 12, period);
+    {
+      io::StringOutputStream stream(&profile_);
+      io::CodedOutputStream out(&stream);
+      for (const std::string& s : strings_) {
+        internal::WireFormatLite::WriteString(6, s, &out);
+      }
+    }
+    return profile_;
+  }
+
+ private:
+  static void AppendMessage(std::string* output, int field_number,
+                            const std::string& message) {
+    io::StringOutputStream stream(output);
+    io::CodedOutputStream out(&stream);
+    internal::WireFormatLite::WriteBytes(field_number, message, &out);
+  }
+
+  static void AppendInt64(std::string* output, int field_number,
+                          int64 value) {
+    io::StringOutputStream stream(output);
+    io::CodedOutputStream out(&stream);
+    internal::WireFormatLite::WriteInt64(field_number, value, &out);
+  }
+
+  int64 StringId(const std::string& s) {
+    auto inserted = string_ids_.insert(std::make_pair(s, strings_.size()));
+    if (inserted.second) strings_.push_back(s);
+    return inserted.first->second;
+  }
+
+  std::string ValueType(const std::string& type, const std::string& unit) {
+    std::string value_type;
+    AppendInt64(&value_type, 1, StringId(type));
+    AppendInt64(&value_type, 2, StringId(unit));
+    return value_type;
+  }
+
+  // Each type or field is a location of its own, with a single line in a
+  // function of the same name and id.
+  uint64 LocationId(const std::string& name) {
+    auto inserted =
+        location_ids_.insert(std::make_pair(name, location_ids_.size() + 1));
+    const uint64 id = inserted.first->second;
+    if (!inserted.second) return id;
+
+    std::string function;
+    AppendInt64(&function, 1, id);
+    AppendInt64(&function, 2, StringId(name));
+    AppendInt64(&function, 3, StringId(name));
+    AppendMessage(&profile_, 5, function);
+
+    std::string line;
+    AppendInt64(&line, 1, id);
+    std::string location;
+    AppendInt64(&location, 1, id);
+    AppendMessage(&location, 4, line);
+    AppendMessage(&profile_, 4, location);
+    return id;
+  }
+
+  std::string profile_;
+  std::vector<std::string> strings_;
+  std::map<std::string, int64> string_ids_;
+  std::map<std::string, uint64> location_ids_;
+};
+
+}  // namespace
+
+namespace internal {
+
+// The messages created on one profiled arena, so that the storage allocated by
+// a container can be attributed to the message field holding it. This is the
+// cookie of the arena hooks of EnableArenaFieldMetrics().
+class ArenaObjects {
+ public:
+  void Add(const std::type_info* type, const void* object, uint64 size,
+           const Message* message) {
+    Object entry;
+    entry.begin = reinterpret_cast<uintptr_t>(object);
+    entry.end = entry.begin + size;
+    entry.type = type;
+    entry.message = message;
+    MutexLock lock(&mutex_);
+    objects_.push_back(entry);
+  }
+
+  // Returns the name of the field holding |container|, see
+  // ArenaProfile::TypeStats::field.
+  std::string FieldName(const void* container);
+
+  void Clear() {
+    MutexLock lock(&mutex_);
+    objects_.clear();
+    num_sorted_ = 0;
+  }
+
+ private:
+  struct Object {
+    uintptr_t begin;
+    uintptr_t end;
+    const std::type_info* type;
+    const Message* message;
+
+    bool operator<(const Object& other) const { return begin < other.begin; }
+  };
+
+  bool Find(uintptr_t address, Object* object);
+
+  Mutex mutex_;
+  // Sorted by address up to num_sorted_. Objects are added far more often
+  // than looked up, so the others are only merged in by the next lookup.
+  std::vector<Object> objects_;
+  size_t num_sorted_ = 0;
+};
+
+bool ArenaObjects::Find(uintptr_t address, Object* object) {
+  MutexLock lock(&mutex_);
+  if (num_sorted_ < objects_.size()) {
+    std::sort(objects_.begin() + num_sorted_, objects_.end());
+    std::inplace_merge(objects_.begin(), objects_.begin() + num_sorted_,
+                       objects_.end());
+    num_sorted_ = objects_.size();
+  }
+  auto it = std::upper_bound(
+      objects_.begin(), objects_.end(), address,
+      [](uintptr_t address, const Object& object) {
+        return address < object.begin;
+      });
+  if (it == objects_.begin()) return false;
+  --it;
+  if (address >= it->end) return false;
+  *object = *it;
+  return true;
+}
+
+std::string ArenaObjects::FieldName(const void* container) {
+  Object owner;
+  if (!Find(reinterpret_cast<uintptr_t>(container), &owner)) return "";
+  if (owner.message == NULL) return TypeName(owner.type);
+  const FieldDescriptor* field =
+      ArenaProfile::FindField(*owner.message, container);
+  if (field == NULL) return owner.message->GetDescriptor()->full_name();
+  return field->full_name();
+}
+
+}  // namespace internal
+
+namespace {
+
+// The hooks of EnableArenaMetrics(). They need no state per arena, but the
+// other hooks are only called if the init hook returns a cookie.
+void* OnArenaInit(Arena* /* arena */) { return profile(); }
+
+void OnArenaAllocation(const std::type_info* allocated_type, uint64 alloc_size,
+                       void* /* cookie */) {
+  double weight = SampleWeight(alloc_size);
+  if (PROTOBUF_PREDICT_TRUE(weight == 0)) return;
+  profile()->RecordAllocation(allocated_type, std::string(), weight,
+                              alloc_size);
+}
+
+void OnArenaReset(Arena* arena, void* /* cookie */, uint64 space_allocated) {
+  // Called on Reset() and right before destruction, so every lifecycle of an
+  // arena is recorded once.
+  profile()->RecordArena(space_allocated, arena->SpaceUsed());
+}
+
+// The hooks EnableArenaFieldMetrics() adds. The cookie is the
+// internal::ArenaObjects of the arena.
+void* OnFieldArenaInit(Arena* /* arena */) {
+  return new internal::ArenaObjects;
+}
+
+void OnArenaContainerAllocation(const void* container,
+                                const std::type_info* allocated_type,
+                                uint64 alloc_size, void* cookie) {
+  double weight = SampleWeight(alloc_size);
+  if (PROTOBUF_PREDICT_TRUE(weight == 0)) return;
+  profile()->RecordAllocation(
+      allocated_type,
+      static_cast<internal::ArenaObjects*>(cookie)->FieldName(container),
+      weight, alloc_size);
+}
+
+void OnArenaMessageCreation(const std::type_info* allocated_type,
+                            const void* object, uint64 size,
+                            const Message* message, void* cookie) {
+  static_cast<internal::ArenaObjects*>(cookie)->Add(allocated_type, object,
+                                                     size, message);
+}
+
+void OnFieldArenaReset(Arena* arena, void* cookie, uint64 space_allocated) {
+  OnArenaReset(arena, cookie, space_allocated);
+  static_cast<internal::ArenaObjects*>(cookie)->Clear();
+}
+
+void OnFieldArenaDestruction(Arena* /* arena */, void* cookie,
+                             uint64 /* space_allocated */) {
+  delete static_cast<internal::ArenaObjects*>(cookie);
+}
+
+}  // namespace
+
+namespace arena_metrics {
+
+void EnableArenaMetrics(ArenaOptions* options) {
+  options->on_arena_init = &OnArenaInit;
+  options->on_arena_allocation = &OnArenaAllocation;
+  options->on_arena_reset = &OnArenaReset;
+}
+
+void EnableArenaFieldMetrics(ArenaOptions* options) {
+  EnableArenaMetrics(options);
+  options->on_arena_init = &OnFieldArenaInit;
+  options->on_arena_container_allocation = &OnArenaContainerAllocation;
+  options->on_arena_message_creation = &OnArenaMessageCreation;
+  options->on_arena_reset = &OnFieldArenaReset;
+  options->on_arena_destruction = &OnFieldArenaDestruction;
+}
+
+}  // namespace arena_metrics
+
+const FieldDescriptor* ArenaProfile::FindField(const Message& message,
+                                               const void* address) {
+  const Reflection* reflection = message.GetReflection();
+  const internal::ReflectionSchema& schema = reflection->schema_;
+  const Descriptor* descriptor = reflection->descriptor_;
+  const uint32 offset = static_cast<uint32>(
+      static_cast<const char*>(address) -
+      reinterpret_cast<const char*>(&message));
+
+  // The address is in the member that starts closest before it: it can be
+  // inside a field rather than at its start, e.g. for the Map in a MapField.
+  // Members that aren't fields are candidates too, with a NULL field.
+  const FieldDescriptor* result = NULL;
+  uint32 result_offset = 0;
+  bool found = false;
+  auto consider = [&](uint32 member_offset, const FieldDescriptor* field) {
+    if (member_offset <= offset && (!found || member_offset > result_offset)) {
+      result = field;
+      result_offset = member_offset;
+      found = true;
+    }
+  };
+  for (int i = 0; i < descriptor->field_count(); i++) {
+    const FieldDescriptor* field = descriptor->field(i);
+    if (field->options().weak() || schema.InRealOneof(field)) continue;
+    consider(schema.GetFieldOffset(field), field);
+  }
+  // The members of a oneof share their storage, it belongs to the one set.
+  for (int i = 0; i < descriptor->real_oneof_decl_count(); i++) {
+    const OneofDescriptor* oneof = descriptor->oneof_decl(i);
+    consider(schema.GetFieldOffset(oneof->field(0)),
+             reflection->GetOneofFieldDescriptor(message, oneof));
+  }
+  if (descriptor->real_oneof_decl_count() > 0) {
+    consider(schema.GetOneofCaseOffset(descriptor->oneof_decl(0)), NULL);
+  }
+  if (schema.HasHasbits()) consider(schema.HasBitsOffset(), NULL);
+  if (schema.HasExtensionSet()) consider(schema.GetExtensionSetOffset(), NULL);
+  if (schema.HasWeakFields()) consider(schema.GetWeakFieldMapOffset(), NULL);
+  consider(schema.GetMetadataOffset(), NULL);
+  return result;
+}
+
+void ArenaProfile::SetSampleInterval(uint64 bytes) {
+  GOOGLE_CHECK_GT(bytes, 0);
+  profile()->sample_interval()->store(bytes, std::memory_order_relaxed);
+}
+
+ArenaProfile::Summary ArenaProfile::GetSummary() {
+  return profile()->GetSummary();
+}
+
+std::string ArenaProfile::DebugString() {
+  Summary summary = GetSummary();
+  std::string result = StringPrintf(
+      "Arena profile, one sample per %llu bytes on average\n"
+      "%llu arenas, %llu bytes allocated, %llu bytes used\n"
+      "%12s %12s  %s\n",
+      static_cast<unsigned long long>(summary.sample_interval),
+      static_cast<unsigned long long>(summary.arenas),
+      static_cast<unsigned long long>(summary.space_allocated),
+      static_cast<unsigned long long>(summary.space_used), "bytes",
+      "allocations", "type");
+  for (const TypeStats& stats : summary.types) {
+    StringAppendF(&result, "%12llu %12llu  %s%s%s\n",
+                  static_cast<unsigned long long>(stats.bytes),
+                  static_cast<unsigned long long>(stats.allocations),
+                  stats.type_name.c_str(), stats.field.empty() ? "" : " in ",
+                  stats.field.c_str());
+  }
+  return result;
+}
+
+std::string ArenaProfile::SerializeAsPprof() {
+  Summary summary = GetSummary();
+  PprofBuilder builder;
+  builder.AddSampleType("allocations", "count");
+  builder.AddSampleType("space", "bytes");
+  for (const TypeStats& stats : summary.types) {
+    std::vector<std::string> stack(1, stats.type_name);
+    if (!stats.field.empty()) stack.push_back(stats.field);
+    builder.AddSample(stack, {static_cast<int64>(stats.allocations),
+                              static_cast<int64>(stats.bytes)});
+  }
+  builder.AddComment(StringPrintf(
+      "%llu arenas, %llu bytes allocated, %llu bytes used",
+      static_cast<unsigned long long>(summary.arenas),
+      static_cast<unsigned long long>(summary.space_allocated),
+      static_cast<unsigned long long>(summary.space_used)));
+  return builder.Finish("space", "bytes",
+                        static_cast<int64>(summary.sample_interval));
+}
+
+void ArenaProfile::Clear() { profile()->Clear(); }
+
+}  // namespace protobuf
+}  // namespace google
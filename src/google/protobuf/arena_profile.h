@@ -0,0 +1,140 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// ArenaProfile attributes the memory allocated on arenas to the types that
+// were allocated. Enable it on the arenas to profile with
+//
+//   ArenaOptions options;
+//   arena_metrics::EnableArenaMetrics(&options);
+//   Arena arena(options);
+//
+// and call ArenaProfile::GetSummary() or ArenaProfile::DebugString() at any
+// time to see which types the bytes went to, and how much of the arenas'
+// blocks was never used. ArenaProfile::SerializeAsPprof() returns the same
+// data for the pprof tool. The profile is process-wide and aggregates all
+// arenas that enabled it.
+//
+// Allocations are sampled: every thread records on average one allocation per
+// sample_interval bytes it allocates, at random points, and scales it up by
+// the inverse of its sampling probability, so the totals are estimates unless
+// the interval is 1. Arenas that don't enable the profile pay nothing for it.
+//
+// Allocations are attributed to the C++ type passed to the arena: messages
+// show up under their generated class, strings of string fields under
+// std::string and the storage of RepeatedField, RepeatedPtrField and Map
+// under the element type of the raw array. Without RTTI all allocations are
+// untyped.
+//
+// Arenas enabled with arena_metrics::EnableArenaFieldMetrics() instead also
+// attribute the storage that these containers and string fields allocate to
+// the message field holding them, if the message was created on the same
+// arena. To find the field, they remember every message created on them until
+// they are reset, which takes a lock and some memory per message whether or
+// not anything is sampled. Use it to find the fields to look at, not to
+// profile production traffic.
+
+#ifndef GOOGLE_PROTOBUF_ARENA_PROFILE_H__
+#define GOOGLE_PROTOBUF_ARENA_PROFILE_H__
+
+#include <string>
+#include <vector>
+
+#include <google/protobuf/arena.h>
+
+#include <google/protobuf/port_def.inc>
+
+namespace google {
+namespace protobuf {
+
+class FieldDescriptor;  // descriptor.h
+
+namespace internal {
+class ArenaObjects;  // arena_profile.cc
+}  // namespace internal
+
+class PROTOBUF_EXPORT ArenaProfile {
+ public:
+  static const uint64 kDefaultSampleInterval = 64 << 10;
+
+  struct TypeStats {
+    std::string type_name;  // Demangled if possible, "(untyped)" if unknown.
+    // Full name of the field whose storage this is, e.g. "pkg.Message.field",
+    // or the name of the type holding the container if it isn't a message
+    // field. Empty for allocations made outside of containers, and for all
+    // allocations of arenas without EnableArenaFieldMetrics().
+    std::string field;
+    uint64 allocations;     // Estimated number of allocations.
+    uint64 bytes;           // Estimated number of bytes allocated.
+  };
+
+  struct Summary {
+    uint64 sample_interval;
+    // Arenas that were reset or destroyed, and the size of their blocks and
+    // the part of it that held allocations at that point.
+    uint64 arenas;
+    uint64 space_allocated;
+    uint64 space_used;
+    // One entry per type and field, sorted by bytes, largest first.
+    std::vector<TypeStats> types;
+  };
+
+  // Sets the number of bytes a thread allocates between two samples. Takes
+  // effect for each thread after its next sample. 1 records every allocation.
+  static void SetSampleInterval(uint64 bytes);
+
+  // Returns everything recorded since the start or the last Clear().
+  static Summary GetSummary();
+
+  // Returns the summary as a human-readable table.
+  static std::string DebugString();
+
+  // Returns the summary as an uncompressed profile.proto message of the pprof
+  // tool (https://github.com/google/pprof), e.g. for `pprof -top`. Each field
+  // is a caller of the types allocated for it.
+  static std::string SerializeAsPprof();
+
+  // Discards everything recorded so far.
+  static void Clear();
+
+ private:
+  ArenaProfile() = delete;
+
+  // Returns the field of |message| whose storage holds |address|, or NULL if
+  // it belongs to none.
+  static const FieldDescriptor* FindField(const Message& message,
+                                          const void* address);
+  friend class internal::ArenaObjects;
+};
+
+}  // namespace protobuf
+}  // namespace google
+
+#include <google/protobuf/port_undef.inc>
+
+#endif  // GOOGLE_PROTOBUF_ARENA_PROFILE_H__
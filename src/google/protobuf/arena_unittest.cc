@@ -34,14 +34,17 @@
 #include <cstring>
 #include <memory>
 #include <string>
+#include <thread>
 #include <type_traits>
 #include <typeinfo>
 #include <vector>
 
 #include <google/protobuf/stubs/logging.h>
 #include <google/protobuf/stubs/common.h>
+#include <google/protobuf/arena_profile.h>
 #include <google/protobuf/arena_test_util.h>
 #include <google/protobuf/test_util.h>
+#include <google/protobuf/map_unittest.pb.h>
 #include <google/protobuf/unittest.pb.h>
 #include <google/protobuf/unittest_arena.pb.h>
 #include <google/protobuf/io/coded_stream.h>
@@ -64,6 +67,7 @@ using proto2_arena_unittest::ArenaMessage;
 using protobuf_unittest::TestAllExtensions;
 using protobuf_unittest::TestAllTypes;
 using protobuf_unittest::TestEmptyMessage;
+using protobuf_unittest::TestMap;
 using protobuf_unittest::TestOneof2;
 
 namespace google {
@@ -1253,6 +1257,232 @@ TEST(ArenaTest, BlockSizeSmallerThanAllocation) {
   }
 }
 
+TEST(ArenaTest, SizePolicyPresizesFirstBlock) {
+  ArenaSizePolicy policy;
+  ArenaOptions options;
+  options.size_policy = &policy;
+  EXPECT_EQ(0, policy.StartBlockSize());
+  const int kNumAllocations = 100;
+  const size_t kAllocationSize = 1000;
+  {
+    Arena arena(options);
+    for (int i = 0; i < kNumAllocations; i++) {
+      Arena::CreateArray<char>(&arena, kAllocationSize);
+    }
+  }
+  size_t start_block_size = policy.StartBlockSize();
+  EXPECT_LE(kNumAllocations * kAllocationSize + Arena::kBlockOverhead,
+            start_block_size);
+  EXPECT_EQ(0, start_block_size & (start_block_size - 1));
+
+  // The next arena fits the same allocations in a single block.
+  Arena arena(options);
+  for (int i = 0; i < kNumAllocations; i++) {
+    Arena::CreateArray<char>(&arena, kAllocationSize);
+  }
+  EXPECT_EQ(start_block_size, arena.SpaceAllocated());
+
+  // Reset() records the space used as well.
+  arena.Reset();
+  EXPECT_EQ(start_block_size, policy.StartBlockSize());
+  Arena::CreateArray<char>(&arena, kAllocationSize);
+  EXPECT_EQ(start_block_size, arena.SpaceAllocated());
+}
+
+TEST(ArenaTest, SizePolicyDecaysSlowly) {
+  ArenaSizePolicy policy;
+  policy.RecordSpaceUsed(100000);
+  EXPECT_EQ(131072, policy.StartBlockSize());
+  // A single small arena doesn't shrink the first block.
+  policy.RecordSpaceUsed(1000);
+  EXPECT_EQ(131072, policy.StartBlockSize());
+  for (int i = 0; i < 100; i++) {
+    policy.RecordSpaceUsed(1000);
+  }
+  EXPECT_GE(2048, policy.StartBlockSize());
+  // A larger one grows it right away.
+  policy.RecordSpaceUsed(200000);
+  EXPECT_EQ(262144, policy.StartBlockSize());
+
+  ArenaSizePolicy capped(4096);
+  capped.RecordSpaceUsed(100000);
+  EXPECT_EQ(4096, capped.StartBlockSize());
+}
+
+TEST(ArenaTest, InterleavedArenasKeepTheirOwnBlocks) {
+  // More arenas than the thread cache holds, so some of them share an entry.
+  const int kNumArenas = 7;
+  const int kNumRounds = 100;
+  std::vector<std::unique_ptr<Arena>> arenas;
+  for (int i = 0; i < kNumArenas; i++) {
+    arenas.emplace_back(new Arena);
+  }
+  for (int round = 0; round < kNumRounds; round++) {
+    for (int i = 0; i < kNumArenas; i++) {
+      Arena::CreateArray<char>(arenas[i].get(), 8 * (i + 1));
+    }
+  }
+  for (int i = 0; i < kNumArenas; i++) {
+    EXPECT_EQ(kNumRounds * 8 * (i + 1), arenas[i]->SpaceUsed());
+  }
+
+  // A reset arena gets a new lifecycle id and must not reuse a stale entry.
+  arenas[0]->Reset();
+  Arena::CreateArray<char>(arenas[0].get(), 8);
+  Arena::CreateArray<char>(arenas[1].get(), 8);
+  EXPECT_EQ(8, arenas[0]->SpaceUsed());
+  EXPECT_EQ(kNumRounds * 16 + 8, arenas[1]->SpaceUsed());
+}
+
+TEST(ArenaTest, StringsAreDestroyedInBulk) {
+  const std::string kLong(100, 'x');  // Too long for the small buffer.
+  Arena arena;
+  std::vector<std::string*> strings;
+  // Enough strings for several chunks of the string list.
+  for (int i = 0; i < 1000; i++) {
+    strings.push_back(Arena::Create<std::string>(&arena, kLong));
+    strings.back()->append(StrCat(i));
+  }
+  for (int i = 0; i < 1000; i++) {
+    EXPECT_EQ(kLong + StrCat(i), *strings[i]);
+  }
+  EXPECT_LE(1000 * sizeof(std::string), arena.SpaceUsed());
+  arena.Reset();
+  EXPECT_EQ(0, arena.SpaceUsed());
+  EXPECT_EQ(kLong, *Arena::Create<std::string>(&arena, kLong));
+}
+
+namespace {
+// Copies a string that lives on the arena when it is destroyed.
+class StringWatcher {
+ public:
+  StringWatcher(const std::string* watched, std::string* copy)
+      : watched_(watched), copy_(copy) {}
+  ~StringWatcher() { *copy_ = *watched_; }
+
+ private:
+  const std::string* watched_;
+  std::string* copy_;
+};
+}  // namespace
+
+TEST(ArenaTest, StringsOutliveOtherDestructors) {
+  const std::string kLong(100, 'x');
+  std::string copy;
+  {
+    Arena arena;
+    std::string* s = Arena::Create<std::string>(&arena, kLong);
+    Arena::Create<StringWatcher>(&arena, s, &copy);
+  }
+  EXPECT_EQ(kLong, copy);
+}
+
+TEST(ArenaTest, BlockCacheRecyclesBlocks) {
+  ArenaBlockCache::Trim();
+  ArenaOptions options;
+  options.start_block_size = 256;
+  options.max_block_size = 8192;
+  options.block_alloc = &ArenaBlockCache::Allocate;
+  options.block_dealloc = &ArenaBlockCache::Deallocate;
+
+  ArenaBlockCache::Stats before = ArenaBlockCache::GetStats();
+  void* first;
+  {
+    Arena arena(options);
+    first = Arena::CreateArray<char>(&arena, 100);
+    Arena::CreateArray<char>(&arena, 300);
+  }
+  ArenaBlockCache::Stats after_first = ArenaBlockCache::GetStats();
+  EXPECT_EQ(before.hits, after_first.hits);
+  EXPECT_EQ(before.misses + 2, after_first.misses);
+  EXPECT_EQ(before.cached_bytes + 256 + 512, after_first.cached_bytes);
+
+  {
+    Arena arena(options);
+    // The blocks of the previous arena are handed out again.
+    EXPECT_EQ(first, Arena::CreateArray<char>(&arena, 100));
+    Arena::CreateArray<char>(&arena, 300);
+    EXPECT_EQ(before.cached_bytes, ArenaBlockCache::GetStats().cached_bytes);
+  }
+  ArenaBlockCache::Stats after_second = ArenaBlockCache::GetStats();
+  EXPECT_EQ(after_first.hits + 2, after_second.hits);
+  EXPECT_EQ(after_first.misses, after_second.misses);
+
+  // Blocks larger than kMaxBlockSize bypass the cache.
+  {
+    Arena arena(options);
+    Arena::CreateArray<char>(&arena, 2 * ArenaBlockCache::kMaxBlockSize);
+  }
+  ArenaBlockCache::Stats after_large = ArenaBlockCache::GetStats();
+  EXPECT_EQ(after_second.uncached + 1, after_large.uncached);
+  EXPECT_EQ(after_second.cached_bytes, after_large.cached_bytes);
+
+  ArenaBlockCache::Trim();
+  EXPECT_EQ(0, ArenaBlockCache::GetStats().cached_bytes);
+}
+
+// An arena in a thread local that was created before the thread first used
+// the cache is destroyed after the thread's lists are flushed.
+struct ThreadLocalArena {
+  static ArenaOptions Options() {
+    ArenaOptions options;
+    options.start_block_size = 256;
+    options.block_alloc = &ArenaBlockCache::Allocate;
+    options.block_dealloc = &ArenaBlockCache::Deallocate;
+    return options;
+  }
+
+  ThreadLocalArena() : arena(Options()) {}
+  Arena arena;
+};
+
+TEST(ArenaTest, BlockCacheTakesBlocksBackAtThreadExit) {
+  ArenaBlockCache::Trim();
+  std::thread([] {
+    static thread_local ThreadLocalArena holder;
+    Arena::CreateArray<char>(&holder.arena, 100);
+  }).join();
+
+  // The block went to the shared pool rather than to the lists of the exited
+  // thread, so Trim() frees it.
+  EXPECT_EQ(256, ArenaBlockCache::GetStats().cached_bytes);
+  ArenaBlockCache::Trim();
+  EXPECT_EQ(0, ArenaBlockCache::GetStats().cached_bytes);
+}
+
+TEST(ArenaTest, BlockCacheOverflowsToSharedPool) {
+  const size_t kSize = ArenaBlockCache::kMinBlockSize;
+  const int kNumBlocks = 20000;
+  ArenaBlockCache::Trim();
+  ArenaBlockCache::Stats before = ArenaBlockCache::GetStats();
+  // Far more blocks than a thread keeps for itself or the shared pool holds.
+  std::vector<void*> blocks;
+  for (int i = 0; i < kNumBlocks; i++) {
+    blocks.push_back(ArenaBlockCache::Allocate(kSize));
+  }
+  for (void* block : blocks) {
+    ArenaBlockCache::Deallocate(block, kSize);
+  }
+  ArenaBlockCache::Stats freed = ArenaBlockCache::GetStats();
+  uint64 releases = freed.releases - before.releases;
+  EXPECT_EQ(before.misses + kNumBlocks, freed.misses);
+  EXPECT_LT(0, releases);
+  EXPECT_EQ((kNumBlocks - releases) * kSize,
+            freed.cached_bytes - before.cached_bytes);
+
+  // Cached blocks come back before any new ones are allocated.
+  for (int i = 0; i < 100; i++) {
+    blocks[i] = ArenaBlockCache::Allocate(kSize);
+  }
+  EXPECT_EQ(freed.hits + 100, ArenaBlockCache::GetStats().hits);
+  EXPECT_EQ(freed.misses, ArenaBlockCache::GetStats().misses);
+  for (int i = 0; i < 100; i++) {
+    ArenaBlockCache::Deallocate(blocks[i], kSize);
+  }
+  ArenaBlockCache::Trim();
+  EXPECT_EQ(0, ArenaBlockCache::GetStats().cached_bytes);
+}
+
 TEST(ArenaTest, GetArenaShouldReturnTheArenaForArenaAllocatedMessages) {
   Arena arena;
   ArenaMessage* message = Arena::CreateMessage<ArenaMessage>(&arena);
@@ -1381,6 +1611,208 @@ TEST(ArenaTest, ArenaHooksSanity) {
   EXPECT_EQ(1, ArenaHooksTestUtil::num_destruct);
 }
 
+TEST(ArenaTest, ProfileAttributesBytesToTypes) {
+  ArenaProfile::SetSampleInterval(1);
+  ArenaProfile::Clear();
+  ArenaOptions options;
+  arena_metrics::EnableArenaMetrics(&options);
+  uint64 space_allocated;
+  uint64 space_used;
+  {
+    Arena arena(options);
+    for (int i = 0; i < 10; i++) {
+      Arena::CreateMessage<TestAllTypes>(&arena);
+    }
+    Arena::Create<std::string>(&arena, "hello");
+    space_allocated = arena.SpaceAllocated();
+    space_used = arena.SpaceUsed();
+  }
+
+  ArenaProfile::Summary summary = ArenaProfile::GetSummary();
+  EXPECT_EQ(1, summary.sample_interval);
+  EXPECT_EQ(1, summary.arenas);
+  EXPECT_EQ(space_allocated, summary.space_allocated);
+  EXPECT_EQ(space_used, summary.space_used);
+  ASSERT_FALSE(summary.types.empty());
+  const ArenaProfile::TypeStats& largest = summary.types[0];
+  const size_t kMessageSize = internal::AlignUpTo8(sizeof(TestAllTypes));
+#if PROTOBUF_RTTI
+  EXPECT_NE(std::string::npos, largest.type_name.find("TestAllTypes"));
+  EXPECT_EQ(10, largest.allocations);
+  EXPECT_EQ(10 * kMessageSize, largest.bytes);
+#else
+  EXPECT_EQ("(untyped)", largest.type_name);
+  EXPECT_EQ(11, largest.allocations);
+  EXPECT_EQ(10 * kMessageSize + internal::AlignUpTo8(sizeof(std::string)),
+            largest.bytes);
+#endif  // PROTOBUF_RTTI
+  EXPECT_NE(std::string::npos,
+            ArenaProfile::DebugString().find(largest.type_name));
+
+  ArenaProfile::Clear();
+  EXPECT_EQ(0, ArenaProfile::GetSummary().arenas);
+  EXPECT_TRUE(ArenaProfile::GetSummary().types.empty());
+  ArenaProfile::SetSampleInterval(ArenaProfile::kDefaultSampleInterval);
+}
+
+TEST(ArenaTest, ProfileSamplesAllocations) {
+  const uint64 kInterval = 1024;
+  ArenaProfile::SetSampleInterval(kInterval);
+  ArenaProfile::Clear();
+  ArenaOptions options;
+  arena_metrics::EnableArenaMetrics(&options);
+  {
+    Arena arena(options);
+    for (int i = 0; i < 100000; i++) {
+      Arena::CreateArray<uint64>(&arena, 8);
+    }
+  }
+
+  // About one in every 16 allocations is sampled, at random, and stands for
+  // about 16 of them. The estimates are within 10% with near certainty.
+  ArenaProfile::Summary summary = ArenaProfile::GetSummary();
+  ASSERT_EQ(1, summary.types.size());
+  EXPECT_NEAR(100000, summary.types[0].allocations, 10000);
+  EXPECT_NEAR(6400000, summary.types[0].bytes, 640000);
+
+  ArenaProfile::Clear();
+  ArenaProfile::SetSampleInterval(ArenaProfile::kDefaultSampleInterval);
+}
+
+// Returns the bytes recorded for the storage of |field|.
+uint64 ProfiledFieldBytes(const ArenaProfile::Summary& summary,
+                          const std::string& field) {
+  uint64 bytes = 0;
+  for (const ArenaProfile::TypeStats& stats : summary.types) {
+    if (stats.field == field) bytes += stats.bytes;
+  }
+  return bytes;
+}
+
+TEST(ArenaTest, ProfileAttributesContainersToFields) {
+  ArenaProfile::SetSampleInterval(1);
+  ArenaProfile::Clear();
+  ArenaOptions options;
+  arena_metrics::EnableArenaFieldMetrics(&options);
+  {
+    Arena arena(options);
+    TestAllTypes* message = Arena::CreateMessage<TestAllTypes>(&arena);
+    for (int i = 0; i < 100; i++) {
+      message->add_repeated_int32(i);
+      message->add_repeated_string("value");
+    }
+    message->set_optional_string("hello");
+    message->set_oneof_string("oneof");
+    TestMap* map_message = Arena::CreateMessage<TestMap>(&arena);
+    for (int i = 0; i < 100; i++) {
+      (*map_message->mutable_map_int32_int32())[i] = i;
+    }
+    // Not in a message, attributed to the type of the container.
+    Arena::CreateMessage<RepeatedField<int32>>(&arena)->Add(1);
+  }
+
+  ArenaProfile::Summary summary = ArenaProfile::GetSummary();
+  EXPECT_GE(ProfiledFieldBytes(summary,
+                               "protobuf_unittest.TestAllTypes.repeated_int32"),
+            100 * sizeof(int32));
+  EXPECT_GE(ProfiledFieldBytes(summary,
+                               "protobuf_unittest.TestAllTypes.repeated_string"),
+            100 * sizeof(void*));
+  EXPECT_GE(ProfiledFieldBytes(summary,
+                               "protobuf_unittest.TestAllTypes.optional_string"),
+            sizeof(std::string));
+  EXPECT_GE(ProfiledFieldBytes(summary,
+                               "protobuf_unittest.TestAllTypes.oneof_string"),
+            sizeof(std::string));
+  EXPECT_GE(ProfiledFieldBytes(summary,
+                               "protobuf_unittest.TestMap.map_int32_int32"),
+            100 * 2 * sizeof(int32));
+  EXPECT_EQ(0, ProfiledFieldBytes(summary,
+                                  "protobuf_unittest.TestAllTypes.oneof_bytes"));
+#if PROTOBUF_RTTI
+  EXPECT_GE(ProfiledFieldBytes(summary, "google::protobuf::RepeatedField<int>"),
+            sizeof(int32));
+#endif  // PROTOBUF_RTTI
+  EXPECT_NE(std::string::npos,
+            ArenaProfile::DebugString().find(
+                " in protobuf_unittest.TestAllTypes.repeated_int32\n"));
+
+  ArenaProfile::Clear();
+  ArenaProfile::SetSampleInterval(ArenaProfile::kDefaultSampleInterval);
+}
+
+TEST(ArenaTest, ProfileAttributesFieldsOnlyWhenEnabled) {
+  ArenaProfile::SetSampleInterval(1);
+  ArenaProfile::Clear();
+  ArenaOptions options;
+  arena_metrics::EnableArenaMetrics(&options);
+  {
+    Arena arena(options);
+    TestAllTypes* message = Arena::CreateMessage<TestAllTypes>(&arena);
+    for (int i = 0; i < 100; i++) {
+      message->add_repeated_int32(i);
+    }
+  }
+
+  ArenaProfile::Summary summary = ArenaProfile::GetSummary();
+  EXPECT_FALSE(summary.types.empty());
+  for (const ArenaProfile::TypeStats& stats : summary.types) {
+    EXPECT_EQ("", stats.field);
+  }
+
+  ArenaProfile::Clear();
+  ArenaProfile::SetSampleInterval(ArenaProfile::kDefaultSampleInterval);
+}
+
+TEST(ArenaTest, ProfileSerializesAsPprof) {
+  ArenaProfile::SetSampleInterval(1);
+  ArenaProfile::Clear();
+  ArenaOptions options;
+  arena_metrics::EnableArenaFieldMetrics(&options);
+  {
+    Arena arena(options);
+    TestAllTypes* message = Arena::CreateMessage<TestAllTypes>(&arena);
+    message->add_repeated_int32(1);
+  }
+  ArenaProfile::Summary summary = ArenaProfile::GetSummary();
+
+  // Check the structure of the profile.proto message of pprof.
+  UnknownFieldSet profile;
+  ASSERT_TRUE(profile.ParseFromString(ArenaProfile::SerializeAsPprof()));
+  int sample_types = 0;
+  int samples = 0;
+  int64 period = 0;
+  std::vector<std::string> strings;
+  for (int i = 0; i < profile.field_count(); i++) {
+    const UnknownField& field = profile.field(i);
+    switch (field.number()) {
+      case 1:
+        sample_types++;
+        break;
+      case 2:
+        samples++;
+        break;
+      case 6:
+        strings.push_back(field.length_delimited());
+        break;
+      case 12:
+        period = field.varint();
+        break;
+    }
+  }
+  EXPECT_EQ(2, sample_types);
+  EXPECT_EQ(summary.types.size(), samples);
+  EXPECT_EQ(1, period);
+  ASSERT_FALSE(strings.empty());
+  EXPECT_EQ("", strings[0]);
+  EXPECT_NE(strings.end(),
+            std::find(strings.begin(), strings.end(),
+                      "protobuf_unittest.TestAllTypes.repeated_int32"));
+
+  ArenaProfile::Clear();
+  ArenaProfile::SetSampleInterval(ArenaProfile::kDefaultSampleInterval);
+}
+
 
 }  // namespace protobuf
 }  // namespace google
@@ -289,7 +289,8 @@ struct PROTOBUF_EXPORT ArenaStringPtr {
   void CreateInstance(Arena* arena, const ::std::string* initial_value) {
     GOOGLE_DCHECK(initial_value != NULL);
     // uses "new ::std::string" when arena is nullptr
-    ptr_ = Arena::Create< ::std::string>(arena, *initial_value);
+    ptr_ = Arena::CreateForContainer< ::std::string>(arena, this,
+                                                     *initial_value);
   }
   PROTOBUF_NOINLINE
   void CreateInstanceNoArena(const ::std::string* initial_value) {
@@ -52,6 +52,7 @@
 #include <ctype.h>
 #include <errno.h>
 #include <fstream>
+#include <functional>
 #include <iostream>
 
 #include <limits.h>  //For PATH_MAX
@@ -74,6 +75,7 @@
 #include <google/protobuf/io/printer.h>
 #include <google/protobuf/io/zero_copy_stream_impl.h>
 #include <google/protobuf/descriptor.h>
+#include <google/protobuf/descriptor_database.h>
 #include <google/protobuf/dynamic_message.h>
 #include <google/protobuf/text_format.h>
 #include <google/protobuf/stubs/strutil.h>
@@ -270,6 +272,40 @@ std::string PluginName(const std::string& plugin_prefix,
   return plugin_prefix + "gen-" + directive.substr(2, directive.size() - 6);
 }
 
+// Creates the binary output file |path| and calls |write| to fill it.  |write|
+// returns false on failure.  Errors are reported on stderr.
+bool WriteBinaryFile(
+    const std::string& path,
+    const std::function<bool(io::CodedOutputStream*)>& write) {
+  int fd;
+  do {
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0666);
+  } while (fd < 0 && errno == EINTR);
+
+  if (fd < 0) {
+    perror(path.c_str());
+    return false;
+  }
+
+  io::FileOutputStream out(fd);
+
+  {
+    io::CodedOutputStream coded_out(&out);
+    if (!write(&coded_out) || coded_out.HadError()) {
+      std::cerr << path << ": " << strerror(out.GetErrno()) << std::endl;
+      out.Close();
+      return false;
+    }
+  }
+
+  if (!out.Close()) {
+    std::cerr << path << ": " << strerror(out.GetErrno()) << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
 }  // namespace
 
 // A MultiFileErrorCollector that prints errors to stderr.
@@ -1099,6 +1135,12 @@ int CommandLineInterface::Run(int argc, const char* const argv[]) {
     }
   }
 
+  if (!descriptor_index_out_name_.empty()) {
+    if (!WriteDescriptorIndex(parsed_files)) {
+      return 1;
+    }
+  }
+
   if (mode_ == MODE_ENCODE || mode_ == MODE_DECODE) {
     if (codec_type_.empty()) {
       // HACK:  Define an EmptyMessage type to use for decoding.
@@ -1328,6 +1370,7 @@ void CommandLineInterface::Clear() {
   codec_type_.clear();
   descriptor_set_in_names_.clear();
   descriptor_set_out_name_.clear();
+  descriptor_index_out_name_.clear();
   dependency_out_name_.clear();
 
 
@@ -1564,7 +1607,7 @@ CommandLineInterface::ParseArgumentStatus CommandLineInterface::ParseArguments(
     return PARSE_ARGUMENT_FAIL;
   }
   if (mode_ == MODE_COMPILE && output_directives_.empty() &&
-      descriptor_set_out_name_.empty()) {
+      descriptor_set_out_name_.empty() && descriptor_index_out_name_.empty()) {
     std::cerr << "Missing output directives." << std::endl;
     return PARSE_ARGUMENT_FAIL;
   }
@@ -1584,9 +1627,10 @@ CommandLineInterface::ParseArgumentStatus CommandLineInterface::ParseArguments(
                  "--descriptor_set_out."
               << std::endl;
   }
-  if (source_info_in_descriptor_set_ && descriptor_set_out_name_.empty()) {
+  if (source_info_in_descriptor_set_ && descriptor_set_out_name_.empty() &&
+      descriptor_index_out_name_.empty()) {
     std::cerr << "--include_source_info only makes sense when combined with "
-                 "--descriptor_set_out."
+                 "--descriptor_set_out or --descriptor_index_out."
               << std::endl;
   }
 
@@ -1803,6 +1847,24 @@ CommandLineInterface::InterpretArgument(const std::string& name,
     }
     descriptor_set_out_name_ = value;
 
+  } else if (name == "--descriptor_index_out") {
+    if (!descriptor_index_out_name_.empty()) {
+      std::cerr << name << " may only be passed once." << std::endl;
+      return PARSE_ARGUMENT_FAIL;
+    }
+    if (value.empty()) {
+      std::cerr << name << " requires a non-empty value." << std::endl;
+      return PARSE_ARGUMENT_FAIL;
+    }
+    if (mode_ != MODE_COMPILE) {
+      std::cerr
+          << "Cannot use --encode or --decode and generate descriptors at the "
+             "same time."
+          << std::endl;
+      return PARSE_ARGUMENT_FAIL;
+    }
+    descriptor_index_out_name_ = value;
+
   } else if (name == "--dependency_out") {
     if (!dependency_out_name_.empty()) {
       std::cerr << name << " may only be passed once." << std::endl;
@@ -1858,7 +1920,8 @@ CommandLineInterface::InterpretArgument(const std::string& name,
                 << std::endl;
       return PARSE_ARGUMENT_FAIL;
     }
-    if (!output_directives_.empty() || !descriptor_set_out_name_.empty()) {
+    if (!output_directives_.empty() || !descriptor_set_out_name_.empty() ||
+        !descriptor_index_out_name_.empty()) {
       std::cerr << "Cannot use " << name
                 << " and generate code or descriptors at the same time."
                 << std::endl;
@@ -1924,7 +1987,8 @@ CommandLineInterface::InterpretArgument(const std::string& name,
                 << "other info at the same time." << std::endl;
       return PARSE_ARGUMENT_FAIL;
     }
-    if (!output_directives_.empty() || !descriptor_set_out_name_.empty()) {
+    if (!output_directives_.empty() || !descriptor_set_out_name_.empty() ||
+        !descriptor_index_out_name_.empty()) {
       std::cerr << "Cannot use " << name
                 << " and generate code or descriptors at the same time."
                 << std::endl;
@@ -2058,6 +2122,13 @@ void CommandLineInterface::PrintHelpText() {
          "    --descriptor_set_out=FILE defined in descriptor.proto) "
          "containing all of\n"
          "                              the input files to FILE.\n"
+         "  --descriptor_index_out=FILE Writes a pre-indexed descriptor "
+         "database\n"
+         "                              containing the input files and all "
+         "their\n"
+         "                              dependencies to FILE.  It can be "
+         "memory-mapped\n"
+         "                              with MappedDescriptorDatabase.\n"
          "  --include_imports           When using --descriptor_set_out, also "
          "include\n"
          "                              all dependencies of the input files in "
@@ -2480,39 +2551,53 @@ bool CommandLineInterface::WriteDescriptorSet(
                               file_set.mutable_file());
   }
 
-  int fd;
-  do {
-    fd = open(descriptor_set_out_name_.c_str(),
-              O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0666);
-  } while (fd < 0 && errno == EINTR);
-
-  if (fd < 0) {
-    perror(descriptor_set_out_name_.c_str());
-    return false;
-  }
-
-  io::FileOutputStream out(fd);
+  return WriteBinaryFile(descriptor_set_out_name_,
+                         [&file_set](io::CodedOutputStream* out) {
+                           // Determinism is useful here because build outputs
+                           // are sometimes checked into version control.
+                           out->SetSerializationDeterministic(true);
+                           return file_set.SerializeToCodedStream(out);
+                         });
+}
 
-  {
-    io::CodedOutputStream coded_out(&out);
-    // Determinism is useful here because build outputs are sometimes checked
-    // into version control.
-    coded_out.SetSerializationDeterministic(true);
-    if (!file_set.SerializeToCodedStream(&coded_out)) {
-      std::cerr << descriptor_set_out_name_ << ": " << strerror(out.GetErrno())
-                << std::endl;
-      out.Close();
-      return false;
-    }
+bool CommandLineInterface::WriteDescriptorIndex(
+    const std::vector<const FileDescriptor*>& parsed_files) {
+  // The index must be self-contained so that a DescriptorPool can build any
+  // file in it, so dependencies are always included.
+  RepeatedPtrField<FileDescriptorProto> file_protos;
+  std::set<const FileDescriptor*> already_seen;
+  for (const FileDescriptor* file : parsed_files) {
+    GetTransitiveDependencies(file,
+                              true,  // Include json_name
+                              source_info_in_descriptor_set_, &already_seen,
+                              &file_protos);
   }
 
-  if (!out.Close()) {
-    std::cerr << descriptor_set_out_name_ << ": " << strerror(out.GetErrno())
-              << std::endl;
+  std::vector<const FileDescriptorProto*> files(file_protos.pointer_begin(),
+                                                file_protos.pointer_end());
+  std::string index;
+  if (!MappedDescriptorDatabase::Build(files, &index)) {
+    std::cerr << descriptor_index_out_name_
+              << ": Failed to build descriptor index." << std::endl;
     return false;
   }
 
-  return true;
+  return WriteBinaryFile(descriptor_index_out_name_,
+                         [&index](io::CodedOutputStream* out) {
+                           // WriteRaw() takes an int size, and an index can be
+                           // larger than 2GB.
+                           const char* data = index.data();
+                           size_t remaining = index.size();
+                           while (remaining > 0) {
+                             int chunk = remaining > INT_MAX
+                                             ? INT_MAX
+                                             : static_cast<int>(remaining);
+                             out->WriteRaw(data, chunk);
+                             data += chunk;
+                             remaining -= chunk;
+                           }
+                           return !out->HadError();
+                         });
 }
 
 void CommandLineInterface::GetTransitiveDependencies(
@@ -302,6 +302,10 @@ class PROTOC_EXPORT CommandLineInterface {
   bool WriteDescriptorSet(
       const std::vector<const FileDescriptor*>& parsed_files);
 
+  // Implements the --descriptor_index_out option.
+  bool WriteDescriptorIndex(
+      const std::vector<const FileDescriptor*>& parsed_files);
+
   // Implements the --dependency_out option
   bool GenerateDependencyManifestFile(
       const std::vector<const FileDescriptor*>& parsed_files,
@@ -432,6 +436,10 @@ class PROTOC_EXPORT CommandLineInterface {
   // FileDescriptorSet should be written.  Otherwise, empty.
   std::string descriptor_set_out_name_;
 
+  // If --descriptor_index_out was given, this is the filename to which the
+  // MappedDescriptorDatabase index should be written.  Otherwise, empty.
+  std::string descriptor_index_out_name_;
+
   // If --dependency_out was given, this is the path to the file where the
   // dependency file will be written. Otherwise, empty.
   std::string dependency_out_name_;
@@ -57,6 +57,7 @@
 #include <google/protobuf/io/zero_copy_stream.h>
 #include <google/protobuf/descriptor.pb.h>
 #include <google/protobuf/descriptor.h>
+#include <google/protobuf/descriptor_database.h>
 #include <google/protobuf/testing/googletest.h>
 #include <gtest/gtest.h>
 #include <google/protobuf/stubs/substitute.h>
@@ -202,6 +203,9 @@ class CommandLineInterfaceTest : public testing::Test {
   void WriteDescriptorSet(const std::string& filename,
                           const FileDescriptorSet* descriptor_set);
 
+  void OpenDescriptorIndex(const std::string& filename,
+                           MappedDescriptorDatabase* database);
+
   void ExpectFileContent(const std::string& filename,
                          const std::string& content);
 
@@ -494,6 +498,14 @@ void CommandLineInterfaceTest::ReadDescriptorSet(
   }
 }
 
+void CommandLineInterfaceTest::OpenDescriptorIndex(
+    const std::string& filename, MappedDescriptorDatabase* database) {
+  std::string path = temp_directory_ + "/" + filename;
+  if (!database->Open(path)) {
+    FAIL() << "Could not open descriptor index: " << path;
+  }
+}
+
 void CommandLineInterfaceTest::WriteDescriptorSet(
     const std::string& filename, const FileDescriptorSet* descriptor_set) {
   std::string binary_proto;
@@ -1662,6 +1674,44 @@ TEST_F(CommandLineInterfaceTest, WriteTransitiveDescriptorSetWithSourceInfo) {
   EXPECT_TRUE(descriptor_set.file(1).has_source_code_info());
 }
 
+TEST_F(CommandLineInterfaceTest, WriteDescriptorIndex) {
+  CreateTempFile("foo.proto",
+                 "syntax = \"proto2\";\n"
+                 "package foo;\n"
+                 "message Foo {}\n");
+  CreateTempFile("bar.proto",
+                 "syntax = \"proto2\";\n"
+                 "import \"foo.proto\";\n"
+                 "message Bar {\n"
+                 "  optional foo.Foo foo = 1;\n"
+                 "}\n");
+
+  Run("protocol_compiler --descriptor_index_out=$tmpdir/descriptor_index "
+      "--proto_path=$tmpdir bar.proto");
+
+  ExpectNoErrors();
+
+  MappedDescriptorDatabase database;
+  OpenDescriptorIndex("descriptor_index", &database);
+  if (HasFatalFailure()) return;
+  // Imports are always included so the index is self-contained.
+  std::vector<std::string> file_names;
+  EXPECT_TRUE(database.FindAllFileNames(&file_names));
+  ASSERT_EQ(2, file_names.size());
+  EXPECT_EQ("bar.proto", file_names[0]);
+  EXPECT_EQ("foo.proto", file_names[1]);
+
+  FileDescriptorProto file;
+  EXPECT_TRUE(database.FindFileContainingSymbol("foo.Foo", &file));
+  EXPECT_EQ("foo.proto", file.name());
+  EXPECT_FALSE(file.has_source_code_info());
+
+  DescriptorPool pool(&database);
+  const Descriptor* bar = pool.FindMessageTypeByName("Bar");
+  ASSERT_TRUE(bar != nullptr);
+  EXPECT_EQ("foo.Foo", bar->field(0)->message_type()->full_name());
+}
+
 #ifdef _WIN32
 // TODO(teboring): Figure out how to write test on windows.
 #else
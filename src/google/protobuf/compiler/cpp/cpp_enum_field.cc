@@ -228,6 +228,7 @@ void RepeatedEnumFieldGenerator::GeneratePrivateMembers(
     io::Printer* printer) const {
   Formatter format(printer, variables_);
   format("::$proto_ns$::RepeatedField<int> $name$_;\n");
+  GenerateInlinedRepeatedStorage(printer, "int");
   if (descriptor_->is_packed() &&
       HasGeneratedMethods(descriptor_->file(), options_)) {
     format("mutable std::atomic<int> _$name$_cached_byte_size_;\n");
@@ -325,7 +326,14 @@ void RepeatedEnumFieldGenerator::GenerateSwappingCode(
 
 void RepeatedEnumFieldGenerator::GenerateConstructorCode(
     io::Printer* printer) const {
-  // Not needed for repeated fields.
+  GenerateInlinedRepeatedStorageAttach(printer);
+}
+
+void RepeatedEnumFieldGenerator::GenerateCopyConstructorCode(
+    io::Printer* printer) const {
+  Formatter format(printer, variables_);
+  GenerateInlinedRepeatedStorageAttach(printer);
+  format("$name$_.CopyFrom(from.$name$_);\n");
 }
 
 void RepeatedEnumFieldGenerator::GenerateMergeFromCodedStream(
@@ -102,6 +102,25 @@ void FieldGenerator::SetHasBitIndex(int32 has_bit_index) {
       strings::Hex(1u << (has_bit_index % 32), strings::ZERO_PAD_8), "u;");
 }
 
+void FieldGenerator::GenerateInlinedRepeatedStorage(
+    io::Printer* printer, const std::string& element_type) const {
+  const int capacity = InlinedRepeatedCapacity(descriptor_, options_);
+  if (capacity == 0) return;
+  Formatter format(printer, variables_);
+  format(
+      "::$proto_ns$::internal::Inlined$1$Storage< $2$, $3$ > "
+      "$name$_inline_;\n",
+      IsStringOrMessage(descriptor_) ? "RepeatedPtrField" : "RepeatedField",
+      element_type, capacity);
+}
+
+void FieldGenerator::GenerateInlinedRepeatedStorageAttach(
+    io::Printer* printer) const {
+  if (InlinedRepeatedCapacity(descriptor_, options_) == 0) return;
+  Formatter format(printer, variables_);
+  format("$name$_inline_.Attach(&$name$_);\n");
+}
+
 void SetCommonOneofFieldVariables(
     const FieldDescriptor* descriptor,
     std::map<std::string, std::string>* variables) {
@@ -170,8 +189,14 @@ FieldGenerator* FieldGeneratorMap::MakeGenerator(
   } else {
     switch (field->cpp_type()) {
       case FieldDescriptor::CPPTYPE_MESSAGE:
+        if (IsLazy(field, options)) {
+          return new LazyMessageFieldGenerator(field, options);
+        }
         return new MessageFieldGenerator(field, options, scc_analyzer);
       case FieldDescriptor::CPPTYPE_STRING:
+        if (IsStringPiece(field, options)) {
+          return new StringPieceFieldGenerator(field, options);
+        }
         return new StringFieldGenerator(field, options);
       case FieldDescriptor::CPPTYPE_ENUM:
         return new EnumFieldGenerator(field, options);
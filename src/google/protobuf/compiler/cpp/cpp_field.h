@@ -186,6 +186,14 @@ class FieldGenerator {
   void SetHasBitIndex(int32 has_bit_index);
 
  protected:
+  // For a repeated field which keeps its first elements inside the message
+  // (see InlinedRepeatedCapacity()), generates the member holding them, and
+  // the constructor code which attaches that member to the field.  Generates
+  // nothing for other fields.
+  void GenerateInlinedRepeatedStorage(io::Printer* printer,
+                                      const std::string& element_type) const;
+  void GenerateInlinedRepeatedStorageAttach(io::Printer* printer) const;
+
   const FieldDescriptor* descriptor_;
   const Options& options_;
   std::map<std::string, std::string> variables_;
@@ -1249,7 +1249,6 @@ void FileGenerator::GenerateLibraryIncludes(io::Printer* printer) {
     IncludeFile("net/proto2/public/weak_field_map.h", printer);
   }
   if (HasLazyFields(file_, options_)) {
-    GOOGLE_CHECK(!options_.opensource_runtime);
     IncludeFile("net/proto2/public/lazy_field.h", printer);
   }
 
@@ -1307,13 +1306,13 @@ void FileGenerator::GenerateLibraryIncludes(io::Printer* printer) {
     if (HasRepeatedFields(file_)) {
       IncludeFileAndExport("net/proto2/public/repeated_field.h", printer);
     }
-    if (HasStringPieceFields(file_, options_)) {
-      IncludeFile("net/proto2/public/string_piece_field_support.h", printer);
-    }
     if (HasCordFields(file_, options_)) {
       format("#include \"third_party/absl/strings/cord.h\"\n");
     }
   }
+  if (HasStringPieceFields(file_, options_)) {
+    IncludeFile("net/proto2/public/string_piece_field_support.h", printer);
+  }
   if (HasMapFields(file_)) {
     IncludeFileAndExport("net/proto2/public/map.h", printer);
     if (HasDescriptorMethods(file_, options_)) {
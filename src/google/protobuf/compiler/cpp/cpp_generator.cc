@@ -104,6 +104,19 @@ bool CppGenerator::Generate(const FileDescriptor* file,
         file_options.num_cc_files =
             strto32(options[i].second.c_str(), NULL, 10);
       }
+    } else if (options[i].first == "string_piece_fields") {
+      file_options.string_piece_fields = true;
+    } else if (options[i].first == "lazy_fields") {
+      file_options.lazy_fields = true;
+    } else if (options[i].first == "inline_repeated_fields") {
+      file_options.inline_repeated_capacity =
+          options[i].second.empty()
+              ? 4
+              : strto32(options[i].second.c_str(), NULL, 10);
+      if (file_options.inline_repeated_capacity <= 0) {
+        *error = "inline_repeated_fields needs a positive capacity.";
+        return false;
+      }
     } else if (options[i].first == "table_driven_parsing") {
       file_options.table_driven_parsing = true;
     } else if (options[i].first == "table_driven_serialization") {
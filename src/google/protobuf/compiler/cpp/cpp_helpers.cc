@@ -205,7 +205,8 @@ void SetIntVar(const Options& options, const std::string& type,
 }
 
 bool HasInternalAccessors(const FieldOptions::CType ctype) {
-  return ctype == FieldOptions::STRING || ctype == FieldOptions::CORD;
+  return ctype == FieldOptions::STRING || ctype == FieldOptions::CORD ||
+         ctype == FieldOptions::STRING_PIECE;
 }
 
 }  // namespace
@@ -806,6 +807,27 @@ bool IsStringInlined(const FieldDescriptor* descriptor,
   return false;
 }
 
+static bool MayHaveRequiredFields(
+    const Descriptor* descriptor,
+    std::unordered_set<const Descriptor*>* visited) {
+  if (!visited->insert(descriptor).second) return false;
+  if (descriptor->extension_range_count() > 0) return true;
+  for (int i = 0; i < descriptor->field_count(); i++) {
+    const FieldDescriptor* field = descriptor->field(i);
+    if (field->is_required()) return true;
+    if (field->message_type() != nullptr &&
+        MayHaveRequiredFields(field->message_type(), visited)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool MayHaveRequiredFields(const Descriptor* descriptor) {
+  std::unordered_set<const Descriptor*> visited;
+  return MayHaveRequiredFields(descriptor, &visited);
+}
+
 static bool HasLazyFields(const Descriptor* descriptor,
                           const Options& options) {
   for (int field_idx = 0; field_idx < descriptor->field_count(); field_idx++) {
@@ -982,11 +1004,35 @@ bool IsStringOrMessage(const FieldDescriptor* field) {
   return false;
 }
 
+int InlinedRepeatedCapacity(const FieldDescriptor* field,
+                            const Options& options) {
+  if (options.inline_repeated_capacity == 0 || !field->is_repeated() ||
+      field->is_map() || field->is_extension() || field->options().weak() ||
+      options.table_driven_parsing || options.table_driven_serialization) {
+    return 0;
+  }
+  // Implicit weak message fields are WeakRepeatedPtrFields.
+  if (field->type() == FieldDescriptor::TYPE_MESSAGE &&
+      UsingImplicitWeakFields(field->file(), options)) {
+    return 0;
+  }
+  return options.inline_repeated_capacity;
+}
+
 FieldOptions::CType EffectiveStringCType(const FieldDescriptor* field,
                                          const Options& options) {
   GOOGLE_DCHECK(field->cpp_type() == FieldDescriptor::CPPTYPE_STRING);
   if (options.opensource_runtime) {
-    // Open-source protobuf release only supports STRING ctype.
+    // Open-source protobuf release only supports STRING ctype, and
+    // STRING_PIECE for plain singular fields on request.
+    if (options.string_piece_fields &&
+        field->options().ctype() == FieldOptions::STRING_PIECE &&
+        !field->is_repeated() && !field->is_extension() &&
+        !field->real_containing_oneof() && !field->has_default_value() &&
+        !field->containing_type()->options().map_entry() &&
+        !options.table_driven_parsing && !options.table_driven_serialization) {
+      return FieldOptions::STRING_PIECE;
+    }
     return FieldOptions::STRING;
   } else {
     // Google-internal supports all ctypes.
@@ -1461,11 +1507,7 @@ class ParseLoopGenerator {
   }
 
   void GenerateStrings(const FieldDescriptor* field, bool check_utf8) {
-    FieldOptions::CType ctype = FieldOptions::STRING;
-    if (!options_.opensource_runtime) {
-      // Open source doesn't support other ctypes;
-      ctype = field->options().ctype();
-    }
+    FieldOptions::CType ctype = EffectiveStringCType(field, options_);
     if (!field->is_repeated() && !options_.opensource_runtime &&
         GetOptimizeFor(field->file(), options_) != FileOptions::LITE_RUNTIME &&
         // For now only use arena string for strings with empty defaults.
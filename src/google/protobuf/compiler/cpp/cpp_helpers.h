@@ -339,13 +339,33 @@ inline bool IsStringPiece(const FieldDescriptor* field,
 // Does the given FileDescriptor use lazy fields?
 bool HasLazyFields(const FileDescriptor* file, const Options& options);
 
+// Can a message of the given type, or of a type it contains, have required
+// fields?  Extensions may be required, so extendable types are included.
+bool MayHaveRequiredFields(const Descriptor* descriptor);
+
 // Is the given field a supported lazy field?
 inline bool IsLazy(const FieldDescriptor* field, const Options& options) {
-  return field->options().lazy() && !field->is_repeated() &&
-         field->type() == FieldDescriptor::TYPE_MESSAGE &&
-         GetOptimizeFor(field->file(), options) != FileOptions::LITE_RUNTIME &&
-         !options.opensource_runtime;
-}
+  if (!field->options().lazy() || field->is_repeated() ||
+      field->type() != FieldDescriptor::TYPE_MESSAGE ||
+      GetOptimizeFor(field->file(), options) == FileOptions::LITE_RUNTIME) {
+    return false;
+  }
+  // Open-source protobuf release supports lazy fields on request, for plain
+  // singular fields.  IsInitialized() does not look into lazy fields, so
+  // those which may have required fields are parsed eagerly.
+  return !options.opensource_runtime ||
+         (options.lazy_fields && !field->is_extension() &&
+          !field->real_containing_oneof() && !field->options().weak() &&
+          !options.table_driven_parsing &&
+          !options.table_driven_serialization &&
+          !MayHaveRequiredFields(field->message_type()));
+}
+
+// Returns the number of elements that the given repeated field keeps inside the
+// message (see internal::InlinedRepeatedFieldStorage), or 0 if it has no inline
+// storage.
+int InlinedRepeatedCapacity(const FieldDescriptor* field,
+                            const Options& options);
 
 inline bool IsFieldUsed(const FieldDescriptor* field, const Options& options) {
   return true;
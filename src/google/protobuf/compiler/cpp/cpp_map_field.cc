@@ -172,8 +172,7 @@ static void GenerateSerializationLoop(const Formatter& format, bool string_key,
   std::string ptr;
   if (is_deterministic) {
     format("for (size_type i = 0; i < n; i++) {\n");
-    ptr = string_key ? "items[static_cast<ptrdiff_t>(i)]"
-                     : "items[static_cast<ptrdiff_t>(i)].second";
+    ptr = "items[static_cast<ptrdiff_t>(i)]";
   } else {
     format(
         "for (::$proto_ns$::Map< $key_cpp$, $val_cpp$ >::const_iterator\n"
@@ -213,18 +212,6 @@ void MapFieldGenerator::GenerateSerializeWithCachedSizesToArray(
   format(
       "typedef ::$proto_ns$::Map< $key_cpp$, $val_cpp$ >::const_pointer\n"
       "    ConstPtr;\n");
-  if (string_key) {
-    format(
-        "typedef ConstPtr SortItem;\n"
-        "typedef ::$proto_ns$::internal::"
-        "CompareByDerefFirst<SortItem> Less;\n");
-  } else {
-    format(
-        "typedef ::$proto_ns$::internal::SortItem< $key_cpp$, ConstPtr > "
-        "SortItem;\n"
-        "typedef ::$proto_ns$::internal::CompareByFirstField<SortItem> "
-        "Less;\n");
-  }
   bool utf8_check = string_key || string_value;
   if (utf8_check) {
     format(
@@ -253,17 +240,11 @@ void MapFieldGenerator::GenerateSerializeWithCachedSizesToArray(
       "\n"
       "if (stream->IsSerializationDeterministic() &&\n"
       "    this->_internal_$name$().size() > 1) {\n"
-      "  ::std::unique_ptr<SortItem[]> items(\n"
-      "      new SortItem[this->_internal_$name$().size()]);\n"
+      "  const ConstPtr* items =\n"
+      "      this->_internal_$name$().InternalSortedItems();\n"
       "  typedef ::$proto_ns$::Map< $key_cpp$, $val_cpp$ >::size_type "
       "size_type;\n"
-      "  size_type n = 0;\n"
-      "  for (::$proto_ns$::Map< $key_cpp$, $val_cpp$ >::const_iterator\n"
-      "      it = this->_internal_$name$().begin();\n"
-      "      it != this->_internal_$name$().end(); ++it, ++n) {\n"
-      "    items[static_cast<ptrdiff_t>(n)] = SortItem(&*it);\n"
-      "  }\n"
-      "  ::std::sort(&items[0], &items[static_cast<ptrdiff_t>(n)], Less());\n");
+      "  size_type n = this->_internal_$name$().size();\n");
   format.Indent();
   GenerateSerializationLoop(format, string_key, string_value, true);
   format.Outdent();
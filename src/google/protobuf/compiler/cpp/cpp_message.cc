@@ -2609,6 +2609,8 @@ void MessageGenerator::GenerateStructors(io::Printer* printer) {
           !IsCord(field, options_)) {
         continue;
       }
+      // Fields with inline storage are attached to it and copied in the body.
+      if (InlinedRepeatedCapacity(field, options_) > 0) continue;
 
       processed[i] = true;
       format(",\n$1$_(from.$1$_)", FieldName(field));
@@ -468,6 +468,187 @@ void MessageFieldGenerator::GenerateByteSize(io::Printer* printer) const {
 
 // ===================================================================
 
+LazyMessageFieldGenerator::LazyMessageFieldGenerator(
+    const FieldDescriptor* descriptor, const Options& options)
+    : FieldGenerator(descriptor, options) {
+  SetMessageVariables(descriptor, options, false, &variables_);
+  variables_["prototype"] = "reinterpret_cast<const " + variables_["type"] +
+                            "&>(" + variables_["type_default_instance"] + ")";
+}
+
+LazyMessageFieldGenerator::~LazyMessageFieldGenerator() {}
+
+void LazyMessageFieldGenerator::GeneratePrivateMembers(
+    io::Printer* printer) const {
+  Formatter format(printer, variables_);
+  format("::$proto_ns$::internal::LazyField $name$_;\n");
+}
+
+void LazyMessageFieldGenerator::GenerateAccessorDeclarations(
+    io::Printer* printer) const {
+  Formatter format(printer, variables_);
+  format(
+      "$deprecated_attr$const $type$& ${1$$name$$}$() const;\n"
+      "$deprecated_attr$$type$* ${1$$release_name$$}$();\n"
+      "$deprecated_attr$$type$* ${1$mutable_$name$$}$();\n"
+      "$deprecated_attr$void ${1$set_allocated_$name$$}$"
+      "($type$* $name$);\n"
+      "private:\n"
+      "const $type$& ${1$_internal_$name$$}$() const;\n"
+      "$type$* ${1$_internal_mutable_$name$$}$();\n"
+      "public:\n"
+      "$deprecated_attr$void "
+      "${1$unsafe_arena_set_allocated_$name$$}$(\n"
+      "    $type$* $name$);\n"
+      "$deprecated_attr$$type$* ${1$unsafe_arena_release_$name$$}$();\n",
+      descriptor_);
+}
+
+void LazyMessageFieldGenerator::GenerateInlineAccessorDefinitions(
+    io::Printer* printer) const {
+  Formatter format(printer, variables_);
+  format(
+      "inline const $type$& $classname$::_internal_$name$() const {\n"
+      "  return static_cast<const $type$&>($name$_.Get($prototype$));\n"
+      "}\n"
+      "inline const $type$& $classname$::$name$() const {\n"
+      "$annotate_accessor$"
+      "  // @@protoc_insertion_point(field_get:$full_name$)\n"
+      "  return _internal_$name$();\n"
+      "}\n"
+      "inline void $classname$::unsafe_arena_set_allocated_$name$(\n"
+      "    $type$* $name$) {\n"
+      "$annotate_accessor$"
+      "  $name$_.UnsafeArenaSetAllocated($name$);\n"
+      "  if ($name$) {\n"
+      "    $set_hasbit$\n"
+      "  } else {\n"
+      "    $clear_hasbit$\n"
+      "  }\n"
+      "  // @@protoc_insertion_point(field_unsafe_arena_set_allocated"
+      ":$full_name$)\n"
+      "}\n"
+      "inline $type$* $classname$::$release_name$() {\n"
+      "  $clear_hasbit$\n"
+      "  $type$* temp =\n"
+      "      static_cast<$type$*>($name$_.UnsafeArenaRelease($prototype$));\n"
+      "  if (GetArena() != nullptr) {\n"
+      "    temp = ::$proto_ns$::internal::DuplicateIfNonNull(temp);\n"
+      "  }\n"
+      "  return temp;\n"
+      "}\n"
+      "inline $type$* $classname$::unsafe_arena_release_$name$() {\n"
+      "$annotate_accessor$"
+      "  // @@protoc_insertion_point(field_release:$full_name$)\n"
+      "  $clear_hasbit$\n"
+      "  return static_cast<$type$*>($name$_.UnsafeArenaRelease($prototype$));\n"
+      "}\n"
+      "inline $type$* $classname$::_internal_mutable_$name$() {\n"
+      "  $set_hasbit$\n"
+      "  return static_cast<$type$*>($name$_.Mutable($prototype$));\n"
+      "}\n"
+      "inline $type$* $classname$::mutable_$name$() {\n"
+      "$annotate_accessor$"
+      "  // @@protoc_insertion_point(field_mutable:$full_name$)\n"
+      "  return _internal_mutable_$name$();\n"
+      "}\n");
+
+  format(
+      "inline void $classname$::set_allocated_$name$($type$* $name$) {\n"
+      "$annotate_accessor$"
+      "  ::$proto_ns$::Arena* message_arena = GetArena();\n"
+      "  if ($name$) {\n");
+  if (IsCrossFileMessage(descriptor_)) {
+    // We have to read the arena through the virtual method, because the type
+    // isn't defined in this file.
+    format(
+        "    ::$proto_ns$::Arena* submessage_arena =\n"
+        "      "
+        "reinterpret_cast<::$proto_ns$::MessageLite*>($name$)->GetArena();\n");
+  } else {
+    format(
+        "    ::$proto_ns$::Arena* submessage_arena =\n"
+        "      ::$proto_ns$::Arena::GetArena($name$);\n");
+  }
+  format(
+      "    if (message_arena != submessage_arena) {\n"
+      "      $name$ = ::$proto_ns$::internal::GetOwnedMessage(\n"
+      "          message_arena, $name$, submessage_arena);\n"
+      "    }\n"
+      "    $set_hasbit$\n"
+      "  } else {\n"
+      "    $clear_hasbit$\n"
+      "  }\n"
+      "  $name$_.UnsafeArenaSetAllocated($name$);\n"
+      "  // @@protoc_insertion_point(field_set_allocated:$full_name$)\n"
+      "}\n");
+}
+
+void LazyMessageFieldGenerator::GenerateClearingCode(
+    io::Printer* printer) const {
+  Formatter format(printer, variables_);
+  format("$name$_.Clear();\n");
+}
+
+void LazyMessageFieldGenerator::GenerateMergingCode(
+    io::Printer* printer) const {
+  Formatter format(printer, variables_);
+  format(
+      "$set_hasbit$\n"
+      "$name$_.MergeFrom($prototype$, from.$name$_);\n");
+}
+
+void LazyMessageFieldGenerator::GenerateSwappingCode(
+    io::Printer* printer) const {
+  Formatter format(printer, variables_);
+  format("$name$_.Swap(&other->$name$_);\n");
+}
+
+void LazyMessageFieldGenerator::GenerateDestructorCode(
+    io::Printer* printer) const {
+  Formatter format(printer, variables_);
+  format("$name$_.Destroy();\n");
+}
+
+void LazyMessageFieldGenerator::GenerateConstructorCode(
+    io::Printer* printer) const {
+  // The field is initialized by the constructor's initializer list.
+}
+
+void LazyMessageFieldGenerator::GenerateCopyConstructorCode(
+    io::Printer* printer) const {
+  Formatter format(printer, variables_);
+  // Copies the encoded bytes if the source was never accessed.
+  format(
+      "if (from._internal_has_$name$()) {\n"
+      "  $name$_.MergeFrom($prototype$, from.$name$_);\n"
+      "}\n");
+}
+
+void LazyMessageFieldGenerator::GenerateSerializeWithCachedSizesToArray(
+    io::Printer* printer) const {
+  Formatter format(printer, variables_);
+  format(
+      "target = stream->EnsureSpace(target);\n"
+      "target = ::$proto_ns$::internal::WireFormatLite::\n"
+      "  InternalWriteMessage($number$, $name$_, target, stream);\n");
+}
+
+void LazyMessageFieldGenerator::GenerateByteSize(io::Printer* printer) const {
+  Formatter format(printer, variables_);
+  format(
+      "total_size += $tag_size$ +\n"
+      "  ::$proto_ns$::internal::WireFormatLite::MessageSize($name$_);\n");
+}
+
+uint32 LazyMessageFieldGenerator::CalculateFieldTag() const {
+  // Tells reflection that the field is a LazyField, see
+  // ReflectionSchema::IsFieldLazy().
+  return 1;
+}
+
+// ===================================================================
+
 MessageOneofFieldGenerator::MessageOneofFieldGenerator(
     const FieldDescriptor* descriptor, const Options& options,
     MessageSCCAnalyzer* scc_analyzer)
@@ -636,6 +817,7 @@ void RepeatedMessageFieldGenerator::GeneratePrivateMembers(
     format("::$proto_ns$::WeakRepeatedPtrField< $type$ > $name$_;\n");
   } else {
     format("::$proto_ns$::RepeatedPtrField< $type$ > $name$_;\n");
+    GenerateInlinedRepeatedStorage(printer, variables_.at("type"));
   }
 }
 
@@ -766,7 +948,14 @@ void RepeatedMessageFieldGenerator::GenerateSwappingCode(
 
 void RepeatedMessageFieldGenerator::GenerateConstructorCode(
     io::Printer* printer) const {
-  // Not needed for repeated fields.
+  GenerateInlinedRepeatedStorageAttach(printer);
+}
+
+void RepeatedMessageFieldGenerator::GenerateCopyConstructorCode(
+    io::Printer* printer) const {
+  Formatter format(printer, variables_);
+  GenerateInlinedRepeatedStorageAttach(printer);
+  format("$name$_.MergeFrom(from.$name$_);\n");
 }
 
 void RepeatedMessageFieldGenerator::GenerateSerializeWithCachedSizesToArray(
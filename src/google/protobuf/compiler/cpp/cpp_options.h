@@ -60,6 +60,9 @@ struct Options {
   bool table_driven_parsing = false;
   bool table_driven_serialization = false;
   bool lite_implicit_weak_fields = false;
+  bool string_piece_fields = false;
+  bool lazy_fields = false;
+  int inline_repeated_capacity = 0;
   bool bootstrap = false;
   bool opensource_runtime = false;
   bool annotate_accessor = false;
@@ -295,6 +295,7 @@ void RepeatedPrimitiveFieldGenerator::GeneratePrivateMembers(
     io::Printer* printer) const {
   Formatter format(printer, variables_);
   format("::$proto_ns$::RepeatedField< $type$ > $name$_;\n");
+  GenerateInlinedRepeatedStorage(printer, variables_.at("type"));
   if (descriptor_->is_packed() &&
       HasGeneratedMethods(descriptor_->file(), options_)) {
     format("mutable std::atomic<int> _$name$_cached_byte_size_;\n");
@@ -390,12 +391,13 @@ void RepeatedPrimitiveFieldGenerator::GenerateSwappingCode(
 
 void RepeatedPrimitiveFieldGenerator::GenerateConstructorCode(
     io::Printer* printer) const {
-  // Not needed for repeated fields.
+  GenerateInlinedRepeatedStorageAttach(printer);
 }
 
 void RepeatedPrimitiveFieldGenerator::GenerateCopyConstructorCode(
     io::Printer* printer) const {
   Formatter format(printer, variables_);
+  GenerateInlinedRepeatedStorageAttach(printer);
   format("$name$_.CopyFrom(from.$name$_);\n");
 }
 
@@ -617,6 +617,160 @@ void StringOneofFieldGenerator::GenerateConstructorCode(
 
 // ===================================================================
 
+StringPieceFieldGenerator::StringPieceFieldGenerator(
+    const FieldDescriptor* descriptor, const Options& options)
+    : FieldGenerator(descriptor, options) {
+  SetStringVariables(descriptor, &variables_, options);
+}
+
+StringPieceFieldGenerator::~StringPieceFieldGenerator() {}
+
+void StringPieceFieldGenerator::GeneratePrivateMembers(
+    io::Printer* printer) const {
+  Formatter format(printer, variables_);
+  format("::$proto_ns$::internal::StringPieceField $name$_;\n");
+}
+
+void StringPieceFieldGenerator::GenerateAccessorDeclarations(
+    io::Printer* printer) const {
+  Formatter format(printer, variables_);
+  format(
+      "$deprecated_attr$::$proto_ns$::StringPiece ${1$$name$$}$() const;\n"
+      "$deprecated_attr$void ${1$set_$name$$}$("
+      "::$proto_ns$::StringPiece value);\n"
+      "$deprecated_attr$void ${1$set_$name$$}$(const $pointer_type$* "
+      "value, size_t size);\n"
+      "// Makes the field refer to |value| instead of holding a copy of it.\n"
+      "// |value| must outlive the message.\n"
+      "$deprecated_attr$void ${1$set_alias_$name$$}$("
+      "::$proto_ns$::StringPiece value);\n",
+      descriptor_);
+  format(
+      "private:\n"
+      "::$proto_ns$::StringPiece _internal_$name$() const;\n"
+      "void _internal_set_$name$(::$proto_ns$::StringPiece value);\n"
+      "::$proto_ns$::internal::StringPieceField* _internal_mutable_$name$();\n"
+      "public:\n");
+}
+
+void StringPieceFieldGenerator::GenerateInlineAccessorDefinitions(
+    io::Printer* printer) const {
+  Formatter format(printer, variables_);
+  format(
+      "inline ::$proto_ns$::StringPiece $classname$::$name$() const {\n"
+      "$annotate_accessor$"
+      "  // @@protoc_insertion_point(field_get:$full_name$)\n"
+      "  return _internal_$name$();\n"
+      "}\n"
+      "inline void $classname$::set_$name$(::$proto_ns$::StringPiece value) "
+      "{\n"
+      "$annotate_accessor$"
+      "  _internal_set_$name$(value);\n"
+      "  // @@protoc_insertion_point(field_set:$full_name$)\n"
+      "}\n"
+      "inline void $classname$::set_$name$(const $pointer_type$* value,\n"
+      "    size_t size) {\n"
+      "$annotate_accessor$"
+      "  _internal_set_$name$(::$proto_ns$::StringPiece(\n"
+      "      reinterpret_cast<const char*>(value), size));\n"
+      "  // @@protoc_insertion_point(field_set_pointer:$full_name$)\n"
+      "}\n"
+      "inline void $classname$::set_alias_$name$("
+      "::$proto_ns$::StringPiece value) {\n"
+      "$annotate_accessor$"
+      "  $set_hasbit$\n"
+      "  $name$_.SetAliased(value);\n"
+      "  // @@protoc_insertion_point(field_set_alias:$full_name$)\n"
+      "}\n"
+      "inline ::$proto_ns$::StringPiece $classname$::_internal_$name$() "
+      "const {\n"
+      "  return $name$_.Get();\n"
+      "}\n"
+      "inline void $classname$::_internal_set_$name$("
+      "::$proto_ns$::StringPiece value) {\n"
+      "  $set_hasbit$\n"
+      "  $name$_.Set(value);\n"
+      "}\n"
+      "inline ::$proto_ns$::internal::StringPieceField* "
+      "$classname$::_internal_mutable_$name$() {\n"
+      "  $set_hasbit$\n"
+      "  return &$name$_;\n"
+      "}\n");
+}
+
+void StringPieceFieldGenerator::GenerateClearingCode(
+    io::Printer* printer) const {
+  Formatter format(printer, variables_);
+  format("$name$_.Clear();\n");
+}
+
+void StringPieceFieldGenerator::GenerateMergingCode(
+    io::Printer* printer) const {
+  Formatter format(printer, variables_);
+  format("_internal_set_$name$(from._internal_$name$());\n");
+}
+
+void StringPieceFieldGenerator::GenerateSwappingCode(
+    io::Printer* printer) const {
+  Formatter format(printer, variables_);
+  format("$name$_.Swap(&other->$name$_);\n");
+}
+
+void StringPieceFieldGenerator::GenerateConstructorCode(
+    io::Printer* printer) const {
+  // The field is initialized by the constructor's initializer list.
+}
+
+void StringPieceFieldGenerator::GenerateCopyConstructorCode(
+    io::Printer* printer) const {
+  Formatter format(printer, variables_);
+  // Copies never alias, the source may not stay alive as long as the copy.
+  if (HasHasbit(descriptor_)) {
+    format("if (from._internal_has_$name$()) {\n");
+  } else {
+    format("if (!from._internal_$name$().empty()) {\n");
+  }
+  format("  $name$_.Set(from._internal_$name$());\n"
+         "}\n");
+}
+
+void StringPieceFieldGenerator::GenerateDestructorCode(
+    io::Printer* printer) const {
+  Formatter format(printer, variables_);
+  format("$name$_.Destroy();\n");
+}
+
+void StringPieceFieldGenerator::GenerateSerializeWithCachedSizesToArray(
+    io::Printer* printer) const {
+  Formatter format(printer, variables_);
+  if (descriptor_->type() == FieldDescriptor::TYPE_STRING) {
+    GenerateUtf8CheckCodeForString(
+        descriptor_, options_, false,
+        "this->_internal_$name$().data(), "
+        "static_cast<int>(this->_internal_$name$().length()),\n",
+        format);
+  }
+  format(
+      "target = stream->Write$declared_type$MaybeAliased(\n"
+      "    $number$, this->_internal_$name$(), target);\n");
+}
+
+void StringPieceFieldGenerator::GenerateByteSize(io::Printer* printer) const {
+  Formatter format(printer, variables_);
+  format(
+      "total_size += $tag_size$ +\n"
+      "  ::$proto_ns$::internal::WireFormatLite::LengthDelimitedSize(\n"
+      "    this->_internal_$name$().size());\n");
+}
+
+uint32 StringPieceFieldGenerator::CalculateFieldTag() const {
+  // Tells reflection that the field is a StringPieceField, see
+  // ReflectionSchema::IsFieldStringPiece().
+  return 2;
+}
+
+// ===================================================================
+
 RepeatedStringFieldGenerator::RepeatedStringFieldGenerator(
     const FieldDescriptor* descriptor, const Options& options)
     : FieldGenerator(descriptor, options) {
@@ -629,6 +783,7 @@ void RepeatedStringFieldGenerator::GeneratePrivateMembers(
     io::Printer* printer) const {
   Formatter format(printer, variables_);
   format("::$proto_ns$::RepeatedPtrField<std::string> $name$_;\n");
+  GenerateInlinedRepeatedStorage(printer, "std::string");
 }
 
 void RepeatedStringFieldGenerator::GenerateAccessorDeclarations(
@@ -836,13 +991,14 @@ void RepeatedStringFieldGenerator::GenerateSwappingCode(
 
 void RepeatedStringFieldGenerator::GenerateConstructorCode(
     io::Printer* printer) const {
-  // Not needed for repeated fields.
+  GenerateInlinedRepeatedStorageAttach(printer);
 }
 
 void RepeatedStringFieldGenerator::GenerateCopyConstructorCode(
     io::Printer* printer) const {
   Formatter format(printer, variables_);
-  format("$name$_.CopyFrom(from.$name$_);");
+  GenerateInlinedRepeatedStorageAttach(printer);
+  format("$name$_.CopyFrom(from.$name$_);\n");
 }
 
 void RepeatedStringFieldGenerator::GenerateSerializeWithCachedSizesToArray(
@@ -100,6 +100,32 @@ class StringOneofFieldGenerator : public StringFieldGenerator {
   GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(StringOneofFieldGenerator);
 };
 
+// Singular fields with ctype=STRING_PIECE, stored as a StringPieceField that
+// may alias the buffer the message was parsed from.
+class StringPieceFieldGenerator : public FieldGenerator {
+ public:
+  StringPieceFieldGenerator(const FieldDescriptor* descriptor,
+                            const Options& options);
+  ~StringPieceFieldGenerator();
+
+  // implements FieldGenerator ---------------------------------------
+  void GeneratePrivateMembers(io::Printer* printer) const;
+  void GenerateAccessorDeclarations(io::Printer* printer) const;
+  void GenerateInlineAccessorDefinitions(io::Printer* printer) const;
+  void GenerateClearingCode(io::Printer* printer) const;
+  void GenerateMergingCode(io::Printer* printer) const;
+  void GenerateSwappingCode(io::Printer* printer) const;
+  void GenerateConstructorCode(io::Printer* printer) const;
+  void GenerateCopyConstructorCode(io::Printer* printer) const;
+  void GenerateDestructorCode(io::Printer* printer) const;
+  void GenerateSerializeWithCachedSizesToArray(io::Printer* printer) const;
+  void GenerateByteSize(io::Printer* printer) const;
+  uint32 CalculateFieldTag() const;
+
+ private:
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(StringPieceFieldGenerator);
+};
+
 class RepeatedStringFieldGenerator : public FieldGenerator {
  public:
   RepeatedStringFieldGenerator(const FieldDescriptor* descriptor,
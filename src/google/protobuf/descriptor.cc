@@ -35,12 +35,17 @@
 #include <google/protobuf/descriptor.h>
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <functional>
 #include <limits>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -56,6 +61,7 @@
 #include <google/protobuf/descriptor_database.h>
 #include <google/protobuf/dynamic_message.h>
 #include <google/protobuf/generated_message_util.h>
+#include <google/protobuf/published_lookup_table.h>
 #include <google/protobuf/text_format.h>
 #include <google/protobuf/unknown_field_set.h>
 #include <google/protobuf/wire_format.h>
@@ -466,6 +472,19 @@ typedef std::map<DescriptorIntPair, const FieldDescriptor*>
 typedef HASH_MAP<std::string, const SourceCodeInfo_Location*>
     LocationsByPathMap;
 
+// Lookup tables for the results of Find*() calls that succeeded before,
+// which are read without holding the pool's mutex.
+typedef internal::PublishedLookupTable<std::string, Symbol,
+                                      HASH_FXN<StringPiece>>
+    PublishedSymbolsMap;
+typedef internal::PublishedLookupTable<std::string, const FileDescriptor*,
+                                      HASH_FXN<StringPiece>>
+    PublishedFilesMap;
+typedef internal::PublishedLookupTable<
+    DescriptorIntPair, const FieldDescriptor*,
+    PointerIntegerPairHash<DescriptorIntPair>>
+    PublishedExtensionsMap;
+
 std::set<std::string>* NewAllowedProto3Extendee() {
   auto allowed_proto3_extendees = new std::set<std::string>;
   const char* kOptionNames[] = {
@@ -565,6 +584,13 @@ class DescriptorPool::Tables {
   // set of extensions numbers from fallback_database_.
   HASH_SET<const Descriptor*> extensions_loaded_from_db_;
 
+  // The results of Find*() calls on a pool with a mutex_, which later calls
+  // read without locking it.  Only written with mutex_ held, and only with
+  // symbols, files and extensions that have been committed.
+  PublishedSymbolsMap published_symbols_;
+  PublishedFilesMap published_files_;
+  PublishedExtensionsMap published_extensions_;
+
   // Maps type name to Descriptor::WellKnownType.  This is logically global
   // and const, but we make it a member here to simplify its construction and
   // destruction.  This only has 20-ish entries and is one per DescriptorPool,
@@ -602,6 +628,15 @@ class DescriptorPool::Tables {
   bool AddFile(const FileDescriptor* file);
   bool AddExtension(const FieldDescriptor* field);
 
+  // Moves the memory and the symbols, files and extensions of |source|, which
+  // holds the file built from |proto|, into these tables as if they had been
+  // added here.  |source| must have a single checkpoint, taken while it was
+  // empty, and is left to be destroyed.  Items already defined here are
+  // reported to |error_collector| like DescriptorBuilder reports them, and
+  // make this return false; these tables must then be rolled back.
+  bool MergeFrom(Tables* source, const FileDescriptorProto& proto,
+                 ErrorCollector* error_collector);
+
   // -----------------------------------------------------------------
   // Allocating memory.
 
@@ -914,12 +949,9 @@ inline Symbol FileDescriptorTables::FindNestedSymbolOfType(
 Symbol DescriptorPool::Tables::FindByNameHelper(const DescriptorPool* pool,
                                                 StringPiece name) {
   if (pool->mutex_ != nullptr) {
-    // Fast path: the Symbol is already cached.  This is just a hash lookup.
-    ReaderMutexLock lock(pool->mutex_);
-    if (known_bad_symbols_.empty() && known_bad_files_.empty()) {
-      Symbol result = FindSymbol(name);
-      if (!result.IsNull()) return result;
-    }
+    // Fast path: the Symbol was found before.  This is a lock-free lookup.
+    const Symbol* published = published_symbols_.Find(name);
+    if (published != nullptr) return *published;
   }
   MutexLockMaybe lock(pool->mutex_);
   if (pool->fallback_database_ != nullptr) {
@@ -940,6 +972,10 @@ Symbol DescriptorPool::Tables::FindByNameHelper(const DescriptorPool* pool,
     }
   }
 
+  if (!result.IsNull() && pool->mutex_ != nullptr) {
+    GOOGLE_DCHECK(checkpoints_.empty());
+    published_symbols_.Insert(name, result);
+  }
   return result;
 }
 
@@ -1169,6 +1205,112 @@ bool DescriptorPool::Tables::AddExtension(const FieldDescriptor* field) {
   }
 }
 
+bool DescriptorPool::Tables::MergeFrom(Tables* source,
+                                       const FileDescriptorProto& proto,
+                                       ErrorCollector* error_collector) {
+  GOOGLE_DCHECK_EQ(1, source->checkpoints_.size());
+  // The memory goes first, so that rolling these tables back frees it with
+  // the rest.
+  for (auto& allocation : source->allocations_) {
+    allocations_.push_back(std::move(allocation));
+  }
+  for (auto& string : source->strings_) strings_.push_back(std::move(string));
+  for (auto& message : source->messages_) {
+    messages_.push_back(std::move(message));
+  }
+  for (auto& once_dynamic : source->once_dynamics_) {
+    once_dynamics_.push_back(std::move(once_dynamic));
+  }
+  for (auto& file_tables : source->file_tables_) {
+    file_tables_.push_back(std::move(file_tables));
+  }
+
+  // The maps of |source| are left with keys pointing into the memory moved
+  // above.  They are not looked at again.
+  std::vector<const char*> symbols;
+  std::vector<const char*> files;
+  std::vector<DescriptorIntPair> extensions;
+  symbols.swap(source->symbols_after_checkpoint_);
+  files.swap(source->files_after_checkpoint_);
+  extensions.swap(source->extensions_after_checkpoint_);
+  source->checkpoints_.clear();
+
+  // Reports like DescriptorBuilder::AddError() and AddWarning() do.
+  bool had_errors = false;
+  auto report = [&](const std::string& element_name,
+                    ErrorCollector::ErrorLocation location,
+                    const std::string& message, bool is_error) {
+    if (error_collector == nullptr) {
+      if (!is_error) {
+        GOOGLE_LOG(WARNING) << proto.name() << " " << element_name << ": "
+                     << message;
+        return;
+      }
+      if (!had_errors) {
+        GOOGLE_LOG(ERROR) << "Invalid proto descriptor for file \""
+                   << proto.name() << "\":";
+      }
+      GOOGLE_LOG(ERROR) << "  " << element_name << ": " << message;
+    } else if (is_error) {
+      error_collector->AddError(proto.name(), element_name, &proto, location,
+                                message);
+    } else {
+      error_collector->AddWarning(proto.name(), element_name, &proto, location,
+                                  message);
+    }
+    had_errors |= is_error;
+  };
+
+  for (const char* name : symbols) {
+    // Not AddSymbol(), which would key the symbol by a temporary string.
+    Symbol symbol = source->FindSymbol(name);
+    if (InsertIfNotPresent(&symbols_by_name_, name, symbol)) {
+      symbols_after_checkpoint_.push_back(name);
+      continue;
+    }
+    Symbol existing = FindSymbol(name);
+    if (symbol.type == Symbol::PACKAGE) {
+      // As in DescriptorBuilder::AddPackage(), it's OK to redefine a package.
+      if (existing.type != Symbol::PACKAGE) {
+        report(name, ErrorCollector::NAME,
+               StrCat("\"", name,
+                      "\" is already defined (as something other than a "
+                      "package) in file \"",
+                      existing.GetFile()->name(), "\"."),
+               true);
+      }
+    } else {
+      report(name, ErrorCollector::NAME,
+             StrCat("\"", name, "\" is already defined in file \"",
+                    existing.GetFile()->name(), "\"."),
+             true);
+    }
+  }
+  for (const char* name : files) {
+    if (!AddFile(FindPtrOrNull(source->files_by_name_, name))) {
+      report(name, ErrorCollector::OTHER,
+             "A file with this name is already in the pool.", true);
+    }
+  }
+  for (const DescriptorIntPair& key : extensions) {
+    const FieldDescriptor* field = FindPtrOrNull(source->extensions_, key);
+    if (!AddExtension(field)) {
+      // Like in DescriptorBuilder::CrossLinkField(), this is only a warning.
+      const FieldDescriptor* conflicting_field =
+          FindExtension(key.first, key.second);
+      report(field->full_name(), ErrorCollector::NUMBER,
+             strings::Substitute("Extension number $0 has already been used "
+                                 "in \"$1\" by extension \"$2\" defined in "
+                                 "$3.",
+                                 key.second, key.first->full_name(),
+                                 conflicting_field->full_name(),
+                                 conflicting_field->file()->name()),
+             false);
+    }
+  }
+  return !had_errors;
+}
+
 // -------------------------------------------------------------------
 
 template <typename Type>
@@ -1380,33 +1522,49 @@ void DescriptorPool::InternalAddGeneratedFile(
 
 const FileDescriptor* DescriptorPool::FindFileByName(
     ConstStringParam name) const {
+  if (mutex_ != nullptr) {
+    // Fast path: the file was found before.  This is a lock-free lookup.
+    const FileDescriptor* const* published =
+        tables_->published_files_.Find(name);
+    if (published != nullptr) return *published;
+  }
   MutexLockMaybe lock(mutex_);
   if (fallback_database_ != nullptr) {
     tables_->known_bad_symbols_.clear();
     tables_->known_bad_files_.clear();
   }
   const FileDescriptor* result = tables_->FindFile(name);
-  if (result != nullptr) return result;
-  if (underlay_ != nullptr) {
+  if (result == nullptr && underlay_ != nullptr) {
     result = underlay_->FindFileByName(name);
-    if (result != nullptr) return result;
   }
-  if (TryFindFileInFallbackDatabase(name)) {
+  if (result == nullptr && TryFindFileInFallbackDatabase(name)) {
     result = tables_->FindFile(name);
-    if (result != nullptr) return result;
   }
-  return nullptr;
+  if (result != nullptr && mutex_ != nullptr) {
+    tables_->published_files_.Insert(name, result);
+  }
+  return result;
 }
 
 const FileDescriptor* DescriptorPool::FindFileContainingSymbol(
     ConstStringParam symbol_name) const {
+  if (mutex_ != nullptr) {
+    // Fast path: the symbol was found before.  This is a lock-free lookup.
+    const Symbol* published = tables_->published_symbols_.Find(symbol_name);
+    if (published != nullptr) return published->GetFile();
+  }
   MutexLockMaybe lock(mutex_);
   if (fallback_database_ != nullptr) {
     tables_->known_bad_symbols_.clear();
     tables_->known_bad_files_.clear();
   }
   Symbol result = tables_->FindSymbol(symbol_name);
-  if (!result.IsNull()) return result.GetFile();
+  if (!result.IsNull()) {
+    if (mutex_ != nullptr) {
+      tables_->published_symbols_.Insert(symbol_name, result);
+    }
+    return result.GetFile();
+  }
   if (underlay_ != nullptr) {
     const FileDescriptor* file_result =
         underlay_->FindFileContainingSymbol(symbol_name);
@@ -1414,7 +1572,12 @@ const FileDescriptor* DescriptorPool::FindFileContainingSymbol(
   }
   if (TryFindSymbolInFallbackDatabase(symbol_name)) {
     result = tables_->FindSymbol(symbol_name);
-    if (!result.IsNull()) return result.GetFile();
+    if (!result.IsNull()) {
+      if (mutex_ != nullptr) {
+        tables_->published_symbols_.Insert(symbol_name, result);
+      }
+      return result.GetFile();
+    }
   }
   return nullptr;
 }
@@ -1480,14 +1643,11 @@ const MethodDescriptor* DescriptorPool::FindMethodByName(
 const FieldDescriptor* DescriptorPool::FindExtensionByNumber(
     const Descriptor* extendee, int number) const {
   if (extendee->extension_range_count() == 0) return nullptr;
-  // A faster path to reduce lock contention in finding extensions, assuming
-  // most extensions will be cache hit.
   if (mutex_ != nullptr) {
-    ReaderMutexLock lock(mutex_);
-    const FieldDescriptor* result = tables_->FindExtension(extendee, number);
-    if (result != nullptr) {
-      return result;
-    }
+    // Fast path: the extension was found before.  This is a lock-free lookup.
+    const FieldDescriptor* const* published =
+        tables_->published_extensions_.Find(std::make_pair(extendee, number));
+    if (published != nullptr) return *published;
   }
   MutexLockMaybe lock(mutex_);
   if (fallback_database_ != nullptr) {
@@ -1495,20 +1655,18 @@ const FieldDescriptor* DescriptorPool::FindExtensionByNumber(
     tables_->known_bad_files_.clear();
   }
   const FieldDescriptor* result = tables_->FindExtension(extendee, number);
-  if (result != nullptr) {
-    return result;
-  }
-  if (underlay_ != nullptr) {
+  if (result == nullptr && underlay_ != nullptr) {
     result = underlay_->FindExtensionByNumber(extendee, number);
-    if (result != nullptr) return result;
   }
-  if (TryFindExtensionInFallbackDatabase(extendee, number)) {
+  if (result == nullptr &&
+      TryFindExtensionInFallbackDatabase(extendee, number)) {
     result = tables_->FindExtension(extendee, number);
-    if (result != nullptr) {
-      return result;
-    }
   }
-  return nullptr;
+  if (result != nullptr && mutex_ != nullptr) {
+    tables_->published_extensions_.Insert(std::make_pair(extendee, number),
+                                          result);
+  }
+  return result;
 }
 
 const FieldDescriptor* DescriptorPool::InternalFindExtensionByNumberNoLock(
@@ -3587,6 +3745,315 @@ const FileDescriptor* DescriptorPool::BuildFileCollectingErrors(
       .BuildFile(proto);
 }
 
+namespace {
+
+// Returns the level of each file of protos in the graph of their imports
+// within the batch: 0 for a file which imports none of the others, and
+// otherwise one more than the highest level of the files it imports.  Files
+// of the same level are independent of each other.  An import cycle is
+// broken at the import which closes it, and left for DescriptorBuilder to
+// report, since the file which is then built first cannot find its import.
+std::vector<int> ComputeDependencyLevels(
+    const std::vector<FileDescriptorProto>& protos,
+    const std::unordered_map<std::string, int>& index_by_name) {
+  enum State { kUnvisited, kVisiting, kVisited };
+  std::vector<State> states(protos.size(), kUnvisited);
+  std::vector<int> levels(protos.size(), 0);
+  // Depth-first, with an explicit stack of (file, next import) so that long
+  // chains of imports can't overflow the call stack.
+  std::vector<std::pair<int, int>> stack;
+  for (int root = 0; root < static_cast<int>(protos.size()); root++) {
+    if (states[root] != kUnvisited) continue;
+    states[root] = kVisiting;
+    stack.emplace_back(root, 0);
+    while (!stack.empty()) {
+      int index = stack.back().first;
+      int& next = stack.back().second;
+      const FileDescriptorProto& proto = protos[index];
+      if (next == proto.dependency_size()) {
+        states[index] = kVisited;
+        stack.pop_back();
+        continue;
+      }
+      auto it = index_by_name.find(proto.dependency(next++));
+      if (it == index_by_name.end()) continue;
+      int dependency = it->second;
+      if (states[dependency] == kUnvisited) {
+        // Come back to this import once the dependency has its level.
+        next--;
+        states[dependency] = kVisiting;
+        stack.emplace_back(dependency, 0);
+      } else if (states[dependency] == kVisited) {
+        levels[index] = std::max(levels[index], levels[dependency] + 1);
+      }
+    }
+  }
+  return levels;
+}
+
+// Forwards to another ErrorCollector, one call at a time, for the files of a
+// batch which are built concurrently.
+class SynchronizedErrorCollector : public DescriptorPool::ErrorCollector {
+ public:
+  explicit SynchronizedErrorCollector(
+      DescriptorPool::ErrorCollector* error_collector)
+      : error_collector_(error_collector) {}
+
+  void AddError(const std::string& filename, const std::string& element_name,
+                const Message* descriptor, ErrorLocation location,
+                const std::string& message) override {
+    MutexLock lock(&mutex_);
+    error_collector_->AddError(filename, element_name, descriptor, location,
+                               message);
+  }
+
+  void AddWarning(const std::string& filename, const std::string& element_name,
+                  const Message* descriptor, ErrorLocation location,
+                  const std::string& message) override {
+    MutexLock lock(&mutex_);
+    error_collector_->AddWarning(filename, element_name, descriptor, location,
+                                 message);
+  }
+
+ private:
+  internal::WrappedMutex mutex_;
+  DescriptorPool::ErrorCollector* error_collector_;
+};
+
+// Runs the tasks it is given on up to max_threads threads, which are started
+// as they are needed and joined when it is destroyed.
+class ThreadPool {
+ public:
+  explicit ThreadPool(int max_threads) : max_threads_(max_threads) {}
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      done_ = true;
+    }
+    task_added_.notify_all();
+    for (std::thread& thread : threads_) thread.join();
+  }
+
+  void Run(std::function<void()> task) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tasks_.push_back(std::move(task));
+    if (idle_threads_ == 0 &&
+        threads_.size() < static_cast<size_t>(max_threads_)) {
+      threads_.emplace_back([this] { Work(); });
+    } else {
+      task_added_.notify_one();
+    }
+  }
+
+ private:
+  void Work() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      if (tasks_.empty()) {
+        if (done_) return;
+        idle_threads_++;
+        task_added_.wait(lock);
+        idle_threads_--;
+        continue;
+      }
+      std::function<void()> task = std::move(tasks_.front());
+      tasks_.pop_front();
+      lock.unlock();
+      task();
+      lock.lock();
+    }
+  }
+
+  const int max_threads_;
+  std::mutex mutex_;
+  std::condition_variable task_added_;
+  std::deque<std::function<void()>> tasks_;
+  std::vector<std::thread> threads_;
+  int idle_threads_ = 0;
+  bool done_ = false;
+};
+
+}  // namespace
+
+bool DescriptorPool::BuildFiles(const std::vector<FileDescriptorProto>& protos,
+                                int num_threads,
+                                std::vector<const FileDescriptor*>* output) {
+  return BuildFilesCollectingErrors(protos, num_threads, nullptr, output);
+}
+
+bool DescriptorPool::BuildFiles(const std::vector<FileDescriptorProto>& protos,
+                                const Executor& executor,
+                                std::vector<const FileDescriptor*>* output) {
+  return BuildFilesCollectingErrors(protos, executor, nullptr, output);
+}
+
+bool DescriptorPool::BuildFilesCollectingErrors(
+    const std::vector<FileDescriptorProto>& protos, int num_threads,
+    ErrorCollector* error_collector,
+    std::vector<const FileDescriptor*>* output) {
+  if (num_threads <= 1) {
+    return BuildFilesCollectingErrors(protos, Executor(), error_collector,
+                                      output);
+  }
+  // The calling thread builds files too.
+  ThreadPool thread_pool(num_threads - 1);
+  return BuildFilesCollectingErrors(
+      protos,
+      [&thread_pool](std::function<void()> task) {
+        thread_pool.Run(std::move(task));
+      },
+      error_collector, output);
+}
+
+bool DescriptorPool::BuildFilesCollectingErrors(
+    const std::vector<FileDescriptorProto>& protos, const Executor& executor,
+    ErrorCollector* error_collector,
+    std::vector<const FileDescriptor*>* output) {
+  GOOGLE_CHECK(fallback_database_ == nullptr)
+      << "Cannot call BuildFiles on a DescriptorPool that uses a "
+         "DescriptorDatabase.  You must instead find a way to get your files "
+         "into the underlying database.";
+  GOOGLE_CHECK(mutex_ == nullptr);  // Implied by the above GOOGLE_CHECK.
+  tables_->known_bad_symbols_.clear();
+  tables_->known_bad_files_.clear();
+
+  std::unordered_map<std::string, int> index_by_name;
+  for (int i = 0; i < static_cast<int>(protos.size()); i++) {
+    index_by_name.insert(std::make_pair(protos[i].name(), i));
+  }
+  const std::vector<int> levels = ComputeDependencyLevels(protos, index_by_name);
+
+  // Files are built level by level.  A file whose name is already in the pool
+  // or earlier in the batch is built last, directly in the pool, which
+  // returns the existing file if it is identical.
+  std::vector<std::vector<int>> files_by_level;
+  std::vector<int> existing_files;
+  for (int i = 0; i < static_cast<int>(protos.size()); i++) {
+    if (index_by_name[protos[i].name()] != i ||
+        tables_->FindFile(protos[i].name()) != nullptr) {
+      existing_files.push_back(i);
+      continue;
+    }
+    if (static_cast<size_t>(levels[i]) >= files_by_level.size()) {
+      files_by_level.resize(levels[i] + 1);
+    }
+    files_by_level[levels[i]].push_back(i);
+  }
+
+  // Placeholders are created in the pool which builds the file, so files which
+  // may need them are built directly in this pool.
+  const bool concurrent =
+      executor != nullptr && !allow_unknown_ && !lazily_build_dependencies_;
+
+  std::unique_ptr<SynchronizedErrorCollector> synchronized_error_collector;
+  if (error_collector != nullptr && concurrent) {
+    synchronized_error_collector.reset(
+        new SynchronizedErrorCollector(error_collector));
+  }
+
+  // Each file's checkpoint is nested in this one, so that a file which fails
+  // to build rolls back the files built before it too.
+  std::vector<const FileDescriptor*> results(protos.size());
+  tables_->AddCheckpoint();
+  for (const std::vector<int>& level : files_by_level) {
+    if (!concurrent || level.size() <= 1) {
+      for (int index : level) {
+        results[index] = DescriptorBuilder(this, tables_.get(), error_collector)
+                             .BuildFile(protos[index]);
+        if (results[index] == nullptr) {
+          tables_->RollbackToLastCheckpoint();
+          return false;
+        }
+      }
+      continue;
+    }
+
+    // The files of the level only import files which are already in this
+    // pool, so each is built in a pool of its own layered over this one,
+    // which is only read meanwhile.  They are merged into this pool once all
+    // of them are built.
+    std::vector<std::unique_ptr<DescriptorPool>> scratch_pools(level.size());
+    for (std::unique_ptr<DescriptorPool>& scratch_pool : scratch_pools) {
+      scratch_pool.reset(new DescriptorPool(this));
+      scratch_pool->enforce_dependencies_ = enforce_dependencies_;
+      scratch_pool->enforce_weak_ = enforce_weak_;
+      scratch_pool->disallow_enforce_utf8_ = disallow_enforce_utf8_;
+      scratch_pool->unused_import_track_files_ = unused_import_track_files_;
+      scratch_pool->tables_->AddCheckpoint();
+    }
+    std::atomic<size_t> next_file(0);
+    std::atomic<bool> had_errors(false);
+    auto build_files = [&] {
+      for (size_t i = next_file++; i < level.size(); i = next_file++) {
+        DescriptorPool* scratch_pool = scratch_pools[i].get();
+        const FileDescriptor* result =
+            DescriptorBuilder(scratch_pool, scratch_pool->tables_.get(),
+                              synchronized_error_collector.get())
+                .BuildFile(protos[level[i]]);
+        results[level[i]] = result;
+        if (result == nullptr) had_errors = true;
+      }
+    };
+    // The calling thread builds files too, so one task fewer than there are
+    // files is enough.  It waits for all the tasks, including those which
+    // start after it took the last file, since they use next_file.
+    std::mutex mutex;
+    std::condition_variable task_finished;
+    size_t pending_tasks = level.size() - 1;
+    for (size_t i = 0; i + 1 < level.size(); i++) {
+      executor([&] {
+        build_files();
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--pending_tasks == 0) task_finished.notify_one();
+      });
+    }
+    build_files();
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      task_finished.wait(lock, [&] { return pending_tasks == 0; });
+    }
+    if (had_errors) {
+      for (auto& scratch_pool : scratch_pools) {
+        scratch_pool->tables_->RollbackToLastCheckpoint();
+      }
+      tables_->RollbackToLastCheckpoint();
+      return false;
+    }
+
+    for (size_t i = 0; i < level.size(); i++) {
+      const FileDescriptorProto& proto = protos[level[i]];
+      if (!tables_->MergeFrom(scratch_pools[i]->tables_.get(), proto,
+                              error_collector)) {
+        for (size_t j = i + 1; j < level.size(); j++) {
+          scratch_pools[j]->tables_->RollbackToLastCheckpoint();
+        }
+        tables_->RollbackToLastCheckpoint();
+        return false;
+      }
+      FileDescriptor* file = const_cast<FileDescriptor*>(results[level[i]]);
+      file->pool_ = this;
+      for (int j = 0; j < file->dependency_count(); j++) {
+        if (file->dependencies_[j]->is_placeholder()) {
+          const_cast<FileDescriptor*>(file->dependencies_[j])->pool_ = this;
+        }
+      }
+    }
+  }
+  for (int index : existing_files) {
+    results[index] = DescriptorBuilder(this, tables_.get(), error_collector)
+                         .BuildFile(protos[index]);
+    if (results[index] == nullptr) {
+      tables_->RollbackToLastCheckpoint();
+      return false;
+    }
+  }
+  tables_->ClearLastCheckpoint();
+
+  if (output != nullptr) output->swap(results);
+  return true;
+}
+
 const FileDescriptor* DescriptorPool::BuildFileFromDatabase(
     const FileDescriptorProto& proto) const {
   mutex_->AssertHeld();
@@ -55,6 +55,7 @@
 #define GOOGLE_PROTOBUF_DESCRIPTOR_H__
 
 #include <atomic>
+#include <functional>
 #include <map>
 #include <memory>
 #include <set>
@@ -1650,6 +1651,9 @@ class PROTOBUF_EXPORT DescriptorPool {
   //   them slower even when they don't have to fall back to the database.
   //   In fact, even the Find*By*() methods of descriptor objects owned by
   //   this pool will be slower, since they will have to obtain locks too.
+  //   Once a FindFileByName(), FindFileContainingSymbol(),
+  //   Find<Symbol>ByName() or FindExtensionByNumber() call has found its
+  //   result, later calls with the same argument find it without locking.
   // - An ErrorCollector may optionally be given to collect validation errors
   //   in files loaded from the database.  If not given, errors will be printed
   //   to GOOGLE_LOG(ERROR).  Remember that files are built on-demand, so this
@@ -1781,6 +1785,48 @@ class PROTOBUF_EXPORT DescriptorPool {
   const FileDescriptor* BuildFileCollectingErrors(
       const FileDescriptorProto& proto, ErrorCollector* error_collector);
 
+  // Builds a batch of files at once.  Unlike with BuildFile(), files of the
+  // batch may import each other and be given in any order: each file is built
+  // after the files of the batch it depends on.  Dependencies from outside the
+  // batch must already be in the pool.  The batch is added atomically: if any
+  // file fails to build, none of them is added and false is returned.
+  // Otherwise, if output is not null, it receives the resulting
+  // FileDescriptors in the order of protos.
+  //
+  // Files which don't depend on each other, directly or not, are built by up
+  // to num_threads threads, the calling one included.  Each of them is built
+  // apart and then added to the pool, after the other files which don't
+  // depend on each other.  The pool must not be used by other threads
+  // meanwhile.  With num_threads <= 1, or AllowUnknownDependencies(), files
+  // are built one at a time by the calling thread.
+  bool BuildFiles(const std::vector<FileDescriptorProto>& protos,
+                  int num_threads, std::vector<const FileDescriptor*>* output);
+
+  // Runs a task, on another thread or before returning.  It lets BuildFiles()
+  // use the caller's thread pool instead of starting threads of its own.
+  typedef std::function<void(std::function<void()>)> Executor;
+
+  // Same as BuildFiles() above, except files which don't depend on each other
+  // are built by the calling thread and by the tasks given to executor, which
+  // must all have run by the time BuildFiles() returns.  Tasks may be run
+  // in any order, and a task which finds no file left to build just returns.
+  // With a null executor, files are built one at a time by the calling
+  // thread.
+  bool BuildFiles(const std::vector<FileDescriptorProto>& protos,
+                  const Executor& executor,
+                  std::vector<const FileDescriptor*>* output);
+
+  // Same as BuildFiles() except errors are sent to the given ErrorCollector.
+  // With several threads, the ErrorCollector is called by one at a time.
+  bool BuildFilesCollectingErrors(
+      const std::vector<FileDescriptorProto>& protos, int num_threads,
+      ErrorCollector* error_collector,
+      std::vector<const FileDescriptor*>* output);
+  bool BuildFilesCollectingErrors(
+      const std::vector<FileDescriptorProto>& protos, const Executor& executor,
+      ErrorCollector* error_collector,
+      std::vector<const FileDescriptor*>* output);
+
   // By default, it is an error if a FileDescriptorProto contains references
   // to types or other files that are not found in the DescriptorPool (or its
   // backing DescriptorDatabase, if any).  If you call
@@ -1950,7 +1996,8 @@ class PROTOBUF_EXPORT DescriptorPool {
                                      PlaceholderType placeholder_type) const;
 
   // If fallback_database_ is nullptr, this is nullptr.  Otherwise, this is a
-  // mutex which must be locked while accessing tables_.
+  // mutex which must be locked while accessing tables_, except for the
+  // lock-free lookups of earlier results in Tables::published_*_.
   internal::WrappedMutex* mutex_;
 
   // See constructor.
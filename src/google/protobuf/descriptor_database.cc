@@ -34,9 +34,24 @@
 
 #include <google/protobuf/descriptor_database.h>
 
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef _WIN32
+#include <fstream>
+#include <iterator>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
 #include <set>
+#include <tuple>
 
 #include <google/protobuf/descriptor.pb.h>
+#include <google/protobuf/io/coded_stream.h>
 #include <google/protobuf/stubs/strutil.h>
 #include <google/protobuf/stubs/map_util.h>
 #include <google/protobuf/stubs/stl_util.h>
@@ -887,6 +902,371 @@ EncodedDescriptorDatabase::~EncodedDescriptorDatabase() {
   }
 }
 
+// ===================================================================
+// MappedDescriptorDatabase
+//
+// An index starts with a header of five little-endian uint32s: the magic
+// number, the version, and the number of files, symbols and extensions.
+// Three tables of little-endian uint32 entries follow, each sorted by its
+// key:
+//   files:       name offset, name size, data offset, data size
+//   symbols:     name offset, name size, file index
+//   extensions:  extendee offset, extendee size, number, file index
+// and then the strings and encoded FileDescriptorProtos they point to.
+// Offsets are from the start of the index.  As in EncodedDescriptorDatabase,
+// the symbols are the fully-qualified names of top-level declarations, and
+// only extensions with a fully-qualified extendee are in the table; the
+// extendees are stored without the leading '.'.
+
+namespace {
+
+const uint32 kIndexMagic = 0x58444250;  // "PBDX"
+const uint32 kIndexVersion = 1;
+const int kIndexHeaderSize = 5 * sizeof(uint32);
+const int kFileEntrySize = 4 * sizeof(uint32);
+const int kSymbolEntrySize = 3 * sizeof(uint32);
+const int kExtensionEntrySize = 4 * sizeof(uint32);
+
+void AppendUInt32(uint32 value, std::string* output) {
+  uint8 bytes[sizeof(value)];
+  io::CodedOutputStream::WriteLittleEndian32ToArray(value, bytes);
+  output->append(reinterpret_cast<const char*>(bytes), sizeof(bytes));
+}
+
+// Returns the first index in [0, count) for which less_than_key() is false.
+template <typename Less>
+uint32 LowerBound(uint32 count, Less less_than_key) {
+  uint32 lo = 0;
+  uint32 hi = count;
+  while (lo < hi) {
+    uint32 mid = lo + (hi - lo) / 2;
+    if (less_than_key(mid)) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+void CollectExtension(const FieldDescriptorProto& extension, uint32 file_index,
+                      std::vector<std::tuple<std::string, int, uint32>>*
+                          extensions) {
+  if (!extension.extendee().empty() && extension.extendee()[0] == '.') {
+    extensions->emplace_back(extension.extendee().substr(1),
+                             extension.number(), file_index);
+  }
+}
+
+void CollectNestedExtensions(const DescriptorProto& message_type,
+                             uint32 file_index,
+                             std::vector<std::tuple<std::string, int, uint32>>*
+                                 extensions) {
+  for (const auto& nested_type : message_type.nested_type()) {
+    CollectNestedExtensions(nested_type, file_index, extensions);
+  }
+  for (const auto& extension : message_type.extension()) {
+    CollectExtension(extension, file_index, extensions);
+  }
+}
+
+}  // namespace
+
+MappedDescriptorDatabase::MappedDescriptorDatabase()
+    : data_(nullptr),
+      size_(0),
+      file_count_(0),
+      symbol_count_(0),
+      extension_count_(0),
+      files_(nullptr),
+      symbols_(nullptr),
+      extensions_(nullptr),
+      mapping_(nullptr),
+      mapping_size_(0) {}
+
+MappedDescriptorDatabase::~MappedDescriptorDatabase() {
+#ifndef _WIN32
+  if (mapping_ != nullptr) munmap(mapping_, mapping_size_);
+#endif
+}
+
+bool MappedDescriptorDatabase::Open(const std::string& filename) {
+#ifdef _WIN32
+  std::ifstream input(filename, std::ios::in | std::ios::binary);
+  if (!input) {
+    GOOGLE_LOG(ERROR) << "Could not open descriptor index " << filename;
+    return false;
+  }
+  contents_.assign(std::istreambuf_iterator<char>(input),
+                   std::istreambuf_iterator<char>());
+  return Init(contents_.data(), contents_.size());
+#else
+  int fd;
+  do {
+    fd = open(filename.c_str(), O_RDONLY);
+  } while (fd < 0 && errno == EINTR);
+  if (fd < 0) {
+    GOOGLE_LOG(ERROR) << "Could not open descriptor index " << filename << ": "
+               << strerror(errno);
+    return false;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    GOOGLE_LOG(ERROR) << "Could not stat descriptor index " << filename << ": "
+               << strerror(errno);
+    close(fd);
+    return false;
+  }
+  size_t size = static_cast<size_t>(info.st_size);
+  if (size == 0) {
+    close(fd);
+    return Init(contents_.data(), 0);
+  }
+  void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    GOOGLE_LOG(ERROR) << "Could not map descriptor index " << filename << ": "
+               << strerror(errno);
+    return false;
+  }
+  mapping_ = mapping;
+  mapping_size_ = size;
+  return Init(mapping, size);
+#endif
+}
+
+bool MappedDescriptorDatabase::Init(const void* data, size_t size) {
+  GOOGLE_DCHECK(data_ == nullptr) << "Init() or Open() was already called.";
+  data_ = static_cast<const char*>(data);
+  size_ = size;
+  if (size_ < kIndexHeaderSize || Read(data_, 0, 0, 0) != kIndexMagic) {
+    GOOGLE_LOG(ERROR) << "Invalid descriptor index passed to "
+                  "MappedDescriptorDatabase.";
+    return false;
+  }
+  if (Read(data_, 0, 0, 1) != kIndexVersion) {
+    GOOGLE_LOG(ERROR) << "Unsupported descriptor index version "
+               << Read(data_, 0, 0, 1) << ".";
+    return false;
+  }
+  uint32 file_count = Read(data_, 0, 0, 2);
+  uint32 symbol_count = Read(data_, 0, 0, 3);
+  uint32 extension_count = Read(data_, 0, 0, 4);
+  uint64 tables_end =
+      kIndexHeaderSize + static_cast<uint64>(file_count) * kFileEntrySize +
+      static_cast<uint64>(symbol_count) * kSymbolEntrySize +
+      static_cast<uint64>(extension_count) * kExtensionEntrySize;
+  if (tables_end > size_) {
+    GOOGLE_LOG(ERROR) << "Truncated descriptor index passed to "
+                  "MappedDescriptorDatabase.";
+    return false;
+  }
+  file_count_ = file_count;
+  symbol_count_ = symbol_count;
+  extension_count_ = extension_count;
+  files_ = data_ + kIndexHeaderSize;
+  symbols_ = files_ + static_cast<size_t>(file_count_) * kFileEntrySize;
+  extensions_ =
+      symbols_ + static_cast<size_t>(symbol_count_) * kSymbolEntrySize;
+  return true;
+}
+
+bool MappedDescriptorDatabase::Build(
+    const std::vector<const FileDescriptorProto*>& files, std::string* output) {
+  std::vector<std::string> encoded_files(files.size());
+  // EncodedDescriptorDatabase finds the conflicts.
+  EncodedDescriptorDatabase checker;
+  for (size_t i = 0; i < files.size(); i++) {
+    if (!files[i]->SerializeToString(&encoded_files[i]) ||
+        !checker.Add(encoded_files[i].data(), encoded_files[i].size())) {
+      return false;
+    }
+  }
+
+  std::vector<std::pair<std::string, uint32>> file_names;
+  std::vector<std::pair<std::string, uint32>> symbols;
+  std::vector<std::tuple<std::string, int, uint32>> extensions;
+  for (uint32 i = 0; i < files.size(); i++) {
+    const FileDescriptorProto& file = *files[i];
+    file_names.emplace_back(file.name(), i);
+    std::string prefix = file.package().empty() ? "" : file.package() + ".";
+    for (const auto& message_type : file.message_type()) {
+      symbols.emplace_back(prefix + message_type.name(), i);
+      CollectNestedExtensions(message_type, i, &extensions);
+    }
+    for (const auto& enum_type : file.enum_type()) {
+      symbols.emplace_back(prefix + enum_type.name(), i);
+    }
+    for (const auto& extension : file.extension()) {
+      symbols.emplace_back(prefix + extension.name(), i);
+      CollectExtension(extension, i, &extensions);
+    }
+    for (const auto& service : file.service()) {
+      symbols.emplace_back(prefix + service.name(), i);
+    }
+  }
+  std::sort(file_names.begin(), file_names.end());
+  std::sort(symbols.begin(), symbols.end());
+  std::sort(extensions.begin(), extensions.end());
+  // Symbols and extensions refer to files by their place in the sorted table.
+  std::vector<uint32> file_table_index(files.size());
+  for (uint32 i = 0; i < file_names.size(); i++) {
+    file_table_index[file_names[i].second] = i;
+  }
+
+  // The strings and file contents go after the tables.
+  const uint64 tables_end =
+      kIndexHeaderSize +
+      static_cast<uint64>(file_names.size()) * kFileEntrySize +
+      static_cast<uint64>(symbols.size()) * kSymbolEntrySize +
+      static_cast<uint64>(extensions.size()) * kExtensionEntrySize;
+  std::string data;
+  auto append_data = [&](const std::string& value) {
+    uint64 offset = tables_end + data.size();
+    data.append(value);
+    return offset;
+  };
+  std::vector<uint64> file_offsets(files.size());
+  for (size_t i = 0; i < files.size(); i++) {
+    file_offsets[i] = append_data(encoded_files[i]);
+  }
+
+  output->clear();
+  AppendUInt32(kIndexMagic, output);
+  AppendUInt32(kIndexVersion, output);
+  AppendUInt32(file_names.size(), output);
+  AppendUInt32(symbols.size(), output);
+  AppendUInt32(extensions.size(), output);
+  for (const auto& file_name : file_names) {
+    AppendUInt32(append_data(file_name.first), output);
+    AppendUInt32(file_name.first.size(), output);
+    AppendUInt32(file_offsets[file_name.second], output);
+    AppendUInt32(encoded_files[file_name.second].size(), output);
+  }
+  for (const auto& symbol : symbols) {
+    AppendUInt32(append_data(symbol.first), output);
+    AppendUInt32(symbol.first.size(), output);
+    AppendUInt32(file_table_index[symbol.second], output);
+  }
+  uint64 extendee_offset = 0;
+  for (size_t i = 0; i < extensions.size(); i++) {
+    const std::string& extendee = std::get<0>(extensions[i]);
+    // Extensions of the same type share its name.
+    if (i == 0 || extendee != std::get<0>(extensions[i - 1])) {
+      extendee_offset = append_data(extendee);
+    }
+    AppendUInt32(extendee_offset, output);
+    AppendUInt32(extendee.size(), output);
+    AppendUInt32(std::get<1>(extensions[i]), output);
+    AppendUInt32(file_table_index[std::get<2>(extensions[i])], output);
+  }
+  GOOGLE_DCHECK_EQ(tables_end, output->size());
+
+  if (tables_end + data.size() > kuint32max) {
+    GOOGLE_LOG(ERROR) << "Descriptor index would be larger than 4GB.";
+    return false;
+  }
+  output->append(data);
+  return true;
+}
+
+uint32 MappedDescriptorDatabase::Read(const char* table, int entry_size,
+                                      uint32 index, int field) const {
+  uint32 value;
+  io::CodedInputStream::ReadLittleEndian32FromArray(
+      reinterpret_cast<const uint8*>(table) +
+          static_cast<size_t>(index) * entry_size + field * sizeof(uint32),
+      &value);
+  return value;
+}
+
+StringPiece MappedDescriptorDatabase::GetString(uint32 offset,
+                                                uint32 size) const {
+  if (offset > size_ || size > size_ - offset) return StringPiece();
+  return StringPiece(data_ + offset, size);
+}
+
+StringPiece MappedDescriptorDatabase::FileName(uint32 index) const {
+  return GetString(Read(files_, kFileEntrySize, index, 0),
+                   Read(files_, kFileEntrySize, index, 1));
+}
+
+StringPiece MappedDescriptorDatabase::SymbolName(uint32 index) const {
+  return GetString(Read(symbols_, kSymbolEntrySize, index, 0),
+                   Read(symbols_, kSymbolEntrySize, index, 1));
+}
+
+StringPiece MappedDescriptorDatabase::Extendee(uint32 index) const {
+  return GetString(Read(extensions_, kExtensionEntrySize, index, 0),
+                   Read(extensions_, kExtensionEntrySize, index, 1));
+}
+
+int MappedDescriptorDatabase::ExtensionNumber(uint32 index) const {
+  return static_cast<int32>(Read(extensions_, kExtensionEntrySize, index, 2));
+}
+
+uint32 MappedDescriptorDatabase::LowerBoundExtension(StringPiece extendee,
+                                                     int number) const {
+  return LowerBound(extension_count_, [&](uint32 i) {
+    return std::make_tuple(Extendee(i), ExtensionNumber(i)) <
+           std::make_tuple(extendee, number);
+  });
+}
+
+bool MappedDescriptorDatabase::ParseFile(uint32 file_index,
+                                         FileDescriptorProto* output) const {
+  if (file_index >= file_count_) return false;
+  StringPiece data = GetString(Read(files_, kFileEntrySize, file_index, 2),
+                               Read(files_, kFileEntrySize, file_index, 3));
+  return output->ParseFromArray(data.data(), data.size());
+}
+
+bool MappedDescriptorDatabase::FindFileByName(const std::string& filename,
+                                              FileDescriptorProto* output) {
+  uint32 i = LowerBound(file_count_,
+                        [&](uint32 i) { return FileName(i) < filename; });
+  return i < file_count_ && FileName(i) == filename && ParseFile(i, output);
+}
+
+bool MappedDescriptorDatabase::FindFileContainingSymbol(
+    const std::string& symbol_name, FileDescriptorProto* output) {
+  // The symbol is in the file of the last symbol that sorts less than or
+  // equal to it, if that symbol is it or one of its parents.
+  uint32 i = LowerBound(symbol_count_,
+                        [&](uint32 i) { return SymbolName(i) <= symbol_name; });
+  return i > 0 && IsSubSymbol(SymbolName(i - 1), symbol_name) &&
+         ParseFile(Read(symbols_, kSymbolEntrySize, i - 1, 2), output);
+}
+
+bool MappedDescriptorDatabase::FindFileContainingExtension(
+    const std::string& containing_type, int field_number,
+    FileDescriptorProto* output) {
+  uint32 i = LowerBoundExtension(containing_type, field_number);
+  return i < extension_count_ && Extendee(i) == containing_type &&
+         ExtensionNumber(i) == field_number &&
+         ParseFile(Read(extensions_, kExtensionEntrySize, i, 3), output);
+}
+
+bool MappedDescriptorDatabase::FindAllExtensionNumbers(
+    const std::string& extendee_type, std::vector<int>* output) {
+  bool success = false;
+  for (uint32 i = LowerBoundExtension(extendee_type, kint32min);
+       i < extension_count_ && Extendee(i) == extendee_type; i++) {
+    output->push_back(ExtensionNumber(i));
+    success = true;
+  }
+  return success;
+}
+
+bool MappedDescriptorDatabase::FindAllFileNames(
+    std::vector<std::string>* output) {
+  output->resize(file_count_);
+  for (uint32 i = 0; i < file_count_; i++) {
+    (*output)[i] = std::string(FileName(i));
+  }
+  return true;
+}
+
 // ===================================================================
 
 DescriptorPoolDatabase::DescriptorPoolDatabase(const DescriptorPool& pool)
@@ -57,6 +57,7 @@ namespace protobuf {
 class DescriptorDatabase;
 class SimpleDescriptorDatabase;
 class EncodedDescriptorDatabase;
+class MappedDescriptorDatabase;
 class DescriptorPoolDatabase;
 class MergedDescriptorDatabase;
 
@@ -331,6 +332,86 @@ class PROTOBUF_EXPORT EncodedDescriptorDatabase : public DescriptorDatabase {
   GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(EncodedDescriptorDatabase);
 };
 
+// A DescriptorDatabase that serves an index written by Build() or by protoc's
+// --descriptor_index_out flag.  The index holds the encoded
+// FileDescriptorProtos together with sorted tables of their file names,
+// symbols and extensions, so it is memory-mapped and searched in place:
+// opening it parses and indexes nothing, and a lookup is a binary search that
+// only parses the FileDescriptorProto it returns.  This makes it suited to
+// processes that start up with a very large number of files, of which they
+// only build a few.
+//
+// The same caveats regarding FindFileContainingExtension() apply as with
+// SimpleDescriptorDatabase.
+class PROTOBUF_EXPORT MappedDescriptorDatabase : public DescriptorDatabase {
+ public:
+  MappedDescriptorDatabase();
+  ~MappedDescriptorDatabase() override;
+
+  // Maps the index in the given file into memory.  Returns false and logs an
+  // error if the file cannot be read or does not hold an index.  Only one of
+  // Open() and Init() may be called, once.
+  bool Open(const std::string& filename);
+
+  // Uses an index that is already in memory.  The database does not make a
+  // copy of the bytes, nor does it take ownership; it's up to the caller to
+  // make sure the bytes remain valid for the life of the database.
+  bool Init(const void* data, size_t size);
+
+  // Writes an index of the given files to *output.  For a DescriptorPool to
+  // build a file from the index, the file's dependencies must be in it too.
+  // Returns false and logs an error if the files conflict with each other,
+  // like EncodedDescriptorDatabase::Add() does.
+  static bool Build(const std::vector<const FileDescriptorProto*>& files,
+                    std::string* output);
+
+  // implements DescriptorDatabase -----------------------------------
+  bool FindFileByName(const std::string& filename,
+                      FileDescriptorProto* output) override;
+  bool FindFileContainingSymbol(const std::string& symbol_name,
+                                FileDescriptorProto* output) override;
+  bool FindFileContainingExtension(const std::string& containing_type,
+                                   int field_number,
+                                   FileDescriptorProto* output) override;
+  bool FindAllExtensionNumbers(const std::string& extendee_type,
+                               std::vector<int>* output) override;
+  bool FindAllFileNames(std::vector<std::string>* output) override;
+
+ private:
+  // Reads field `field` of entry `index` of a table of the index.
+  uint32 Read(const char* table, int entry_size, uint32 index,
+              int field) const;
+  // Returns the string stored at the given range of the index, or an empty
+  // string if the range is out of bounds.
+  StringPiece GetString(uint32 offset, uint32 size) const;
+  StringPiece FileName(uint32 index) const;
+  StringPiece SymbolName(uint32 index) const;
+  StringPiece Extendee(uint32 index) const;
+  int ExtensionNumber(uint32 index) const;
+  // Returns the index of the first extension of (extendee, number) or
+  // greater.
+  uint32 LowerBoundExtension(StringPiece extendee, int number) const;
+  // Parses file `file_index` into *output.
+  bool ParseFile(uint32 file_index, FileDescriptorProto* output) const;
+
+  const char* data_;
+  size_t size_;
+  uint32 file_count_;
+  uint32 symbol_count_;
+  uint32 extension_count_;
+  const char* files_;
+  const char* symbols_;
+  const char* extensions_;
+
+  // The mapping made by Open(), or null.
+  void* mapping_;
+  size_t mapping_size_;
+  // The contents read by Open() where files cannot be mapped.
+  std::string contents_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(MappedDescriptorDatabase);
+};
+
 // A DescriptorDatabase that fetches files from a given pool.
 class PROTOBUF_EXPORT DescriptorPoolDatabase : public DescriptorDatabase {
  public:
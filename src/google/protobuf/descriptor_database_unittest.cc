@@ -45,6 +45,7 @@
 #include <google/protobuf/descriptor.h>
 #include <google/protobuf/text_format.h>
 #include <gmock/gmock.h>
+#include <google/protobuf/testing/file.h>
 #include <google/protobuf/testing/googletest.h>
 #include <gtest/gtest.h>
 
@@ -149,6 +150,78 @@ class DescriptorPoolDatabaseTestCase : public DescriptorDatabaseTestCase {
   DescriptorPoolDatabase database_;
 };
 
+// Specialization for MappedDescriptorDatabase.  Each file added rebuilds the
+// index from all files added so far, and the database GetDatabase() returns
+// forwards to a MappedDescriptorDatabase of the latest index.
+class MappedDescriptorDatabaseTestCase : public DescriptorDatabaseTestCase {
+ public:
+  static DescriptorDatabaseTestCase* New() {
+    return new MappedDescriptorDatabaseTestCase;
+  }
+
+  MappedDescriptorDatabaseTestCase() : forwarder_(this) { Rebuild(); }
+  virtual ~MappedDescriptorDatabaseTestCase() {}
+
+  virtual DescriptorDatabase* GetDatabase() { return &forwarder_; }
+  virtual bool AddToDatabase(const FileDescriptorProto& file) {
+    files_.push_back(file);
+    if (!Rebuild()) {
+      files_.pop_back();
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  class Forwarder : public DescriptorDatabase {
+   public:
+    explicit Forwarder(MappedDescriptorDatabaseTestCase* test_case)
+        : test_case_(test_case) {}
+
+    bool FindFileByName(const std::string& filename,
+                        FileDescriptorProto* output) override {
+      return test_case_->database_->FindFileByName(filename, output);
+    }
+    bool FindFileContainingSymbol(const std::string& symbol_name,
+                                  FileDescriptorProto* output) override {
+      return test_case_->database_->FindFileContainingSymbol(symbol_name,
+                                                             output);
+    }
+    bool FindFileContainingExtension(const std::string& containing_type,
+                                     int field_number,
+                                     FileDescriptorProto* output) override {
+      return test_case_->database_->FindFileContainingExtension(
+          containing_type, field_number, output);
+    }
+    bool FindAllExtensionNumbers(const std::string& extendee_type,
+                                 std::vector<int>* output) override {
+      return test_case_->database_->FindAllExtensionNumbers(extendee_type,
+                                                            output);
+    }
+    bool FindAllFileNames(std::vector<std::string>* output) override {
+      return test_case_->database_->FindAllFileNames(output);
+    }
+
+   private:
+    MappedDescriptorDatabaseTestCase* test_case_;
+  };
+
+  bool Rebuild() {
+    std::vector<const FileDescriptorProto*> files;
+    for (const FileDescriptorProto& file : files_) files.push_back(&file);
+    std::string index;
+    if (!MappedDescriptorDatabase::Build(files, &index)) return false;
+    index_.swap(index);
+    database_.reset(new MappedDescriptorDatabase);
+    return database_->Init(index_.data(), index_.size());
+  }
+
+  std::vector<FileDescriptorProto> files_;
+  std::string index_;
+  std::unique_ptr<MappedDescriptorDatabase> database_;
+  Forwarder forwarder_;
+};
+
 // -------------------------------------------------------------------
 
 class DescriptorDatabaseTest
@@ -480,6 +553,9 @@ INSTANTIATE_TEST_CASE_P(
     testing::Values(&EncodedDescriptorDatabaseTestCase::New));
 INSTANTIATE_TEST_CASE_P(Pool, DescriptorDatabaseTest,
                         testing::Values(&DescriptorPoolDatabaseTestCase::New));
+INSTANTIATE_TEST_CASE_P(
+    Mapped, DescriptorDatabaseTest,
+    testing::Values(&MappedDescriptorDatabaseTestCase::New));
 
 #endif  // GTEST_HAS_PARAM_TEST
 
@@ -572,6 +648,65 @@ TEST(SimpleDescriptorDatabaseExtraTest, FindAllMessageNames) {
   EXPECT_THAT(messages, ::testing::UnorderedElementsAre("foo.Foo", "Bar"));
 }
 
+TEST(MappedDescriptorDatabaseExtraTest, OpenAndBuildPool) {
+  FileDescriptorProto foo;
+  ASSERT_TRUE(TextFormat::ParseFromString(
+      "name: 'foo.proto' package: 'foo' "
+      "message_type { name: 'Foo' extension_range { start: 1 end: 10 } }",
+      &foo));
+  FileDescriptorProto bar;
+  ASSERT_TRUE(TextFormat::ParseFromString(
+      "name: 'bar.proto' package: 'bar' dependency: 'foo.proto' "
+      "message_type { name: 'Bar' field { name: 'foo' number: 1 "
+      "  label: LABEL_OPTIONAL type: TYPE_MESSAGE type_name: '.foo.Foo' } } "
+      "extension { name: 'ext' number: 1 label: LABEL_OPTIONAL "
+      "  type: TYPE_INT32 extendee: '.foo.Foo' }",
+      &bar));
+  std::string index;
+  ASSERT_TRUE(MappedDescriptorDatabase::Build({&foo, &bar}, &index));
+  std::string filename = TestTempDir() + "/descriptor_index.bin";
+  ASSERT_TRUE(File::SetContents(filename, index, true));
+
+  MappedDescriptorDatabase db;
+  ASSERT_TRUE(db.Open(filename));
+  std::vector<std::string> files;
+  EXPECT_TRUE(db.FindAllFileNames(&files));
+  EXPECT_THAT(files, testing::ElementsAre("bar.proto", "foo.proto"));
+
+  // The pool builds files and their dependencies from the index on demand.
+  DescriptorPool pool(&db);
+  const Descriptor* bar_type = pool.FindMessageTypeByName("bar.Bar");
+  ASSERT_TRUE(bar_type != nullptr);
+  EXPECT_EQ("foo.Foo", bar_type->field(0)->message_type()->full_name());
+  const Descriptor* foo_type = pool.FindMessageTypeByName("foo.Foo");
+  ASSERT_TRUE(foo_type != nullptr);
+  const FieldDescriptor* ext = pool.FindExtensionByNumber(foo_type, 1);
+  ASSERT_TRUE(ext != nullptr);
+  EXPECT_EQ("bar.ext", ext->full_name());
+}
+
+TEST(MappedDescriptorDatabaseExtraTest, RejectsInvalidIndex) {
+  MappedDescriptorDatabase missing;
+  EXPECT_FALSE(missing.Open(TestTempDir() + "/no_such_index.bin"));
+
+  MappedDescriptorDatabase garbage;
+  std::string data = "not a descriptor index";
+  EXPECT_FALSE(garbage.Init(data.data(), data.size()));
+
+  FileDescriptorProto foo;
+  foo.set_name("foo.proto");
+  foo.add_message_type()->set_name("Foo");
+  std::string index;
+  ASSERT_TRUE(MappedDescriptorDatabase::Build({&foo}, &index));
+  MappedDescriptorDatabase truncated;
+  EXPECT_FALSE(truncated.Init(index.data(), 24));
+
+  // Conflicting files are not indexed.
+  FileDescriptorProto foo2 = foo;
+  foo2.set_name("foo2.proto");
+  EXPECT_FALSE(MappedDescriptorDatabase::Build({&foo, &foo2}, &index));
+}
+
 // ===================================================================
 
 class MergedDescriptorDatabaseTest : public testing::Test {
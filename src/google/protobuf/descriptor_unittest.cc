@@ -34,8 +34,12 @@
 //
 // This file makes extensive use of RFC 3092.  :)
 
+#include <algorithm>
+#include <atomic>
+#include <functional>
 #include <limits>
 #include <memory>
+#include <thread>
 #include <vector>
 
 #include <google/protobuf/compiler/importer.h>
@@ -521,6 +525,214 @@ TEST_F(FileDescriptorTest, BuildAgainWithSyntax) {
   EXPECT_EQ(proto3_descriptor, pool_.BuildFile(proto_syntax3));
 }
 
+TEST_F(FileDescriptorTest, BuildFiles) {
+  // Files of the batch may import each other in any order.
+  std::vector<FileDescriptorProto> protos(3);
+  protos[0].set_name("corge.proto");
+  protos[0].add_dependency("qux.proto");
+  protos[0].add_dependency("foo.proto");
+  AddField(AddMessage(&protos[0], "Corge"), "qux", 1,
+           FieldDescriptorProto::LABEL_OPTIONAL,
+           FieldDescriptorProto::TYPE_MESSAGE)
+      ->set_type_name("Qux");
+  protos[1].set_name("qux.proto");
+  protos[1].add_dependency("grault.proto");
+  AddField(AddMessage(&protos[1], "Qux"), "grault", 1,
+           FieldDescriptorProto::LABEL_OPTIONAL,
+           FieldDescriptorProto::TYPE_MESSAGE)
+      ->set_type_name("Grault");
+  protos[2].set_name("grault.proto");
+  AddMessage(&protos[2], "Grault");
+
+  std::vector<const FileDescriptor*> files;
+  ASSERT_TRUE(pool_.BuildFiles(protos, 1, &files));
+  ASSERT_EQ(3, files.size());
+  EXPECT_EQ("corge.proto", files[0]->name());
+  EXPECT_EQ("qux.proto", files[1]->name());
+  EXPECT_EQ("grault.proto", files[2]->name());
+  EXPECT_EQ(foo_file_, files[0]->dependency(1));
+  EXPECT_EQ(files[1]->message_type(0),
+            files[0]->message_type(0)->field(0)->message_type());
+  EXPECT_EQ(files[1], pool_.FindFileByName("qux.proto"));
+
+  // Building the same files again returns them.
+  std::vector<FileDescriptorProto> copies(files.size());
+  for (int i = 0; i < files.size(); i++) {
+    files[i]->CopyTo(&copies[i]);
+  }
+  std::vector<const FileDescriptor*> again;
+  ASSERT_TRUE(pool_.BuildFiles(copies, 1, &again));
+  EXPECT_EQ(files, again);
+}
+
+TEST_F(FileDescriptorTest, BuildFilesIsAtomic) {
+  std::vector<FileDescriptorProto> protos(2);
+  protos[0].set_name("corge.proto");
+  AddMessage(&protos[0], "Corge");
+  protos[1].set_name("qux.proto");
+  protos[1].add_dependency("corge.proto");
+  AddField(AddMessage(&protos[1], "Qux"), "corge", 1,
+           FieldDescriptorProto::LABEL_OPTIONAL,
+           FieldDescriptorProto::TYPE_MESSAGE)
+      ->set_type_name("NoSuchType");
+
+  MockErrorCollector error_collector;
+  EXPECT_FALSE(pool_.BuildFilesCollectingErrors(protos, 1, &error_collector,
+                                                nullptr));
+  EXPECT_EQ("qux.proto: Qux.corge: TYPE: \"NoSuchType\" is not defined.\n",
+            error_collector.text_);
+  // The file which built was rolled back with the one that didn't.
+  EXPECT_TRUE(pool_.FindFileByName("corge.proto") == nullptr);
+  EXPECT_TRUE(pool_.FindMessageTypeByName("Corge") == nullptr);
+
+  // An import cycle fails the batch too.
+  protos[0].add_dependency("qux.proto");
+  protos[1].mutable_message_type(0)->mutable_field(0)->set_type_name("Corge");
+  EXPECT_FALSE(pool_.BuildFilesCollectingErrors(protos, 1, &error_collector,
+                                                nullptr));
+  EXPECT_TRUE(pool_.FindFileByName("corge.proto") == nullptr);
+  EXPECT_TRUE(pool_.FindFileByName("qux.proto") == nullptr);
+}
+
+TEST_F(FileDescriptorTest, BuildFilesOnSeveralThreads) {
+  // Files 1 to 8 only import file 0, and file 9 imports all of them.
+  std::vector<FileDescriptorProto> protos(10);
+  for (int i = 0; i < protos.size(); i++) {
+    protos[i].set_name(StrCat("file", i, ".proto"));
+    protos[i].set_package(StrCat("pkg.sub", i));
+    DescriptorProto* message = AddMessage(&protos[i], StrCat("Message", i));
+    if (i > 0) {
+      protos[i].add_dependency("file0.proto");
+      AddField(message, "base", 1, FieldDescriptorProto::LABEL_OPTIONAL,
+               FieldDescriptorProto::TYPE_MESSAGE)
+          ->set_type_name(".pkg.sub0.Message0");
+      AddExtensionRange(AddMessage(&protos[i], "Extendable"), 1, 2);
+      AddExtension(&protos[i], "Extendable", "ext", 1,
+                   FieldDescriptorProto::LABEL_OPTIONAL,
+                   FieldDescriptorProto::TYPE_INT32);
+    }
+  }
+  for (int i = 1; i < 9; i++) protos[9].add_dependency(protos[i].name());
+  std::reverse(protos.begin(), protos.end());
+
+  std::vector<const FileDescriptor*> files;
+  ASSERT_TRUE(pool_.BuildFiles(protos, 4, &files));
+  ASSERT_EQ(10, files.size());
+  const FileDescriptor* file0 = pool_.FindFileByName("file0.proto");
+  ASSERT_TRUE(file0 != nullptr);
+  for (int i = 0; i < files.size(); i++) {
+    EXPECT_EQ(protos[i].name(), files[i]->name());
+    EXPECT_EQ(files[i], pool_.FindFileByName(protos[i].name()));
+    EXPECT_EQ(&pool_, files[i]->pool());
+    if (files[i] != file0) {
+      const Descriptor* message = files[i]->message_type(0);
+      EXPECT_EQ(message, pool_.FindMessageTypeByName(message->full_name()));
+      EXPECT_EQ(file0->message_type(0), message->field(0)->message_type());
+      const Descriptor* extendable = files[i]->message_type(1);
+      EXPECT_EQ(files[i]->extension(0),
+                pool_.FindExtensionByNumber(extendable, 1));
+    }
+  }
+  EXPECT_EQ(9, files[0]->dependency_count());
+
+  // Building the same files again returns them.
+  std::vector<FileDescriptorProto> copies(files.size());
+  for (int i = 0; i < files.size(); i++) {
+    files[i]->CopyTo(&copies[i]);
+  }
+  std::vector<const FileDescriptor*> again;
+  ASSERT_TRUE(pool_.BuildFiles(copies, 4, &again));
+  EXPECT_EQ(files, again);
+}
+
+TEST_F(FileDescriptorTest, BuildFilesWithExecutor) {
+  // Files 1 to 4 only import file 0.
+  std::vector<FileDescriptorProto> protos(5);
+  for (int i = 0; i < protos.size(); i++) {
+    protos[i].set_name(StrCat("file", i, ".proto"));
+    DescriptorProto* message = AddMessage(&protos[i], StrCat("Message", i));
+    if (i > 0) {
+      protos[i].add_dependency("file0.proto");
+      AddField(message, "base", 1, FieldDescriptorProto::LABEL_OPTIONAL,
+               FieldDescriptorProto::TYPE_MESSAGE)
+          ->set_type_name("Message0");
+    }
+  }
+
+  // The tasks run on threads owned by the caller.
+  std::vector<std::thread> threads;
+  std::vector<const FileDescriptor*> files;
+  ASSERT_TRUE(pool_.BuildFiles(
+      protos,
+      [&threads](std::function<void()> task) {
+        threads.emplace_back(std::move(task));
+      },
+      &files));
+  for (std::thread& thread : threads) thread.join();
+  // One task fewer than the files of level 1: the calling thread builds one.
+  EXPECT_EQ(3, threads.size());
+  ASSERT_EQ(5, files.size());
+  for (int i = 0; i < files.size(); i++) {
+    EXPECT_EQ(files[i], pool_.FindFileByName(protos[i].name()));
+    EXPECT_EQ(&pool_, files[i]->pool());
+  }
+
+  // An executor may also run the tasks before returning.
+  DescriptorPool pool;
+  int num_tasks = 0;
+  ASSERT_TRUE(pool.BuildFiles(
+      protos,
+      [&num_tasks](std::function<void()> task) {
+        num_tasks++;
+        task();
+      },
+      &files));
+  EXPECT_EQ(3, num_tasks);
+  EXPECT_EQ(pool.FindMessageTypeByName("Message0"),
+            pool.FindMessageTypeByName("Message4")->field(0)->message_type());
+}
+
+TEST_F(FileDescriptorTest, BuildFilesOnSeveralThreadsIsAtomic) {
+  // Both files define Corge, and don't import each other.
+  std::vector<FileDescriptorProto> protos(3);
+  protos[0].set_name("corge.proto");
+  AddMessage(&protos[0], "Corge");
+  protos[1].set_name("qux.proto");
+  AddMessage(&protos[1], "Qux");
+  protos[2].set_name("grault.proto");
+  AddMessage(&protos[2], "Corge");
+
+  MockErrorCollector error_collector;
+  EXPECT_FALSE(pool_.BuildFilesCollectingErrors(protos, 2, &error_collector,
+                                                nullptr));
+  EXPECT_EQ(
+      "grault.proto: Corge: NAME: \"Corge\" is already defined in file "
+      "\"corge.proto\".\n",
+      error_collector.text_);
+  EXPECT_TRUE(pool_.FindFileByName("corge.proto") == nullptr);
+  EXPECT_TRUE(pool_.FindFileByName("qux.proto") == nullptr);
+  EXPECT_TRUE(pool_.FindMessageTypeByName("Corge") == nullptr);
+
+  // A file which fails to build fails the batch too.
+  protos[2].mutable_message_type(0)->set_name("Grault");
+  AddField(protos[2].mutable_message_type(0), "corge", 1,
+           FieldDescriptorProto::LABEL_OPTIONAL,
+           FieldDescriptorProto::TYPE_MESSAGE)
+      ->set_type_name("NoSuchType");
+  error_collector.text_.clear();
+  EXPECT_FALSE(pool_.BuildFilesCollectingErrors(protos, 2, &error_collector,
+                                                nullptr));
+  EXPECT_EQ(
+      "grault.proto: Grault.corge: TYPE: \"NoSuchType\" is not defined.\n",
+      error_collector.text_);
+  EXPECT_TRUE(pool_.FindFileByName("corge.proto") == nullptr);
+  EXPECT_TRUE(pool_.FindMessageTypeByName("Qux") == nullptr);
+
+  protos[2].mutable_message_type(0)->clear_field();
+  EXPECT_TRUE(pool_.BuildFiles(protos, 2, nullptr));
+  EXPECT_TRUE(pool_.FindMessageTypeByName("Grault") != nullptr);
+}
+
 TEST_F(FileDescriptorTest, Syntax) {
   FileDescriptorProto proto;
   proto.set_name("foo");
@@ -7052,6 +7264,133 @@ TEST_F(DatabaseBackedPoolTest, DoesntFallbackOnWrongType) {
   EXPECT_EQ(0, call_counter.call_count_);
 }
 
+TEST_F(DatabaseBackedPoolTest, RepeatedLookupsFindSameResults) {
+  // Results found once are found again without the lock, so repeat lookups
+  // of enough symbols that the lock-free table has to grow.
+  FileDescriptorProto many;
+  many.set_name("many.proto");
+  many.add_dependency("foo.proto");
+  // Foo's extension range is [1, 100), and bar.proto uses number 5.
+  const int kCount = 90;
+  const int kFirstNumber = 10;
+  for (int i = 0; i < kCount; i++) {
+    many.add_message_type()->set_name(StrCat("Many", i));
+    FieldDescriptorProto* extension = many.add_extension();
+    extension->set_name(StrCat("many_ext", i));
+    extension->set_extendee(".Foo");
+    extension->set_number(kFirstNumber + i);
+    extension->set_label(FieldDescriptorProto::LABEL_OPTIONAL);
+    extension->set_type(FieldDescriptorProto::TYPE_INT32);
+  }
+  ASSERT_TRUE(database_.Add(many));
+
+  CallCountingDatabase call_counter(&database_);
+  DescriptorPool pool(&call_counter);
+
+  std::vector<const Descriptor*> messages;
+  std::vector<const FieldDescriptor*> extensions;
+  const Descriptor* foo = pool.FindMessageTypeByName("Foo");
+  ASSERT_TRUE(foo != nullptr);
+  for (int i = 0; i < kCount; i++) {
+    messages.push_back(pool.FindMessageTypeByName(StrCat("Many", i)));
+    ASSERT_TRUE(messages.back() != nullptr);
+    extensions.push_back(pool.FindExtensionByNumber(foo, kFirstNumber + i));
+    ASSERT_TRUE(extensions.back() != nullptr);
+  }
+  const FileDescriptor* file = pool.FindFileByName("many.proto");
+  ASSERT_TRUE(file != nullptr);
+
+  call_counter.Clear();
+  for (int round = 0; round < 2; round++) {
+    EXPECT_EQ(foo, pool.FindMessageTypeByName("Foo"));
+    for (int i = 0; i < kCount; i++) {
+      EXPECT_EQ(messages[i], pool.FindMessageTypeByName(StrCat("Many", i)));
+      EXPECT_EQ(extensions[i],
+                pool.FindExtensionByNumber(foo, kFirstNumber + i));
+      EXPECT_EQ(extensions[i],
+                pool.FindExtensionByName(StrCat("many_ext", i)));
+      EXPECT_EQ(file, pool.FindFileContainingSymbol(StrCat("Many", i)));
+    }
+    EXPECT_EQ(file, pool.FindFileByName("many.proto"));
+    // A symbol found before is still only returned for its own type.
+    EXPECT_TRUE(pool.FindEnumTypeByName("Many0") == nullptr);
+    EXPECT_TRUE(pool.FindFieldByName("many_ext0") == nullptr);
+  }
+  EXPECT_EQ(0, call_counter.call_count_);
+}
+
+TEST_F(DatabaseBackedPoolTest, ConcurrentLookupsWhileLoading) {
+  // Every message is in a file of its own, so that the first lookup of each
+  // loads a file from the database and adds to the lock-free tables while
+  // other threads read them.
+  const int kCount = 200;
+  const int kNumLoaded = kCount / 2;
+  for (int i = 0; i < kCount; i++) {
+    FileDescriptorProto file;
+    file.set_name(StrCat("concurrent", i, ".proto"));
+    DescriptorProto* message = file.add_message_type();
+    message->set_name(StrCat("Concurrent", i));
+    FieldDescriptorProto* field = message->add_field();
+    field->set_name("value");
+    field->set_number(1);
+    field->set_label(FieldDescriptorProto::LABEL_OPTIONAL);
+    field->set_type(FieldDescriptorProto::TYPE_INT32);
+    ASSERT_TRUE(database_.Add(file));
+  }
+  DescriptorPool pool(&database_);
+
+  // The first half is loaded before the threads start, the second half by
+  // whichever thread looks it up first.
+  std::vector<std::atomic<const Descriptor*>> results(kCount);
+  for (int i = 0; i < kCount; i++) {
+    results[i].store(nullptr, std::memory_order_relaxed);
+  }
+  for (int i = 0; i < kNumLoaded; i++) {
+    results[i].store(pool.FindMessageTypeByName(StrCat("Concurrent", i)));
+    ASSERT_TRUE(results[i].load() != nullptr);
+  }
+
+  // Returns whether the lookups of message i agree with the other threads.
+  auto check = [&](int i) {
+    const Descriptor* message =
+        pool.FindMessageTypeByName(StrCat("Concurrent", i));
+    if (message == nullptr) return false;
+    const Descriptor* expected = nullptr;
+    if (!results[i].compare_exchange_strong(expected, message) &&
+        expected != message) {
+      return false;
+    }
+    return pool.FindFieldByName(StrCat("Concurrent", i, ".value")) ==
+               message->field(0) &&
+           pool.FindFileContainingSymbol(StrCat("Concurrent", i)) ==
+               message->file();
+  };
+
+  const int kNumThreads = 8;
+  std::atomic<int> next_to_load(kNumLoaded);
+  std::atomic<int> failures(0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kNumThreads; t++) {
+    threads.emplace_back([&, t] {
+      if (t % 2 == 0) {
+        // Loads the second half, one message at a time.
+        for (int i = next_to_load++; i < kCount; i = next_to_load++) {
+          if (!check(i)) failures++;
+        }
+      } else {
+        // Looks up the messages loaded before, and the ones being loaded.
+        for (int round = 0; round < 10; round++) {
+          for (int i = 0; i < kCount; i++) {
+            if (!check((i + t * kCount / kNumThreads) % kCount)) failures++;
+          }
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) thread.join();
+  EXPECT_EQ(0, failures.load());
+}
+
 // ===================================================================
 
 class AbortingErrorCollector : public DescriptorPool::ErrorCollector {
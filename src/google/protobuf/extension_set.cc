@@ -86,7 +86,11 @@ inline bool is_packable(WireFormatLite::WireType type) {
 // Registry stuff.
 struct ExtensionHasher {
   std::size_t operator()(const std::pair<const MessageLite*, int>& p) const {
-    return std::hash<const MessageLite*>{}(p.first) ^
+    // Default instances are often close together, so XORing their addresses
+    // with the field numbers of many extensions collides.  Scale the address
+    // by a large odd constant instead.
+    return std::hash<const MessageLite*>{}(p.first) *
+               static_cast<std::size_t>(0x9E3779B97F4A7C15ULL) +
            std::hash<int>{}(p.second);
   }
 };
@@ -1811,11 +1815,7 @@ const ExtensionSet::Extension* ExtensionSet::FindOrNull(int key) const {
 const ExtensionSet::Extension* ExtensionSet::FindOrNullInLargeMap(
     int key) const {
   assert(is_large());
-  LargeMap::const_iterator it = map_.large->find(key);
-  if (it != map_.large->end()) {
-    return &it->second;
-  }
-  return NULL;
+  return map_.large->Find(key);
 }
 
 ExtensionSet::Extension* ExtensionSet::FindOrNull(int key) {
@@ -1833,17 +1833,25 @@ ExtensionSet::Extension* ExtensionSet::FindOrNull(int key) {
 
 ExtensionSet::Extension* ExtensionSet::FindOrNullInLargeMap(int key) {
   assert(is_large());
-  LargeMap::iterator it = map_.large->find(key);
-  if (it != map_.large->end()) {
-    return &it->second;
+  return map_.large->Find(key);
+}
+
+std::pair<ExtensionSet::Extension*, bool> ExtensionSet::LargeMap::Insert(
+    int key, const Extension& extension) {
+  auto maybe = index_.insert({key, nullptr});
+  if (maybe.second) {
+    maybe.first->second = &map_.insert({key, extension}).first->second;
   }
-  return NULL;
+  return {maybe.first->second, maybe.second};
+}
+
+void ExtensionSet::LargeMap::Erase(int key) {
+  if (index_.erase(key) != 0) map_.erase(key);
 }
 
 std::pair<ExtensionSet::Extension*, bool> ExtensionSet::Insert(int key) {
   if (PROTOBUF_PREDICT_FALSE(is_large())) {
-    auto maybe = map_.large->insert({key, Extension()});
-    return {&maybe.first->second, maybe.second};
+    return map_.large->Insert(key, Extension());
   }
   KeyValue* end = flat_end();
   KeyValue* it =
@@ -1880,9 +1888,8 @@ void ExtensionSet::GrowCapacity(size_t minimum_new_capacity) {
   AllocatedData new_map;
   if (new_flat_capacity > kMaximumFlatCapacity) {
     new_map.large = Arena::Create<LargeMap>(arena_);
-    LargeMap::iterator hint = new_map.large->begin();
     for (const KeyValue* it = begin; it != end; ++it) {
-      hint = new_map.large->insert(hint, {it->first, it->second});
+      new_map.large->Insert(it->first, it->second);
     }
   } else {
     new_map.flat = Arena::CreateArray<KeyValue>(arena_, new_flat_capacity);
@@ -1904,7 +1911,7 @@ constexpr uint16 ExtensionSet::kMaximumFlatCapacity;
 
 void ExtensionSet::Erase(int key) {
   if (PROTOBUF_PREDICT_FALSE(is_large())) {
-    map_.large->erase(key);
+    map_.large->Erase(key);
     return;
   }
   KeyValue* end = flat_end();
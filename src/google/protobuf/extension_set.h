@@ -42,6 +42,7 @@
 #include <cassert>
 #include <map>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -643,7 +644,32 @@ class PROTOBUF_EXPORT ExtensionSet {
     };
   };
 
-  typedef std::map<int, Extension> LargeMap;
+  // Past kMaximumFlatCapacity, extensions are kept in a std::map, which
+  // iterates in field number order as ForEach() and serialization need, plus
+  // a hash index of the map for lookups.
+  class LargeMap {
+   public:
+    typedef std::map<int, Extension>::iterator iterator;
+    typedef std::map<int, Extension>::const_iterator const_iterator;
+
+    iterator begin() { return map_.begin(); }
+    const_iterator begin() const { return map_.begin(); }
+    iterator end() { return map_.end(); }
+    const_iterator end() const { return map_.end(); }
+    const_iterator lower_bound(int key) const { return map_.lower_bound(key); }
+    size_t size() const { return map_.size(); }
+
+    Extension* Find(int key) const {
+      auto it = index_.find(key);
+      return it == index_.end() ? nullptr : it->second;
+    }
+    std::pair<Extension*, bool> Insert(int key, const Extension& extension);
+    void Erase(int key);
+
+   private:
+    std::map<int, Extension> map_;
+    std::unordered_map<int, Extension*> index_;
+  };
 
   // Wrapper API that switches between flat-map and LargeMap.
 
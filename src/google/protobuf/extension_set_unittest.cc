@@ -1324,6 +1324,32 @@ TEST(ExtensionSetTest, BoolExtension) {
   EXPECT_TRUE(msg.GetExtension(protobuf_unittest::optional_bool_extension));
 }
 
+TEST(ExtensionSetTest, ManyExtensions) {
+  // Enough extensions to move the set out of its flat array.
+  ExtensionSet extensions;
+  for (int i = 1000; i > 0; i--) {
+    extensions.SetInt32(i, WireFormatLite::TYPE_INT32, i * 2, nullptr);
+  }
+  EXPECT_EQ(1000, extensions.NumExtensions());
+  for (int i = 1; i <= 1000; i++) {
+    ASSERT_TRUE(extensions.Has(i)) << i;
+    EXPECT_EQ(i * 2, extensions.GetInt32(i, 0));
+  }
+  EXPECT_FALSE(extensions.Has(1001));
+
+  ExtensionSet other;
+  other.SwapExtension(&extensions, 7);
+  EXPECT_FALSE(extensions.Has(7));
+  EXPECT_EQ(14, other.GetInt32(7, 0));
+  extensions.SetInt32(7, WireFormatLite::TYPE_INT32, 1, nullptr);
+  EXPECT_EQ(1, extensions.GetInt32(7, 0));
+
+  other.MergeFrom(extensions);
+  EXPECT_EQ(1000, other.NumExtensions());
+  EXPECT_EQ(1, other.GetInt32(7, 0));
+  EXPECT_EQ(2000, other.GetInt32(1000, 0));
+}
+
 }  // namespace
 }  // namespace internal
 }  // namespace protobuf
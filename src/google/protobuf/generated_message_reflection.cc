@@ -44,10 +44,12 @@
 #include <google/protobuf/extension_set.h>
 #include <google/protobuf/generated_message_util.h>
 #include <google/protobuf/inlined_string_field.h>
+#include <google/protobuf/lazy_field.h>
 #include <google/protobuf/map_field.h>
 #include <google/protobuf/map_field_inl.h>
 #include <google/protobuf/stubs/mutex.h>
 #include <google/protobuf/repeated_field.h>
+#include <google/protobuf/string_piece_field_support.h>
 #include <google/protobuf/unknown_field_set.h>
 #include <google/protobuf/wire_format.h>
 #include <google/protobuf/stubs/strutil.h>
@@ -63,6 +65,7 @@ using google::protobuf::internal::ExtensionSet;
 using google::protobuf::internal::GenericTypeHandler;
 using google::protobuf::internal::GetEmptyString;
 using google::protobuf::internal::InlinedStringField;
+using google::protobuf::internal::StringPieceField;
 using google::protobuf::internal::InternalMetadata;
 using google::protobuf::internal::LazyField;
 using google::protobuf::internal::MapFieldBase;
@@ -320,6 +323,12 @@ size_t Reflection::SpaceUsedLong(const Message& message) const {
                 break;
               }
 
+              if (IsStringPiece(field)) {
+                total_size += GetField<StringPieceField>(message, field)
+                                  .SpaceUsedExcludingSelfLong();
+                break;
+              }
+
               const std::string* ptr =
                   &GetField<ArenaStringPtr>(message, field).Get();
 
@@ -345,6 +354,14 @@ size_t Reflection::SpaceUsedLong(const Message& message) const {
           if (schema_.IsDefaultInstance(message)) {
             // For singular fields, the prototype just stores a pointer to the
             // external type's prototype, so there is no extra memory usage.
+          } else if (IsLazyField(field)) {
+            const LazyField& lazy = GetRaw<LazyField>(message, field);
+            total_size += lazy.UnparsedSpaceUsedExcludingSelfLong();
+            if (lazy.GetIfParsed() != nullptr) {
+              total_size +=
+                  static_cast<const Message*>(lazy.GetIfParsed())
+                      ->SpaceUsedLong();
+            }
           } else {
             const Message* sub_message = GetRaw<const Message*>(message, field);
             if (sub_message != nullptr) {
@@ -420,7 +437,22 @@ void Reflection::SwapField(Message* message1, Message* message2,
       SWAP_VALUES(ENUM, int);
 #undef SWAP_VALUES
       case FieldDescriptor::CPPTYPE_MESSAGE:
-        if (GetArena(message1) == GetArena(message2)) {
+        if (IsLazyField(field)) {
+          LazyField* lazy1 = MutableRaw<LazyField>(message1, field);
+          LazyField* lazy2 = MutableRaw<LazyField>(message2, field);
+          if (GetArena(message1) == GetArena(message2)) {
+            lazy1->Swap(lazy2);
+          } else {
+            // Copies the bytes, or the messages if they were accessed.
+            const Message& prototype = *GetDefaultMessageInstance(field);
+            LazyField temp(GetArena(message1));
+            if (!lazy2->IsCleared()) temp.MergeFrom(prototype, *lazy2);
+            lazy2->Clear();
+            if (!lazy1->IsCleared()) lazy2->MergeFrom(prototype, *lazy1);
+            lazy1->Clear();
+            lazy1->Swap(&temp);
+          }
+        } else if (GetArena(message1) == GetArena(message2)) {
           std::swap(*MutableRaw<Message*>(message1, field),
                     *MutableRaw<Message*>(message2, field));
         } else {
@@ -459,6 +491,21 @@ void Reflection::SwapField(Message* message1, Message* message2,
               break;
             }
 
+            if (IsStringPiece(field)) {
+              StringPieceField* string1 =
+                  MutableRaw<StringPieceField>(message1, field);
+              StringPieceField* string2 =
+                  MutableRaw<StringPieceField>(message2, field);
+              if (arena1 == arena2) {
+                string1->Swap(string2);
+              } else {
+                const std::string temp(string1->Get());
+                string1->Set(string2->Get());
+                string2->Set(temp);
+              }
+              break;
+            }
+
             ArenaStringPtr* string1 =
                 MutableRaw<ArenaStringPtr>(message1, field);
             ArenaStringPtr* string2 =
@@ -842,6 +889,12 @@ void Reflection::ClearField(Message* message,
                 break;
               }
 
+              if (IsStringPiece(field)) {
+                // StringPiece fields never have a default value.
+                MutableRaw<StringPieceField>(message, field)->Clear();
+                break;
+              }
+
               const std::string* default_ptr =
                   &DefaultRaw<ArenaStringPtr>(field).Get();
               MutableRaw<ArenaStringPtr>(message, field)
@@ -853,7 +906,9 @@ void Reflection::ClearField(Message* message,
         }
 
         case FieldDescriptor::CPPTYPE_MESSAGE:
-          if (schema_.HasBitIndex(field) == -1) {
+          if (IsLazyField(field)) {
+            MutableRaw<LazyField>(message, field)->Clear();
+          } else if (schema_.HasBitIndex(field) == -1) {
             // Proto3 does not have has-bits and we need to set a message field
             // to nullptr in order to indicate its un-presence.
             if (GetArena(message) == nullptr) {
@@ -1201,6 +1256,10 @@ std::string Reflection::GetString(const Message& message,
           return GetField<InlinedStringField>(message, field).GetNoArena();
         }
 
+        if (IsStringPiece(field)) {
+          return std::string(GetField<StringPieceField>(message, field).Get());
+        }
+
         return GetField<ArenaStringPtr>(message, field).Get();
       }
     }
@@ -1225,6 +1284,12 @@ const std::string& Reflection::GetStringReference(const Message& message,
           return GetField<InlinedStringField>(message, field).GetNoArena();
         }
 
+        if (IsStringPiece(field)) {
+          *scratch =
+              std::string(GetField<StringPieceField>(message, field).Get());
+          return *scratch;
+        }
+
         return GetField<ArenaStringPtr>(message, field).Get();
       }
     }
@@ -1248,6 +1313,11 @@ void Reflection::SetString(Message* message, const FieldDescriptor* field,
           break;
         }
 
+        if (IsStringPiece(field)) {
+          MutableField<StringPieceField>(message, field)->Set(value);
+          break;
+        }
+
         // Oneof string fields are never set as a default instance.
         // We just need to pass some arbitrary default string to make it work.
         // This allows us to not have the real default accessible from
@@ -1539,6 +1609,10 @@ const Message& Reflection::GetMessage(const Message& message,
     if (schema_.InRealOneof(field) && !HasOneofField(message, field)) {
       return *GetDefaultMessageInstance(field);
     }
+    if (IsLazyField(field)) {
+      return static_cast<const Message&>(GetRaw<LazyField>(message, field).Get(
+          *GetDefaultMessageInstance(field)));
+    }
     const Message* result = GetRaw<const Message*>(message, field);
     if (result == nullptr) {
       result = GetDefaultMessageInstance(field);
@@ -1559,6 +1633,13 @@ Message* Reflection::MutableMessage(Message* message,
     return static_cast<Message*>(
         MutableExtensionSet(message)->MutableMessage(field, factory));
   } else {
+    if (IsLazyField(field)) {
+      SetBit(message, field);
+      return static_cast<Message*>(MutableRaw<LazyField>(message, field)
+                                       ->Mutable(*GetDefaultMessageInstance(
+                                           field)));
+    }
+
     Message* result;
 
     Message** result_holder = MutableRaw<Message*>(message, field);
@@ -1609,6 +1690,11 @@ void Reflection::UnsafeArenaSetAllocatedMessage(
     } else {
       SetBit(message, field);
     }
+    if (IsLazyField(field)) {
+      MutableRaw<LazyField>(message, field)
+          ->UnsafeArenaSetAllocated(sub_message);
+      return;
+    }
     Message** sub_message_holder = MutableRaw<Message*>(message, field);
     if (GetArena(message) == nullptr) {
       delete *sub_message_holder;
@@ -1668,6 +1754,11 @@ Message* Reflection::UnsafeArenaReleaseMessage(Message* message,
         return nullptr;
       }
     }
+    if (IsLazyField(field)) {
+      return static_cast<Message*>(
+          MutableRaw<LazyField>(message, field)
+              ->UnsafeArenaRelease(*GetDefaultMessageInstance(field)));
+    }
     Message** result = MutableRaw<Message*>(message, field);
     Message* ret = *result;
     *result = nullptr;
@@ -1972,6 +2063,14 @@ bool Reflection::IsInlined(const FieldDescriptor* field) const {
   return schema_.IsFieldInlined(field);
 }
 
+bool Reflection::IsStringPiece(const FieldDescriptor* field) const {
+  return schema_.IsFieldStringPiece(field);
+}
+
+bool Reflection::IsLazyField(const FieldDescriptor* field) const {
+  return schema_.IsFieldLazy(field);
+}
+
 template <typename Type>
 Type* Reflection::MutableRaw(Message* message,
                              const FieldDescriptor* field) const {
@@ -2041,6 +2140,9 @@ bool Reflection::HasBit(const Message& message,
   // proto3: no has-bits. All fields present except messages, which are
   // present only if their message-field pointer is non-null.
   if (field->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE) {
+    if (IsLazyField(field)) {
+      return !GetRaw<LazyField>(message, field).IsCleared();
+    }
     return !schema_.IsDefaultInstance(message) &&
            GetRaw<const Message*>(message, field) != nullptr;
   } else {
@@ -2063,6 +2165,9 @@ bool Reflection::HasBit(const Message& message,
                           .GetNoArena()
                           .empty();
             }
+            if (IsStringPiece(field)) {
+              return !GetField<StringPieceField>(message, field).empty();
+            }
             return GetField<ArenaStringPtr>(message, field).Get().size() > 0;
           }
         }
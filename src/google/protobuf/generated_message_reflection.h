@@ -159,6 +159,20 @@ struct ReflectionSchema {
     }
   }
 
+  // Whether a string field is stored as a StringPieceField.  Never true for
+  // oneof members.
+  bool IsFieldStringPiece(const FieldDescriptor* field) const {
+    return !InRealOneof(field) &&
+           StringPieceStorage(offsets_[field->index()], field->type());
+  }
+
+  // Whether a message field is stored as a LazyField.  Never true for oneof
+  // members.
+  bool IsFieldLazy(const FieldDescriptor* field) const {
+    return !InRealOneof(field) &&
+           LazyStorage(offsets_[field->index()], field->type());
+  }
+
   uint32 GetOneofCaseOffset(const OneofDescriptor* oneof_descriptor) const {
     return static_cast<uint32>(oneof_case_offset_) +
            static_cast<uint32>(static_cast<size_t>(oneof_descriptor->index()) *
@@ -246,11 +260,13 @@ struct ReflectionSchema {
   int weak_field_map_offset_;
 
   // We tag offset values to provide additional data about fields (such as
-  // inlined).
+  // inlined, StringPiece or lazy storage).
   static uint32 OffsetValue(uint32 v, FieldDescriptor::Type type) {
     v &= 0x7FFFFFFFu;
     if (type == FieldDescriptor::TYPE_STRING ||
         type == FieldDescriptor::TYPE_BYTES) {
+      return v & ~3u;
+    } else if (type == FieldDescriptor::TYPE_MESSAGE) {
       return v & ~1u;
     } else {
       return v;
@@ -266,6 +282,19 @@ struct ReflectionSchema {
       return false;
     }
   }
+
+  static bool StringPieceStorage(uint32 v, FieldDescriptor::Type type) {
+    if (type == FieldDescriptor::TYPE_STRING ||
+        type == FieldDescriptor::TYPE_BYTES) {
+      return v & 2u;
+    } else {
+      return false;
+    }
+  }
+
+  static bool LazyStorage(uint32 v, FieldDescriptor::Type type) {
+    return type == FieldDescriptor::TYPE_MESSAGE && (v & 1u);
+  }
 };
 
 // Structs that the code generator emits directly to describe a message.
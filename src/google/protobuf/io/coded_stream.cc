@@ -910,7 +910,7 @@ uint8* EpsCopyOutputStream::WriteRawLittleEndian64(const void* data, int size,
 
 
 uint8* EpsCopyOutputStream::WriteStringMaybeAliasedOutline(uint32 num,
-                                                           const std::string& s,
+                                                           StringPiece s,
                                                            uint8* ptr) {
   ptr = EnsureSpace(ptr);
   uint32 size = s.size();
@@ -112,6 +112,7 @@
 
 #include <assert.h>
 
+#include <algorithm>
 #include <atomic>
 #include <climits>
 #include <cstddef>
@@ -651,7 +652,7 @@ class PROTOBUF_EXPORT CodedInputStream {
 // for the compiler to sync the ptr value between register and memory.
 class PROTOBUF_EXPORT EpsCopyOutputStream {
  public:
-  enum { kSlopBytes = 16 };
+  enum { kSlopBytes = 16, kMaxVarintBytes = 10 };
 
   // Initialize from a stream.
   EpsCopyOutputStream(ZeroCopyOutputStream* stream, bool deterministic,
@@ -713,6 +714,9 @@ class PROTOBUF_EXPORT EpsCopyOutputStream {
 
 
   uint8* WriteStringMaybeAliased(uint32 num, const std::string& s, uint8* ptr) {
+    return WriteStringMaybeAliased(num, StringPiece(s), ptr);
+  }
+  uint8* WriteStringMaybeAliased(uint32 num, StringPiece s, uint8* ptr) {
     std::ptrdiff_t size = s.size();
     if (PROTOBUF_PREDICT_FALSE(
             size >= 128 || end_ - ptr + 16 - TagSize(num << 3) - 1 < size)) {
@@ -726,6 +730,9 @@ class PROTOBUF_EXPORT EpsCopyOutputStream {
   uint8* WriteBytesMaybeAliased(uint32 num, const std::string& s, uint8* ptr) {
     return WriteStringMaybeAliased(num, s, ptr);
   }
+  uint8* WriteBytesMaybeAliased(uint32 num, StringPiece s, uint8* ptr) {
+    return WriteStringMaybeAliased(num, s, ptr);
+  }
 
   template <typename T>
   PROTOBUF_ALWAYS_INLINE uint8* WriteString(uint32 num, const T& s,
@@ -869,7 +876,7 @@ class PROTOBUF_EXPORT EpsCopyOutputStream {
 
   uint8* WriteAliasedRaw(const void* data, int size, uint8* ptr);
 
-  uint8* WriteStringMaybeAliasedOutline(uint32 num, const std::string& s,
+  uint8* WriteStringMaybeAliasedOutline(uint32 num, StringPiece s,
                                         uint8* ptr);
   uint8* WriteStringOutline(uint32 num, const std::string& s, uint8* ptr);
 
@@ -882,11 +889,45 @@ class PROTOBUF_EXPORT EpsCopyOutputStream {
     auto end = it + r.size();
     do {
       ptr = EnsureSpace(ptr);
-      ptr = UnsafeVarint(encode(*it++), ptr);
+      // No varint is longer than kMaxVarintBytes, so we know up front how
+      // many elements fit in the space that is left and can encode all of
+      // them without bounds checks.
+      auto n = (std::min)(end - it, GetSize(ptr) / kMaxVarintBytes);
+      ptr = UnsafeVarintRun(it, it + n, encode, ptr);
+      it += n;
     } while (it < end);
     return ptr;
   }
 
+  // Encodes the elements in [it, end). The caller must guarantee room for
+  // kMaxVarintBytes per element. Numeric arrays are dominated by small
+  // values, so groups that encode to a single byte per element are detected
+  // and narrowed with straight line code that the compiler can vectorize.
+  template <typename T, typename E>
+  PROTOBUF_ALWAYS_INLINE static uint8* UnsafeVarintRun(const T* it,
+                                                       const T* end,
+                                                       const E& encode,
+                                                       uint8* ptr) {
+    constexpr int kGroupSize = 8;
+    while (end - it >= kGroupSize) {
+      decltype(encode(*it)) bits = 0;
+      for (int i = 0; i < kGroupSize; i++) bits |= encode(it[i]);
+      if (bits < 0x80) {
+        for (int i = 0; i < kGroupSize; i++) {
+          ptr[i] = static_cast<uint8>(encode(it[i]));
+        }
+        ptr += kGroupSize;
+      } else {
+        for (int i = 0; i < kGroupSize; i++) {
+          ptr = UnsafeVarint(encode(it[i]), ptr);
+        }
+      }
+      it += kGroupSize;
+    }
+    while (it < end) ptr = UnsafeVarint(encode(*it++), ptr);
+    return ptr;
+  }
+
   static uint32 Encode32(uint32 v) { return v; }
   static uint64 Encode64(uint64 v) { return v; }
   static uint32 ZigZagEncode32(int32 v) {
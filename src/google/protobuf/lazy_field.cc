@@ -0,0 +1,203 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <google/protobuf/lazy_field.h>
+
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/parse_context.h>
+#include <google/protobuf/wire_format_lite.h>
+
+#include <google/protobuf/port_def.inc>
+
+namespace google {
+namespace protobuf {
+namespace internal {
+
+namespace {
+
+// Returns true if data is a sequence of well-formed fields: valid tags,
+// varints and lengths within bounds, and groups which are closed.  The
+// contents of length-delimited fields are not looked into.
+bool IsWellFormed(const char* data, size_t size) {
+  io::CodedInputStream input(reinterpret_cast<const uint8*>(data),
+                             static_cast<int>(size));
+  while (true) {
+    uint32 tag = input.ReadTag();
+    if (tag == 0) return input.ConsumedEntireMessage();
+    if (!WireFormatLite::SkipField(&input, tag)) return false;
+  }
+}
+
+}  // namespace
+
+const MessageLite& LazyField::GetSlow(const MessageLite& prototype) const {
+  if (unparsed_ == nullptr) return prototype;
+  MessageLite* message = prototype.New(arena_);
+  if (!message->ParsePartialFromString(*unparsed_)) {
+    // _InternalParse() only checked the fields of the message itself, those
+    // of its submessages may still be malformed.  There is no way to return
+    // an error from here, keep what parses.
+    GOOGLE_LOG(ERROR) << "Failed to parse lazy field of type "
+                      << prototype.GetTypeName()
+                      << ", keeping the fields which parsed.";
+  }
+  MessageLite* expected = nullptr;
+  if (!message_.compare_exchange_strong(expected, message,
+                                        std::memory_order_acq_rel)) {
+    // Another thread was first.
+    if (arena_ == nullptr) delete message;
+    return *expected;
+  }
+  return *message;
+}
+
+MessageLite* LazyField::Mutable(const MessageLite& prototype) {
+  MessageLite* message = message_.load(std::memory_order_relaxed);
+  if (message == nullptr) {
+    if (unparsed_ != nullptr) {
+      message = const_cast<MessageLite*>(&GetSlow(prototype));
+    } else {
+      message = prototype.New(arena_);
+      message_.store(message, std::memory_order_relaxed);
+    }
+  }
+  // The bytes would go stale once the message changes.
+  DropUnparsed();
+  return message;
+}
+
+MessageLite* LazyField::UnsafeArenaRelease(const MessageLite& prototype) {
+  if (IsCleared()) return nullptr;
+  MessageLite* message = Mutable(prototype);
+  message_.store(nullptr, std::memory_order_relaxed);
+  return message;
+}
+
+void LazyField::UnsafeArenaSetAllocated(MessageLite* message) {
+  Clear();
+  message_.store(message, std::memory_order_relaxed);
+}
+
+void LazyField::Clear() {
+  DropUnparsed();
+  DropMessage();
+}
+
+void LazyField::MergeFrom(const MessageLite& prototype,
+                          const LazyField& other) {
+  if (other.unparsed_ != nullptr &&
+      message_.load(std::memory_order_relaxed) == nullptr) {
+    // Merging two encoded messages is appending their bytes, so neither side
+    // has to be parsed.  Once the message exists callers may hold references
+    // to it, so it is merged into instead.
+    if (unparsed_ == nullptr) unparsed_ = Arena::Create<std::string>(arena_);
+    unparsed_->append(*other.unparsed_);
+    return;
+  }
+  Mutable(prototype)->CheckTypeAndMergeFrom(other.Get(prototype));
+}
+
+void LazyField::Swap(LazyField* other) {
+  GOOGLE_DCHECK(arena_ == other->arena_);
+  MessageLite* message = message_.load(std::memory_order_relaxed);
+  message_.store(other->message_.load(std::memory_order_relaxed),
+                 std::memory_order_relaxed);
+  other->message_.store(message, std::memory_order_relaxed);
+  std::swap(unparsed_, other->unparsed_);
+}
+
+void LazyField::Destroy() {
+  if (arena_ != nullptr) return;
+  delete message_.load(std::memory_order_relaxed);
+  delete unparsed_;
+}
+
+size_t LazyField::UnparsedSpaceUsedExcludingSelfLong() const {
+  if (unparsed_ == nullptr) return 0;
+  return sizeof(*unparsed_) + StringSpaceUsedExcludingSelfLong(*unparsed_);
+}
+
+size_t LazyField::ByteSizeLong() const {
+  if (unparsed_ != nullptr) return unparsed_->size();
+  const MessageLite* message = message_.load(std::memory_order_relaxed);
+  return message != nullptr ? message->ByteSizeLong() : 0;
+}
+
+int LazyField::GetCachedSize() const {
+  if (unparsed_ != nullptr) return static_cast<int>(unparsed_->size());
+  const MessageLite* message = message_.load(std::memory_order_relaxed);
+  return message != nullptr ? message->GetCachedSize() : 0;
+}
+
+uint8* LazyField::_InternalSerialize(uint8* target,
+                                     io::EpsCopyOutputStream* stream) const {
+  if (unparsed_ != nullptr) {
+    return stream->WriteRaw(unparsed_->data(),
+                            static_cast<int>(unparsed_->size()), target);
+  }
+  const MessageLite* message = message_.load(std::memory_order_relaxed);
+  if (message == nullptr) return target;
+  return message->_InternalSerialize(target, stream);
+}
+
+const char* LazyField::_InternalParse(const char* ptr, ParseContext* ctx) {
+  MessageLite* message = message_.load(std::memory_order_relaxed);
+  if (message != nullptr) {
+    // The message was read or mutated and may be referenced, the bytes have
+    // to be merged into it.
+    DropUnparsed();
+    return message->_InternalParse(ptr, ctx);
+  }
+  // Like MergeFrom(), keep the encoded messages appended to each other.
+  if (unparsed_ == nullptr) unparsed_ = Arena::Create<std::string>(arena_);
+  size_t start = unparsed_->size();
+  ptr = ctx->AppendString(ptr, unparsed_);
+  // Fail the parse of the containing message on bytes which are not a
+  // message at all, like it does for an eagerly parsed field.
+  if (ptr != nullptr &&
+      !IsWellFormed(unparsed_->data() + start, unparsed_->size() - start)) {
+    return nullptr;
+  }
+  return ptr;
+}
+
+void LazyField::DropUnparsed() {
+  if (arena_ == nullptr) delete unparsed_;
+  unparsed_ = nullptr;
+}
+
+void LazyField::DropMessage() {
+  if (arena_ == nullptr) delete message_.load(std::memory_order_relaxed);
+  message_.store(nullptr, std::memory_order_relaxed);
+}
+
+}  // namespace internal
+}  // namespace protobuf
+}  // namespace google
@@ -0,0 +1,153 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef GOOGLE_PROTOBUF_LAZY_FIELD_H__
+#define GOOGLE_PROTOBUF_LAZY_FIELD_H__
+
+#include <atomic>
+#include <string>
+
+#include <google/protobuf/stubs/logging.h>
+#include <google/protobuf/arena.h>
+#include <google/protobuf/message_lite.h>
+
+// Must be included last.
+#include <google/protobuf/port_def.inc>
+
+#ifdef SWIG
+#error "You cannot SWIG proto headers"
+#endif
+
+// This file is logically internal-only and should only be used by protobuf
+// generated code.
+
+namespace google {
+namespace protobuf {
+
+namespace io {
+class EpsCopyOutputStream;
+}  // namespace io
+
+namespace internal {
+
+class ParseContext;
+
+// LazyField is the storage of a singular message field declared with
+// [lazy = true] when the C++ code generator runs with the lazy_fields option.
+//
+// Parsing the containing message only copies the bytes of the submessage, and
+// checks that they are well-formed fields.  They are parsed the first time the
+// field is read, and dropped the first time the field is mutated or merged
+// into.  Until the field is read, serializing, merging or copying it copies
+// the bytes as they are.  Malformed submessages of the field are therefore
+// not noticed by the parse of the containing message; an error is logged when
+// the field is read, and it reads as whatever part of them parses.  Once the
+// field is read, merges go into the parsed message so references to it stay
+// valid.
+//
+// Reading the field is thread-safe like reading any other field: concurrent
+// first reads may all parse the bytes, but only one of the results is kept.
+//
+// The |prototype| arguments are the default instance of the field's type.
+class PROTOBUF_EXPORT LazyField {
+ public:
+  constexpr LazyField() : LazyField(nullptr) {}
+  explicit constexpr LazyField(Arena* arena)
+      : message_(nullptr), unparsed_(nullptr), arena_(arena) {}
+
+  // True if the field holds neither bytes nor a message.
+  bool IsCleared() const {
+    return unparsed_ == nullptr &&
+           message_.load(std::memory_order_relaxed) == nullptr;
+  }
+
+  // Returns the message, or |prototype| if the field is cleared.
+  const MessageLite& Get(const MessageLite& prototype) const {
+    const MessageLite* message = message_.load(std::memory_order_acquire);
+    if (PROTOBUF_PREDICT_TRUE(message != nullptr)) return *message;
+    return GetSlow(prototype);
+  }
+  MessageLite* Mutable(const MessageLite& prototype);
+
+  // Hands the message over to the caller, who is responsible for deleting it
+  // if the field is not on an arena.  Returns nullptr if the field is cleared.
+  MessageLite* UnsafeArenaRelease(const MessageLite& prototype);
+  // Frees the current value unless the field is on an arena, and takes
+  // |message|, which must live on the field's arena (or the heap if it has
+  // none).  |message| may be null.
+  void UnsafeArenaSetAllocated(MessageLite* message);
+
+  void Clear();
+  void MergeFrom(const MessageLite& prototype, const LazyField& other);
+  // Only valid for fields of messages on the same arena.
+  void Swap(LazyField* other);
+  // Frees the bytes and message unless they are on an arena.
+  void Destroy();
+
+  // The space used by the unparsed bytes.  Reflection adds the space used by
+  // the message, which it can measure.
+  size_t UnparsedSpaceUsedExcludingSelfLong() const;
+  // The message if it was parsed or set, nullptr otherwise.
+  const MessageLite* GetIfParsed() const {
+    return message_.load(std::memory_order_acquire);
+  }
+
+  // These let WireFormatLite::InternalWriteMessage() and MessageSize() write
+  // the field like a submessage.  The bytes are written as they were parsed.
+  size_t ByteSizeLong() const;
+  int GetCachedSize() const;
+  uint8* _InternalSerialize(uint8* target,
+                            io::EpsCopyOutputStream* stream) const;
+
+  // Called by ParseContext::ParseMessage() with the limit of the submessage
+  // pushed.
+  const char* _InternalParse(const char* ptr, ParseContext* ctx);
+
+ private:
+  const MessageLite& GetSlow(const MessageLite& prototype) const;
+  void DropUnparsed();
+  void DropMessage();
+
+  // The parsed message.  Written by const readers, see GetSlow().
+  mutable std::atomic<MessageLite*> message_;
+  // The encoded message.  If message_ is also set, both hold the same value.
+  std::string* unparsed_;
+  Arena* arena_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(LazyField);
+};
+
+}  // namespace internal
+}  // namespace protobuf
+}  // namespace google
+
+#include <google/protobuf/port_undef.inc>
+
+#endif  // GOOGLE_PROTOBUF_LAZY_FIELD_H__
@@ -30,12 +30,55 @@
 
 #include <google/protobuf/map.h>
 
+#include <algorithm>
+
 namespace google {
 namespace protobuf {
 namespace internal {
 
 void* const kGlobalEmptyTable[kGlobalEmptyTableSize] = {nullptr};
 
+void MapNodePool::NewBlock(size_t node_size, Arena* arena) {
+  // Blocks double the capacity until they are big enough that the allocation
+  // cost is negligible, so that few Nodes are wasted in small maps.
+  constexpr size_t kMinBlockNodes = 8;
+  constexpr size_t kMaxBlockNodes = 4096;
+  const size_t num_nodes =
+      std::min(std::max(capacity_, kMinBlockNodes), kMaxBlockNodes);
+  const size_t size = sizeof(Block) + num_nodes * node_size;
+  Block* block;
+  if (arena == nullptr) {
+    block = static_cast<Block*>(::operator new(size));
+  } else {
+    // The pool is part of the map, which the profiling hooks can attribute
+    // the block to.
+    block = reinterpret_cast<Block*>(
+        Arena::CreateArrayForContainer<char>(arena, this, size));
+  }
+  block->next = blocks_;
+  block->size = size;
+  blocks_ = block;
+  next_ = reinterpret_cast<char*>(block + 1);
+  end_ = next_ + num_nodes * node_size;
+  capacity_ += num_nodes;
+  space_used_ += size;
+}
+
+void MapNodePool::FreeBlocks() {
+  while (blocks_ != nullptr) {
+    Block* next = blocks_->next;
+#if defined(__GXX_DELETE_WITH_SIZE__) || defined(__cpp_sized_deallocation)
+    ::operator delete(blocks_, blocks_->size);
+#else
+    ::operator delete(blocks_);
+#endif
+    blocks_ = next;
+  }
+  free_ = nullptr;
+  next_ = end_ = nullptr;
+  capacity_ = space_used_ = 0;
+}
+
 }  // namespace internal
 }  // namespace protobuf
 }  // namespace google
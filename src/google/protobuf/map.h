@@ -37,6 +37,8 @@
 #ifndef GOOGLE_PROTOBUF_MAP_H__
 #define GOOGLE_PROTOBUF_MAP_H__
 
+#include <algorithm>
+#include <atomic>
 #include <functional>
 #include <initializer_list>
 #include <iterator>
@@ -56,6 +58,10 @@
 #include <google/protobuf/map_type_handler.h>
 #include <google/protobuf/stubs/hash.h>
 
+#if defined(PROTOBUF_MAP_SWISS_TABLE) && defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #ifdef SWIG
 #error "You cannot SWIG proto headers"
 #endif
@@ -324,6 +330,146 @@ size_t SpaceUsedInValues(const Map* map) {
 
 inline size_t SpaceUsedInValues(const void*) { return 0; }
 
+// Allocates the Nodes of maps with integer keys and scalar values.  Such
+// Nodes need no destructor, so instead of allocating them one by one they are
+// carved out of blocks that double in size, up to a limit, and erased Nodes
+// are kept on a free list for the next insert.  The blocks are freed together
+// when the map is destroyed, or with the arena.
+class PROTOBUF_EXPORT MapNodePool {
+ public:
+  constexpr MapNodePool()
+      : free_(nullptr),
+        next_(nullptr),
+        end_(nullptr),
+        blocks_(nullptr),
+        capacity_(0),
+        space_used_(0) {}
+
+  // The size of a pooled Node: a free Node holds the free list link, and
+  // Nodes are 8-byte aligned in their block.
+  static constexpr size_t NodeSize(size_t size) {
+    return ((size < sizeof(void*) ? sizeof(void*) : size) + 7) & ~size_t{7};
+  }
+
+  void* NewNode(size_t node_size, Arena* arena) {
+    if (free_ != nullptr) {
+      void* node = free_;
+      free_ = *static_cast<void**>(node);
+      return node;
+    }
+    if (PROTOBUF_PREDICT_FALSE(next_ == end_)) NewBlock(node_size, arena);
+    void* node = next_;
+    next_ += node_size;
+    return node;
+  }
+
+  void DeleteNode(void* node) {
+    *static_cast<void**>(node) = free_;
+    free_ = node;
+  }
+
+  // Frees all the blocks.  Only for pools not on an arena.
+  void FreeBlocks();
+
+  void SwapPool(MapNodePool* other) {
+    std::swap(free_, other->free_);
+    std::swap(next_, other->next_);
+    std::swap(end_, other->end_);
+    std::swap(blocks_, other->blocks_);
+    std::swap(capacity_, other->capacity_);
+    std::swap(space_used_, other->space_used_);
+  }
+
+  size_t PoolSpaceUsed() const { return space_used_; }
+
+ private:
+  struct Block {
+    Block* next;
+    size_t size;
+  };
+
+  void NewBlock(size_t node_size, Arena* arena);
+
+  void* free_;
+  char* next_;  // the unused part of the current block
+  char* end_;
+  Block* blocks_;
+  size_t capacity_;  // in Nodes, of all blocks
+  size_t space_used_;
+};
+
+// Stands in for MapNodePool in maps that allocate each Node.
+class MapNoNodePool {
+ public:
+  void* NewNode(size_t, Arena*) { return nullptr; }
+  void DeleteNode(void*) {}
+  void FreeBlocks() {}
+  void SwapPool(MapNoNodePool*) {}
+  size_t PoolSpaceUsed() const { return 0; }
+};
+
+#ifdef PROTOBUF_MAP_SWISS_TABLE
+// Control bytes of the Swiss table InnerMap, one per slot.  A full slot holds
+// the 7 low bits of its hash, so the sign bit is set only for free slots.
+enum : int8 {
+  kMapCtrlEmpty = -128,   // 0b10000000
+  kMapCtrlDeleted = -2,   // 0b11111110
+};
+
+// A run of kWidth consecutive control bytes, matched all at once.  The Match*
+// methods return a bit mask in which bit i stands for the i-th byte.
+class MapCtrlGroup {
+ public:
+#if defined(__SSE2__)
+  enum { kWidth = 16 };
+
+  explicit MapCtrlGroup(const int8* ctrl)
+      : ctrl_(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl))) {}
+
+  uint32 Match(int8 h2) const {
+    return static_cast<uint32>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl_)));
+  }
+  uint32 MatchEmptyOrDeleted() const {
+    return static_cast<uint32>(_mm_movemask_epi8(ctrl_));
+  }
+
+ private:
+  __m128i ctrl_;
+#else   // defined(__SSE2__)
+  enum { kWidth = 8 };
+
+  explicit MapCtrlGroup(const int8* ctrl) : ctrl_(ctrl) {}
+
+  uint32 Match(int8 h2) const {
+    uint32 mask = 0;
+    for (int i = 0; i < kWidth; i++) {
+      mask |= static_cast<uint32>(ctrl_[i] == h2) << i;
+    }
+    return mask;
+  }
+  uint32 MatchEmptyOrDeleted() const {
+    uint32 mask = 0;
+    for (int i = 0; i < kWidth; i++) {
+      mask |= static_cast<uint32>(ctrl_[i] < 0) << i;
+    }
+    return mask;
+  }
+
+ private:
+  const int8* ctrl_;
+#endif  // !defined(__SSE2__)
+
+ public:
+  uint32 MatchEmpty() const { return Match(kMapCtrlEmpty); }
+
+  // Returns the index of the lowest bit set in a non-zero mask.
+  static int LowestBit(uint32 mask) {
+    return static_cast<int>(Bits::Log2FloorNonZero(mask & (~mask + 1)));
+  }
+};
+#endif  // PROTOBUF_MAP_SWISS_TABLE
+
 }  // namespace internal
 
 // This is the class for Map's internal value_type. Instead of using
@@ -380,8 +526,8 @@ class Map {
   using size_type = size_t;
   using hasher = typename internal::TransparentSupport<Key>::hash;
 
-  Map() : elements_(nullptr) {}
-  explicit Map(Arena* arena) : elements_(arena) {}
+  Map() : elements_(nullptr), sorted_items_(0) {}
+  explicit Map(Arena* arena) : elements_(arena), sorted_items_(0) {}
 
   Map(const Map& other) : Map() { insert(other.begin(), other.end()); }
 
@@ -409,11 +555,435 @@ class Map {
     insert(first, last);
   }
 
-  ~Map() {}
+  ~Map() {
+    if (arena() == nullptr) {
+      FreeSortedItems(
+          UntagSortedItems(sorted_items_.load(std::memory_order_relaxed)));
+    }
+  }
 
  private:
   using Allocator = internal::MapAllocator<void*>;
 
+  // Integer keys and scalar values need no destructor, so their Nodes come from
+  // a pool (see internal::MapNodePool).
+  static constexpr bool kPooledNodes =
+      std::is_integral<Key>::value && std::is_scalar<T>::value;
+  using NodePool =
+      typename std::conditional<kPooledNodes, internal::MapNodePool,
+                                internal::MapNoNodePool>::type;
+
+#ifdef PROTOBUF_MAP_SWISS_TABLE
+  // InnerMap is a generic hash-based map.  It doesn't contain any
+  // protocol-buffer-specific logic.  This is the open addressing version,
+  // used when PROTOBUF_MAP_SWISS_TABLE is defined for the whole program,
+  // including libprotobuf (see the protobuf_MAP_SWISS_TABLE CMake option).
+  // Some implementation details:
+  // 1. The table is an array of slots, each pointing to a Node, plus an array
+  //    of one control byte per slot: empty, deleted, or the 7 low bits of the
+  //    hash of the key in the slot (internal::MapCtrlGroup).
+  // 2. A lookup starts at the slot chosen by the other hash bits, and checks
+  //    the control bytes of a whole group of slots at once, with SSE2 if
+  //    available.  Only slots whose control byte matches have their key
+  //    compared, so most lookups touch one cache line of control bytes and
+  //    one Node.  Groups are probed in triangular order until one has an
+  //    empty slot.
+  // 3. The number of slots is a power of two, at least one group, and at most
+  //    7/8 of them are used.  The first kWidth - 1 control bytes are repeated
+  //    after the last one, so that a group can start at any slot.
+  // 4. As in the chaining version, the Keys and Values are stored in Nodes, so
+  //    that pointers and references to elements are never invalidated until
+  //    the element is deleted, and a rehash only moves pointers.
+  // 5. Mutations to a map do not invalidate the map's iterators, pointers to
+  //    elements, or references to elements.
+  // 6. Except for erase(iterator), any non-const method can reorder iterators.
+  class InnerMap : private hasher, private NodePool {
+   public:
+    explicit InnerMap(Arena* arena)
+        : hasher(),
+          NodePool(),
+          num_elements_(0),
+          num_slots_(0),
+          growth_left_(0),
+          seed_(Seed()),
+          slots_(nullptr),
+          ctrl_(nullptr),
+          alloc_(arena) {}
+
+    ~InnerMap() {
+      if (alloc_.arena() == nullptr) {
+        if (num_slots_ != 0) {
+          clear();
+          DeallocTable(slots_, ctrl_, num_slots_);
+        }
+        NodePool::FreeBlocks();
+      }
+    }
+
+   private:
+    enum { kWidth = internal::MapCtrlGroup::kWidth };
+
+    struct Node {
+      value_type kv;
+    };
+    static constexpr size_t kPooledNodeSize =
+        internal::MapNodePool::NodeSize(sizeof(Node));
+
+    // iterator and const_iterator are instantiations of iterator_base.
+    template <typename KeyValueType>
+    class iterator_base {
+     public:
+      using reference = KeyValueType&;
+      using pointer = KeyValueType*;
+
+      // Invariants:
+      // node_ is always correct.  slot_index_ is where node_ was when the
+      // iterator was last moved, and is checked, and updated if necessary,
+      // when the map may have been modified since.
+      iterator_base() : node_(nullptr), m_(nullptr), slot_index_(0) {}
+
+      explicit iterator_base(const InnerMap* m) : m_(m) { SearchFrom(0); }
+
+      // Any iterator_base can convert to any other.  This is overkill, and we
+      // rely on the enclosing class to use it wisely.  The standard "iterator
+      // can convert to const_iterator" is OK but the reverse direction is not.
+      template <typename U>
+      explicit iterator_base(const iterator_base<U>& it)
+          : node_(it.node_), m_(it.m_), slot_index_(it.slot_index_) {}
+
+      iterator_base(Node* n, const InnerMap* m, size_type index)
+          : node_(n), m_(m), slot_index_(index) {}
+
+      // Advance through slots, looking for the first full one.
+      // If nothing is found then leave node_ == nullptr.
+      void SearchFrom(size_type start_slot) {
+        node_ = nullptr;
+        for (slot_index_ = start_slot; slot_index_ < m_->num_slots_;
+             slot_index_++) {
+          if (m_->ctrl_[slot_index_] >= 0) {
+            node_ = static_cast<Node*>(m_->slots_[slot_index_]);
+            break;
+          }
+        }
+      }
+
+      reference operator*() const { return node_->kv; }
+      pointer operator->() const { return &(operator*()); }
+
+      friend bool operator==(const iterator_base& a, const iterator_base& b) {
+        return a.node_ == b.node_;
+      }
+      friend bool operator!=(const iterator_base& a, const iterator_base& b) {
+        return a.node_ != b.node_;
+      }
+
+      iterator_base& operator++() {
+        revalidate_if_necessary();
+        SearchFrom(slot_index_ + 1);
+        return *this;
+      }
+
+      iterator_base operator++(int /* unused */) {
+        iterator_base tmp = *this;
+        ++*this;
+        return tmp;
+      }
+
+      // Assumes node_ and m_ are correct and non-null, but slot_index_ may be
+      // stale after a rehash.  Fix it if needed.
+      void revalidate_if_necessary() {
+        GOOGLE_DCHECK(node_ != nullptr && m_ != nullptr);
+        if (slot_index_ < m_->num_slots_ && m_->ctrl_[slot_index_] >= 0 &&
+            m_->slots_[slot_index_] == static_cast<void*>(node_)) {
+          return;
+        }
+        slot_index_ = m_->FindSlot(node_->kv.first);
+        GOOGLE_DCHECK(m_->slots_[slot_index_] == static_cast<void*>(node_));
+      }
+
+      Node* node_;
+      const InnerMap* m_;
+      size_type slot_index_;
+    };
+
+   public:
+    using iterator = iterator_base<value_type>;
+    using const_iterator = iterator_base<const value_type>;
+
+    Arena* arena() const { return alloc_.arena(); }
+
+    void Swap(InnerMap* other) {
+      std::swap(num_elements_, other->num_elements_);
+      std::swap(num_slots_, other->num_slots_);
+      std::swap(growth_left_, other->growth_left_);
+      std::swap(seed_, other->seed_);
+      std::swap(slots_, other->slots_);
+      std::swap(ctrl_, other->ctrl_);
+      std::swap(alloc_, other->alloc_);
+      NodePool::SwapPool(other);
+    }
+
+    iterator begin() { return iterator(this); }
+    iterator end() { return iterator(); }
+    const_iterator begin() const { return const_iterator(this); }
+    const_iterator end() const { return const_iterator(); }
+
+    void clear() {
+      if (num_slots_ == 0) return;
+      for (size_type i = 0; i < num_slots_; i++) {
+        if (ctrl_[i] >= 0) DestroyNode(static_cast<Node*>(slots_[i]));
+      }
+      memset(ctrl_, internal::kMapCtrlEmpty, num_slots_ + kWidth);
+      num_elements_ = 0;
+      growth_left_ = MaxLoad(num_slots_);
+    }
+
+    const hasher& hash_function() const { return *this; }
+
+    static size_type max_size() {
+      return static_cast<size_type>(1) << (sizeof(void**) >= 8 ? 60 : 28);
+    }
+    size_type size() const { return num_elements_; }
+    bool empty() const { return size() == 0; }
+
+    template <typename K>
+    iterator find(const K& k) {
+      return iterator(FindHelper(k));
+    }
+
+    template <typename K>
+    const_iterator find(const K& k) const {
+      return FindHelper(k);
+    }
+
+    // Insert the key into the map, if not present. In that case, the value will
+    // be value initialized.
+    std::pair<iterator, bool> insert(const Key& k) {
+      const_iterator it = FindHelper(k);
+      // Case 1: key was already present.
+      if (it.node_ != nullptr) return std::make_pair(iterator(it), false);
+      // Case 2: insert.
+      Node* node;
+      if (kPooledNodes) {
+        node = new (NodePool::NewNode(kPooledNodeSize, alloc_.arena()))
+            Node{value_type(k)};
+      } else if (alloc_.arena() == nullptr) {
+        node = new Node{value_type(k)};
+      } else {
+        node = Alloc<Node>(1);
+        Arena::CreateInArenaStorage(const_cast<Key*>(&node->kv.first),
+                                    alloc_.arena(), k);
+        Arena::CreateInArenaStorage(&node->kv.second, alloc_.arena());
+      }
+      size_type index = InsertUnique(Hash(k), node);
+      ++num_elements_;
+      return std::make_pair(iterator(node, this, index), true);
+    }
+
+    value_type& operator[](const Key& k) { return *insert(k).first; }
+
+    void erase(iterator it) {
+      GOOGLE_DCHECK_EQ(it.m_, this);
+      it.revalidate_if_necessary();
+      // The slot may be in the middle of a probe sequence, so it can only be
+      // reused by inserts, not marked empty.
+      SetCtrl(it.slot_index_, internal::kMapCtrlDeleted);
+      DestroyNode(it.node_);
+      --num_elements_;
+    }
+
+    size_t SpaceUsedInternal() const {
+      size_t size = NodePool::PoolSpaceUsed();
+      if (num_slots_ == 0) return size;
+      size += num_slots_ * sizeof(void*) + num_slots_ + kWidth;
+      if (!kPooledNodes) size += num_elements_ * sizeof(Node);
+      return size;
+    }
+
+   private:
+    template <typename K>
+    const_iterator FindHelper(const K& k) const {
+      if (num_slots_ == 0) return end();
+      uint64 hash = Hash(k);
+      const int8 h2 = H2(hash);
+      const size_type mask = num_slots_ - 1;
+      size_type offset = H1(hash) & mask;
+      for (size_type step = kWidth;; step += kWidth) {
+        internal::MapCtrlGroup group(ctrl_ + offset);
+        for (uint32 match = group.Match(h2); match != 0; match &= match - 1) {
+          size_type index =
+              (offset + internal::MapCtrlGroup::LowestBit(match)) & mask;
+          Node* node = static_cast<Node*>(slots_[index]);
+          if (internal::TransparentSupport<Key>::Equals(node->kv.first, k)) {
+            return const_iterator(node, this, index);
+          }
+        }
+        if (group.MatchEmpty() != 0) return end();
+        offset = (offset + step) & mask;
+        GOOGLE_DCHECK_LE(step, num_slots_);
+      }
+    }
+
+    // Returns the slot of a key known to be present.
+    size_type FindSlot(const Key& k) const {
+      const_iterator it = FindHelper(k);
+      GOOGLE_DCHECK(it.node_ != nullptr);
+      return it.slot_index_;
+    }
+
+    // Puts node, whose key is not in the map, in the first free slot of the
+    // probe sequence of hash, growing the table first if needed.
+    // num_elements_ is not modified.  Returns the slot used.
+    size_type InsertUnique(uint64 hash, Node* node) {
+      if (PROTOBUF_PREDICT_FALSE(num_slots_ == 0)) AllocTable(kMinTableSize);
+      size_type index = FindFirstFree(hash);
+      if (PROTOBUF_PREDICT_FALSE(growth_left_ == 0 &&
+                                 ctrl_[index] != internal::kMapCtrlDeleted)) {
+        Rehash();
+        index = FindFirstFree(hash);
+      }
+      if (ctrl_[index] == internal::kMapCtrlEmpty) --growth_left_;
+      SetCtrl(index, H2(hash));
+      slots_[index] = static_cast<void*>(node);
+      return index;
+    }
+
+    size_type FindFirstFree(uint64 hash) const {
+      const size_type mask = num_slots_ - 1;
+      size_type offset = H1(hash) & mask;
+      for (size_type step = kWidth;; step += kWidth) {
+        uint32 free =
+            internal::MapCtrlGroup(ctrl_ + offset).MatchEmptyOrDeleted();
+        if (free != 0) {
+          return (offset + internal::MapCtrlGroup::LowestBit(free)) & mask;
+        }
+        offset = (offset + step) & mask;
+        GOOGLE_DCHECK_LE(step, num_slots_);
+      }
+    }
+
+    // Makes room for one more element.  Rehashing drops the deleted slots, so
+    // the table is only doubled if it would otherwise stay over half full.
+    // Nodes are not moved.
+    void Rehash() {
+      size_type new_num_slots = num_slots_;
+      if (num_elements_ + 1 > MaxLoad(num_slots_) / 2) {
+        GOOGLE_CHECK_LE(num_slots_, max_size() / 2);
+        new_num_slots *= 2;
+      }
+      void** const old_slots = slots_;
+      int8* const old_ctrl = ctrl_;
+      const size_type old_num_slots = num_slots_;
+      AllocTable(new_num_slots);
+      for (size_type i = 0; i < old_num_slots; i++) {
+        if (old_ctrl[i] >= 0) {
+          Node* node = static_cast<Node*>(old_slots[i]);
+          InsertUnique(Hash(node->kv.first), node);
+        }
+      }
+      DeallocTable(old_slots, old_ctrl, old_num_slots);
+    }
+
+    void AllocTable(size_type n) {
+      GOOGLE_DCHECK(n >= kMinTableSize);
+      GOOGLE_DCHECK_EQ(n & (n - 1), 0);
+      num_slots_ = n;
+      slots_ = Alloc<void*>(n);
+      ctrl_ = Alloc<int8>(n + kWidth);
+      memset(ctrl_, internal::kMapCtrlEmpty, n + kWidth);
+      growth_left_ = MaxLoad(n);
+    }
+
+    void DeallocTable(void** slots, int8* ctrl, size_type n) {
+      Dealloc<void*>(slots, n);
+      Dealloc<int8>(ctrl, n + kWidth);
+    }
+
+    // Sets the control byte of slot i, and its copy past the end if any.
+    void SetCtrl(size_type i, int8 h) {
+      ctrl_[i] = h;
+      if (i < kWidth - 1) ctrl_[num_slots_ + i] = h;
+    }
+
+    static size_type MaxLoad(size_type num_slots) {
+      return num_slots - num_slots / 8;
+    }
+
+    template <typename K>
+    uint64 Hash(const K& k) const {
+      // We xor the hash value against the random seed so that we effectively
+      // have a random hash function, and mix it with the multiplication
+      // method, so that both the low bits (H2) and the bits above them (H1)
+      // depend on the whole hash.  The constant kPhi (suggested by Knuth) is
+      // roughly (sqrt(5) - 1) / 2 * 2^64.
+      constexpr uint64 kPhi = uint64{0x9e3779b97f4a7c15};
+      uint64 h = (hash_function()(k) ^ seed_) * kPhi;
+      return h ^ (h >> 32);
+    }
+    static size_type H1(uint64 hash) {
+      return static_cast<size_type>(hash >> 7);
+    }
+    static int8 H2(uint64 hash) { return static_cast<int8>(hash & 0x7f); }
+
+    // Use alloc_ to allocate an array of n objects of type U.
+    template <typename U>
+    U* Alloc(size_type n) {
+      if (alloc_.arena() != nullptr) {
+        return reinterpret_cast<U*>(Arena::CreateArrayForContainer<uint8>(
+            alloc_.arena(), this, n * sizeof(U)));
+      }
+      using alloc_type = typename Allocator::template rebind<U>::other;
+      return alloc_type(alloc_).allocate(n);
+    }
+
+    // Use alloc_ to deallocate an array of n objects of type U.
+    template <typename U>
+    void Dealloc(U* t, size_type n) {
+      using alloc_type = typename Allocator::template rebind<U>::other;
+      alloc_type(alloc_).deallocate(t, n);
+    }
+
+    void DestroyNode(Node* node) {
+      if (kPooledNodes) {
+        NodePool::DeleteNode(node);
+      } else if (alloc_.arena() == nullptr) {
+        delete node;
+      }
+    }
+
+    // Return a randomish value.
+    size_type Seed() const {
+      // We get a little bit of randomness from the address of the map. The
+      // lower bits are not very random, due to alignment, so we discard them
+      // and shift the higher bits into their place.
+      size_type s = reinterpret_cast<uintptr_t>(this) >> 12;
+#if defined(__x86_64__) && defined(__GNUC__) && \
+    !defined(GOOGLE_PROTOBUF_NO_RDTSC)
+      uint32 hi, lo;
+      asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+      s += ((static_cast<uint64>(hi) << 32) | lo);
+#endif
+      return s;
+    }
+
+    enum { kMinTableSize = kWidth };
+
+    friend class Arena;
+    using InternalArenaConstructable_ = void;
+    using DestructorSkippable_ = void;
+
+    size_type num_elements_;
+    size_type num_slots_;
+    // How many more elements fit before the table has to be rehashed.
+    // Deleted slots do not give it back.
+    size_type growth_left_;
+    size_type seed_;
+    void** slots_;  // an array with num_slots_ entries
+    int8* ctrl_;    // an array with num_slots_ + kWidth entries
+    Allocator alloc_;
+    GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(InnerMap);
+  };  // end of class InnerMap
+#else   // PROTOBUF_MAP_SWISS_TABLE
   // InnerMap is a generic hash-based map.  It doesn't contain any
   // protocol-buffer-specific logic.  It is a chaining hash map with the
   // additional feature that some buckets can be converted to use an ordered
@@ -446,10 +1016,11 @@ class Map {
   // 10. InnerMap uses KeyForTree<Key> when using the Tree representation, which
   //    is either `Key`, if Key is a scalar, or `reference_wrapper<const Key>`
   //    otherwise. This avoids unnecessary copies of string keys, for example.
-  class InnerMap : private hasher {
+  class InnerMap : private hasher, private NodePool {
    public:
     explicit InnerMap(Arena* arena)
         : hasher(),
+          NodePool(),
           num_elements_(0),
           num_buckets_(internal::kGlobalEmptyTableSize),
           seed_(Seed()),
@@ -458,10 +1029,12 @@ class Map {
           alloc_(arena) {}
 
     ~InnerMap() {
-      if (alloc_.arena() == nullptr &&
-          num_buckets_ != internal::kGlobalEmptyTableSize) {
-        clear();
-        Dealloc<void*>(table_, num_buckets_);
+      if (alloc_.arena() == nullptr) {
+        if (num_buckets_ != internal::kGlobalEmptyTableSize) {
+          clear();
+          Dealloc<void*>(table_, num_buckets_);
+        }
+        NodePool::FreeBlocks();
       }
     }
 
@@ -473,6 +1046,8 @@ class Map {
       value_type kv;
       Node* next;
     };
+    static constexpr size_t kPooledNodeSize =
+        internal::MapNodePool::NodeSize(sizeof(Node));
 
     // Trees. The payload type is a copy of Key, so that we can query the tree
     // with Keys that are not in any particular data structure.
@@ -627,6 +1202,7 @@ class Map {
       std::swap(index_of_first_non_null_, other->index_of_first_non_null_);
       std::swap(table_, other->table_);
       std::swap(alloc_, other->alloc_);
+      NodePool::SwapPool(other);
     }
 
     iterator begin() { return iterator(this); }
@@ -696,7 +1272,10 @@ class Map {
       }
       const size_type b = p.second;  // bucket number
       Node* node;
-      if (alloc_.arena() == nullptr) {
+      if (kPooledNodes) {
+        node = new (NodePool::NewNode(kPooledNodeSize, alloc_.arena()))
+            Node{value_type(k), nullptr};
+      } else if (alloc_.arena() == nullptr) {
         node = new Node{value_type(k), nullptr};
       } else {
         node = Alloc<Node>(1);
@@ -746,8 +1325,10 @@ class Map {
     }
 
     size_t SpaceUsedInternal() const {
-      return internal::SpaceUsedInTable<Key>(table_, num_buckets_,
-                                             num_elements_, sizeof(Node));
+      return internal::SpaceUsedInTable<Key>(
+                 table_, num_buckets_, kPooledNodes ? 0 : num_elements_,
+                 sizeof(Node)) +
+             NodePool::PoolSpaceUsed();
     }
 
    private:
@@ -1033,6 +1614,10 @@ class Map {
     // Use alloc_ to allocate an array of n objects of type U.
     template <typename U>
     U* Alloc(size_type n) {
+      if (alloc_.arena() != nullptr) {
+        return reinterpret_cast<U*>(Arena::CreateArrayForContainer<uint8>(
+            alloc_.arena(), this, n * sizeof(U)));
+      }
       using alloc_type = typename Allocator::template rebind<U>::other;
       return alloc_type(alloc_).allocate(n);
     }
@@ -1045,7 +1630,9 @@ class Map {
     }
 
     void DestroyNode(Node* node) {
-      if (alloc_.arena() == nullptr) {
+      if (kPooledNodes) {
+        NodePool::DeleteNode(node);
+      } else if (alloc_.arena() == nullptr) {
         delete node;
       }
     }
@@ -1091,6 +1678,7 @@ class Map {
     Allocator alloc_;
     GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(InnerMap);
   };  // end of class InnerMap
+#endif  // !PROTOBUF_MAP_SWISS_TABLE
 
   template <typename LookupKey>
   using key_arg = typename internal::TransparentSupport<
@@ -1183,7 +1771,11 @@ class Map {
   bool empty() const { return size() == 0; }
 
   // Element access
-  T& operator[](const key_type& key) { return elements_[key].second; }
+  T& operator[](const key_type& key) {
+    std::pair<typename InnerMap::iterator, bool> p = elements_.insert(key);
+    if (p.second) InvalidateSortedItems();
+    return p.first->second;
+  }
 
   template <typename K = key_type>
   const T& at(const key_arg<K>& key) const {
@@ -1247,6 +1839,7 @@ class Map {
     std::pair<typename InnerMap::iterator, bool> p =
         elements_.insert(value.first);
     if (p.second) {
+      InvalidateSortedItems();
       p.first->second = value.second;
     }
     return std::pair<iterator, bool>(iterator(p.first), p.second);
@@ -1276,6 +1869,7 @@ class Map {
     }
   }
   iterator erase(iterator pos) {
+    InvalidateSortedItems();
     iterator i = pos++;
     elements_.erase(i.it_);
     return pos;
@@ -1285,7 +1879,10 @@ class Map {
       first = erase(first);
     }
   }
-  void clear() { elements_.clear(); }
+  void clear() {
+    InvalidateSortedItems();
+    elements_.clear();
+  }
 
   // Assign
   Map& operator=(const Map& other) {
@@ -1299,6 +1896,10 @@ class Map {
   void swap(Map& other) {
     if (arena() == other.arena()) {
       elements_.Swap(&other.elements_);
+      uintptr_t sorted = sorted_items_.load(std::memory_order_relaxed);
+      sorted_items_.store(other.sorted_items_.load(std::memory_order_relaxed),
+                          std::memory_order_relaxed);
+      other.sorted_items_.store(sorted, std::memory_order_relaxed);
     } else {
       // TODO(zuguang): optimize this. The temporary copy can be allocated
       // in the same arena as the other message, and the "other = copy" can
@@ -1315,12 +1916,122 @@ class Map {
 
   size_t SpaceUsedExcludingSelfLong() const {
     if (empty()) return 0;
-    return elements_.SpaceUsedInternal() + internal::SpaceUsedInValues(this);
+    size_t size =
+        elements_.SpaceUsedInternal() + internal::SpaceUsedInValues(this);
+    SortedItems* sorted =
+        UntagSortedItems(sorted_items_.load(std::memory_order_acquire));
+    if (sorted != nullptr) size += SortedItemsSize(sorted->capacity);
+    return size;
+  }
+
+  // For internal use by generated code: returns the size() elements sorted by
+  // key, for deterministic serialization.  The order is kept until the set of
+  // keys changes, so serializing an unchanged map again does not sort it.
+  // Like other const methods, this can be called from several threads.
+  const const_pointer* InternalSortedItems() const {
+    uintptr_t sorted = sorted_items_.load(std::memory_order_acquire);
+    if (PROTOBUF_PREDICT_FALSE(sorted == 0 || (sorted & kStaleSortedItems))) {
+      return SortItems()->items;
+    }
+    return reinterpret_cast<SortedItems*>(sorted)->items;
   }
 
  private:
   Arena* arena() const { return elements_.arena(); }
+
+  struct SortedItems {
+    size_type capacity;
+    const_pointer items[1];  // capacity entries, the first size() are used
+  };
+
+  // sorted_items_ holds a SortedItems*, tagged with kStaleSortedItems once the
+  // set of keys has changed.  The stale array is refilled by the next
+  // SortItems() if it is large enough, so a map on an arena does not leave an
+  // array behind each time its keys change.
+  static constexpr uintptr_t kStaleSortedItems = 1;
+
+  static SortedItems* UntagSortedItems(uintptr_t sorted) {
+    return reinterpret_cast<SortedItems*>(sorted & ~kStaleSortedItems);
+  }
+
+  static size_t SortedItemsSize(size_type n) {
+    return sizeof(SortedItems) +
+           (n > 0 ? n - 1 : 0) * sizeof(const_pointer);
+  }
+
+  PROTOBUF_NOINLINE SortedItems* SortItems() const {
+    const size_type n = size();
+    SortedItems* sorted = nullptr;
+    size_type capacity = n;
+    uintptr_t current = sorted_items_.load(std::memory_order_acquire);
+    if (current & kStaleSortedItems) {
+      // Take the stale array.  Only one reader can, the others see 0 below and
+      // sort into an array of their own.
+      if (sorted_items_.compare_exchange_strong(current, 0,
+                                                std::memory_order_acquire)) {
+        sorted = UntagSortedItems(current);
+        if (sorted->capacity < n) {
+          // Grow geometrically, so that on an arena a growing map abandons
+          // O(n) bytes in total rather than on every change.
+          capacity = std::max(n, 2 * sorted->capacity);
+          FreeSortedItems(sorted);
+          sorted = nullptr;
+        }
+      } else if (current != 0) {
+        return reinterpret_cast<SortedItems*>(current);
+      }
+    } else if (current != 0) {
+      return reinterpret_cast<SortedItems*>(current);
+    }
+    if (sorted == nullptr) {
+      if (arena() == nullptr) {
+        sorted = static_cast<SortedItems*>(
+            ::operator new(SortedItemsSize(capacity)));
+      } else {
+        sorted = reinterpret_cast<SortedItems*>(
+            Arena::CreateArrayForContainer<char>(arena(), this,
+                                                 SortedItemsSize(capacity)));
+      }
+      sorted->capacity = capacity;
+    }
+    const_pointer* items = sorted->items;
+    for (const_iterator it = begin(); it != end(); ++it) *items++ = &*it;
+    std::sort(sorted->items, items, [](const_pointer a, const_pointer b) {
+      return a->first < b->first;
+    });
+    uintptr_t expected = 0;
+    if (!sorted_items_.compare_exchange_strong(
+            expected, reinterpret_cast<uintptr_t>(sorted),
+            std::memory_order_acq_rel)) {
+      // Another thread was first.
+      FreeSortedItems(sorted);
+      return reinterpret_cast<SortedItems*>(expected);
+    }
+    return sorted;
+  }
+
+  // Called before and after any change to the set of keys.  No const reader
+  // can run concurrently, so the array is only marked stale.
+  void InvalidateSortedItems() {
+    uintptr_t sorted = sorted_items_.load(std::memory_order_relaxed);
+    if (PROTOBUF_PREDICT_FALSE(sorted != 0)) {
+      sorted_items_.store(sorted | kStaleSortedItems,
+                          std::memory_order_relaxed);
+    }
+  }
+
+  void FreeSortedItems(SortedItems* sorted) const {
+    if (sorted == nullptr || arena() != nullptr) return;
+#if defined(__GXX_DELETE_WITH_SIZE__) || defined(__cpp_sized_deallocation)
+    ::operator delete(sorted, SortedItemsSize(sorted->capacity));
+#else
+    ::operator delete(sorted);
+#endif
+  }
+
   InnerMap elements_;
+  // Written by const readers, see SortItems().
+  mutable std::atomic<uintptr_t> sorted_items_;
 
   friend class Arena;
   using InternalArenaConstructable_ = void;
@@ -982,7 +982,43 @@ TEST_F(MapImplTest, CopyAssignMapIterator) {
 }
 
 TEST_F(MapImplTest, SpaceUsed) {
+#ifdef PROTOBUF_MAP_SWISS_TABLE
+  // A slot pointer and a control byte per slot, the copied control bytes, and
+  // nodes without a next pointer.
+  constexpr size_t kMinCap = internal::MapCtrlGroup::kWidth;
+  auto table_size = [](size_t capacity) {
+    return (sizeof(void*) + 1) * capacity + internal::MapCtrlGroup::kWidth;
+  };
+  auto node_size = [](size_t node_value_size) { return node_value_size; };
+  // At most 7/8 of the slots are used.
+  auto must_grow = [](size_t size, size_t capacity) {
+    return size > capacity - capacity / 8;
+  };
+#else
   constexpr size_t kMinCap = 8;
+  auto table_size = [](size_t capacity) { return sizeof(void*) * capacity; };
+  auto node_size = [](size_t node_value_size) {
+    return node_value_size + sizeof(void*);
+  };
+  auto must_grow = [](size_t size, size_t capacity) {
+    static constexpr double kMaxLoadFactor = .75;
+    return size >= capacity * kMaxLoadFactor;
+  };
+#endif
+
+  // Integer keys and scalar values take their nodes from blocks that double
+  // in size, each with a two pointer header.
+  auto pool_size = [&](size_t num_nodes) {
+    const size_t kNodeSize = node_size(sizeof(std::pair<int32, int32>));
+    size_t capacity = 0;
+    size_t size = 0;
+    while (capacity < num_nodes) {
+      size_t block_nodes = std::max<size_t>(8, capacity);
+      capacity += block_nodes;
+      size += 2 * sizeof(void*) + block_nodes * kNodeSize;
+    }
+    return size;
+  };
 
   Map<int32, int32> m;
   // An newly constructed map should have no space used.
@@ -991,13 +1027,11 @@ TEST_F(MapImplTest, SpaceUsed) {
   size_t capacity = kMinCap;
   for (int i = 0; i < 100; ++i) {
     m[i];
-    static constexpr double kMaxLoadFactor = .75;
-    if (m.size() >= capacity * kMaxLoadFactor) {
+    if (must_grow(m.size(), capacity)) {
       capacity *= 2;
     }
     EXPECT_EQ(m.SpaceUsedExcludingSelfLong(),
-              sizeof(void*) * capacity +
-                  m.size() * sizeof(std::pair<std::pair<int32, int32>, void*>));
+              table_size(capacity) + pool_size(m.size()));
   }
 
   // Test string, and non-scalar keys.
@@ -1005,19 +1039,124 @@ TEST_F(MapImplTest, SpaceUsed) {
   std::string str = "Some arbitrarily large string";
   m2[str] = 1;
   EXPECT_EQ(m2.SpaceUsedExcludingSelfLong(),
-            sizeof(void*) * kMinCap +
-                sizeof(std::pair<std::pair<std::string, int32>, void*>) +
+            table_size(kMinCap) +
+                node_size(sizeof(std::pair<std::string, int32>)) +
                 internal::StringSpaceUsedExcludingSelfLong(str));
 
   // Test messages, and non-scalar values.
   Map<int32, TestAllTypes> m3;
   m3[0].set_optional_string(str);
   EXPECT_EQ(m3.SpaceUsedExcludingSelfLong(),
-            sizeof(void*) * kMinCap +
-                sizeof(std::pair<std::pair<int32, TestAllTypes>, void*>) +
+            table_size(kMinCap) +
+                node_size(sizeof(std::pair<int32, TestAllTypes>)) +
                 m3[0].SpaceUsedLong() - sizeof(m3[0]));
 }
 
+TEST_F(MapImplTest, PooledNodesAreReused) {
+  Map<int64, int64> m;
+  for (int i = 0; i < 100; ++i) {
+    m[i] = i;
+  }
+  const int64* value = &m[50];
+  m.erase(50);
+  m[1000] = 1000;
+  EXPECT_EQ(value, &m[1000]);
+  EXPECT_EQ(1000, *value);
+
+  m.clear();
+  for (int i = 0; i < 100; ++i) {
+    m[i] = -i;
+  }
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(-i, m[i]);
+  }
+
+  Arena arena;
+  Map<int64, int64>* on_arena = Arena::Create<Map<int64, int64>>(&arena);
+  for (int i = 0; i < 10000; ++i) {
+    (*on_arena)[i] = i;
+  }
+  on_arena->swap(m);
+  EXPECT_EQ(10000, m.size());
+  EXPECT_EQ(9999, m[9999]);
+  EXPECT_EQ(-99, (*on_arena)[99]);
+}
+
+TEST_F(MapImplTest, SortedItemsAreKeptUntilKeysChange) {
+  Map<std::string, int32> m;
+  for (int i = 0; i < 20; ++i) {
+    m[StrCat(i)] = i;
+  }
+  const Map<std::string, int32>& const_m = m;
+  const Map<std::string, int32>::const_pointer* items =
+      const_m.InternalSortedItems();
+  for (int i = 1; i < 20; ++i) {
+    EXPECT_LT(items[i - 1]->first, items[i]->first);
+  }
+
+  // Changing values keeps the sorted order.
+  m["5"] = 500;
+  m.at("7") = 700;
+  m.insert({"9", 900});
+  EXPECT_EQ(items, const_m.InternalSortedItems());
+  EXPECT_EQ(0, m.count("50"));
+
+  // Changing keys does not.
+  m["50"] = 50;
+  items = const_m.InternalSortedItems();
+  ASSERT_EQ(21, m.size());
+  for (int i = 1; i < 21; ++i) {
+    EXPECT_LT(items[i - 1]->first, items[i]->first);
+  }
+  m.erase("0");
+  items = const_m.InternalSortedItems();
+  EXPECT_EQ("1", items[0]->first);
+  EXPECT_EQ("10", items[1]->first);
+
+  Map<std::string, int32> other;
+  other["a"] = 1;
+  const Map<std::string, int32>::const_pointer* other_items =
+      other.InternalSortedItems();
+  m.swap(other);
+  EXPECT_EQ(other_items, const_m.InternalSortedItems());
+  EXPECT_EQ(items, other.InternalSortedItems());
+
+  m.clear();
+  m["b"] = 2;
+  m["a"] = 1;
+  items = const_m.InternalSortedItems();
+  EXPECT_EQ("a", items[0]->first);
+  EXPECT_EQ("b", items[1]->first);
+}
+
+TEST_F(MapImplTest, SortedItemsAreReusedOnArena) {
+  Arena arena;
+  Map<int32, int32>* m = Arena::Create<Map<int32, int32>>(&arena);
+  for (int i = 0; i < 100; ++i) (*m)[i] = i;
+  const Map<int32, int32>& const_m = *m;
+  const Map<int32, int32>::const_pointer* items = const_m.InternalSortedItems();
+
+  // Changing keys refills the same array instead of leaving it on the arena.
+  for (int i = 0; i < 1000; ++i) {
+    m->erase(i);
+    (*m)[i + 100] = i;
+    EXPECT_EQ(items, const_m.InternalSortedItems());
+    EXPECT_EQ(i + 1, items[0]->first);
+  }
+
+  // A growing map gets a larger array, but not on every new key.
+  int arrays = 0;
+  for (int i = 0; i < 1000; ++i) {
+    (*m)[-i - 1] = i;
+    const Map<int32, int32>::const_pointer* grown =
+        const_m.InternalSortedItems();
+    if (grown != items) ++arrays;
+    items = grown;
+    EXPECT_EQ(-i - 1, items[0]->first);
+  }
+  EXPECT_LT(arrays, 10);
+}
+
 // Attempts to verify that a map with keys a and b has a random ordering. This
 // function returns true if it succeeds in observing both possible orderings.
 bool MapOrderingIsRandom(int a, int b) {
@@ -2560,7 +2699,9 @@ TEST(GeneratedMapFieldTest, SpaceUsed) {
   // so we can't predict it. But we can predict a lower bound.
   size_t lower_bound =
       initial + kNumValues * (space_used_message + sizeof(int32) +
+#ifndef PROTOBUF_MAP_SWISS_TABLE
                               /* Node::next */ sizeof(void*) +
+#endif
                               /* table entry */ sizeof(void*));
 
   EXPECT_LE(lower_bound, map_message.SpaceUsed());
@@ -142,6 +142,7 @@ class Reflection;
 class MessageFactory;
 
 // Defined in other files.
+class ArenaProfile;  // arena_profile.h
 class AssignDescriptorsHelper;
 class DynamicMessageFactory;
 class MapKey;
@@ -950,6 +951,7 @@ class PROTOBUF_EXPORT Reflection final {
   friend class MutableRepeatedFieldRef;
   friend class ::PROTOBUF_NAMESPACE_ID::MessageLayoutInspector;
   friend class ::PROTOBUF_NAMESPACE_ID::AssignDescriptorsHelper;
+  friend class ::PROTOBUF_NAMESPACE_ID::ArenaProfile;  // For FindField.
   friend class DynamicMessageFactory;
   friend class python::MapReflectionFriend;
   friend class util::MessageDifferencer;
@@ -1058,6 +1060,8 @@ class PROTOBUF_EXPORT Reflection final {
   internal::InternalMetadata* MutableInternalMetadata(Message* message) const;
 
   inline bool IsInlined(const FieldDescriptor* field) const;
+  inline bool IsStringPiece(const FieldDescriptor* field) const;
+  inline bool IsLazyField(const FieldDescriptor* field) const;
 
   inline bool HasBit(const Message& message,
                      const FieldDescriptor* field) const;
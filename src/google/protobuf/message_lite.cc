@@ -329,6 +329,15 @@ bool MessageLite::ParsePartialFromArray(const void* data, int size) {
   return ParseFrom<kParsePartial>(as_string_view(data, size));
 }
 
+bool MessageLite::ParseFromArrayWithAliasing(const void* data, int size) {
+  return ParseFrom<kParseWithAliasing>(as_string_view(data, size));
+}
+
+bool MessageLite::ParsePartialFromArrayWithAliasing(const void* data,
+                                                    int size) {
+  return ParseFrom<kParsePartialWithAliasing>(as_string_view(data, size));
+}
+
 bool MessageLite::MergeFromString(const std::string& data) {
   return ParseFrom<kMerge>(data);
 }
@@ -328,6 +328,16 @@ class PROTOBUF_EXPORT MessageLite {
   // required fields.
   PROTOBUF_ATTRIBUTE_REINITIALIZES bool ParsePartialFromArray(const void* data,
                                                               int size);
+  // Like ParseFromArray(), but string and bytes fields stored as StringPieces
+  // (ctype=STRING_PIECE with the C++ generator's string_piece_fields option)
+  // refer to |data| instead of holding a copy of it. |data| must outlive the
+  // message, and any message such fields are swapped into.
+  PROTOBUF_ATTRIBUTE_REINITIALIZES bool ParseFromArrayWithAliasing(
+      const void* data, int size);
+  // Like ParseFromArrayWithAliasing(), but accepts messages that are missing
+  // required fields.
+  PROTOBUF_ATTRIBUTE_REINITIALIZES bool ParsePartialFromArrayWithAliasing(
+      const void* data, int size);
 
 
   // Reads a protocol buffer from the stream and merges it into this
@@ -33,6 +33,9 @@
 //  Sanjay Ghemawat, Jeff Dean, and others.
 
 #include <google/protobuf/unittest.pb.h>
+#include <google/protobuf/unittest_inline_repeated_fields.pb.h>
+#include <google/protobuf/unittest_lazy_fields.pb.h>
+#include <google/protobuf/unittest_string_piece_fields.pb.h>
 
 #define MESSAGE_TEST_NAME MessageTest
 #define MESSAGE_FACTORY_TEST_NAME MessageFactoryTest
@@ -43,3 +46,321 @@
 // Must include after the above macros.
 #include <google/protobuf/test_util.inc>
 #include <google/protobuf/message_unittest.inc>
+
+namespace google {
+namespace protobuf {
+namespace {
+
+// unittest_inline_repeated_fields.proto is compiled with the
+// inline_repeated_fields option, so its repeated fields have room for four
+// elements inside the message.
+template <typename T>
+bool PointsIntoObject(const void* data, const T& object) {
+  const char* begin = reinterpret_cast<const char*>(&object);
+  return data >= begin && data < begin + sizeof(object);
+}
+
+TEST(MessageTest, InlineRepeatedFieldSwap) {
+  protobuf_unittest::TestInlineRepeatedFields message1;
+  EXPECT_EQ(4, message1.repeated_int32().Capacity());
+  message1.add_repeated_int32(1);
+  message1.add_repeated_string("a");
+  message1.add_repeated_nested_message()->set_bb(2);
+  const std::string* string = &message1.repeated_string(0);
+  const protobuf_unittest::TestAllTypes::NestedMessage* nested =
+      &message1.repeated_nested_message(0);
+
+  // Unlike the array of an ordinary RepeatedField, elements in inline storage
+  // are copied to the other message on swap, so their addresses change.  The
+  // elements of pointer fields still keep theirs.
+  protobuf_unittest::TestInlineRepeatedFields message2;
+  using std::swap;
+  swap(message1, message2);
+  EXPECT_EQ(0, message1.repeated_int32_size());
+  ASSERT_EQ(1, message2.repeated_int32_size());
+  EXPECT_EQ(1, message2.repeated_int32(0));
+  EXPECT_TRUE(PointsIntoObject(&message2.repeated_int32().Get(0), message2));
+  EXPECT_EQ(string, &message2.repeated_string(0));
+  EXPECT_EQ(nested, &message2.repeated_nested_message(0));
+
+  // Arrays outside the message are swapped as usual.
+  for (int i = 0; i < 10; i++) message2.add_repeated_int32(i);
+  const int32* outline_int32 = &message2.repeated_int32().Get(0);
+  swap(message1, message2);
+  EXPECT_EQ(outline_int32, &message1.repeated_int32().Get(0));
+  EXPECT_EQ(string, &message1.repeated_string(0));
+}
+
+TEST(MessageTest, InlineRepeatedFieldSwapKeepsInlineStorage) {
+  // Swapping or moving fields which fit into each other's inline storage
+  // allocates nothing: both keep their arrays inside their messages.
+  protobuf_unittest::TestInlineRepeatedFields message1;
+  protobuf_unittest::TestInlineRepeatedFields message2;
+  using std::swap;
+  swap(message1, message2);
+  message1 = std::move(message2);
+  for (const auto* message : {&message1, &message2}) {
+    EXPECT_EQ(4, message->repeated_int32().Capacity());
+    EXPECT_EQ(4, message->repeated_string().Capacity());
+    EXPECT_EQ(4, message->repeated_nested_message().Capacity());
+    EXPECT_EQ(sizeof(*message), message->SpaceUsedLong());
+  }
+
+  message1.add_repeated_int32(1);
+  message1.add_repeated_int32(2);
+  message1.add_repeated_string("a");
+  message2.add_repeated_int32(3);
+  message2.add_repeated_nested_message()->set_bb(4);
+  swap(message1, message2);
+  protobuf_unittest::TestInlineRepeatedFields message3;
+  message3 = std::move(message1);
+  ASSERT_EQ(1, message3.repeated_int32_size());
+  EXPECT_EQ(3, message3.repeated_int32(0));
+  EXPECT_EQ(1, message3.repeated_nested_message_size());
+  ASSERT_EQ(2, message2.repeated_int32_size());
+  EXPECT_EQ(2, message2.repeated_int32(1));
+  EXPECT_EQ(1, message2.repeated_string_size());
+  for (const auto* message : {&message2, &message3}) {
+    EXPECT_EQ(4, message->repeated_int32().Capacity());
+    EXPECT_EQ(4, message->repeated_string().Capacity());
+    EXPECT_EQ(4, message->repeated_nested_message().Capacity());
+    EXPECT_TRUE(
+        PointsIntoObject(message->repeated_int32().data(), *message));
+  }
+}
+
+// unittest_string_piece_fields.proto is compiled with the string_piece_fields
+// option, so its STRING_PIECE fields are backed by internal::StringPieceField.
+bool PointsInto(StringPiece value, const std::string& buffer) {
+  return value.data() >= buffer.data() &&
+         value.data() + value.size() <= buffer.data() + buffer.size();
+}
+
+TEST(MessageTest, StringPieceFieldAliasesParsedBuffer) {
+  protobuf_unittest::TestStringPieceFields source;
+  source.set_optional_string_piece(std::string(100, 'x'));
+  source.set_optional_bytes_piece(std::string(50, '\xff'));
+  source.set_optional_string("not a string piece");
+  std::string data = source.SerializeAsString();
+
+  protobuf_unittest::TestStringPieceFields message;
+  ASSERT_TRUE(message.ParseFromArrayWithAliasing(data.data(), data.size()));
+  EXPECT_EQ(std::string(100, 'x'), message.optional_string_piece());
+  EXPECT_TRUE(PointsInto(message.optional_string_piece(), data));
+  EXPECT_EQ(std::string(50, '\xff'), message.optional_bytes_piece());
+  EXPECT_TRUE(PointsInto(message.optional_bytes_piece(), data));
+  EXPECT_EQ("not a string piece", message.optional_string());
+  EXPECT_EQ(data, message.SerializeAsString());
+
+  protobuf_unittest::TestStringPieceFields copy;
+  ASSERT_TRUE(copy.ParseFromArray(data.data(), data.size()));
+  EXPECT_EQ(std::string(100, 'x'), copy.optional_string_piece());
+  EXPECT_FALSE(PointsInto(copy.optional_string_piece(), data));
+}
+
+TEST(MessageTest, StringPieceFieldSetters) {
+  std::string value = "aliased";
+  protobuf_unittest::TestStringPieceFields message;
+  message.set_alias_optional_string_piece(value);
+  EXPECT_TRUE(message.has_optional_string_piece());
+  EXPECT_EQ(value.data(), message.optional_string_piece().data());
+
+  message.set_optional_string_piece(value);
+  EXPECT_NE(value.data(), message.optional_string_piece().data());
+  value = "changed";
+  EXPECT_EQ("aliased", message.optional_string_piece());
+
+  const Reflection* reflection = message.GetReflection();
+  const FieldDescriptor* field =
+      message.GetDescriptor()->FindFieldByName("optional_string_piece");
+  EXPECT_EQ("aliased", reflection->GetString(message, field));
+  reflection->SetString(&message, field, "reflected");
+  EXPECT_EQ("reflected", message.optional_string_piece());
+
+  protobuf_unittest::TestStringPieceFields other;
+  other.CopyFrom(message);
+  EXPECT_EQ("reflected", other.optional_string_piece());
+  message.clear_optional_string_piece();
+  EXPECT_FALSE(message.has_optional_string_piece());
+  EXPECT_TRUE(message.optional_string_piece().empty());
+}
+
+TEST(MessageTest, StringPieceFieldOnArena) {
+  protobuf_unittest::TestStringPieceFields source;
+  source.set_optional_string_piece("on arena");
+  std::string data = source.SerializeAsString();
+
+  Arena arena;
+  auto* message =
+      Arena::CreateMessage<protobuf_unittest::TestStringPieceFields>(&arena);
+  ASSERT_TRUE(message->ParseFromString(data));
+  EXPECT_EQ("on arena", message->optional_string_piece());
+  EXPECT_FALSE(PointsInto(message->optional_string_piece(), data));
+
+  protobuf_unittest::TestStringPieceFields heap;
+  heap.Swap(message);
+  EXPECT_EQ("on arena", heap.optional_string_piece());
+  EXPECT_TRUE(message->optional_string_piece().empty());
+}
+
+// TestLazyFields.sub_message is backed by internal::LazyField.
+TEST(MessageTest, LazyFieldKeepsBytesUntilAccessed) {
+  // sub_message holds optional_int32 and optional_nested_message, which has
+  // an invalid tag inside.
+  const std::string data("\x0a\x08\x08\x01\x92\x01\x03\x08\x01\x00", 10);
+
+  protobuf_unittest::TestEagerFields eager;
+  EXPECT_FALSE(eager.ParseFromString(data));
+
+  protobuf_unittest::TestLazyFields message;
+  ASSERT_TRUE(message.ParseFromString(data));
+  EXPECT_TRUE(message.has_sub_message());
+  EXPECT_EQ(data, message.SerializeAsString());
+  protobuf_unittest::TestLazyFields copy(message);
+  EXPECT_EQ(data, copy.SerializeAsString());
+
+  // Reading logs the error and keeps what parses, mutating drops the bytes.
+  {
+    ScopedMemoryLog log;
+    EXPECT_EQ(1, message.sub_message().optional_int32());
+    EXPECT_EQ(1, log.GetMessages(ERROR).size());
+  }
+  message.mutable_sub_message()->set_optional_int64(2);
+  protobuf_unittest::TestLazyFields reparsed;
+  ASSERT_TRUE(reparsed.ParseFromString(message.SerializeAsString()));
+  EXPECT_EQ(1, reparsed.sub_message().optional_int32());
+  EXPECT_EQ(2, reparsed.sub_message().optional_int64());
+}
+
+TEST(MessageTest, LazyFieldRejectsMalformedBytes) {
+  // Bytes which are not well-formed fields fail the parse of the containing
+  // message, as they do when the field is parsed eagerly.
+  const std::string invalid_tag("\x0a\x03\x08\x01\x00", 5);
+  const std::string truncated_varint("\x0a\x02\x08\xff", 4);
+  const std::string unclosed_group("\x0a\x01\x0b", 3);
+  for (const std::string& data :
+       {invalid_tag, truncated_varint, unclosed_group}) {
+    protobuf_unittest::TestEagerFields eager;
+    EXPECT_FALSE(eager.ParseFromString(data));
+    protobuf_unittest::TestLazyFields message;
+    EXPECT_FALSE(message.ParseFromString(data));
+  }
+
+  // Appending well-formed bytes to held ones is checked too.
+  protobuf_unittest::TestLazyFields message;
+  ASSERT_TRUE(message.ParseFromString(std::string("\x0a\x02\x08\x01", 4)));
+  EXPECT_FALSE(message.MergeFromString(invalid_tag));
+}
+
+TEST(MessageTest, LazyFieldWithRequiredFields) {
+  // sub_message has required fields, so it is parsed eagerly and checked.
+  protobuf_unittest::TestLazyRequiredFields message;
+  message.mutable_sub_message()->set_a(1);
+  EXPECT_FALSE(message.IsInitialized());
+  protobuf_unittest::TestLazyRequiredFields parsed;
+  EXPECT_FALSE(parsed.ParseFromString(message.SerializePartialAsString()));
+  EXPECT_TRUE(parsed.ParsePartialFromString(
+      message.SerializePartialAsString()));
+  EXPECT_FALSE(parsed.IsInitialized());
+
+  message.mutable_sub_message()->set_b(2);
+  message.mutable_sub_message()->set_c(3);
+  EXPECT_TRUE(message.IsInitialized());
+  ASSERT_TRUE(parsed.ParseFromString(message.SerializeAsString()));
+  EXPECT_EQ(3, parsed.sub_message().c());
+}
+
+TEST(MessageTest, LazyFieldMerge) {
+  protobuf_unittest::TestLazyFields first;
+  first.mutable_sub_message()->set_optional_int32(1);
+  first.mutable_sub_message()->add_repeated_int32(1);
+  protobuf_unittest::TestLazyFields second;
+  second.mutable_sub_message()->set_optional_int64(2);
+  second.mutable_sub_message()->add_repeated_int32(2);
+
+  protobuf_unittest::TestLazyFields message;
+  ASSERT_TRUE(message.ParseFromString(first.SerializeAsString()));
+  protobuf_unittest::TestLazyFields other;
+  ASSERT_TRUE(other.ParseFromString(second.SerializeAsString()));
+  message.MergeFrom(other);
+  ASSERT_TRUE(message.MergeFromString(second.SerializeAsString()));
+  EXPECT_EQ(1, message.sub_message().optional_int32());
+  EXPECT_EQ(2, message.sub_message().optional_int64());
+  EXPECT_EQ(3, message.sub_message().repeated_int32_size());
+
+  // Merging into a mutated message parses into it.
+  message.mutable_sub_message()->clear_repeated_int32();
+  ASSERT_TRUE(message.MergeFromString(second.SerializeAsString()));
+  EXPECT_EQ(1, message.sub_message().optional_int32());
+  EXPECT_EQ(1, message.sub_message().repeated_int32_size());
+}
+
+TEST(MessageTest, LazyFieldMergeKeepsReadMessage) {
+  protobuf_unittest::TestLazyFields source;
+  source.mutable_sub_message()->set_optional_int32(1);
+  source.mutable_sub_message()->add_repeated_int32(1);
+  const std::string data = source.SerializeAsString();
+
+  protobuf_unittest::TestLazyFields message;
+  ASSERT_TRUE(message.ParseFromString(data));
+  // Merges must go into the message this reference points to.
+  const protobuf_unittest::TestAllTypes& sub = message.sub_message();
+  EXPECT_EQ(1, sub.repeated_int32_size());
+
+  protobuf_unittest::TestLazyFields other;
+  ASSERT_TRUE(other.ParseFromString(data));
+  message.MergeFrom(other);
+  EXPECT_EQ(&sub, &message.sub_message());
+  EXPECT_EQ(2, sub.repeated_int32_size());
+
+  ASSERT_TRUE(message.MergeFromString(data));
+  EXPECT_EQ(&sub, &message.sub_message());
+  EXPECT_EQ(1, sub.optional_int32());
+  EXPECT_EQ(3, sub.repeated_int32_size());
+
+  protobuf_unittest::TestLazyFields reparsed;
+  ASSERT_TRUE(reparsed.ParseFromString(message.SerializeAsString()));
+  EXPECT_EQ(3, reparsed.sub_message().repeated_int32_size());
+}
+
+TEST(MessageTest, LazyFieldReflection) {
+  protobuf_unittest::TestLazyFields source;
+  source.mutable_sub_message()->set_optional_int32(1);
+  std::string data = source.SerializeAsString();
+
+  Arena arena;
+  auto* message =
+      Arena::CreateMessage<protobuf_unittest::TestLazyFields>(&arena);
+  ASSERT_TRUE(message->ParseFromString(data));
+  const Reflection* reflection = message->GetReflection();
+  const FieldDescriptor* field =
+      message->GetDescriptor()->FindFieldByName("sub_message");
+  EXPECT_TRUE(reflection->HasField(*message, field));
+  const auto& sub = static_cast<const protobuf_unittest::TestAllTypes&>(
+      reflection->GetMessage(*message, field));
+  EXPECT_EQ(1, sub.optional_int32());
+  EXPECT_EQ(data, message->SerializeAsString());
+
+  protobuf_unittest::TestLazyFields heap;
+  ASSERT_TRUE(heap.ParseFromString(data));
+  reflection->SwapFields(message, &heap, {field});
+  EXPECT_EQ(1, heap.sub_message().optional_int32());
+  EXPECT_EQ(1, message->sub_message().optional_int32());
+
+  std::unique_ptr<Message> released(reflection->ReleaseMessage(&heap, field));
+  EXPECT_FALSE(heap.has_sub_message());
+  EXPECT_EQ(1, static_cast<protobuf_unittest::TestAllTypes*>(released.get())
+                   ->optional_int32());
+
+  static_cast<protobuf_unittest::TestAllTypes*>(
+      reflection->MutableMessage(message, field))
+      ->set_optional_int32(3);
+  EXPECT_EQ(3, message->sub_message().optional_int32());
+  reflection->ClearField(message, field);
+  EXPECT_FALSE(message->has_sub_message());
+  EXPECT_EQ(0, message->sub_message().optional_int32());
+}
+
+}  // namespace
+}  // namespace protobuf
+}  // namespace google
@@ -30,12 +30,17 @@
 
 #include <google/protobuf/parse_context.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include <google/protobuf/stubs/stringprintf.h>
 #include <google/protobuf/io/coded_stream.h>
 #include <google/protobuf/io/zero_copy_stream.h>
 #include <google/protobuf/arenastring.h>
 #include <google/protobuf/message_lite.h>
 #include <google/protobuf/repeated_field.h>
+#include <google/protobuf/string_piece_field_support.h>
 #include <google/protobuf/wire_format_lite.h>
 #include <google/protobuf/stubs/strutil.h>
 
@@ -221,6 +226,31 @@ const char* EpsCopyInputStream::AppendStringFallback(const char* ptr, int size,
                     [str](const char* p, int s) { str->append(p, s); });
 }
 
+const char* EpsCopyInputStream::ReadStringPiece(const char* ptr, int size,
+                                                StringPieceField* s) {
+  if (size <= buffer_end_ + kSlopBytes - ptr) {
+    if (aliasing_ == kNoDelta) {
+      // We are reading straight from the input.
+      s->SetAliased(StringPiece(ptr, size));
+    } else if (aliasing_ != kNoAliasing && aliasing_ != kOnPatch) {
+      // The patch buffer holds a copy of the end of the input, aliasing_ is
+      // the distance between the two.
+      s->SetAliased(StringPiece(
+          reinterpret_cast<const char*>(reinterpret_cast<std::uintptr_t>(ptr) +
+                                        aliasing_),
+          size));
+    } else {
+      s->Set(StringPiece(ptr, size));
+    }
+    return ptr + size;
+  }
+  // The bytes span several buffers, they can't be aliased.
+  std::string str;
+  ptr = ReadStringFallback(ptr, size, &str);
+  if (ptr != nullptr) s->Set(str);
+  return ptr;
+}
+
 
 template <typename Tag, typename T>
 const char* EpsCopyInputStream::ReadRepeatedFixed(const char* ptr,
@@ -283,6 +313,138 @@ const char* EpsCopyInputStream::ReadPackedFixed(const char* ptr, int size,
   return ptr;
 }
 
+namespace {
+
+#if defined(__SSE2__)
+constexpr int kVarintBlockSize = 16;
+
+// Returns a mask with bit i set iff byte i of the block at p has its
+// continuation bit cleared, ie. it is the last byte of a varint.
+inline uint32 VarintTerminators(const char* p) {
+  __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+  return ~static_cast<uint32>(_mm_movemask_epi8(bytes)) & 0xFFFF;
+}
+#else
+constexpr int kVarintBlockSize = 8;
+
+inline uint32 VarintTerminators(const char* p) {
+  uint64 x = ~UnalignedLoad<uint64>(p) & 0x8080808080808080ULL;
+  // Gather the 8 terminator bits in the top byte. The partial products never
+  // overlap, so the multiply can't produce carries.
+  return static_cast<uint32>(((x >> 7) * 0x0102040810204080ULL) >> 56);
+}
+#endif
+
+// Decodes a varint of at most 8 bytes without looping over its bytes, by
+// squeezing out the continuation bits of all bytes in parallel.
+inline uint64 DecodeShortVarint(const char* p, int len) {
+  GOOGLE_DCHECK(len >= 1 && len <= 8);
+  uint64 x = UnalignedLoad<uint64>(p);
+  if (len < 8) x &= (uint64{1} << (8 * len)) - 1;
+  x &= 0x7F7F7F7F7F7F7F7FULL;
+  x = ((x & 0x7F007F007F007F00ULL) >> 1) | (x & 0x007F007F007F007FULL);
+  x = ((x & 0x3FFF00003FFF0000ULL) >> 2) | (x & 0x00003FFF00003FFFULL);
+  x = ((x & 0x0FFFFFFF00000000ULL) >> 4) | (x & 0x000000000FFFFFFFULL);
+  return x;
+}
+
+inline int CountOnes(uint32 x) {
+  x = x - ((x >> 1) & 0x55555555);
+  x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+  return static_cast<int>((((x + (x >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24);
+}
+
+// Returns the number of varints ending in [ptr, end), which must be readable.
+inline int CountVarints(const char* ptr, const char* end) {
+  int count = 0;
+  for (; end - ptr >= kVarintBlockSize; ptr += kVarintBlockSize) {
+    count += CountOnes(VarintTerminators(ptr));
+  }
+  for (; ptr < end; ptr++) count += static_cast<uint8>(*ptr) < 0x80;
+  return count;
+}
+
+template <typename T, bool zigzag>
+inline T ConvertVarint(uint64 varint) {
+  if (zigzag) {
+    if (sizeof(T) == 8) return WireFormatLite::ZigZagDecode64(varint);
+    return WireFormatLite::ZigZagDecode32(static_cast<uint32>(varint));
+  }
+  return static_cast<T>(varint);
+}
+
+// Decodes the varints in [ptr, end) a block at a time. Only whole blocks are
+// consumed, so the caller must ensure end is before the limit of the packed
+// field and that kSlopBytes past end are readable. Returns the start of the
+// first varint that was not decoded or nullptr on a malformed varint.
+template <typename T, bool zigzag>
+const char* ParseVarintBlocks(const char* ptr, const char* end,
+                              RepeatedField<T>* out) {
+  T values[kVarintBlockSize];
+  while (end - ptr >= kVarintBlockSize) {
+    uint32 mask = VarintTerminators(ptr);
+    int n = 0;
+    if (mask == (1u << kVarintBlockSize) - 1) {
+      // All single byte varints, which is the common case for small values.
+      for (; n < kVarintBlockSize; n++) {
+        values[n] = ConvertVarint<T, zigzag>(static_cast<uint8>(ptr[n]));
+      }
+      ptr += kVarintBlockSize;
+    } else {
+      // A varint spanning the whole block is left to the scalar loop.
+      if (mask == 0) return ptr;
+      do {
+        int len = Bits::Log2FloorNonZero(mask & (0u - mask)) + 1;
+        uint64 varint;
+        if (PROTOBUF_PREDICT_TRUE(len <= 8)) {
+          varint = DecodeShortVarint(ptr, len);
+        } else if (VarintParse(ptr, &varint) == nullptr) {
+          return nullptr;
+        }
+        values[n++] = ConvertVarint<T, zigzag>(varint);
+        ptr += len;
+        mask >>= len;
+      } while (mask != 0);
+    }
+    out->Reserve(out->size() + n);
+    std::copy(values, values + n, out->AddNAlreadyReserved(n));
+  }
+  return ptr;
+}
+
+}  // namespace
+
+template <typename T, bool zigzag>
+const char* EpsCopyInputStream::ReadPackedVarintArray(const char* ptr,
+                                                      RepeatedField<T>* out) {
+  int size = ReadSize(&ptr);
+  if (ptr == nullptr) return nullptr;
+  auto old = PushLimit(ptr, size);
+  if (old < 0) return nullptr;
+  while (!DoneWithCheck(&ptr, -1)) {
+    // Size the field for the varints that are in the buffer, which is all of
+    // them unless the field continues in the next chunk.  Every varint takes
+    // at least a byte, so there is nothing to count if the field has room for
+    // as many elements as there are bytes, eg. when parsing into a cleared
+    // message.
+    const char* end = buffer_end_ + (std::min)(limit_, int{kSlopBytes});
+    if (out->Capacity() - out->size() < end - ptr) {
+      out->Reserve(out->size() + CountVarints(ptr, end));
+    }
+    // Everything before limit_end_ belongs to this field and is followed by
+    // at least kSlopBytes of readable data.
+    ptr = ParseVarintBlocks<T, zigzag>(ptr, limit_end_, out);
+    if (ptr == nullptr) return nullptr;
+    if (ptr >= limit_end_) continue;
+    uint64 varint;
+    ptr = VarintParse(ptr, &varint);
+    if (ptr == nullptr) return nullptr;
+    out->Add(ConvertVarint<T, zigzag>(varint));
+  }
+  if (!PopLimit(old)) return nullptr;
+  return ptr;
+}
+
 const char* EpsCopyInputStream::InitFrom(io::ZeroCopyInputStream* zcis) {
   zcis_ = zcis;
   const void* data;
@@ -427,22 +589,18 @@ const char* InlineGreedyStringParser(std::string* s, const char* ptr,
   return ctx->ReadString(ptr, size, s);
 }
 
+const char* InlineStringPieceParser(StringPieceField* s, const char* ptr,
+                                    ParseContext* ctx) {
+  int size = ReadSize(&ptr);
+  if (!ptr) return nullptr;
+  return ctx->ReadStringPiece(ptr, size, s);
+}
+
 
 template <typename T, bool sign>
 const char* VarintParser(void* object, const char* ptr, ParseContext* ctx) {
-  return ctx->ReadPackedVarint(ptr, [object](uint64 varint) {
-    T val;
-    if (sign) {
-      if (sizeof(T) == 8) {
-        val = WireFormatLite::ZigZagDecode64(varint);
-      } else {
-        val = WireFormatLite::ZigZagDecode32(varint);
-      }
-    } else {
-      val = varint;
-    }
-    static_cast<RepeatedField<T>*>(object)->Add(val);
-  });
+  return ctx->ReadPackedVarintArray<T, sign>(
+      ptr, static_cast<RepeatedField<T>*>(object));
 }
 
 const char* PackedInt32Parser(void* object, const char* ptr,
@@ -58,6 +58,8 @@ class MessageFactory;
 
 namespace internal {
 
+class StringPieceField;
+
 // Template code below needs to know about the existence of these functions.
 PROTOBUF_EXPORT void WriteVarint(uint32 num, uint64 val, std::string* s);
 PROTOBUF_EXPORT void WriteLengthDelimited(uint32 num, StringPiece val,
@@ -166,6 +168,12 @@ class PROTOBUF_EXPORT EpsCopyInputStream {
     }
     return AppendStringFallback(ptr, size, s);
   }
+  // Reads |size| bytes into |s|. If the stream was set up for aliasing and the
+  // bytes can be referenced in the buffer that is being parsed, |s| is pointed
+  // at them instead of getting a copy.
+  PROTOBUF_MUST_USE_RESULT const char* ReadStringPiece(const char* ptr,
+                                                       int size,
+                                                       StringPieceField* s);
 
   template <typename Tag, typename T>
   PROTOBUF_MUST_USE_RESULT const char* ReadRepeatedFixed(const char* ptr,
@@ -179,6 +187,11 @@ class PROTOBUF_EXPORT EpsCopyInputStream {
   template <typename Add>
   PROTOBUF_MUST_USE_RESULT const char* ReadPackedVarint(const char* ptr,
                                                         Add add);
+  // Same as ReadPackedVarint but stores directly into a RepeatedField. Parts
+  // of the payload that lie before limit_end_ are decoded a block at a time.
+  template <typename T, bool zigzag>
+  PROTOBUF_MUST_USE_RESULT const char* ReadPackedVarintArray(
+      const char* ptr, RepeatedField<T>* out);
 
   uint32 LastTag() const { return last_tag_minus_1_ + 1; }
   bool ConsumeEndGroup(uint32 start_tag) {
@@ -332,6 +345,7 @@ class PROTOBUF_EXPORT EpsCopyInputStream {
         ptr, [str](const char* p, ptrdiff_t s) { str->append(p, s); });
   }
   friend class ImplicitWeakMessage;
+  friend class LazyField;
 };
 
 // ParseContext holds all data that is global to the entire parse. Most
@@ -645,6 +659,8 @@ inline bool VerifyUTF8(const std::string* s, const char* field_name) {
 // All the string parsers with or without UTF checking and for all CTypes.
 PROTOBUF_EXPORT PROTOBUF_MUST_USE_RESULT const char* InlineGreedyStringParser(
     std::string* s, const char* ptr, ParseContext* ctx);
+PROTOBUF_EXPORT PROTOBUF_MUST_USE_RESULT const char* InlineStringPieceParser(
+    StringPieceField* s, const char* ptr, ParseContext* ctx);
 
 
 // Add any of the following lines to debug which parse function is failing.
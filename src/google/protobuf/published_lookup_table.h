@@ -0,0 +1,129 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef GOOGLE_PROTOBUF_PUBLISHED_LOOKUP_TABLE_H__
+#define GOOGLE_PROTOBUF_PUBLISHED_LOOKUP_TABLE_H__
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include <google/protobuf/stubs/macros.h>
+
+namespace google {
+namespace protobuf {
+namespace internal {
+
+// A hash table which is only ever added to, and which is read without a lock.
+// Readers never lock.  Inserts must be serialized by the caller, and entries
+// are never removed.  Outgrown slot arrays are kept until the table is
+// destroyed, so a reader may go on probing one after a writer has replaced it.
+template <typename Key, typename Value, typename Hash>
+class PublishedLookupTable {
+ public:
+  PublishedLookupTable() : slots_(nullptr) {}
+
+  // Returns the value stored for key, or nullptr.
+  template <typename LookupKey>
+  const Value* Find(const LookupKey& key) const {
+    const Slots* slots = slots_.load(std::memory_order_acquire);
+    if (slots == nullptr) return nullptr;
+    for (size_t i = Hash()(key) & slots->mask;; i = (i + 1) & slots->mask) {
+      const Entry* entry = slots->entries[i].load(std::memory_order_acquire);
+      if (entry == nullptr) return nullptr;
+      if (entry->key == key) return &entry->value;
+    }
+  }
+
+  // Stores value for key, unless key is already present.  Returns the value
+  // stored for key.
+  template <typename LookupKey>
+  const Value* Insert(const LookupKey& key, const Value& value) {
+    const Value* existing = Find(key);
+    if (existing != nullptr) return existing;
+    const Slots* slots = slots_.load(std::memory_order_relaxed);
+    if (slots == nullptr || (entries_.size() + 1) * 2 > slots->mask + 1) {
+      slots = Grow();
+    }
+    entries_.emplace_back(new Entry{Key(key), value});
+    Store(slots, entries_.back().get(), std::memory_order_release);
+    return &entries_.back()->value;
+  }
+
+ private:
+  struct Entry {
+    Key key;
+    Value value;
+  };
+
+  struct Slots {
+    explicit Slots(size_t size)
+        : mask(size - 1), entries(new std::atomic<const Entry*>[size]) {
+      for (size_t i = 0; i < size; i++) {
+        entries[i].store(nullptr, std::memory_order_relaxed);
+      }
+    }
+    size_t mask;
+    std::unique_ptr<std::atomic<const Entry*>[]> entries;
+  };
+
+  static void Store(const Slots* slots, const Entry* entry,
+                    std::memory_order order) {
+    size_t i = Hash()(entry->key) & slots->mask;
+    while (slots->entries[i].load(std::memory_order_relaxed) != nullptr) {
+      i = (i + 1) & slots->mask;
+    }
+    slots->entries[i].store(entry, order);
+  }
+
+  const Slots* Grow() {
+    const Slots* slots = slots_.load(std::memory_order_relaxed);
+    Slots* grown = new Slots(slots == nullptr ? 16 : 2 * (slots->mask + 1));
+    all_slots_.emplace_back(grown);
+    for (const auto& entry : entries_) {
+      Store(grown, entry.get(), std::memory_order_relaxed);
+    }
+    slots_.store(grown, std::memory_order_release);
+    return grown;
+  }
+
+  std::vector<std::unique_ptr<Entry>> entries_;
+  std::vector<std::unique_ptr<Slots>> all_slots_;
+  std::atomic<const Slots*> slots_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(PublishedLookupTable);
+};
+
+}  // namespace internal
+}  // namespace protobuf
+}  // namespace google
+
+#endif  // GOOGLE_PROTOBUF_PUBLISHED_LOOKUP_TABLE_H__
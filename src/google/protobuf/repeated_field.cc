@@ -56,6 +56,7 @@ void** RepeatedPtrFieldBase::InternalExtend(int extend_amount) {
   }
   Rep* old_rep = rep_;
   Arena* arena = GetArena();
+  const bool old_rep_is_inline = UsesInlineRep();
   new_size = std::max(internal::kRepeatedFieldLowerClampLimit,
                       std::max(total_size_ * 2, new_size));
   GOOGLE_CHECK_LE(new_size, (std::numeric_limits<size_t>::max() - kRepHeaderSize) /
@@ -65,12 +66,14 @@ void** RepeatedPtrFieldBase::InternalExtend(int extend_amount) {
   if (arena == NULL) {
     rep_ = reinterpret_cast<Rep*>(::operator new(bytes));
   } else {
-    rep_ = reinterpret_cast<Rep*>(Arena::CreateArray<char>(arena, bytes));
+    rep_ = reinterpret_cast<Rep*>(
+        Arena::CreateArrayForContainer<char>(arena, this, bytes));
   }
 #if defined(__GXX_DELETE_WITH_SIZE__) || defined(__cpp_sized_deallocation)
   const int old_total_size = total_size_;
 #endif
   total_size_ = new_size;
+  arena_ = arena;
   if (old_rep && old_rep->allocated_size > 0) {
     memcpy(rep_->elements, old_rep->elements,
            old_rep->allocated_size * sizeof(rep_->elements[0]));
@@ -78,7 +81,7 @@ void** RepeatedPtrFieldBase::InternalExtend(int extend_amount) {
   } else {
     rep_->allocated_size = 0;
   }
-  if (arena == NULL) {
+  if (arena == NULL && !old_rep_is_inline) {
 #if defined(__GXX_DELETE_WITH_SIZE__) || defined(__cpp_sized_deallocation)
     const size_t old_size =
         old_total_size * sizeof(rep_->elements[0]) + kRepHeaderSize;
@@ -96,6 +99,59 @@ void RepeatedPtrFieldBase::Reserve(int new_size) {
   }
 }
 
+void RepeatedPtrFieldBase::InternalInitInlineRep(void* storage, int capacity) {
+  GOOGLE_DCHECK(rep_ == NULL);
+  rep_ = static_cast<Rep*>(storage);
+  rep_->allocated_size = 0;
+  total_size_ = capacity;
+  arena_ = reinterpret_cast<Arena*>(reinterpret_cast<uintptr_t>(arena_) |
+                                    kInlineRepTag);
+}
+
+void RepeatedPtrFieldBase::InternalSwapWithInlineRep(
+    RepeatedPtrFieldBase* other) {
+  const int allocated = rep_ != NULL ? rep_->allocated_size : 0;
+  const int other_allocated =
+      other->rep_ != NULL ? other->rep_->allocated_size : 0;
+  if (allocated <= other->total_size_ && other_allocated <= total_size_) {
+    // Each array has room for the other's element pointers, so swap them in
+    // place rather than moving an inline array out.
+    const int n = std::max(allocated, other_allocated);
+    if (n > 0) {
+      std::swap_ranges(rep_->elements, rep_->elements + n,
+                       other->rep_->elements);
+      std::swap(rep_->allocated_size, other->rep_->allocated_size);
+    }
+    std::swap(current_size_, other->current_size_);
+    return;
+  }
+  if (UsesInlineRep()) ReleaseInlineRep();
+  if (other->UsesInlineRep()) other->ReleaseInlineRep();
+  InternalSwap(other);
+}
+
+void RepeatedPtrFieldBase::ReleaseInlineRep() {
+  GOOGLE_DCHECK(UsesInlineRep());
+  Rep* inline_rep = rep_;
+  Arena* arena = GetArena();
+  arena_ = arena;
+  if (inline_rep->allocated_size == 0) {
+    rep_ = NULL;
+    total_size_ = 0;
+    return;
+  }
+  size_t bytes = kRepHeaderSize + sizeof(rep_->elements[0]) * total_size_;
+  if (arena == NULL) {
+    rep_ = reinterpret_cast<Rep*>(::operator new(bytes));
+  } else {
+    rep_ = reinterpret_cast<Rep*>(
+        Arena::CreateArrayForContainer<char>(arena, this, bytes));
+  }
+  memcpy(rep_->elements, inline_rep->elements,
+         inline_rep->allocated_size * sizeof(rep_->elements[0]));
+  rep_->allocated_size = inline_rep->allocated_size;
+}
+
 void RepeatedPtrFieldBase::CloseGap(int start, int num) {
   if (rep_ == NULL) return;
   // Close up a gap of "num" elements starting at offset "start".
@@ -113,9 +169,10 @@ MessageLite* RepeatedPtrFieldBase::AddWeak(const MessageLite* prototype) {
     Reserve(total_size_ + 1);
   }
   ++rep_->allocated_size;
+  Arena* arena = GetArena();
   MessageLite* result = prototype
-                            ? prototype->New(arena_)
-                            : Arena::CreateMessage<ImplicitWeakMessage>(arena_);
+                            ? prototype->New(arena)
+                            : Arena::CreateMessage<ImplicitWeakMessage>(arena);
   rep_->elements[current_size_++] = result;
   return result;
 }
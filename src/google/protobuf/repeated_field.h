@@ -85,6 +85,10 @@ struct WeakRepeatedPtrField;
 namespace internal {
 
 class MergePartialFromCodedStreamHelper;
+template <typename Element, int kInlineCapacity>
+class InlinedRepeatedFieldStorage;
+template <typename Element, int kInlineCapacity>
+class InlinedRepeatedPtrFieldStorage;
 
 // kRepeatedFieldLowerClampLimit is the smallest size that will be allocated
 // when growing a repeated field.
@@ -310,7 +314,7 @@ class RepeatedField final {
   // Get the Arena on which this RepeatedField stores its elements.
   inline Arena* GetArena() const {
     return (total_size_ == 0) ? static_cast<Arena*>(arena_or_elements_)
-                              : rep()->arena;
+                              : RepArena(rep());
   }
 
   // For internal use only.
@@ -341,6 +345,22 @@ class RepeatedField final {
   };
   static constexpr size_t kRepHeaderSize = offsetof(Rep, elements);
 
+  // A field attached to an internal::InlinedRepeatedFieldStorage starts out
+  // with the Rep inside that storage.  The arena pointer of that Rep is tagged
+  // with kInlineRepTag so that it is never freed, nor handed to another field
+  // by InternalSwap().
+  static constexpr uintptr_t kInlineRepTag = 1;
+
+  static Arena* RepArena(const Rep* rep) {
+    return reinterpret_cast<Arena*>(reinterpret_cast<uintptr_t>(rep->arena) &
+                                    ~kInlineRepTag);
+  }
+
+  bool UsesInlineRep() const {
+    return total_size_ > 0 &&
+           (reinterpret_cast<uintptr_t>(rep()->arena) & kInlineRepTag) != 0;
+  }
+
   // If total_size_ == 0 this points to an Arena otherwise it points to the
   // elements member of a Rep struct. Using this invariant allows the storage of
   // the arena pointer without an extra allocation in the constructor.
@@ -371,6 +391,20 @@ class RepeatedField final {
   friend class Arena;
   typedef void InternalArenaConstructable_;
 
+  template <typename E, int kInlineCapacity>
+  friend class internal::InlinedRepeatedFieldStorage;
+
+  // Makes the Rep at |storage| the initial storage of an empty field, with room
+  // for |capacity| elements.
+  void InternalInitInlineRep(void* storage, int capacity);
+
+  // InternalSwap() for when either field uses its inline Rep.
+  PROTOBUF_NOINLINE void InternalSwapWithInlineRep(RepeatedField* other);
+
+  // Moves the elements to a newly allocated Rep of the same capacity, or
+  // leaves the field without a Rep if it is empty.
+  void ReleaseInlineRep();
+
   // Move the contents of |from| into |to|, possibly clobbering |from| in the
   // process.  For primitive types this is just a memcpy(), but it could be
   // specialized for non-primitive types to, say, swap each element instead.
@@ -397,6 +431,7 @@ class RepeatedField final {
         ::operator delete(static_cast<void*>(rep));
 #endif
       }
+      // Other Reps are owned by the arena, or are inline (and tagged).
     }
   }
 
@@ -583,7 +618,7 @@ class PROTOBUF_EXPORT RepeatedPtrFieldBase {
 #ifndef NDEBUG
     // Try to trigger segfault / asan failure in non-opt builds. If arena_
     // lifetime has ended before the destructor.
-    if (arena_) (void)arena_->SpaceAllocated();
+    if (GetArena()) (void)GetArena()->SpaceAllocated();
 #endif
   }
 
@@ -716,7 +751,20 @@ class PROTOBUF_EXPORT RepeatedPtrFieldBase {
   template <typename TypeHandler>
   PROTOBUF_NOINLINE void SwapFallback(RepeatedPtrFieldBase* other);
 
-  inline Arena* GetArena() const { return arena_; }
+  inline Arena* GetArena() const {
+    return reinterpret_cast<Arena*>(reinterpret_cast<uintptr_t>(arena_) &
+                                    ~kInlineRepTag);
+  }
+
+  // Size of the storage that InternalInitInlineRep() needs for |capacity|
+  // elements.
+  static constexpr size_t InlineRepSize(int capacity) {
+    return kRepHeaderSize + capacity * sizeof(void*);
+  }
+
+  // Makes the Rep at |storage| the initial storage of an empty field, with room
+  // for |capacity| elements.  Used by InlinedRepeatedPtrFieldStorage.
+  void InternalInitInlineRep(void* storage, int capacity);
 
  private:
   static constexpr int kInitialSize = 0;
@@ -731,6 +779,10 @@ class PROTOBUF_EXPORT RepeatedPtrFieldBase {
   // misses due to the indirection, because these fields are checked frequently.
   // Placing all fields directly in the RepeatedPtrFieldBase instance costs
   // significant performance for memory-sensitive workloads.
+  //
+  // The low bit of arena_ (kInlineRepTag) is set while rep_ points into an
+  // internal::InlinedRepeatedPtrFieldStorage, so that rep_ is never freed nor
+  // handed to another field by InternalSwap().  Use GetArena() to read it.
   Arena* arena_;
   int current_size_;
   int total_size_;
@@ -744,6 +796,19 @@ class PROTOBUF_EXPORT RepeatedPtrFieldBase {
   static constexpr size_t kRepHeaderSize = offsetof(Rep, elements);
   Rep* rep_;
 
+  static constexpr uintptr_t kInlineRepTag = 1;
+
+  bool UsesInlineRep() const {
+    return (reinterpret_cast<uintptr_t>(arena_) & kInlineRepTag) != 0;
+  }
+
+  // InternalSwap() for when either field uses its inline Rep.
+  void InternalSwapWithInlineRep(RepeatedPtrFieldBase* other);
+
+  // Moves the element pointers to a newly allocated Rep of the same capacity,
+  // or leaves the field without a Rep if it has no allocated elements.
+  void ReleaseInlineRep();
+
   template <typename TypeHandler>
   static inline typename TypeHandler::Type* cast(void* element) {
     return reinterpret_cast<typename TypeHandler::Type*>(element);
@@ -1173,6 +1238,9 @@ class RepeatedPtrField final : private internal::RepeatedPtrFieldBase {
   template <typename T>
   friend struct WeakRepeatedPtrField;
 
+  template <typename E, int kInlineCapacity>
+  friend class internal::InlinedRepeatedPtrFieldStorage;
+
   typedef void InternalArenaConstructable_;
 
 };
@@ -1458,6 +1526,10 @@ template <typename Element>
 inline void RepeatedField<Element>::InternalSwap(RepeatedField* other) {
   GOOGLE_DCHECK(this != other);
   GOOGLE_DCHECK(GetArena() == other->GetArena());
+  if (PROTOBUF_PREDICT_FALSE(UsesInlineRep() || other->UsesInlineRep())) {
+    InternalSwapWithInlineRep(other);
+    return;
+  }
 
   // Swap all fields at once.
   static_assert(std::is_standard_layout<RepeatedField<Element>>::value,
@@ -1526,7 +1598,9 @@ RepeatedField<Element>::cend() const {
 
 template <typename Element>
 inline size_t RepeatedField<Element>::SpaceUsedExcludingSelfLong() const {
-  return total_size_ > 0 ? (total_size_ * sizeof(Element) + kRepHeaderSize) : 0;
+  return total_size_ > 0 && !UsesInlineRep()
+             ? (total_size_ * sizeof(Element) + kRepHeaderSize)
+             : 0;
 }
 
 namespace internal {
@@ -1571,7 +1645,8 @@ void RepeatedField<Element>::Reserve(int new_size) {
   if (arena == NULL) {
     new_rep = static_cast<Rep*>(::operator new(bytes));
   } else {
-    new_rep = reinterpret_cast<Rep*>(Arena::CreateArray<char>(arena, bytes));
+    new_rep = reinterpret_cast<Rep*>(
+        Arena::CreateArrayForContainer<char>(arena, this, bytes));
   }
   new_rep->arena = arena;
   int old_total_size = total_size_;
@@ -1595,7 +1670,7 @@ void RepeatedField<Element>::Reserve(int new_size) {
   for (; e < limit; e++) {
     new (e) Element;
   }
-  if (current_size_ > 0) {
+  if (old_rep != NULL && current_size_ > 0) {
     MoveArray(&elements()[0], old_rep->elements, current_size_);
   }
 
@@ -1604,6 +1679,58 @@ void RepeatedField<Element>::Reserve(int new_size) {
 
 }
 
+template <typename Element>
+void RepeatedField<Element>::InternalInitInlineRep(void* storage,
+                                                  int capacity) {
+  GOOGLE_DCHECK_EQ(total_size_, 0);
+  Rep* inline_rep = static_cast<Rep*>(storage);
+  inline_rep->arena = reinterpret_cast<Arena*>(
+      reinterpret_cast<uintptr_t>(GetArena()) | kInlineRepTag);
+  Element* e = &inline_rep->elements[0];
+  Element* limit = e + capacity;
+  for (; e < limit; e++) {
+    new (e) Element;
+  }
+  total_size_ = capacity;
+  arena_or_elements_ = inline_rep->elements;
+}
+
+template <typename Element>
+void RepeatedField<Element>::InternalSwapWithInlineRep(RepeatedField* other) {
+  if (current_size_ <= other->total_size_ &&
+      other->current_size_ <= total_size_) {
+    // Each array has room for the other's elements, so swap them in place
+    // rather than moving an inline array out.
+    Element* elements = unsafe_elements();
+    std::swap_ranges(elements,
+                     elements + std::max(current_size_, other->current_size_),
+                     other->unsafe_elements());
+    std::swap(current_size_, other->current_size_);
+    return;
+  }
+  if (UsesInlineRep()) ReleaseInlineRep();
+  if (other->UsesInlineRep()) other->ReleaseInlineRep();
+  InternalSwap(other);
+}
+
+template <typename Element>
+void RepeatedField<Element>::ReleaseInlineRep() {
+  GOOGLE_DCHECK(UsesInlineRep());
+  Rep* inline_rep = rep();
+  const int capacity = total_size_;
+  const int size = current_size_;
+  current_size_ = 0;
+  total_size_ = 0;
+  arena_or_elements_ = RepArena(inline_rep);
+  if (size > 0) {
+    Reserve(capacity);
+    MoveArray(elements(), inline_rep->elements, size);
+    current_size_ = size;
+  }
+  // Only destroys the elements, as the Rep is tagged.
+  InternalDeallocate(inline_rep, capacity);
+}
+
 template <typename Element>
 inline void RepeatedField<Element>::Truncate(int new_size) {
   GOOGLE_DCHECK_LE(new_size, current_size_);
@@ -1655,18 +1782,20 @@ inline RepeatedPtrFieldBase::RepeatedPtrFieldBase(Arena* arena)
 
 template <typename TypeHandler>
 void RepeatedPtrFieldBase::Destroy() {
-  if (rep_ != NULL && arena_ == NULL) {
+  if (rep_ != NULL && GetArena() == NULL) {
     int n = rep_->allocated_size;
     void* const* elements = rep_->elements;
     for (int i = 0; i < n; i++) {
       TypeHandler::Delete(cast<TypeHandler>(elements[i]), NULL);
     }
+    if (!UsesInlineRep()) {
 #if defined(__GXX_DELETE_WITH_SIZE__) || defined(__cpp_sized_deallocation)
-    const size_t size = total_size_ * sizeof(elements[0]) + kRepHeaderSize;
-    ::operator delete(static_cast<void*>(rep_), size);
+      const size_t size = total_size_ * sizeof(elements[0]) + kRepHeaderSize;
+      ::operator delete(static_cast<void*>(rep_), size);
 #else
-    ::operator delete(static_cast<void*>(rep_));
+      ::operator delete(static_cast<void*>(rep_));
 #endif
+    }
   }
   rep_ = NULL;
 }
@@ -1733,7 +1862,7 @@ template <typename TypeHandler>
 inline void RepeatedPtrFieldBase::Delete(int index) {
   GOOGLE_DCHECK_GE(index, 0);
   GOOGLE_DCHECK_LT(index, current_size_);
-  TypeHandler::Delete(cast<TypeHandler>(rep_->elements[index]), arena_);
+  TypeHandler::Delete(cast<TypeHandler>(rep_->elements[index]), GetArena());
 }
 
 template <typename TypeHandler>
@@ -1747,7 +1876,7 @@ inline typename TypeHandler::Type* RepeatedPtrFieldBase::Add(
   }
   ++rep_->allocated_size;
   typename TypeHandler::Type* result =
-      TypeHandler::NewFromPrototype(prototype, arena_);
+      TypeHandler::NewFromPrototype(prototype, GetArena());
   rep_->elements[current_size_++] = result;
   return result;
 }
@@ -1764,7 +1893,7 @@ inline void RepeatedPtrFieldBase::Add(typename TypeHandler::Type&& value) {
   }
   ++rep_->allocated_size;
   typename TypeHandler::Type* result =
-      TypeHandler::New(arena_, std::move(value));
+      TypeHandler::New(GetArena(), std::move(value));
   rep_->elements[current_size_++] = result;
 }
 
@@ -1884,13 +2013,16 @@ inline void RepeatedPtrFieldBase::SwapElements(int index1, int index2) {
 
 template <typename TypeHandler>
 inline size_t RepeatedPtrFieldBase::SpaceUsedExcludingSelfLong() const {
-  size_t allocated_bytes = static_cast<size_t>(total_size_) * sizeof(void*);
+  size_t allocated_bytes = 0;
   if (rep_ != NULL) {
     for (int i = 0; i < rep_->allocated_size; ++i) {
       allocated_bytes +=
           TypeHandler::SpaceUsedLong(*cast<TypeHandler>(rep_->elements[i]));
     }
-    allocated_bytes += kRepHeaderSize;
+    if (!UsesInlineRep()) {
+      allocated_bytes += static_cast<size_t>(total_size_) * sizeof(void*) +
+                         kRepHeaderSize;
+    }
   }
   return allocated_bytes;
 }
@@ -1988,7 +2120,7 @@ void RepeatedPtrFieldBase::UnsafeArenaAddAllocated(
     // case because otherwise a loop calling AddAllocated() followed by Clear()
     // would leak memory.
     TypeHandler::Delete(cast<TypeHandler>(rep_->elements[current_size_]),
-                        arena_);
+                        GetArena());
   } else if (current_size_ < rep_->allocated_size) {
     // We have some cleared objects.  We don't care about their order, so we
     // can just move the first one to the end to make space.
@@ -2588,6 +2720,10 @@ class RepeatedPtrOverPtrsIterator {
 void RepeatedPtrFieldBase::InternalSwap(RepeatedPtrFieldBase* other) {
   GOOGLE_DCHECK(this != other);
   GOOGLE_DCHECK(GetArena() == other->GetArena());
+  if (PROTOBUF_PREDICT_FALSE(UsesInlineRep() || other->UsesInlineRep())) {
+    InternalSwapWithInlineRep(other);
+    return;
+  }
 
   // Swap all fields at once.
   static_assert(std::is_standard_layout<RepeatedPtrFieldBase>::value,
@@ -2655,6 +2791,55 @@ RepeatedPtrField<Element>::pointer_end() const {
       const_cast<const void* const*>(raw_data() + size()));
 }
 
+namespace internal {
+
+// InlinedRepeatedFieldStorage and InlinedRepeatedPtrFieldStorage hold the
+// array for the first kInlineCapacity elements (element pointers for
+// RepeatedPtrField) of a repeated field.  With the inline_repeated_fields
+// generator option, a message declares one next to each repeated field and
+// attaches it to the field in its constructors, so that short fields need no
+// allocation for their array, which stays next to the field's size.
+//
+// Growing past kInlineCapacity moves the array out, as if the field had been
+// allocated with a capacity of kInlineCapacity.  Swapping two fields swaps
+// their elements in place when each array has room for the other's, and
+// otherwise moves the inline arrays out first.  The storage must outlive the
+// field, and is not copied, moved or swapped along with it.
+template <typename Element, int kInlineCapacity>
+class InlinedRepeatedFieldStorage {
+  static_assert(kInlineCapacity > 0, "Use RepeatedField");
+
+ public:
+  // |field| must be empty, and must not have been attached to storage before.
+  void Attach(RepeatedField<Element>* field) {
+    field->InternalInitInlineRep(&storage_, kInlineCapacity);
+  }
+
+ private:
+  typedef typename RepeatedField<Element>::Rep Rep;
+  typename std::aligned_storage<RepeatedField<Element>::kRepHeaderSize +
+                                    kInlineCapacity * sizeof(Element),
+                                alignof(Rep)>::type storage_;
+};
+
+template <typename Element, int kInlineCapacity>
+class InlinedRepeatedPtrFieldStorage {
+  static_assert(kInlineCapacity > 0, "Use RepeatedPtrField");
+
+ public:
+  // |field| must be empty, and must not have been attached to storage before.
+  void Attach(RepeatedPtrField<Element>* field) {
+    field->InternalInitInlineRep(&storage_, kInlineCapacity);
+  }
+
+ private:
+  typename std::aligned_storage<
+      RepeatedPtrField<Element>::InlineRepSize(kInlineCapacity),
+      alignof(void*)>::type storage_;
+};
+
+}  // namespace internal
+
 // Iterators and helper functions that follow the spirit of the STL
 // std::back_insert_iterator and std::back_inserter but are tailor-made
 // for RepeatedField and RepeatedPtrField. Typical usage would be:
@@ -823,6 +823,83 @@ TEST(RepeatedField, TestSAddFromSelf) {
   }
 }
 
+TEST(RepeatedField, Inlined) {
+  internal::InlinedRepeatedFieldStorage<int, 4> storage;
+  RepeatedField<int> field;
+  storage.Attach(&field);
+  const int* inline_data = field.data();
+  EXPECT_EQ(4, field.Capacity());
+  EXPECT_EQ(0, field.SpaceUsedExcludingSelf());
+  for (int i = 0; i < 4; i++) field.Add(i);
+  EXPECT_EQ(inline_data, field.data());
+  EXPECT_EQ(0, field.SpaceUsedExcludingSelf());
+
+  field.Add(4);
+  EXPECT_NE(inline_data, field.data());
+  EXPECT_GT(field.Capacity(), 4);
+  EXPECT_THAT(field, ElementsAre(0, 1, 2, 3, 4));
+
+  // The other field's inline array has no room for five elements, so it moves
+  // out before the arrays are swapped.
+  internal::InlinedRepeatedFieldStorage<int, 4> other_storage;
+  RepeatedField<int> other;
+  other_storage.Attach(&other);
+  other.Add(5);
+  field.Swap(&other);
+  EXPECT_THAT(field, ElementsAre(5));
+  EXPECT_EQ(4, field.Capacity());
+  EXPECT_THAT(other, ElementsAre(0, 1, 2, 3, 4));
+
+  Arena arena;
+  internal::InlinedRepeatedFieldStorage<int, 2> arena_storage;
+  RepeatedField<int> on_arena(&arena);
+  arena_storage.Attach(&on_arena);
+  EXPECT_EQ(&arena, on_arena.GetArena());
+  on_arena.Add(1);
+  on_arena.Add(2);
+  on_arena.Add(3);
+  EXPECT_EQ(&arena, on_arena.GetArena());
+  EXPECT_THAT(on_arena, ElementsAre(1, 2, 3));
+}
+
+TEST(RepeatedField, InlinedSwapInPlace) {
+  internal::InlinedRepeatedFieldStorage<int, 4> storage1;
+  internal::InlinedRepeatedFieldStorage<int, 4> storage2;
+  RepeatedField<int> field1;
+  RepeatedField<int> field2;
+  storage1.Attach(&field1);
+  storage2.Attach(&field2);
+  const int* data1 = field1.data();
+  const int* data2 = field2.data();
+
+  // Fields which fit into each other's arrays swap their elements, so both
+  // keep their inline arrays.
+  field1.Swap(&field2);
+  EXPECT_EQ(data1, field1.data());
+  EXPECT_EQ(data2, field2.data());
+  field1.Add(1);
+  field1.Add(2);
+  field2.Add(3);
+  field1.Swap(&field2);
+  EXPECT_THAT(field1, ElementsAre(3));
+  EXPECT_THAT(field2, ElementsAre(1, 2));
+  EXPECT_EQ(data1, field1.data());
+  EXPECT_EQ(data2, field2.data());
+  EXPECT_EQ(4, field1.Capacity());
+  EXPECT_EQ(4, field2.Capacity());
+
+  // Including with a field which has no inline storage.
+  RepeatedField<int> field3;
+  field3.Reserve(8);
+  field3.Add(4);
+  const int* data3 = field3.data();
+  field1.Swap(&field3);
+  EXPECT_THAT(field1, ElementsAre(4));
+  EXPECT_THAT(field3, ElementsAre(3));
+  EXPECT_EQ(data1, field1.data());
+  EXPECT_EQ(data3, field3.data());
+}
+
 // ===================================================================
 // RepeatedPtrField tests.  These pretty much just mirror the RepeatedField
 // tests above.
@@ -1473,6 +1550,76 @@ TEST(RepeatedPtrField, DeleteSubrange) {
   // DeleteSubrange is a trivial extension of ExtendSubrange.
 }
 
+TEST(RepeatedPtrField, Inlined) {
+  internal::InlinedRepeatedPtrFieldStorage<std::string, 2> storage;
+  RepeatedPtrField<std::string> field;
+  storage.Attach(&field);
+  EXPECT_EQ(2, field.Capacity());
+  *field.Add() = "a";
+  *field.Add() = "b";
+  const std::string* const* inline_data = field.data();
+  EXPECT_EQ(2, field.Capacity());
+  *field.Add() = "c";
+  EXPECT_NE(inline_data, field.data());
+  EXPECT_THAT(field, ElementsAre("a", "b", "c"));
+
+  // The other field's inline array has no room for three elements, so it
+  // moves out before the arrays are swapped.  Elements keep their addresses.
+  internal::InlinedRepeatedPtrFieldStorage<std::string, 2> other_storage;
+  RepeatedPtrField<std::string> other;
+  other_storage.Attach(&other);
+  std::string* d = other.Add();
+  *d = "d";
+  field.Swap(&other);
+  EXPECT_EQ(d, &field.Get(0));
+  EXPECT_THAT(other, ElementsAre("a", "b", "c"));
+
+  field.RemoveLast();
+  EXPECT_EQ(1, field.ClearedCount());
+  EXPECT_EQ(d, field.Add());
+
+  Arena arena;
+  internal::InlinedRepeatedPtrFieldStorage<std::string, 1> arena_storage;
+  RepeatedPtrField<std::string> on_arena(&arena);
+  arena_storage.Attach(&on_arena);
+  *on_arena.Add() = "e";
+  *on_arena.Add() = "f";
+  EXPECT_EQ(&arena, on_arena.GetArena());
+  EXPECT_THAT(on_arena, ElementsAre("e", "f"));
+}
+
+TEST(RepeatedPtrField, InlinedSwapInPlace) {
+  internal::InlinedRepeatedPtrFieldStorage<std::string, 2> storage1;
+  internal::InlinedRepeatedPtrFieldStorage<std::string, 2> storage2;
+  RepeatedPtrField<std::string> field1;
+  RepeatedPtrField<std::string> field2;
+  storage1.Attach(&field1);
+  storage2.Attach(&field2);
+  const std::string* const* data1 = field1.data();
+  const std::string* const* data2 = field2.data();
+
+  // Fields which fit into each other's arrays swap their element pointers,
+  // cleared ones included, so both keep their inline arrays.
+  field1.Swap(&field2);
+  EXPECT_EQ(data1, field1.data());
+  EXPECT_EQ(data2, field2.data());
+  std::string* a = field1.Add();
+  *a = "a";
+  std::string* b = field2.Add();
+  *b = "b";
+  *field2.Add() = "c";
+  field2.RemoveLast();
+  field1.Swap(&field2);
+  EXPECT_EQ(b, &field1.Get(0));
+  EXPECT_EQ(a, &field2.Get(0));
+  EXPECT_EQ(1, field1.ClearedCount());
+  EXPECT_EQ(0, field2.ClearedCount());
+  EXPECT_EQ(data1, field1.data());
+  EXPECT_EQ(data2, field2.data());
+  EXPECT_EQ(2, field1.Capacity());
+  EXPECT_EQ(2, field2.Capacity());
+}
+
 // ===================================================================
 
 // Iterator tests stolen from net/proto/proto-array_unittest.
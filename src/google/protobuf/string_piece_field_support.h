@@ -0,0 +1,139 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef GOOGLE_PROTOBUF_STRING_PIECE_FIELD_SUPPORT_H__
+#define GOOGLE_PROTOBUF_STRING_PIECE_FIELD_SUPPORT_H__
+
+#include <cstring>
+#include <string>
+#include <utility>
+
+#include <google/protobuf/stubs/logging.h>
+#include <google/protobuf/arena.h>
+#include <google/protobuf/parse_context.h>
+#include <google/protobuf/stubs/strutil.h>
+
+// Must be included last.
+#include <google/protobuf/port_def.inc>
+
+#ifdef SWIG
+#error "You cannot SWIG proto headers"
+#endif
+
+namespace google {
+namespace protobuf {
+namespace internal {
+
+// StringPieceField is the storage of a singular string or bytes field declared
+// with [ctype = STRING_PIECE] when the C++ code generator runs with the
+// string_piece_fields option.
+//
+// The value is either a copy owned by the field, or a reference to bytes that
+// outlive the message.  Parsing with aliasing enabled (e.g.
+// MessageLite::ParseFromArrayWithAliasing()) makes the field refer into the
+// parsed buffer, so that large payloads are never copied.  Copies live on the
+// arena of the message if it has one, and are otherwise freed by Destroy().
+class PROTOBUF_EXPORT StringPieceField {
+ public:
+  constexpr StringPieceField() : StringPieceField(nullptr) {}
+  explicit constexpr StringPieceField(Arena* arena)
+      : data_(nullptr),
+        size_(0),
+        buffer_(nullptr),
+        capacity_(0),
+        arena_(arena) {}
+
+  StringPiece Get() const { return StringPiece(data_, size_); }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  // Copies |value| into storage owned by the field.
+  void Set(StringPiece value) {
+    if (value.size() > capacity_) {
+      // |value| can't point into buffer_, it doesn't fit in it.
+      if (arena_ == nullptr) ::operator delete[](buffer_);
+      buffer_ = Arena::CreateArray<char>(arena_, value.size());
+      capacity_ = value.size();
+    }
+    if (!value.empty()) std::memmove(buffer_, value.data(), value.size());
+    data_ = buffer_;
+    size_ = value.size();
+  }
+
+  // Points the field at |value| without copying it.  The caller must make sure
+  // that the bytes outlive the field, or at least its next Set() or Clear().
+  void SetAliased(StringPiece value) {
+    data_ = value.data();
+    size_ = value.size();
+  }
+
+  // Empties the field.  An owned buffer is kept for reuse.
+  void Clear() {
+    data_ = buffer_;
+    size_ = 0;
+  }
+
+  // Only valid for fields of messages on the same arena.
+  void Swap(StringPieceField* other) {
+    GOOGLE_DCHECK(arena_ == other->arena_);
+    std::swap(data_, other->data_);
+    std::swap(size_, other->size_);
+    std::swap(buffer_, other->buffer_);
+    std::swap(capacity_, other->capacity_);
+  }
+
+  // Frees the owned buffer unless it is on an arena.
+  void Destroy() {
+    if (arena_ == nullptr) ::operator delete[](buffer_);
+  }
+
+  // Aliased bytes are not counted, they belong to someone else.
+  size_t SpaceUsedExcludingSelfLong() const { return capacity_; }
+
+ private:
+  const char* data_;
+  size_t size_;
+  // Storage for copies, allocated on arena_ if it is not null.
+  char* buffer_;
+  size_t capacity_;
+  Arena* arena_;
+};
+
+inline bool VerifyUTF8(const StringPieceField* s, const char* field_name) {
+  return VerifyUTF8(s->Get(), field_name);
+}
+
+}  // namespace internal
+}  // namespace protobuf
+}  // namespace google
+
+#include <google/protobuf/port_undef.inc>
+
+#endif  // GOOGLE_PROTOBUF_STRING_PIECE_FIELD_SUPPORT_H__
@@ -546,8 +546,8 @@ PROTOBUF_EXPORT string SimpleItoa(unsigned long long i);
 //    Description: converts a double or float to a string which, if
 //    passed to NoLocaleStrtod(), will produce the exact same original double
 //    (except in case of NaN; all NaNs are considered the same value).
-//    We try to keep the string short but it's not guaranteed to be as
-//    short as possible.
+//    The string has as few significant digits as possible, laid out like
+//    printf("%g") output.
 //
 //    DoubleToBuffer() and FloatToBuffer() write the text to the given
 //    buffer and return it.  The buffer must be at least
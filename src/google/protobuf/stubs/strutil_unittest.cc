@@ -34,6 +34,11 @@
 
 #include <locale.h>
 
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <random>
+
 #include <google/protobuf/stubs/stl_util.h>
 #include <google/protobuf/testing/googletest.h>
 #include <gtest/gtest.h>
@@ -74,6 +79,170 @@ TEST(StringUtilityTest, ImmuneToLocales) {
   setlocale(LC_NUMERIC, old_locale.c_str());
 }
 
+TEST(StringUtilityTest, DoubleToBufferSpecialValues) {
+  EXPECT_EQ("0", SimpleDtoa(0.0));
+  EXPECT_EQ("-0", SimpleDtoa(-0.0));
+  EXPECT_EQ("inf", SimpleDtoa(std::numeric_limits<double>::infinity()));
+  EXPECT_EQ("-inf", SimpleDtoa(-std::numeric_limits<double>::infinity()));
+  EXPECT_EQ("nan", SimpleDtoa(std::numeric_limits<double>::quiet_NaN()));
+  EXPECT_EQ("0.1", SimpleDtoa(0.1));
+  EXPECT_EQ("-2.5", SimpleDtoa(-2.5));
+  EXPECT_EQ("100000", SimpleDtoa(1e5));
+  EXPECT_EQ("1e+15", SimpleDtoa(1e15));
+  EXPECT_EQ("1e+100", SimpleDtoa(1e100));
+  EXPECT_EQ("0.0001", SimpleDtoa(1e-4));
+  EXPECT_EQ("1e-05", SimpleDtoa(1e-5));
+  EXPECT_EQ("0.30000000000000004", SimpleDtoa(0.1 + 0.2));
+  EXPECT_EQ("0.7999999999999999", SimpleDtoa(0.1 + 0.7));
+  EXPECT_EQ("1.7976931348623157e+308",
+            SimpleDtoa(std::numeric_limits<double>::max()));
+  EXPECT_EQ("2.2250738585072014e-308",
+            SimpleDtoa(std::numeric_limits<double>::min()));
+  EXPECT_EQ("5e-324", SimpleDtoa(std::numeric_limits<double>::denorm_min()));
+  EXPECT_EQ("9007199254740992", SimpleDtoa(9007199254740992.0));
+}
+
+TEST(StringUtilityTest, FloatToBufferSpecialValues) {
+  EXPECT_EQ("0", SimpleFtoa(0.0f));
+  EXPECT_EQ("-0", SimpleFtoa(-0.0f));
+  EXPECT_EQ("inf", SimpleFtoa(std::numeric_limits<float>::infinity()));
+  EXPECT_EQ("nan", SimpleFtoa(std::numeric_limits<float>::quiet_NaN()));
+  EXPECT_EQ("0.1", SimpleFtoa(0.1f));
+  EXPECT_EQ("1e+10", SimpleFtoa(1e10f));
+  EXPECT_EQ("3.4028235e+38", SimpleFtoa(std::numeric_limits<float>::max()));
+  EXPECT_EQ("1e-45", SimpleFtoa(std::numeric_limits<float>::denorm_min()));
+}
+
+// Returns the number of significant digits in the output of DoubleToBuffer()
+// or FloatToBuffer(), not counting the zeros padding integers.
+int CountSignificantDigits(const std::string& text) {
+  std::string digits;
+  for (char c : text) {
+    if (c == 'e') break;
+    if (c < '0' || c > '9' || (digits.empty() && c == '0')) continue;
+    digits += c;
+  }
+  return digits.find_last_not_of('0') + 1;
+}
+
+template <typename T>
+T ParseAs(const char* text, char** end);
+
+template <>
+double ParseAs<double>(const char* text, char** end) {
+  return strtod(text, end);
+}
+
+template <>
+float ParseAs<float>(const char* text, char** end) {
+  return strtof(text, end);
+}
+
+// Checks that text is the shortest string that reads back as value, and
+// that it is what snprintf() printed before whenever that was exact.
+template <typename T>
+void ExpectShortestRoundTrip(T value, const std::string& text,
+                             int short_precision, int long_precision) {
+  char* end;
+  const T parsed = ParseAs<T>(text.c_str(), &end);
+  EXPECT_EQ(*end, '\0') << text;
+  ASSERT_EQ(value, parsed) << text;
+
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "%.*g", short_precision, value);
+  const bool short_exact = ParseAs<T>(buffer, nullptr) == value;
+  if (short_exact && std::abs(value) >= std::numeric_limits<T>::min()) {
+    EXPECT_EQ(buffer, text);
+    return;
+  }
+  const int digits = CountSignificantDigits(text);
+  EXPECT_LE(digits, long_precision) << text;
+  // Having one digit less, correctly rounded, must not read back.
+  if (digits > 1) {
+    snprintf(buffer, sizeof(buffer), "%.*e", digits - 2, value);
+    EXPECT_NE(value, ParseAs<T>(buffer, nullptr))
+        << text << " " << buffer;
+  }
+}
+
+TEST(StringUtilityTest, DoubleToBufferPrintsShortestRoundTrip) {
+  std::mt19937_64 random(301);
+  for (int i = 0; i < 100000; ++i) {
+    uint64 bits = random();
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    if (!std::isfinite(value)) continue;
+    ExpectShortestRoundTrip(value, SimpleDtoa(value), 15, 17);
+  }
+  // Short decimals, integers and values near powers of two.
+  for (int i = 0; i < 20000; ++i) {
+    const double value = static_cast<double>(random() % 1000000) /
+                         std::pow(10.0, static_cast<int>(random() % 12));
+    ExpectShortestRoundTrip(value, SimpleDtoa(value), 15, 17);
+  }
+  for (int e = -1074; e <= 1023; ++e) {
+    const double power = std::ldexp(1.0, e);
+    ExpectShortestRoundTrip(power, SimpleDtoa(power), 15, 17);
+    const double below = std::nextafter(power, 0.0);
+    ExpectShortestRoundTrip(below, SimpleDtoa(below), 15, 17);
+  }
+}
+
+TEST(StringUtilityTest, FloatToBufferPrintsShortestRoundTrip) {
+  std::mt19937 random(301);
+  for (int i = 0; i < 100000; ++i) {
+    uint32 bits = random();
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    if (!std::isfinite(value)) continue;
+    ExpectShortestRoundTrip(value, SimpleFtoa(value), 6, 9);
+  }
+  for (int e = -149; e <= 127; ++e) {
+    const float power = std::ldexp(1.0f, e);
+    ExpectShortestRoundTrip(power, SimpleFtoa(power), 6, 9);
+    const float below = std::nextafter(power, 0.0f);
+    ExpectShortestRoundTrip(below, SimpleFtoa(below), 6, 9);
+  }
+}
+
+TEST(StringUtilityTest, NoLocaleStrtodMatchesStrtod) {
+  const char* kInputs[] = {
+      "0",        "-0",         "+1.5",     "1.",          ".5",
+      "0.000123", "123.456e-7", "1e22",     "1e23",        "9007199254740993",
+      "1e",       "1e+",        "2.5E-3x",  "1.5f",        "0x10",
+      "inf",      "-nan",       " 1",       ".",           "-",
+      "1e-400",   "1e400",      "0e999999", "4.9e-324",    "3.14159265358979323846",
+      "00012",    "1234567890123456789",    "12345678901234567890",
+  };
+  for (const char* input : kInputs) {
+    char* expected_end;
+    const double expected = strtod(input, &expected_end);
+    char* end;
+    const double value = internal::NoLocaleStrtod(input, &end);
+    EXPECT_EQ(expected_end, end) << input;
+    if (std::isnan(expected)) {
+      EXPECT_TRUE(std::isnan(value)) << input;
+    } else {
+      EXPECT_EQ(expected, value) << input;
+      EXPECT_EQ(std::signbit(expected), std::signbit(value)) << input;
+    }
+  }
+
+  std::mt19937_64 random(301);
+  for (int i = 0; i < 100000; ++i) {
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%llu.%llue%d",
+             static_cast<unsigned long long>(random() % 100000000),
+             static_cast<unsigned long long>(random() % 10000000000ULL),
+             static_cast<int>(random() % 60) - 30);
+    char* expected_end;
+    const double expected = strtod(buffer, &expected_end);
+    char* end;
+    EXPECT_EQ(expected, internal::NoLocaleStrtod(buffer, &end)) << buffer;
+    EXPECT_EQ(expected_end, end) << buffer;
+  }
+}
+
 #define EXPECT_EQ_ARRAY(len, x, y, msg)                     \
   for (int j = 0; j < len; ++j) {                           \
     EXPECT_EQ(x[j], y[j]) << "" # x << " != " # y           \
@@ -49,38 +49,106 @@
 namespace google {
 namespace protobuf {
 
+namespace {
+
+std::atomic<bool> raw_bytes_mode_enabled{false};
+
+void DeleteFields(std::vector<UnknownField>* fields) {
+  for (UnknownField& field : *fields) field.Delete();
+  fields->clear();
+}
+
+}  // namespace
+
 const UnknownFieldSet& UnknownFieldSet::default_instance() {
   static auto instance = internal::OnShutdownDelete(new UnknownFieldSet());
   return *instance;
 }
 
+void UnknownFieldSet::SetRawBytesMode(bool enabled) {
+  raw_bytes_mode_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool UnknownFieldSet::raw_bytes_mode() {
+  return raw_bytes_mode_enabled.load(std::memory_order_relaxed);
+}
+
 void UnknownFieldSet::ClearFallback() {
-  GOOGLE_DCHECK(!fields_.empty());
-  int n = fields_.size();
-  do {
-    (fields_)[--n].Delete();
-  } while (n > 0);
-  fields_.clear();
+  GOOGLE_DCHECK(!fields_.empty() || !raw_.empty());
+  DeleteFields(&fields_);
+  ClearDecodedFields();
+  raw_.clear();
 }
 
-void UnknownFieldSet::InternalMergeFrom(const UnknownFieldSet& other) {
-  int other_field_count = other.field_count();
-  if (other_field_count > 0) {
-    fields_.reserve(fields_.size() + other_field_count);
-    for (int i = 0; i < other_field_count; i++) {
-      fields_.push_back((other.fields_)[i]);
-      fields_.back().DeepCopy((other.fields_)[i]);
-    }
+const std::vector<UnknownField>& UnknownFieldSet::DecodedFields() const {
+  std::vector<UnknownField>* decoded =
+      decoded_fields_.load(std::memory_order_acquire);
+  if (decoded != nullptr) return *decoded;
+
+  UnknownFieldSet set;
+  const char* ptr;
+  internal::ParseContext ctx(io::CodedInputStream::GetDefaultRecursionLimit(),
+                             false, &ptr, raw_);
+  // raw_ was copied by a parser that checked it, so this only fails if that
+  // parse failed part way, in which case what was copied is kept.
+  internal::UnknownGroupParse(&set, ptr, &ctx);
+  decoded = new std::vector<UnknownField>(std::move(set.fields_));
+  set.fields_.clear();
+
+  std::vector<UnknownField>* expected = nullptr;
+  if (!decoded_fields_.compare_exchange_strong(expected, decoded,
+                                               std::memory_order_acq_rel)) {
+    // Another thread was first.
+    DeleteFields(decoded);
+    delete decoded;
+    decoded = expected;
   }
+  return *decoded;
+}
+
+void UnknownFieldSet::DecodeRawBytes() {
+  GOOGLE_DCHECK(fields_.empty());
+  DecodedFields();
+  std::vector<UnknownField>* decoded =
+      decoded_fields_.exchange(nullptr, std::memory_order_relaxed);
+  fields_ = std::move(*decoded);
+  delete decoded;
+  raw_.clear();
+}
+
+void UnknownFieldSet::ClearDecodedFields() {
+  std::vector<UnknownField>* decoded =
+      decoded_fields_.exchange(nullptr, std::memory_order_relaxed);
+  if (decoded != nullptr) {
+    DeleteFields(decoded);
+    delete decoded;
+  }
+}
+
+std::string* UnknownFieldSet::MutableRawBytesForParse() {
+  if (!fields_.empty() || !raw_bytes_mode()) return nullptr;
+  ClearDecodedFields();
+  return &raw_;
+}
+
+void UnknownFieldSet::InternalMergeFrom(const UnknownFieldSet& other) {
+  MergeFrom(other);
 }
 
 void UnknownFieldSet::MergeFrom(const UnknownFieldSet& other) {
-  int other_field_count = other.field_count();
-  if (other_field_count > 0) {
-    fields_.reserve(fields_.size() + other_field_count);
-    for (int i = 0; i < other_field_count; i++) {
-      fields_.push_back((other.fields_)[i]);
-      fields_.back().DeepCopy((other.fields_)[i]);
+  if (!other.raw_.empty() && fields_.empty()) {
+    // Appending bytes to bytes keeps them undecoded.
+    ClearDecodedFields();
+    raw_.append(other.raw_);
+    return;
+  }
+  const std::vector<UnknownField>& other_fields = other.fields();
+  if (!other_fields.empty()) {
+    if (!raw_.empty()) DecodeRawBytes();
+    fields_.reserve(fields_.size() + other_fields.size());
+    for (const UnknownField& field : other_fields) {
+      fields_.push_back(field);
+      fields_.back().DeepCopy(field);
     }
   }
 }
@@ -88,6 +156,19 @@ void UnknownFieldSet::MergeFrom(const UnknownFieldSet& other) {
 // A specialized MergeFrom for performance when we are merging from an UFS that
 // is temporary and can be destroyed in the process.
 void UnknownFieldSet::MergeFromAndDestroy(UnknownFieldSet* other) {
+  if (!other->raw_.empty() && fields_.empty()) {
+    ClearDecodedFields();
+    if (raw_.empty()) {
+      raw_.swap(other->raw_);
+    } else {
+      raw_.append(other->raw_);
+    }
+    other->Clear();
+    return;
+  }
+  if (other->empty()) return;
+  if (!raw_.empty()) DecodeRawBytes();
+  if (!other->raw_.empty()) other->DecodeRawBytes();
   if (fields_.empty()) {
     fields_ = std::move(other->fields_);
   } else {
@@ -104,6 +185,9 @@ void UnknownFieldSet::MergeToInternalMetadata(
 }
 
 size_t UnknownFieldSet::SpaceUsedExcludingSelfLong() const {
+  if (!raw_.empty()) {
+    return internal::StringSpaceUsedExcludingSelfLong(raw_);
+  }
   if (fields_.empty()) return 0;
 
   size_t total_size = sizeof(fields_) + sizeof(UnknownField) * fields_.size();
@@ -131,6 +215,7 @@ size_t UnknownFieldSet::SpaceUsedLong() const {
 }
 
 void UnknownFieldSet::AddVarint(int number, uint64 value) {
+  if (!raw_.empty()) DecodeRawBytes();
   UnknownField field;
   field.number_ = number;
   field.SetType(UnknownField::TYPE_VARINT);
@@ -139,6 +224,7 @@ void UnknownFieldSet::AddVarint(int number, uint64 value) {
 }
 
 void UnknownFieldSet::AddFixed32(int number, uint32 value) {
+  if (!raw_.empty()) DecodeRawBytes();
   UnknownField field;
   field.number_ = number;
   field.SetType(UnknownField::TYPE_FIXED32);
@@ -147,6 +233,7 @@ void UnknownFieldSet::AddFixed32(int number, uint32 value) {
 }
 
 void UnknownFieldSet::AddFixed64(int number, uint64 value) {
+  if (!raw_.empty()) DecodeRawBytes();
   UnknownField field;
   field.number_ = number;
   field.SetType(UnknownField::TYPE_FIXED64);
@@ -155,6 +242,7 @@ void UnknownFieldSet::AddFixed64(int number, uint64 value) {
 }
 
 std::string* UnknownFieldSet::AddLengthDelimited(int number) {
+  if (!raw_.empty()) DecodeRawBytes();
   UnknownField field;
   field.number_ = number;
   field.SetType(UnknownField::TYPE_LENGTH_DELIMITED);
@@ -165,6 +253,7 @@ std::string* UnknownFieldSet::AddLengthDelimited(int number) {
 
 
 UnknownFieldSet* UnknownFieldSet::AddGroup(int number) {
+  if (!raw_.empty()) DecodeRawBytes();
   UnknownField field;
   field.number_ = number;
   field.SetType(UnknownField::TYPE_GROUP);
@@ -174,11 +263,13 @@ UnknownFieldSet* UnknownFieldSet::AddGroup(int number) {
 }
 
 void UnknownFieldSet::AddField(const UnknownField& field) {
+  if (!raw_.empty()) DecodeRawBytes();
   fields_.push_back(field);
   fields_.back().DeepCopy(field);
 }
 
 void UnknownFieldSet::DeleteSubrange(int start, int num) {
+  if (!raw_.empty()) DecodeRawBytes();
   // Delete the specified fields.
   for (int i = 0; i < num; ++i) {
     (fields_)[i + start].Delete();
@@ -194,6 +285,7 @@ void UnknownFieldSet::DeleteSubrange(int start, int num) {
 }
 
 void UnknownFieldSet::DeleteByNumber(int number) {
+  if (!raw_.empty()) DecodeRawBytes();
   int left = 0;  // The number of fields left after deletion.
   for (int i = 0; i < fields_.size(); ++i) {
     UnknownField* field = &(fields_)[i];
@@ -283,6 +375,12 @@ class UnknownFieldParserHelper {
   explicit UnknownFieldParserHelper(UnknownFieldSet* unknown)
       : unknown_(unknown) {}
 
+  // Returns where UnknownFieldParse() should copy the fields it parses into
+  // unknown, or null.
+  static std::string* RawBytes(UnknownFieldSet* unknown) {
+    return unknown->MutableRawBytesForParse();
+  }
+
   void AddVarint(uint32 num, uint64 value) { unknown_->AddVarint(num, value); }
   void AddFixed64(uint32 num, uint64 value) {
     unknown_->AddFixed64(num, value);
@@ -318,6 +416,9 @@ const char* UnknownGroupParse(UnknownFieldSet* unknown, const char* ptr,
 
 const char* UnknownFieldParse(uint64 tag, UnknownFieldSet* unknown,
                               const char* ptr, ParseContext* ctx) {
+  if (std::string* raw = UnknownFieldParserHelper::RawBytes(unknown)) {
+    return UnknownFieldParse(static_cast<uint32>(tag), raw, ptr, ctx);
+  }
   UnknownFieldParserHelper field_parser(unknown);
   return FieldParser(tag, field_parser, ptr, ctx);
 }
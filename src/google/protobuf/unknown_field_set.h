@@ -40,6 +40,7 @@
 
 #include <assert.h>
 
+#include <atomic>
 #include <string>
 #include <vector>
 
@@ -62,6 +63,7 @@ namespace protobuf {
 namespace internal {
 class InternalMetadata;           // metadata_lite.h
 class WireFormat;                 // wire_format.h
+class UnknownFieldParserHelper;   // unknown_field_set.cc
 class MessageSetFieldSkipperUsingCord;
 // extension_set_heavy.cc
 }  // namespace internal
@@ -81,6 +83,10 @@ class UnknownField;  // below
 //
 // This class is necessarily tied to the protocol buffer wire format, unlike
 // the Reflection interface which is independent of any serialization scheme.
+//
+// In raw bytes mode (see SetRawBytesMode()) parsed unknown fields are kept as
+// their wire-format bytes and only decoded into UnknownFields when they are
+// read through field_count() or field(), or modified.
 class PROTOBUF_EXPORT UnknownFieldSet {
  public:
   UnknownFieldSet();
@@ -174,14 +180,55 @@ class PROTOBUF_EXPORT UnknownFieldSet {
 
   static const UnknownFieldSet& default_instance();
 
+  // Raw bytes mode --------------------------------------------------
+
+  // When enabled, parsing a full (non-lite) message appends its unknown
+  // fields to the set as the wire-format bytes they arrived in, the way the
+  // lite runtime stores them, instead of allocating an UnknownField (and a
+  // string for each length-delimited field) per field. Serializing the
+  // message again copies the bytes unchanged, so a proxy that forwards
+  // messages it does not fully understand neither decodes nor allocates for
+  // their unknown fields.
+  //
+  // The first read through field_count() or field() decodes the bytes into
+  // UnknownFields; concurrent first reads are safe. Modifying the set
+  // replaces the bytes with the decoded fields. Sets that already hold
+  // decoded fields keep adding parsed fields as UnknownFields.
+  //
+  // The mode is process-wide and off by default. It only affects parsing
+  // through the ParseContext parser, which is what Message::ParseFrom*()
+  // uses.
+  static void SetRawBytesMode(bool enabled);
+  static bool raw_bytes_mode();
+
  private:
   // For InternalMergeFrom
   friend class UnknownField;
+  // For the raw bytes.
+  friend class internal::WireFormat;
+  friend class internal::UnknownFieldParserHelper;
+  friend void internal::WriteVarint(uint32 num, uint64 val,
+                                    UnknownFieldSet* unknown);
+  friend void internal::WriteLengthDelimited(uint32 num, StringPiece val,
+                                             UnknownFieldSet* unknown);
   // Merges from other UnknownFieldSet. This method assumes, that this object
   // is newly created and has no fields.
   void InternalMergeFrom(const UnknownFieldSet& other);
   void ClearFallback();
 
+  // The fields of the set, decoding raw_ if the set holds bytes.
+  const std::vector<UnknownField>& fields() const {
+    return PROTOBUF_PREDICT_TRUE(raw_.empty()) ? fields_ : DecodedFields();
+  }
+  const std::vector<UnknownField>& DecodedFields() const;
+  // Replaces raw_ by the fields it encodes.
+  void DecodeRawBytes();
+  // Drops the fields decoded from raw_ by readers, before raw_ changes.
+  void ClearDecodedFields();
+  // Returns the string newly parsed fields should be appended to as bytes,
+  // or null if they should be added as UnknownFields.
+  std::string* MutableRawBytesForParse();
+
   template <typename MessageType,
             typename std::enable_if<
                 std::is_base_of<Message, MessageType>::value, int>::type = 0>
@@ -204,17 +251,30 @@ class PROTOBUF_EXPORT UnknownFieldSet {
   }
 
   std::vector<UnknownField> fields_;
+  // The wire-format bytes of the fields of a set parsed in raw bytes mode.
+  // At most one of fields_ and raw_ is non-empty.
+  std::string raw_;
+  // raw_ decoded by the first reader, or null.
+  mutable std::atomic<std::vector<UnknownField>*> decoded_fields_{nullptr};
   GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(UnknownFieldSet);
 };
 
 namespace internal {
 
 inline void WriteVarint(uint32 num, uint64 val, UnknownFieldSet* unknown) {
-  unknown->AddVarint(num, val);
+  if (std::string* raw = unknown->MutableRawBytesForParse()) {
+    WriteVarint(num, val, raw);
+  } else {
+    unknown->AddVarint(num, val);
+  }
 }
 inline void WriteLengthDelimited(uint32 num, StringPiece val,
                                  UnknownFieldSet* unknown) {
-  unknown->AddLengthDelimited(num)->assign(val.data(), val.size());
+  if (std::string* raw = unknown->MutableRawBytesForParse()) {
+    WriteLengthDelimited(num, val, raw);
+  } else {
+    unknown->AddLengthDelimited(num)->assign(val.data(), val.size());
+  }
 }
 
 PROTOBUF_EXPORT
@@ -308,24 +368,33 @@ inline UnknownFieldSet::~UnknownFieldSet() { Clear(); }
 inline void UnknownFieldSet::ClearAndFreeMemory() { Clear(); }
 
 inline void UnknownFieldSet::Clear() {
-  if (!fields_.empty()) {
+  if (!fields_.empty() || !raw_.empty()) {
     ClearFallback();
   }
 }
 
-inline bool UnknownFieldSet::empty() const { return fields_.empty(); }
+inline bool UnknownFieldSet::empty() const {
+  return fields_.empty() && raw_.empty();
+}
 
 inline void UnknownFieldSet::Swap(UnknownFieldSet* x) {
   fields_.swap(x->fields_);
+  raw_.swap(x->raw_);
+  std::vector<UnknownField>* decoded =
+      decoded_fields_.load(std::memory_order_relaxed);
+  decoded_fields_.store(x->decoded_fields_.load(std::memory_order_relaxed),
+                        std::memory_order_relaxed);
+  x->decoded_fields_.store(decoded, std::memory_order_relaxed);
 }
 
 inline int UnknownFieldSet::field_count() const {
-  return static_cast<int>(fields_.size());
+  return static_cast<int>(fields().size());
 }
 inline const UnknownField& UnknownFieldSet::field(int index) const {
-  return (fields_)[static_cast<size_t>(index)];
+  return fields()[static_cast<size_t>(index)];
 }
 inline UnknownField* UnknownFieldSet::mutable_field(int index) {
+  if (!raw_.empty()) DecodeRawBytes();
   return &(fields_)[static_cast<size_t>(index)];
 }
 
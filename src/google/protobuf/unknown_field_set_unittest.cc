@@ -646,6 +646,98 @@ TEST_F(UnknownFieldSetTest, DeleteByNumber) {
                       MAKE_VECTOR(kExpectedFieldNumbers5));
 }
 #undef MAKE_VECTOR
+
+// Enables UnknownFieldSet's raw bytes mode for the lifetime of the object.
+class RawBytesModeScope {
+ public:
+  RawBytesModeScope() { UnknownFieldSet::SetRawBytesMode(true); }
+  ~RawBytesModeScope() { UnknownFieldSet::SetRawBytesMode(false); }
+};
+
+TEST_F(UnknownFieldSetTest, RawBytesMode) {
+  RawBytesModeScope scope;
+  unittest::TestEmptyMessage message;
+  ASSERT_TRUE(message.ParseFromString(all_fields_data_));
+
+  // The bytes are written back as they were parsed.
+  EXPECT_EQ(all_fields_data_.size(), message.ByteSizeLong());
+  EXPECT_EQ(all_fields_data_, message.SerializeAsString());
+
+  // Reading the fields decodes them.
+  const UnknownFieldSet& unknown_fields = message.unknown_fields();
+  ASSERT_EQ(unknown_fields_->field_count(), unknown_fields.field_count());
+  for (int i = 0; i < unknown_fields.field_count(); i++) {
+    EXPECT_EQ(unknown_fields_->field(i).number(),
+              unknown_fields.field(i).number());
+    EXPECT_EQ(unknown_fields_->field(i).type(), unknown_fields.field(i).type());
+  }
+  EXPECT_EQ(empty_message_.DebugString(), message.DebugString());
+  EXPECT_EQ(all_fields_data_, message.SerializeAsString());
+
+  // Modifying the set keeps the decoded fields.
+  message.mutable_unknown_fields()->AddVarint(123456, 654321);
+  EXPECT_EQ(unknown_fields_->field_count() + 1, unknown_fields.field_count());
+  unittest::TestEmptyMessage expected;
+  expected.CopyFrom(empty_message_);
+  expected.mutable_unknown_fields()->AddVarint(123456, 654321);
+  EXPECT_EQ(expected.SerializeAsString(), message.SerializeAsString());
+}
+
+TEST_F(UnknownFieldSetTest, RawBytesModeMerge) {
+  RawBytesModeScope scope;
+  unittest::TestEmptyMessage message1;
+  unittest::TestEmptyMessage message2;
+  ASSERT_TRUE(message1.ParseFromString(all_fields_data_));
+  std::string bizarro_data = GetBizarroData();
+  ASSERT_TRUE(message2.ParseFromString(bizarro_data));
+
+  // Bytes merged into bytes are appended.
+  unittest::TestEmptyMessage merged;
+  merged.MergeFrom(message1);
+  merged.MergeFrom(message2);
+  EXPECT_EQ(all_fields_data_ + bizarro_data, merged.SerializeAsString());
+  ASSERT_TRUE(merged.MergeFromString(all_fields_data_));
+  EXPECT_EQ(all_fields_data_ + bizarro_data + all_fields_data_,
+            merged.SerializeAsString());
+
+  // Bytes merged into decoded fields are decoded.
+  unittest::TestEmptyMessage decoded;
+  decoded.mutable_unknown_fields()->AddVarint(123456, 654321);
+  decoded.MergeFrom(message1);
+  ASSERT_EQ(unknown_fields_->field_count() + 1,
+            decoded.unknown_fields().field_count());
+  EXPECT_EQ(123456, decoded.unknown_fields().field(0).number());
+  ASSERT_TRUE(decoded.MergeFromString(bizarro_data));
+  unittest::TestEmptyMessage expected;
+  expected.mutable_unknown_fields()->AddVarint(123456, 654321);
+  ASSERT_TRUE(expected.MergeFromString(all_fields_data_ + bizarro_data));
+  EXPECT_EQ(expected.SerializeAsString(), decoded.SerializeAsString());
+
+  message1.Swap(&decoded);
+  EXPECT_EQ(all_fields_data_, decoded.SerializeAsString());
+  message1.Clear();
+  EXPECT_TRUE(message1.unknown_fields().empty());
+}
+
+TEST_F(UnknownFieldSetTest, RawBytesModeUnknownEnumValue) {
+  RawBytesModeScope scope;
+  unittest::TestAllTypes message;
+  message.add_repeated_nested_enum(unittest::TestAllTypes::FOO);
+  message.add_repeated_nested_enum(unittest::TestAllTypes::BAR);
+  // A value NestedEnum does not define.
+  unittest::TestEmptyMessage invalid;
+  invalid.mutable_unknown_fields()->AddVarint(
+      unittest::TestAllTypes::kOptionalNestedEnumFieldNumber, 5);
+  std::string data = message.SerializeAsString() + invalid.SerializeAsString();
+
+  unittest::TestAllTypes parsed;
+  ASSERT_TRUE(parsed.ParseFromString(data));
+  EXPECT_EQ(2, parsed.repeated_nested_enum_size());
+  ASSERT_EQ(1, parsed.unknown_fields().field_count());
+  EXPECT_EQ(5, parsed.unknown_fields().field(0).varint());
+  EXPECT_EQ(data, parsed.SerializeAsString());
+}
+
 }  // namespace
 
 }  // namespace protobuf
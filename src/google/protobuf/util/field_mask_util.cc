@@ -30,7 +30,10 @@
 
 #include <google/protobuf/util/field_mask_util.h>
 
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
 #include <google/protobuf/message.h>
+#include <google/protobuf/wire_format_lite.h>
 #include <google/protobuf/stubs/strutil.h>
 #include <google/protobuf/stubs/map_util.h>
 
@@ -41,6 +44,7 @@ namespace protobuf {
 namespace util {
 
 using google::protobuf::FieldMask;
+using google::protobuf::internal::WireFormatLite;
 
 std::string FieldMaskUtil::ToString(const FieldMask& mask) {
   return Join(mask.paths(), ",");
@@ -241,6 +245,11 @@ class FieldMaskTree {
     return TrimMessage(&root_, message);
   }
 
+  // Merges the fields specified by this tree from the serialized message in
+  // 'input' into 'message'. All other fields are skipped without being parsed.
+  bool MergePartialFromCodedStream(io::CodedInputStream* input,
+                                   Message* message) const;
+
  private:
   struct Node {
     Node() {}
@@ -285,6 +294,14 @@ class FieldMaskTree {
   // Returns true if the message is actually modified
   bool TrimMessage(const Node* node, Message* message);
 
+  // Copies the fields specified by a sub-tree from the serialized message of
+  // type 'descriptor' in 'input' to 'output' and skips all other fields.
+  // Stops at the end of input or at an end-group tag, which the caller has to
+  // check like for WireFormat::ParseAndMergePartial().
+  bool FilterMessage(const Node* node, const Descriptor* descriptor,
+                     io::CodedInputStream* input,
+                     io::CodedOutputStream* output) const;
+
   Node root_;
 
   GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(FieldMaskTree);
@@ -620,6 +637,92 @@ bool FieldMaskTree::TrimMessage(const Node* node, Message* message) {
   return modified;
 }
 
+bool FieldMaskTree::MergePartialFromCodedStream(io::CodedInputStream* input,
+                                                Message* message) const {
+  // Do not filter if the tree is empty.
+  if (root_.children.empty()) {
+    return message->MergePartialFromCodedStream(input);
+  }
+  std::string filtered;
+  {
+    io::StringOutputStream stream(&filtered);
+    io::CodedOutputStream output(&stream);
+    if (!FilterMessage(&root_, message->GetDescriptor(), input, &output)) {
+      return false;
+    }
+  }
+  // Only the masked fields are left, so this parses nothing more than needed.
+  io::CodedInputStream filtered_input(
+      reinterpret_cast<const uint8*>(filtered.data()),
+      static_cast<int>(filtered.size()));
+  return message->MergePartialFromCodedStream(&filtered_input);
+}
+
+bool FieldMaskTree::FilterMessage(const Node* node,
+                                  const Descriptor* descriptor,
+                                  io::CodedInputStream* input,
+                                  io::CodedOutputStream* output) const {
+  GOOGLE_DCHECK(!node->children.empty());
+  while (true) {
+    uint32 tag = input->ReadTag();
+    if (tag == 0 || WireFormatLite::GetTagWireType(tag) ==
+                        WireFormatLite::WIRETYPE_END_GROUP) {
+      return true;
+    }
+    int field_number = WireFormatLite::GetTagFieldNumber(tag);
+    const FieldDescriptor* field = descriptor->FindFieldByNumber(field_number);
+    const Node* child = nullptr;
+    if (field != nullptr) {
+      child = FindPtrOrNull(node->children, field->name());
+    }
+    if (child == nullptr) {
+      // Not in the mask. Length-delimited fields are skipped in one step.
+      if (!WireFormatLite::SkipField(input, tag)) return false;
+    } else if (child->children.empty() ||
+               field->cpp_type() != FieldDescriptor::CPPTYPE_MESSAGE) {
+      // The whole field is in the mask.
+      if (!WireFormatLite::SkipField(input, tag, output)) return false;
+    } else if (WireFormatLite::GetTagWireType(tag) ==
+               WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+      uint32 length;
+      if (!input->ReadVarint32(&length)) return false;
+      std::pair<io::CodedInputStream::Limit, int> limit =
+          input->IncrementRecursionDepthAndPushLimit(length);
+      if (limit.second < 0) return false;
+      std::string nested;
+      {
+        io::StringOutputStream stream(&nested);
+        io::CodedOutputStream nested_output(&stream);
+        if (!FilterMessage(child, field->message_type(), input,
+                           &nested_output)) {
+          return false;
+        }
+      }
+      if (!input->DecrementRecursionDepthAndPopLimit(limit.first)) {
+        return false;
+      }
+      output->WriteTag(tag);
+      output->WriteVarint32(static_cast<uint32>(nested.size()));
+      output->WriteString(nested);
+    } else if (WireFormatLite::GetTagWireType(tag) ==
+               WireFormatLite::WIRETYPE_START_GROUP) {
+      if (!input->IncrementRecursionDepth()) return false;
+      output->WriteTag(tag);
+      if (!FilterMessage(child, field->message_type(), input, output)) {
+        return false;
+      }
+      input->DecrementRecursionDepth();
+      uint32 end_tag = WireFormatLite::MakeTag(
+          field_number, WireFormatLite::WIRETYPE_END_GROUP);
+      if (!input->LastTagWas(end_tag)) return false;
+      output->WriteTag(end_tag);
+    } else {
+      // A mismatched wire type, parsing would keep it as an unknown field.
+      if (!WireFormatLite::SkipField(input, tag, output)) return false;
+    }
+  }
+}
+
 }  // namespace
 
 void FieldMaskUtil::ToCanonicalForm(const FieldMask& mask, FieldMask* out) {
@@ -715,6 +818,23 @@ bool FieldMaskUtil::TrimMessage(const FieldMask& mask, Message* message,
   return tree.TrimMessage(GOOGLE_CHECK_NOTNULL(message));
 }
 
+bool FieldMaskUtil::ParsePartialFromArray(const FieldMask& mask,
+                                          const void* data, int size,
+                                          Message* message) {
+  io::CodedInputStream input(static_cast<const uint8*>(data), size);
+  GOOGLE_CHECK_NOTNULL(message)->Clear();
+  return MergePartialFromCodedStream(mask, &input, message) &&
+         input.ConsumedEntireMessage();
+}
+
+bool FieldMaskUtil::MergePartialFromCodedStream(const FieldMask& mask,
+                                                io::CodedInputStream* input,
+                                                Message* message) {
+  FieldMaskTree tree;
+  tree.MergeFromFieldMask(mask);
+  return tree.MergePartialFromCodedStream(input, GOOGLE_CHECK_NOTNULL(message));
+}
+
 }  // namespace util
 }  // namespace protobuf
 }  // namespace google
@@ -177,6 +177,21 @@ class PROTOBUF_EXPORT FieldMaskUtil {
   static bool TrimMessage(const FieldMask& mask, Message* message,
                           const TrimOptions& options);
 
+  // Parses 'message' from the given serialized data, keeping only the fields
+  // represented in the given FieldMask. The other fields, including unknown
+  // fields, are skipped on the wire without being parsed, so this is cheaper
+  // than parsing everything and calling TrimMessage() afterwards. Like
+  // TrimMessage(), an empty FieldMask keeps all fields.
+  // Required fields are NOT checked. Returns false if the input is invalid.
+  static bool ParsePartialFromArray(const FieldMask& mask, const void* data,
+                                    int size, Message* message);
+
+  // Like ParsePartialFromArray(), but reads from 'input' and merges the
+  // masked fields into 'message' without clearing it first.
+  static bool MergePartialFromCodedStream(const FieldMask& mask,
+                                          io::CodedInputStream* input,
+                                          Message* message);
+
  private:
   friend class SnakeCaseCamelCaseTest;
   // Converts a field name from snake_case to camelCase:
@@ -828,6 +828,54 @@ TEST(FieldMaskUtilTest, TrimMessageReturnValue) {
   // supported.
 }
 
+TEST(FieldMaskUtilTest, ParsePartialFromArray) {
+  NestedTestAllTypes source;
+  TestUtil::SetAllFields(source.mutable_payload());
+  TestUtil::SetAllFields(source.mutable_child()->mutable_payload());
+  std::string data = source.SerializeAsString();
+
+  // Skipping fields on the wire gives the same result as trimming.
+  const char* const kMasks[] = {
+      "",
+      "payload.optional_int32",
+      "payload.optional_nested_message.bb,payload.optionalgroup.a",
+      "payload.repeated_string,child.payload.optional_string",
+      "child",
+  };
+  for (const char* paths : kMasks) {
+    FieldMask mask;
+    FieldMaskUtil::FromString(paths, &mask);
+    NestedTestAllTypes expected;
+    ASSERT_TRUE(expected.ParseFromString(data));
+    FieldMaskUtil::TrimMessage(mask, &expected);
+    NestedTestAllTypes message;
+    message.mutable_payload()->set_optional_int64(1);
+    ASSERT_TRUE(FieldMaskUtil::ParsePartialFromArray(mask, data.data(),
+                                                     data.size(), &message));
+    EXPECT_EQ(expected.DebugString(), message.DebugString()) << paths;
+  }
+
+  // Sub-paths of a repeated message apply to every element.
+  TestAllTypes repeated;
+  repeated.add_repeated_nested_message()->set_bb(1);
+  repeated.add_repeated_nested_message()->set_bb(2);
+  repeated.set_optional_int32(3);
+  data = repeated.SerializeAsString();
+  FieldMask mask;
+  FieldMaskUtil::FromString("repeated_nested_message.bb", &mask);
+  TestAllTypes message;
+  ASSERT_TRUE(FieldMaskUtil::ParsePartialFromArray(mask, data.data(),
+                                                   data.size(), &message));
+  ASSERT_EQ(2, message.repeated_nested_message_size());
+  EXPECT_EQ(2, message.repeated_nested_message(1).bb());
+  EXPECT_FALSE(message.has_optional_int32());
+
+  // Skipped fields must still be well-formed.
+  data.resize(data.size() - 1);
+  EXPECT_FALSE(FieldMaskUtil::ParsePartialFromArray(mask, data.data(),
+                                                    data.size(), &message));
+}
+
 
 }  // namespace
 }  // namespace util
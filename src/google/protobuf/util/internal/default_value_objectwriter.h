@@ -80,6 +80,12 @@ class PROTOBUF_EXPORT DefaultValueObjectWriter : public ObjectWriter {
                            const google::protobuf::Type& type,
                            ObjectWriter* ow);
 
+  // Like the constructor above, but looks up types with typeinfo, which may
+  // be shared with other writers. Does not take ownership of typeinfo.
+  DefaultValueObjectWriter(const TypeInfo* typeinfo,
+                           const google::protobuf::Type& type,
+                           ObjectWriter* ow);
+
   virtual ~DefaultValueObjectWriter();
 
   // ObjectWriter methods.
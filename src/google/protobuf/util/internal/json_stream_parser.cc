@@ -134,10 +134,41 @@ static bool ConsumeKeyPermissive(StringPiece* input,
   return true;
 }
 
+// Returns true if status is the one parse methods return to ask for more
+// data.
+static bool IsCancelled(const util::Status& status) {
+  return status.code() == util::error::CANCELLED && status.message().empty();
+}
+
 static bool MatchKey(StringPiece input) {
   return !input.empty() && IsLetter(input[0]);
 }
 
+// Returns the first backslash or quote character in [begin, end), or end if
+// there is none. String values are mostly long runs of plain characters, so
+// they are scanned a 64-bit word at a time: a byte of the word is one of the
+// two characters iff that byte is zero after xor-ing the word with the
+// character in every byte. Both are ASCII, so they are never part of a
+// multibyte UTF-8 sequence and the scan may skip over whole words.
+static const char* FindEscapeOrQuote(const char* begin, const char* end,
+                                     char quote) {
+  static const int kWordSize = sizeof(uint64);
+  static const uint64 kLowBits = 0x0101010101010101ULL;
+  static const uint64 kHighBits = 0x8080808080808080ULL;
+  const uint64 backslashes = kLowBits * '\\';
+  const uint64 quotes = kLowBits * static_cast<uint8>(quote);
+  while (end - begin >= kWordSize) {
+    uint64 word;
+    memcpy(&word, begin, kWordSize);
+    const uint64 x = word ^ backslashes;
+    const uint64 y = word ^ quotes;
+    if ((((x - kLowBits) & ~x) | ((y - kLowBits) & ~y)) & kHighBits) break;
+    begin += kWordSize;
+  }
+  while (begin < end && *begin != '\\' && *begin != quote) ++begin;
+  return begin;
+}
+
 JsonStreamParser::JsonStreamParser(ObjectWriter* ow)
     : ow_(ow),
       stack_(),
@@ -264,41 +295,10 @@ util::Status JsonStreamParser::RunParser() {
     ParseType type = stack_.top();
     TokenType t = (string_open_ == 0) ? GetNextTokenType() : BEGIN_STRING;
     stack_.pop();
-    util::Status result;
-    switch (type) {
-      case VALUE:
-        result = ParseValue(t);
-        break;
-
-      case OBJ_MID:
-        result = ParseObjectMid(t);
-        break;
-
-      case ENTRY:
-        result = ParseEntry(t);
-        break;
-
-      case ENTRY_MID:
-        result = ParseEntryMid(t);
-        break;
-
-      case ARRAY_VALUE:
-        result = ParseArrayValue(t);
-        break;
-
-      case ARRAY_MID:
-        result = ParseArrayMid(t);
-        break;
-
-      default:
-        result = util::Status(util::error::INTERNAL,
-                              StrCat("Unknown parse type: ", type));
-        break;
-    }
+    util::Status result = ParseNext(type, t);
     if (!result.ok()) {
       // If we were cancelled, save our state and try again later.
-      if (!finishing_ &&
-          result == util::Status(util::error::CANCELLED, "")) {
+      if (!finishing_ && IsCancelled(result)) {
         stack_.push(type);
         // If we have a key we still need to render, make sure to save off the
         // contents in our own storage.
@@ -314,6 +314,32 @@ util::Status JsonStreamParser::RunParser() {
   return util::Status();
 }
 
+util::Status JsonStreamParser::ParseNext(ParseType type, TokenType t) {
+  switch (type) {
+    case VALUE:
+      return ParseValue(t);
+
+    case OBJ_MID:
+      return ParseObjectMid(t);
+
+    case ENTRY:
+      return ParseEntry(t);
+
+    case ENTRY_MID:
+      return ParseEntryMid(t);
+
+    case ARRAY_VALUE:
+      return ParseArrayValue(t);
+
+    case ARRAY_MID:
+      return ParseArrayMid(t);
+
+    default:
+      return util::Status(util::error::INTERNAL,
+                          StrCat("Unknown parse type: ", type));
+  }
+}
+
 util::Status JsonStreamParser::ParseValue(TokenType type) {
   switch (type) {
     case BEGIN_OBJECT:
@@ -370,7 +396,11 @@ util::Status JsonStreamParser::ParseStringHelper() {
   // Track where we last copied data from so we can minimize copying.
   const char* last = p_.data();
   while (!p_.empty()) {
-    const char* data = p_.data();
+    // Skip the plain characters up to the next escape or quote.
+    const char* data =
+        FindEscapeOrQuote(p_.data(), p_.data() + p_.size(), string_open_);
+    p_.remove_prefix(data - p_.data());
+    if (p_.empty()) break;
     if (*data == '\\') {
       // We're about to handle an escape, copy all bytes from last to data.
       if (last < data) {
@@ -439,8 +469,6 @@ util::Status JsonStreamParser::ParseStringHelper() {
       Advance();
       return util::Status();
     }
-    // Normal character, just advance past it.
-    Advance();
   }
   // If we ran out of characters, copy over what we have so far.
   if (last < p_.data()) {
@@ -569,6 +597,8 @@ util::Status JsonStreamParser::ParseNumberHelper(NumberResult* result) {
   int index = 0;
   bool floating = false;
   bool negative = data[index] == '-';
+  // Whether the number is only digits after the optional '-'.
+  bool digits_only = true;
   // Find the first character that cannot be part of the number. Along the way
   // detect if the number needs to be parsed as a double.
   // Note that this restricts numbers to the JSON specification, so for example
@@ -580,7 +610,10 @@ util::Status JsonStreamParser::ParseNumberHelper(NumberResult* result) {
       floating = true;
       continue;
     }
-    if (c == '+' || c == '-' || c == 'x') continue;
+    if (c == '+' || c == '-' || c == 'x') {
+      if (index > 0 || c != '-') digits_only = false;
+      continue;
+    }
     // Not a valid number character, break out.
     break;
   }
@@ -591,6 +624,27 @@ util::Status JsonStreamParser::ParseNumberHelper(NumberResult* result) {
     return util::Status(util::error::CANCELLED, "");
   }
 
+  // Integers of up to 18 digits without leading zeros fit both an int64 and
+  // a uint64, so convert them here instead of copying them for safe_strtoX.
+  const int first_digit = negative ? 1 : 0;
+  const int digits = index - first_digit;
+  if (!floating && digits_only && digits > 0 && digits <= 18 &&
+      (digits == 1 || data[first_digit] != '0')) {
+    uint64 value = 0;
+    for (int i = first_digit; i < index; ++i) {
+      value = value * 10 + (data[i] - '0');
+    }
+    if (negative) {
+      result->type = NumberResult::INT;
+      result->int_val = -static_cast<int64>(value);
+    } else {
+      result->type = NumberResult::UINT;
+      result->uint_val = value;
+    }
+    p_.remove_prefix(index);
+    return util::Status();
+  }
+
   // Create a string containing just the number, so we can use safe_strtoX
   std::string number = std::string(p_.substr(0, index));
 
@@ -763,7 +817,7 @@ util::Status JsonStreamParser::ParseArrayValue(TokenType type) {
   // empty-null array value is relying on this ARRAY_MID token.
   stack_.push(ARRAY_MID);
   util::Status result = ParseValue(type);
-  if (result == util::Status(util::error::CANCELLED, "")) {
+  if (IsCancelled(result)) {
     // If we were cancelled, pop back off the ARRAY_MID so we don't try to
     // push it on again when we try over.
     stack_.pop();
@@ -862,9 +916,13 @@ util::Status JsonStreamParser::IncrementRecursionDepth(
 }
 
 void JsonStreamParser::SkipWhitespace() {
-  while (!p_.empty() && ascii_isspace(*p_.data())) {
-    Advance();
+  // Whitespace is all single byte characters.
+  const char* data = p_.data();
+  const char* end = data + p_.size();
+  while (data < end && ascii_isspace(*data)) {
+    ++data;
   }
+  p_.remove_prefix(data - p_.data());
 }
 
 void JsonStreamParser::Advance() {
@@ -33,6 +33,7 @@
 
 #include <stack>
 #include <string>
+#include <vector>
 
 #include <google/protobuf/stubs/common.h>
 #include <google/protobuf/stubs/strutil.h>
@@ -137,6 +138,10 @@ class PROTOBUF_EXPORT JsonStreamParser {
   // the stack and return.
   util::Status RunParser();
 
+  // Parses the next part of the input as type expects, given the type of the
+  // next token.
+  util::Status ParseNext(ParseType type, TokenType token_type);
+
   // Parses a value from p_ and writes it to ow_.
   // A value may be an object, array, true, false, null, string or number.
   util::Status ParseValue(TokenType type);
@@ -227,7 +232,7 @@ class PROTOBUF_EXPORT JsonStreamParser {
 
   // The stack of parsing we still need to do. When the stack runs empty we will
   // have parsed a single value from the root (e.g. an object or list).
-  std::stack<ParseType> stack_;
+  std::stack<ParseType, std::vector<ParseType>> stack_;
 
   // Contains any leftover text from a previous chunk that we weren't able to
   // fully parse, for example the start of a key or number.
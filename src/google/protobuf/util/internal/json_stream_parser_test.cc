@@ -30,6 +30,8 @@
 
 #include <google/protobuf/util/internal/json_stream_parser.h>
 
+#include <limits>
+
 #include <google/protobuf/stubs/logging.h>
 #include <google/protobuf/stubs/common.h>
 #include <google/protobuf/util/internal/expecting_objectwriter.h>
@@ -248,6 +250,24 @@ TEST_F(JsonStreamParserTest, SimpleUnsignedInt) {
   }
 }
 
+TEST_F(JsonStreamParserTest, IntegerLimits) {
+  StringPiece str =
+      "[0, -0, 999999999999999999, -999999999999999999, 9223372036854775807,"
+      " -9223372036854775808, 18446744073709551615]";
+  for (int i = 0; i <= str.length(); ++i) {
+    ow_.StartList("")
+        ->RenderUint64("", 0)
+        ->RenderInt64("", 0)
+        ->RenderUint64("", uint64{999999999999999999u})
+        ->RenderInt64("", int64{-999999999999999999})
+        ->RenderUint64("", uint64{9223372036854775807u})
+        ->RenderInt64("", std::numeric_limits<int64>::min())
+        ->RenderUint64("", std::numeric_limits<uint64>::max())
+        ->EndList();
+    DoTest(str, i);
+  }
+}
+
 TEST_F(JsonStreamParserTest, OctalNumberIsInvalid) {
   StringPiece str = "01234";
   for (int i = 0; i <= str.length(); ++i) {
@@ -505,6 +525,23 @@ TEST_F(JsonStreamParserTest, AsciiEscaping) {
   }
 }
 
+// Strings are scanned a word at a time; put escapes and quotes at every offset
+// within a word.
+TEST_F(JsonStreamParserTest, EscapesAndQuotesAtEveryOffset) {
+  for (int offset = 0; offset < 17; ++offset) {
+    std::string prefix(offset, 'a');
+    std::string str = StrCat("[\"", prefix, "\\n'bcdefghijklmnop\", '",
+                                   prefix, "\"\\'xyz']");
+    for (int i = 0; i <= str.length(); ++i) {
+      ow_.StartList("")
+          ->RenderString("", StrCat(prefix, "\n'bcdefghijklmnop"))
+          ->RenderString("", StrCat(prefix, "\"'xyz"))
+          ->EndList();
+      DoTest(str, i);
+    }
+  }
+}
+
 // - trailing commas, we support a single trailing comma but no internal commas.
 TEST_F(JsonStreamParserTest, TrailingCommas) {
   StringPiece str = "[['a',true,], {b: null,},]";
@@ -85,9 +85,6 @@ bool IsPackable(const google::protobuf::Field& field);
 const google::protobuf::EnumValue* FindEnumValueByNumber(
     const google::protobuf::Enum& tech_enum, int number);
 
-// Utility function to format nanos.
-const std::string FormatNanos(uint32 nanos, bool with_trailing_zeros);
-
 StatusOr<std::string> MapKeyDefaultValueAsString(
     const google::protobuf::Field& field) {
   switch (field.kind()) {
@@ -1133,21 +1130,6 @@ const google::protobuf::EnumValue* FindEnumValueByNumber(
   }
   return nullptr;
 }
-
-// TODO(skarvaje): Look into optimizing this by not doing computation on
-// double.
-const std::string FormatNanos(uint32 nanos, bool with_trailing_zeros) {
-  if (nanos == 0) {
-    return with_trailing_zeros ? ".000" : "";
-  }
-
-  const char* format =
-      (nanos % 1000 != 0) ? "%.9f" : (nanos % 1000000 != 0) ? "%.6f" : "%.3f";
-  std::string formatted =
-      StringPrintf(format, static_cast<double>(nanos) / kNanosPerSecond);
-  // remove the leading 0 before decimal.
-  return formatted.substr(1);
-}
 }  // namespace
 
 }  // namespace converter
@@ -0,0 +1,546 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <google/protobuf/util/internal/reflection_objectsource.h>
+
+#include <google/protobuf/stubs/logging.h>
+#include <google/protobuf/stubs/common.h>
+#include <google/protobuf/stubs/stringprintf.h>
+#include <google/protobuf/stubs/once.h>
+#include <google/protobuf/util/internal/field_mask_utility.h>
+#include <google/protobuf/util/internal/constants.h>
+#include <google/protobuf/util/internal/utility.h>
+#include <google/protobuf/stubs/strutil.h>
+#include <google/protobuf/stubs/time.h>
+#include <google/protobuf/stubs/map_util.h>
+#include <google/protobuf/stubs/status_macros.h>
+
+
+#include <google/protobuf/port_def.inc>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace converter {
+using util::Status;
+
+namespace {
+
+static int kDefaultMaxRecursionDepth = 64;
+
+// Returns the key of a map entry as the name of its JSON field.
+std::string MapKeyAsString(const Message& entry, const FieldDescriptor* key) {
+  const Reflection* reflection = entry.GetReflection();
+  switch (key->cpp_type()) {
+    case FieldDescriptor::CPPTYPE_BOOL:
+      return reflection->GetBool(entry, key) ? "true" : "false";
+    case FieldDescriptor::CPPTYPE_INT32:
+      return StrCat(reflection->GetInt32(entry, key));
+    case FieldDescriptor::CPPTYPE_INT64:
+      return StrCat(reflection->GetInt64(entry, key));
+    case FieldDescriptor::CPPTYPE_UINT32:
+      return StrCat(reflection->GetUInt32(entry, key));
+    case FieldDescriptor::CPPTYPE_UINT64:
+      return StrCat(reflection->GetUInt64(entry, key));
+    case FieldDescriptor::CPPTYPE_STRING:
+      return reflection->GetString(entry, key);
+    default:
+      return std::string();
+  }
+}
+
+}  // namespace
+
+ReflectionObjectSource::ReflectionObjectSource(
+    const Message& message, const std::string& type_url_prefix)
+    : message_(message),
+      type_url_prefix_(type_url_prefix),
+      use_ints_for_enums_(false),
+      preserve_proto_field_names_(false),
+      recursion_depth_(0),
+      max_recursion_depth_(kDefaultMaxRecursionDepth) {}
+
+ReflectionObjectSource::~ReflectionObjectSource() {}
+
+Status ReflectionObjectSource::NamedWriteTo(StringPiece name,
+                                            ObjectWriter* ow) const {
+  return WriteMessage(message_, name, true, ow);
+}
+
+Status ReflectionObjectSource::WriteMessage(const Message& message,
+                                            StringPiece name,
+                                            bool include_start_and_end,
+                                            ObjectWriter* ow) const {
+  const TypeRenderer* type_renderer =
+      FindTypeRenderer(message.GetDescriptor()->full_name());
+  if (type_renderer != nullptr) {
+    return (*type_renderer)(this, message, name, ow);
+  }
+
+  // ListFields() returns the fields in field number order, the order in which
+  // they are serialized.
+  std::vector<const FieldDescriptor*> fields;
+  message.GetReflection()->ListFields(message, &fields);
+
+  if (include_start_and_end) {
+    ow->StartObject(name);
+  }
+  for (const FieldDescriptor* field : fields) {
+    // A google::protobuf::Type has no extensions, and groups are not rendered
+    // by the stream source either.
+    if (field->is_extension() || field->type() == FieldDescriptor::TYPE_GROUP) {
+      continue;
+    }
+    const std::string& field_name =
+        preserve_proto_field_names_ ? field->name() : field->json_name();
+    if (field->is_repeated()) {
+      RETURN_IF_ERROR(RenderRepeatedField(message, field, field_name, ow));
+    } else {
+      RETURN_IF_ERROR(RenderField(message, field, -1, field_name, ow));
+    }
+  }
+  if (include_start_and_end) {
+    ow->EndObject();
+  }
+  return util::Status();
+}
+
+Status ReflectionObjectSource::RenderRepeatedField(
+    const Message& message, const FieldDescriptor* field, StringPiece name,
+    ObjectWriter* ow) const {
+  if (field->is_map()) {
+    ow->StartObject(name);
+    RETURN_IF_ERROR(RenderMapEntries(message, field, ow));
+    ow->EndObject();
+    return util::Status();
+  }
+  ow->StartList(name);
+  const int size = message.GetReflection()->FieldSize(message, field);
+  for (int i = 0; i < size; i++) {
+    RETURN_IF_ERROR(RenderField(message, field, i, StringPiece(), ow));
+  }
+  ow->EndList();
+  return util::Status();
+}
+
+Status ReflectionObjectSource::RenderMapEntries(const Message& message,
+                                                const FieldDescriptor* field,
+                                                ObjectWriter* ow) const {
+  const Reflection* reflection = message.GetReflection();
+  const FieldDescriptor* key = field->message_type()->map_key();
+  const FieldDescriptor* value = field->message_type()->map_value();
+  const int size = reflection->FieldSize(message, field);
+  for (int i = 0; i < size; i++) {
+    const Message& entry = reflection->GetRepeatedMessage(message, field, i);
+    RETURN_IF_ERROR(
+        RenderField(entry, value, -1, MapKeyAsString(entry, key), ow));
+  }
+  return util::Status();
+}
+
+Status ReflectionObjectSource::RenderField(const Message& message,
+                                           const FieldDescriptor* field,
+                                           int index, StringPiece name,
+                                           ObjectWriter* ow) const {
+  const Reflection* reflection = message.GetReflection();
+  const bool repeated = index != -1;
+  switch (field->cpp_type()) {
+    case FieldDescriptor::CPPTYPE_BOOL:
+      ow->RenderBool(name, repeated
+                               ? reflection->GetRepeatedBool(message, field,
+                                                             index)
+                               : reflection->GetBool(message, field));
+      break;
+    case FieldDescriptor::CPPTYPE_INT32:
+      ow->RenderInt32(name, repeated ? reflection->GetRepeatedInt32(
+                                           message, field, index)
+                                     : reflection->GetInt32(message, field));
+      break;
+    case FieldDescriptor::CPPTYPE_INT64:
+      ow->RenderInt64(name, repeated ? reflection->GetRepeatedInt64(
+                                           message, field, index)
+                                     : reflection->GetInt64(message, field));
+      break;
+    case FieldDescriptor::CPPTYPE_UINT32:
+      ow->RenderUint32(name, repeated ? reflection->GetRepeatedUInt32(
+                                            message, field, index)
+                                      : reflection->GetUInt32(message, field));
+      break;
+    case FieldDescriptor::CPPTYPE_UINT64:
+      ow->RenderUint64(name, repeated ? reflection->GetRepeatedUInt64(
+                                            message, field, index)
+                                      : reflection->GetUInt64(message, field));
+      break;
+    case FieldDescriptor::CPPTYPE_FLOAT:
+      ow->RenderFloat(name, repeated ? reflection->GetRepeatedFloat(
+                                           message, field, index)
+                                     : reflection->GetFloat(message, field));
+      break;
+    case FieldDescriptor::CPPTYPE_DOUBLE:
+      ow->RenderDouble(name, repeated ? reflection->GetRepeatedDouble(
+                                            message, field, index)
+                                      : reflection->GetDouble(message, field));
+      break;
+    case FieldDescriptor::CPPTYPE_ENUM: {
+      const int value =
+          repeated ? reflection->GetRepeatedEnumValue(message, field, index)
+                   : reflection->GetEnumValue(message, field);
+      // If the field represents an explicit NULL value, render null.
+      if (field->enum_type()->full_name() == "google.protobuf.NullValue") {
+        ow->RenderNull(name);
+        break;
+      }
+      // Unknown enum values are printed as integers.
+      const EnumValueDescriptor* enum_value =
+          field->enum_type()->FindValueByNumber(value);
+      if (enum_value != nullptr && !use_ints_for_enums_) {
+        ow->RenderString(name, enum_value->name());
+      } else {
+        ow->RenderInt32(name, value);
+      }
+      break;
+    }
+    case FieldDescriptor::CPPTYPE_STRING: {
+      std::string scratch;
+      const std::string& value =
+          repeated ? reflection->GetRepeatedStringReference(message, field,
+                                                            index, &scratch)
+                   : reflection->GetStringReference(message, field, &scratch);
+      if (field->type() == FieldDescriptor::TYPE_BYTES) {
+        ow->RenderBytes(name, value);
+      } else {
+        ow->RenderString(name, value);
+      }
+      break;
+    }
+    case FieldDescriptor::CPPTYPE_MESSAGE:
+      return RenderMessage(
+          repeated ? reflection->GetRepeatedMessage(message, field, index)
+                   : reflection->GetMessage(message, field),
+          name, ow);
+  }
+  return util::Status();
+}
+
+Status ReflectionObjectSource::RenderMessage(const Message& message,
+                                             StringPiece name,
+                                             ObjectWriter* ow) const {
+  RETURN_IF_ERROR(
+      IncrementRecursionDepth(message.GetDescriptor()->full_name(), name));
+  RETURN_IF_ERROR(WriteMessage(message, name, true, ow));
+  --recursion_depth_;
+  return util::Status();
+}
+
+Status ReflectionObjectSource::RenderTimestamp(const ReflectionObjectSource* os,
+                                               const Message& message,
+                                               StringPiece field_name,
+                                               ObjectWriter* ow) {
+  const Descriptor* descriptor = message.GetDescriptor();
+  const Reflection* reflection = message.GetReflection();
+  // 'seconds' has field number of 1 and 'nanos' has field number 2
+  // //google/protobuf/timestamp.proto
+  int64 seconds =
+      reflection->GetInt64(message, descriptor->FindFieldByNumber(1));
+  int32 nanos = reflection->GetInt32(message, descriptor->FindFieldByNumber(2));
+  if (seconds > kTimestampMaxSeconds || seconds < kTimestampMinSeconds) {
+    return Status(util::error::INTERNAL,
+                  StrCat("Timestamp seconds exceeds limit for field: ",
+                               field_name));
+  }
+
+  if (nanos < 0 || nanos >= kNanosPerSecond) {
+    return Status(
+        util::error::INTERNAL,
+        StrCat("Timestamp nanos exceeds limit for field: ", field_name));
+  }
+
+  ow->RenderString(field_name,
+                   ::google::protobuf::internal::FormatTime(seconds, nanos));
+
+  return util::Status();
+}
+
+Status ReflectionObjectSource::RenderDuration(const ReflectionObjectSource* os,
+                                              const Message& message,
+                                              StringPiece field_name,
+                                              ObjectWriter* ow) {
+  const Descriptor* descriptor = message.GetDescriptor();
+  const Reflection* reflection = message.GetReflection();
+  // 'seconds' has field number of 1 and 'nanos' has field number 2
+  // //google/protobuf/duration.proto
+  int64 seconds =
+      reflection->GetInt64(message, descriptor->FindFieldByNumber(1));
+  int32 nanos = reflection->GetInt32(message, descriptor->FindFieldByNumber(2));
+  if (seconds > kDurationMaxSeconds || seconds < kDurationMinSeconds) {
+    return Status(
+        util::error::INTERNAL,
+        StrCat("Duration seconds exceeds limit for field: ", field_name));
+  }
+
+  if (nanos <= -kNanosPerSecond || nanos >= kNanosPerSecond) {
+    return Status(
+        util::error::INTERNAL,
+        StrCat("Duration nanos exceeds limit for field: ", field_name));
+  }
+
+  std::string sign = "";
+  if (seconds < 0) {
+    if (nanos > 0) {
+      return Status(
+          util::error::INTERNAL,
+          StrCat("Duration nanos is non-negative, but seconds is "
+                       "negative for field: ",
+                       field_name));
+    }
+    sign = "-";
+    seconds = -seconds;
+    nanos = -nanos;
+  } else if (seconds == 0 && nanos < 0) {
+    sign = "-";
+    nanos = -nanos;
+  }
+  std::string formatted_duration = StringPrintf(
+      "%s%lld%ss", sign.c_str(), static_cast<long long>(seconds),  // NOLINT
+      FormatNanos(nanos, false).c_str());
+  ow->RenderString(field_name, formatted_duration);
+  return util::Status();
+}
+
+Status ReflectionObjectSource::RenderWrapper(const ReflectionObjectSource* os,
+                                             const Message& message,
+                                             StringPiece field_name,
+                                             ObjectWriter* ow) {
+  // Every wrapper has its value in field number 1, which is rendered even if
+  // it is not set.
+  return os->RenderField(message, message.GetDescriptor()->FindFieldByNumber(1),
+                         -1, field_name, ow);
+}
+
+Status ReflectionObjectSource::RenderStruct(const ReflectionObjectSource* os,
+                                            const Message& message,
+                                            StringPiece field_name,
+                                            ObjectWriter* ow) {
+  // google.protobuf.Struct has only one field that is a map.
+  ow->StartObject(field_name);
+  RETURN_IF_ERROR(os->RenderMapEntries(
+      message, message.GetDescriptor()->FindFieldByNumber(1), ow));
+  ow->EndObject();
+  return util::Status();
+}
+
+Status ReflectionObjectSource::RenderStructValue(
+    const ReflectionObjectSource* os, const Message& message,
+    StringPiece field_name, ObjectWriter* ow) {
+  // The field of the kind oneof that is set, if any, is rendered under the
+  // name of the Value itself.
+  std::vector<const FieldDescriptor*> fields;
+  message.GetReflection()->ListFields(message, &fields);
+  for (const FieldDescriptor* field : fields) {
+    RETURN_IF_ERROR(os->RenderField(message, field, -1, field_name, ow));
+  }
+  return util::Status();
+}
+
+Status ReflectionObjectSource::RenderStructListValue(
+    const ReflectionObjectSource* os, const Message& message,
+    StringPiece field_name, ObjectWriter* ow) {
+  return os->RenderRepeatedField(
+      message, message.GetDescriptor()->FindFieldByNumber(1), field_name, ow);
+}
+
+Status ReflectionObjectSource::RenderAny(const ReflectionObjectSource* os,
+                                         const Message& message,
+                                         StringPiece field_name,
+                                         ObjectWriter* ow) {
+  // An Any is of the form { string type_url = 1; bytes value = 2; }
+  const Descriptor* descriptor = message.GetDescriptor();
+  const Reflection* reflection = message.GetReflection();
+  const std::string type_url =
+      reflection->GetString(message, descriptor->FindFieldByNumber(1));
+  const std::string value =
+      reflection->GetString(message, descriptor->FindFieldByNumber(2));
+
+  // If there is no value, we don't lookup the type, we just output it (if
+  // present). If both type and value are empty we output an empty object.
+  if (value.empty()) {
+    ow->StartObject(field_name);
+    if (!type_url.empty()) {
+      ow->RenderString("@type", type_url);
+    }
+    ow->EndObject();
+    return util::Status();
+  }
+
+  // If there is a value but no type, we cannot render it, so report an error.
+  if (type_url.empty()) {
+    return util::Status(util::error::INTERNAL,
+                        "Invalid Any, the type_url is missing.");
+  }
+
+  // Report the errors a DescriptorPool TypeResolver reports for the type URL.
+  const std::string& prefix = os->type_url_prefix_;
+  if (type_url.compare(0, prefix.size() + 1, prefix + "/") != 0) {
+    return util::Status(
+        util::error::INTERNAL,
+        StrCat("Invalid type URL, type URLs must be of the form '", prefix,
+                     "/<typename>', got: ", type_url));
+  }
+  const std::string type_name = type_url.substr(prefix.size() + 1);
+  std::unique_ptr<Message> nested(os->NewMessageOfType(type_name));
+  if (nested == nullptr) {
+    return util::Status(util::error::INTERNAL,
+                        "Invalid type URL, unknown type: " + type_name);
+  }
+  if (!nested->ParsePartialFromString(value)) {
+    return util::Status(util::error::INTERNAL,
+                        StrCat("Invalid Any, the value is not a valid ",
+                                     type_name, "."));
+  }
+
+  // Like the stream source, the nested message gets a recursion depth of its
+  // own.
+  ReflectionObjectSource nested_os(*nested, prefix);
+  nested_os.set_use_ints_for_enums(os->use_ints_for_enums_);
+  nested_os.set_preserve_proto_field_names(os->preserve_proto_field_names_);
+
+  // We manually call start and end object here so we can inject the @type.
+  ow->StartObject(field_name);
+  ow->RenderString("@type", type_url);
+  util::Status result = nested_os.WriteMessage(*nested, "value", false, ow);
+  ow->EndObject();
+  return result;
+}
+
+Status ReflectionObjectSource::RenderFieldMask(
+    const ReflectionObjectSource* os, const Message& message,
+    StringPiece field_name, ObjectWriter* ow) {
+  const Reflection* reflection = message.GetReflection();
+  const FieldDescriptor* paths = message.GetDescriptor()->FindFieldByNumber(1);
+  std::string combined;
+  const int size = reflection->FieldSize(message, paths);
+  for (int i = 0; i < size; i++) {
+    if (!combined.empty()) {
+      combined.append(",");
+    }
+    combined.append(ConvertFieldMaskPath(
+        reflection->GetRepeatedString(message, paths, i), &ToCamelCase));
+  }
+  ow->RenderString(field_name, combined);
+  return util::Status();
+}
+
+
+std::unordered_map<std::string, ReflectionObjectSource::TypeRenderer>*
+    ReflectionObjectSource::renderers_ = NULL;
+PROTOBUF_NAMESPACE_ID::internal::once_flag reflection_renderers_init_;
+
+
+void ReflectionObjectSource::InitRendererMap() {
+  renderers_ = new std::unordered_map<std::string,
+                                      ReflectionObjectSource::TypeRenderer>();
+  (*renderers_)["google.protobuf.Timestamp"] =
+      &ReflectionObjectSource::RenderTimestamp;
+  (*renderers_)["google.protobuf.Duration"] =
+      &ReflectionObjectSource::RenderDuration;
+  (*renderers_)["google.protobuf.DoubleValue"] =
+      &ReflectionObjectSource::RenderWrapper;
+  (*renderers_)["google.protobuf.FloatValue"] =
+      &ReflectionObjectSource::RenderWrapper;
+  (*renderers_)["google.protobuf.Int64Value"] =
+      &ReflectionObjectSource::RenderWrapper;
+  (*renderers_)["google.protobuf.UInt64Value"] =
+      &ReflectionObjectSource::RenderWrapper;
+  (*renderers_)["google.protobuf.Int32Value"] =
+      &ReflectionObjectSource::RenderWrapper;
+  (*renderers_)["google.protobuf.UInt32Value"] =
+      &ReflectionObjectSource::RenderWrapper;
+  (*renderers_)["google.protobuf.BoolValue"] =
+      &ReflectionObjectSource::RenderWrapper;
+  (*renderers_)["google.protobuf.StringValue"] =
+      &ReflectionObjectSource::RenderWrapper;
+  (*renderers_)["google.protobuf.BytesValue"] =
+      &ReflectionObjectSource::RenderWrapper;
+  (*renderers_)["google.protobuf.Any"] = &ReflectionObjectSource::RenderAny;
+  (*renderers_)["google.protobuf.Struct"] =
+      &ReflectionObjectSource::RenderStruct;
+  (*renderers_)["google.protobuf.Value"] =
+      &ReflectionObjectSource::RenderStructValue;
+  (*renderers_)["google.protobuf.ListValue"] =
+      &ReflectionObjectSource::RenderStructListValue;
+  (*renderers_)["google.protobuf.FieldMask"] =
+      &ReflectionObjectSource::RenderFieldMask;
+  ::google::protobuf::internal::OnShutdown(&DeleteRendererMap);
+}
+
+void ReflectionObjectSource::DeleteRendererMap() {
+  delete ReflectionObjectSource::renderers_;
+  renderers_ = NULL;
+}
+
+// static
+ReflectionObjectSource::TypeRenderer*
+ReflectionObjectSource::FindTypeRenderer(const std::string& type_name) {
+  PROTOBUF_NAMESPACE_ID::internal::call_once(reflection_renderers_init_,
+                                             InitRendererMap);
+  return FindOrNull(*renderers_, type_name);
+}
+
+Message* ReflectionObjectSource::NewMessageOfType(
+    const std::string& type_name) const {
+  const DescriptorPool* pool = message_.GetDescriptor()->file()->pool();
+  const Descriptor* descriptor = pool->FindMessageTypeByName(type_name);
+  if (descriptor == nullptr) return nullptr;
+  if (pool == DescriptorPool::generated_pool()) {
+    return MessageFactory::generated_factory()
+        ->GetPrototype(descriptor)
+        ->New();
+  }
+  if (dynamic_factory_ == nullptr) {
+    dynamic_factory_.reset(new DynamicMessageFactory(pool));
+  }
+  return dynamic_factory_->GetPrototype(descriptor)->New();
+}
+
+Status ReflectionObjectSource::IncrementRecursionDepth(
+    StringPiece type_name, StringPiece field_name) const {
+  if (++recursion_depth_ > max_recursion_depth_) {
+    return Status(
+        util::error::INVALID_ARGUMENT,
+        StrCat("Message too deep. Max recursion depth reached for type '",
+                     type_name, "', field '", field_name, "'"));
+  }
+  return util::Status();
+}
+
+}  // namespace converter
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
@@ -0,0 +1,221 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef GOOGLE_PROTOBUF_UTIL_CONVERTER_REFLECTION_OBJECTSOURCE_H__
+#define GOOGLE_PROTOBUF_UTIL_CONVERTER_REFLECTION_OBJECTSOURCE_H__
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <google/protobuf/stubs/common.h>
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/dynamic_message.h>
+#include <google/protobuf/message.h>
+#include <google/protobuf/util/internal/object_source.h>
+#include <google/protobuf/util/internal/object_writer.h>
+#include <google/protobuf/stubs/strutil.h>
+#include <google/protobuf/stubs/status.h>
+
+
+#include <google/protobuf/port_def.inc>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace converter {
+
+// An ObjectSource that walks a Message through its Reflection. It writes the
+// same events as a ProtoStreamObjectSource does for the serialized message and
+// the google::protobuf::Type a DescriptorPool TypeResolver gives for it, but
+// without serializing the message, parsing it back and looking up its fields
+// by name.  Like the stream source, it writes fields in field number order,
+// skips extensions and unknown fields, and renders well-known types in their
+// special JSON forms.
+//
+// Sample usage:
+//   ReflectionObjectSource os(message, "type.googleapis.com");
+//   Status status = os.WriteTo(<some ObjectWriter>);
+class PROTOBUF_EXPORT ReflectionObjectSource : public ObjectSource {
+ public:
+  // The type_url_prefix is the one the Any messages in message use, without
+  // the trailing '/'.  The types they hold are looked up in the DescriptorPool
+  // of message.
+  ReflectionObjectSource(const Message& message,
+                         const std::string& type_url_prefix);
+
+  ~ReflectionObjectSource() override;
+
+  util::Status NamedWriteTo(StringPiece name,
+                              ObjectWriter* ow) const override;
+
+  // Sets whether to always output enums as ints, by default this is off, and
+  // enums are rendered as strings.
+  void set_use_ints_for_enums(bool value) { use_ints_for_enums_ = value; }
+
+  // Sets whether to use original proto field names
+  void set_preserve_proto_field_names(bool value) {
+    preserve_proto_field_names_ = value;
+  }
+
+  // Sets the max recursion depth of proto message to be rendered. Proto
+  // messages over this depth will fail to be rendered.
+  // Default value is 64.
+  void set_max_recursion_depth(int max_depth) {
+    max_recursion_depth_ = max_depth;
+  }
+
+ private:
+  // Function that renders a well known type with a modified behavior.
+  typedef util::Status (*TypeRenderer)(const ReflectionObjectSource*,
+                                         const Message&, StringPiece,
+                                         ObjectWriter*);
+
+  // Writes a message to the ObjectWriter. The include_start_and_end parameter
+  // allows this method to be called when already inside of an object, and
+  // skip calling StartObject and EndObject.
+  util::Status WriteMessage(const Message& message, StringPiece name,
+                              bool include_start_and_end,
+                              ObjectWriter* ow) const;
+
+  // Renders a repeated field as a list, or a map field as an object.
+  util::Status RenderRepeatedField(const Message& message,
+                                     const FieldDescriptor* field,
+                                     StringPiece name,
+                                     ObjectWriter* ow) const;
+
+  // Renders the entries of a map field as the fields of an object.
+  util::Status RenderMapEntries(const Message& message,
+                                  const FieldDescriptor* field,
+                                  ObjectWriter* ow) const;
+
+  // Renders a singular field, or element index of a repeated field if index
+  // is not -1.
+  util::Status RenderField(const Message& message,
+                             const FieldDescriptor* field, int index,
+                             StringPiece name, ObjectWriter* ow) const;
+
+  // Renders a message field value, with the type renderer of its type if it
+  // has one.
+  util::Status RenderMessage(const Message& message, StringPiece name,
+                               ObjectWriter* ow) const;
+
+  // Renders a google.protobuf.Timestamp value to ObjectWriter
+  static util::Status RenderTimestamp(const ReflectionObjectSource* os,
+                                        const Message& message,
+                                        StringPiece name, ObjectWriter* ow);
+
+  // Renders a google.protobuf.Duration value to ObjectWriter
+  static util::Status RenderDuration(const ReflectionObjectSource* os,
+                                       const Message& message,
+                                       StringPiece name, ObjectWriter* ow);
+
+  // Renders the wrapper types of google/protobuf/wrappers.proto as their
+  // value.
+  static util::Status RenderWrapper(const ReflectionObjectSource* os,
+                                      const Message& message,
+                                      StringPiece name, ObjectWriter* ow);
+
+  // Renders a google.protobuf.Struct to ObjectWriter.
+  static util::Status RenderStruct(const ReflectionObjectSource* os,
+                                     const Message& message,
+                                     StringPiece name, ObjectWriter* ow);
+
+  // Helper to render google.protobuf.Struct's Value fields to ObjectWriter.
+  static util::Status RenderStructValue(const ReflectionObjectSource* os,
+                                          const Message& message,
+                                          StringPiece name,
+                                          ObjectWriter* ow);
+
+  // Helper to render google.protobuf.Struct's ListValue fields to ObjectWriter.
+  static util::Status RenderStructListValue(const ReflectionObjectSource* os,
+                                              const Message& message,
+                                              StringPiece name,
+                                              ObjectWriter* ow);
+
+  // Render the "Any" type.
+  static util::Status RenderAny(const ReflectionObjectSource* os,
+                                  const Message& message, StringPiece name,
+                                  ObjectWriter* ow);
+
+  // Render the "FieldMask" type.
+  static util::Status RenderFieldMask(const ReflectionObjectSource* os,
+                                        const Message& message,
+                                        StringPiece name, ObjectWriter* ow);
+
+  static std::unordered_map<std::string, TypeRenderer>* renderers_;
+  static void InitRendererMap();
+  static void DeleteRendererMap();
+  static TypeRenderer* FindTypeRenderer(const std::string& type_name);
+
+  // Returns a new message of the type with the given name from the pool of
+  // message_, or null if the pool has no such type.
+  Message* NewMessageOfType(const std::string& type_name) const;
+
+  // Helper function to check recursion depth and increment it. It will return
+  // Status::OK if the current depth is allowed. Otherwise an error is returned.
+  // type_name and field_name are used for error reporting.
+  util::Status IncrementRecursionDepth(StringPiece type_name,
+                                         StringPiece field_name) const;
+
+  // The message to write.
+  const Message& message_;
+
+  // Prefix of the type URLs of Any messages.
+  const std::string type_url_prefix_;
+
+  // Makes the messages held in Any fields when message_ is not from the
+  // generated pool. Created on first use.
+  mutable std::unique_ptr<DynamicMessageFactory> dynamic_factory_;
+
+  // Whether to render enums as ints always. Defaults to false.
+  bool use_ints_for_enums_;
+
+  // Whether to preserve proto field names
+  bool preserve_proto_field_names_;
+
+  // Tracks current recursion depth.
+  mutable int recursion_depth_;
+
+  // Maximum allowed recursion depth.
+  int max_recursion_depth_;
+
+  GOOGLE_DISALLOW_IMPLICIT_CONSTRUCTORS(ReflectionObjectSource);
+};
+
+}  // namespace converter
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
+
+#include <google/protobuf/port_undef.inc>
+
+#endif  // GOOGLE_PROTOBUF_UTIL_CONVERTER_REFLECTION_OBJECTSOURCE_H__
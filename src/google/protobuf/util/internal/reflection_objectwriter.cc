@@ -0,0 +1,1202 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <google/protobuf/util/internal/reflection_objectwriter.h>
+
+#include <functional>
+
+#include <google/protobuf/stubs/logging.h>
+#include <google/protobuf/stubs/common.h>
+#include <google/protobuf/stubs/once.h>
+#include <google/protobuf/util/internal/field_mask_utility.h>
+#include <google/protobuf/util/internal/constants.h>
+#include <google/protobuf/util/internal/utility.h>
+#include <google/protobuf/stubs/strutil.h>
+#include <google/protobuf/stubs/time.h>
+#include <google/protobuf/stubs/map_util.h>
+#include <google/protobuf/stubs/statusor.h>
+
+
+#include <google/protobuf/port_def.inc>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace converter {
+
+using std::placeholders::_1;
+using util::Status;
+using util::StatusOr;
+using util::error::INVALID_ARGUMENT;
+
+namespace {
+
+// Returns true if a null value for field leaves the field unset, which it does
+// for all fields but the ones of type google.protobuf.Value and
+// google.protobuf.NullValue.
+bool IgnoresNull(const FieldDescriptor* field) {
+  switch (field->cpp_type()) {
+    case FieldDescriptor::CPPTYPE_MESSAGE:
+      return field->message_type()->full_name() != kStructValueType;
+    case FieldDescriptor::CPPTYPE_ENUM:
+      return field->enum_type()->full_name() != "google.protobuf.NullValue";
+    default:
+      return true;
+  }
+}
+
+// Adds one path, converted to snake case, to the paths of a FieldMask.
+Status AddFieldMaskPath(Message* message, const FieldDescriptor* paths,
+                        StringPiece path) {
+  message->GetReflection()->AddString(message, paths,
+                                      ConvertFieldMaskPath(path, &ToSnakeCase));
+  return Status();
+}
+
+}  // namespace
+
+// Collects the events of an Any message. Like the AnyWriter of
+// ProtoStreamObjectWriter, it keeps the events that come before the "@type"
+// field and replays them once the type is known, then writes the message the
+// Any holds with a nested ReflectionObjectWriter and packs it at the end.
+class ReflectionObjectWriter::AnyWriter {
+ public:
+  AnyWriter(ReflectionObjectWriter* parent, Message* any)
+      : parent_(parent),
+        any_(any),
+        depth_(0),
+        is_well_known_type_(false),
+        well_known_type_render_(nullptr) {}
+
+  // Passes a StartObject call through to the Any writer.
+  void StartObject(StringPiece name);
+
+  // Passes an EndObject call through to the Any. Returns true if the any
+  // handled the EndObject call, false if the Any is now all done and is no
+  // longer needed.
+  bool EndObject();
+
+  // Passes a StartList call through to the Any writer.
+  void StartList(StringPiece name);
+
+  // Passes an EndList call through to the Any writer.
+  void EndList();
+
+  // Renders a data piece on the any.
+  void RenderDataPiece(StringPiece name, const DataPiece& value);
+
+ private:
+  // An event received before the "@type" field.
+  class Event {
+   public:
+    enum Type {
+      START_OBJECT = 0,
+      END_OBJECT = 1,
+      START_LIST = 2,
+      END_LIST = 3,
+      RENDER_DATA_PIECE = 4,
+    };
+
+    // Constructor for END_OBJECT and END_LIST events.
+    explicit Event(Type type) : type_(type), value_(DataPiece::NullData()) {}
+
+    // Constructor for START_OBJECT and START_LIST events.
+    explicit Event(Type type, StringPiece name)
+        : type_(type), name_(name), value_(DataPiece::NullData()) {}
+
+    // Constructor for RENDER_DATA_PIECE events.
+    explicit Event(StringPiece name, const DataPiece& value)
+        : type_(RENDER_DATA_PIECE), name_(name), value_(value) {
+      DeepCopy();
+    }
+
+    Event(const Event& other)
+        : type_(other.type_), name_(other.name_), value_(other.value_) {
+      DeepCopy();
+    }
+
+    Event& operator=(const Event& other) {
+      type_ = other.type_;
+      name_ = other.name_;
+      value_ = other.value_;
+      DeepCopy();
+      return *this;
+    }
+
+    void Replay(AnyWriter* writer) const;
+
+   private:
+    // DataPiece only references its string, which the parser may reuse, so
+    // keep a copy of it.
+    void DeepCopy();
+
+    Type type_;
+    std::string name_;
+    DataPiece value_;
+    std::string value_storage_;
+  };
+
+  // Handles starting up the any once we have a type.
+  void StartAny(const DataPiece& value);
+
+  // Packs the written message into the Any.
+  void WriteAny();
+
+  // The writer of the message that holds the Any.
+  ReflectionObjectWriter* parent_;
+
+  // The Any being written.
+  Message* any_;
+
+  // The message the Any holds, and the writer for it.
+  std::unique_ptr<Message> packed_;
+  std::unique_ptr<ReflectionObjectWriter> ow_;
+
+  // The type_url_ that this Any represents.
+  std::string type_url_;
+
+  // The depth within the Any, so we can track when we're done.
+  int depth_;
+
+  // True if the type is a well-known type, which an Any holds in a "value"
+  // field with the special JSON form of the type.
+  bool is_well_known_type_;
+  TypeRenderer* well_known_type_render_;
+
+  // Store data before the "@type" field.
+  std::vector<Event> uninterpreted_events_;
+
+  GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(AnyWriter);
+};
+
+void ReflectionObjectWriter::AnyWriter::StartObject(StringPiece name) {
+  ++depth_;
+  if (ow_ == nullptr) {
+    // Save data before the "@type" field for later replay.
+    uninterpreted_events_.push_back(Event(Event::START_OBJECT, name));
+  } else if (is_well_known_type_ && depth_ == 1) {
+    // For well-known types, the only other field besides "@type" should be a
+    // "value" field.
+    if (name != "value") {
+      parent_->Fail("Any", "Expect a \"value\" field for well-known types.");
+      return;
+    }
+    ow_->StartObject("");
+  } else {
+    ow_->StartObject(name);
+  }
+}
+
+bool ReflectionObjectWriter::AnyWriter::EndObject() {
+  --depth_;
+  if (ow_ == nullptr) {
+    if (depth_ >= 0) {
+      // Save data before the "@type" field for later replay.
+      uninterpreted_events_.push_back(Event(Event::END_OBJECT));
+    }
+  } else if (depth_ >= 0 || !is_well_known_type_) {
+    // As long as depth_ >= 0, we know we haven't reached the end of Any.
+    // Propagate these EndObject() calls to the contained ow_. For regular
+    // message types, we propagate the end of Any as well.
+    ow_->EndObject();
+  }
+  // A negative depth_ implies that we have reached the end of Any
+  // object. Now we write out its contents.
+  if (depth_ < 0) {
+    WriteAny();
+    return false;
+  }
+  return true;
+}
+
+void ReflectionObjectWriter::AnyWriter::StartList(StringPiece name) {
+  ++depth_;
+  if (ow_ == nullptr) {
+    // Save data before the "@type" field for later replay.
+    uninterpreted_events_.push_back(Event(Event::START_LIST, name));
+  } else if (is_well_known_type_ && depth_ == 1) {
+    if (name != "value") {
+      parent_->Fail("Any", "Expect a \"value\" field for well-known types.");
+      return;
+    }
+    ow_->StartList("");
+  } else {
+    ow_->StartList(name);
+  }
+}
+
+void ReflectionObjectWriter::AnyWriter::EndList() {
+  --depth_;
+  if (depth_ < 0) {
+    GOOGLE_LOG(DFATAL) << "Mismatched EndList found, should not be possible";
+    depth_ = 0;
+  }
+  if (ow_ == nullptr) {
+    // Save data before the "@type" field for later replay.
+    uninterpreted_events_.push_back(Event(Event::END_LIST));
+  } else {
+    ow_->EndList();
+  }
+}
+
+void ReflectionObjectWriter::AnyWriter::RenderDataPiece(
+    StringPiece name, const DataPiece& value) {
+  // Start an Any only at depth_ 0. Other RenderDataPiece calls with "@type"
+  // should go to the contained ow_ as they indicate nested Anys.
+  if (depth_ == 0 && ow_ == nullptr && name == "@type") {
+    StartAny(value);
+  } else if (ow_ == nullptr) {
+    // Save data before the "@type" field.
+    uninterpreted_events_.push_back(Event(name, value));
+  } else if (depth_ == 0 && is_well_known_type_) {
+    if (name != "value") {
+      parent_->Fail("Any", "Expect a \"value\" field for well-known types.");
+      return;
+    }
+    if (well_known_type_render_ == nullptr) {
+      // Only Any and Struct don't have a special type render but both of
+      // them expect a JSON object (i.e., a StartObject() call).
+      if (value.type() != DataPiece::TYPE_NULL) {
+        parent_->Fail("Any", "Expect a JSON object.");
+      }
+    } else {
+      ow_->RenderDataPiece("", value);
+    }
+  } else {
+    ow_->RenderDataPiece(name, value);
+  }
+}
+
+void ReflectionObjectWriter::AnyWriter::StartAny(const DataPiece& value) {
+  if (value.type() == DataPiece::TYPE_STRING) {
+    type_url_ = std::string(value.str());
+  } else {
+    StatusOr<std::string> s = value.ToString();
+    if (!s.ok()) {
+      parent_->Fail("String", s.status().message());
+      return;
+    }
+    type_url_ = s.value();
+  }
+  // Look up the type the same way the DescriptorPool TypeResolver does.
+  const std::string& prefix = parent_->type_url_prefix_;
+  if (type_url_.compare(0, prefix.size() + 1, prefix + "/") != 0) {
+    parent_->Fail(
+        "Any", StrCat("Invalid type URL, type URLs must be of the form '",
+                            prefix, "/<typename>', got: ", type_url_));
+    return;
+  }
+  const std::string type_name = type_url_.substr(prefix.size() + 1);
+  packed_.reset(parent_->root_->NewMessageOfType(type_name));
+  if (packed_ == nullptr) {
+    parent_->Fail("Any",
+                  StrCat("Invalid type URL, unknown type: ", type_name));
+    return;
+  }
+
+  well_known_type_render_ = FindTypeRenderer(type_name);
+  if (well_known_type_render_ != nullptr ||
+      // Explicitly list Any and Struct here because they don't have a
+      // custom renderer.
+      type_name == kAnyType || type_name == kStructType) {
+    is_well_known_type_ = true;
+  }
+
+  ow_.reset(new ReflectionObjectWriter(packed_.get(), parent_));
+
+  // Don't call StartObject() for well-known types yet. Depending on the
+  // type of actual data, we may not need to call StartObject().
+  if (!is_well_known_type_) {
+    ow_->StartObject("");
+  }
+
+  // Now we know the proto type and can interpret all data fields we gathered
+  // before the "@type" field.
+  for (int i = 0; i < uninterpreted_events_.size(); ++i) {
+    uninterpreted_events_[i].Replay(this);
+  }
+}
+
+void ReflectionObjectWriter::AnyWriter::WriteAny() {
+  if (ow_ == nullptr) {
+    // An Any without content is an empty Any.
+    if (!uninterpreted_events_.empty()) {
+      // There are uninterpreted data, but we never got a "@type" field.
+      parent_->Fail("Any",
+                    StrCat("Missing @type for any field in ",
+                                 parent_->message_->GetDescriptor()->full_name()));
+    }
+    return;
+  }
+  if (!ow_->status().ok()) {
+    parent_->Fail("Any", ow_->status().message());
+    return;
+  }
+  const Reflection* reflection = any_->GetReflection();
+  const Descriptor* descriptor = any_->GetDescriptor();
+  reflection->SetString(any_, descriptor->FindFieldByNumber(1), type_url_);
+  std::string value;
+  packed_->SerializePartialToString(&value);
+  if (!value.empty()) {
+    reflection->SetString(any_, descriptor->FindFieldByNumber(2),
+                          std::move(value));
+  }
+}
+
+void ReflectionObjectWriter::AnyWriter::Event::Replay(
+    AnyWriter* writer) const {
+  switch (type_) {
+    case START_OBJECT:
+      writer->StartObject(name_);
+      break;
+    case END_OBJECT:
+      writer->EndObject();
+      break;
+    case START_LIST:
+      writer->StartList(name_);
+      break;
+    case END_LIST:
+      writer->EndList();
+      break;
+    case RENDER_DATA_PIECE:
+      writer->RenderDataPiece(name_, value_);
+      break;
+  }
+}
+
+void ReflectionObjectWriter::AnyWriter::Event::DeepCopy() {
+  if (value_.type() == DataPiece::TYPE_STRING) {
+    StrAppend(&value_storage_, value_.str());
+    value_ = DataPiece(value_storage_, value_.use_strict_base64_decoding());
+  } else if (value_.type() == DataPiece::TYPE_BYTES) {
+    value_storage_ = value_.ToBytes().ValueOrDie();
+    value_ =
+        DataPiece(value_storage_, true, value_.use_strict_base64_decoding());
+  }
+}
+
+ReflectionObjectWriter::Element::Element(Kind kind, Message* message,
+                                         const FieldDescriptor* field)
+    : kind(kind), message(message), field(field) {}
+
+ReflectionObjectWriter::Element::Element(Element&& other)
+    : kind(other.kind),
+      message(other.message),
+      field(other.field),
+      map_keys(std::move(other.map_keys)),
+      ignored_oneofs(std::move(other.ignored_oneofs)),
+      any(std::move(other.any)) {}
+
+ReflectionObjectWriter::Element::~Element() {}
+
+ReflectionObjectWriter::ReflectionObjectWriter(
+    Message* message, const std::string& type_url_prefix,
+    const Options& options)
+    : message_(message),
+      type_url_prefix_(type_url_prefix),
+      options_(options),
+      root_(this),
+      skip_depth_(0),
+      started_(false),
+      done_(false) {}
+
+ReflectionObjectWriter::ReflectionObjectWriter(Message* message,
+                                               ReflectionObjectWriter* parent)
+    : message_(message),
+      type_url_prefix_(parent->type_url_prefix_),
+      options_(parent->options_),
+      root_(parent->root_),
+      skip_depth_(0),
+      started_(false),
+      done_(false) {
+  set_use_strict_base64_decoding(parent->use_strict_base64_decoding());
+}
+
+ReflectionObjectWriter::~ReflectionObjectWriter() {}
+
+ReflectionObjectWriter* ReflectionObjectWriter::StartObject(
+    StringPiece name) {
+  if (!status_.ok()) return this;
+  if (skip_depth_ > 0) {
+    ++skip_depth_;
+    return this;
+  }
+
+  // Starting the root message.
+  if (!started_) {
+    started_ = true;
+    if (!name.empty()) {
+      Fail(name, "Root element should not be named.");
+      return this;
+    }
+    StartObjectIn(message_, nullptr, false);
+    return this;
+  }
+  if (stack_.empty()) {
+    Fail(name, "Root element must be a message.");
+    return this;
+  }
+
+  Element& element = stack_.back();
+  switch (element.kind) {
+    case Element::ANY:
+      element.any->StartObject(name);
+      break;
+    case Element::MAP: {
+      Message* entry = AddMapEntry(name);
+      if (entry != nullptr) {
+        StartObjectIn(entry, entry->GetDescriptor()->map_value(), false);
+      }
+      break;
+    }
+    case Element::LIST:
+      StartObjectIn(element.message, element.field, true);
+      break;
+    case Element::MESSAGE: {
+      Message* message = element.message;
+      const FieldDescriptor* field = Lookup(name);
+      if (field == nullptr) {
+        ++skip_depth_;
+      } else if (ValidOneof(*message, field, name)) {
+        // A repeated field without a list gets one element.
+        StartObjectIn(message, field, field->is_repeated() && !field->is_map());
+      }
+      break;
+    }
+  }
+  return this;
+}
+
+ReflectionObjectWriter* ReflectionObjectWriter::EndObject() {
+  if (!status_.ok()) return this;
+  if (skip_depth_ > 0) {
+    --skip_depth_;
+    return this;
+  }
+  if (stack_.empty()) return this;
+
+  if (stack_.back().kind == Element::ANY && stack_.back().any->EndObject()) {
+    return this;
+  }
+  Pop();
+  return this;
+}
+
+ReflectionObjectWriter* ReflectionObjectWriter::StartList(StringPiece name) {
+  if (!status_.ok()) return this;
+  if (skip_depth_ > 0) {
+    ++skip_depth_;
+    return this;
+  }
+
+  // Since we cannot have a top-level repeated item in protobuf, the only way
+  // this is valid is if we start a google.protobuf.ListValue or
+  // google.protobuf.Value.
+  if (!started_) {
+    started_ = true;
+    if (!name.empty()) {
+      Fail(name, "Root element should not be named.");
+      return this;
+    }
+    StartListIn(message_, nullptr, false);
+    return this;
+  }
+  if (stack_.empty()) {
+    Fail(name, "Root element must be a message.");
+    return this;
+  }
+
+  Element& element = stack_.back();
+  switch (element.kind) {
+    case Element::ANY:
+      element.any->StartList(name);
+      break;
+    case Element::MAP: {
+      Message* entry = AddMapEntry(name);
+      if (entry != nullptr) {
+        StartListIn(entry, entry->GetDescriptor()->map_value(), false);
+      }
+      break;
+    }
+    case Element::LIST:
+      StartListIn(element.message, element.field, true);
+      break;
+    case Element::MESSAGE: {
+      Message* message = element.message;
+      const FieldDescriptor* field = Lookup(name);
+      if (field == nullptr) {
+        ++skip_depth_;
+      } else if (ValidOneof(*message, field, name)) {
+        StartListIn(message, field, false);
+      }
+      break;
+    }
+  }
+  return this;
+}
+
+ReflectionObjectWriter* ReflectionObjectWriter::EndList() {
+  if (!status_.ok()) return this;
+  if (skip_depth_ > 0) {
+    --skip_depth_;
+    return this;
+  }
+  if (stack_.empty()) return this;
+
+  if (stack_.back().kind == Element::ANY) {
+    stack_.back().any->EndList();
+    return this;
+  }
+  Pop();
+  return this;
+}
+
+ReflectionObjectWriter* ReflectionObjectWriter::RenderDataPiece(
+    StringPiece name, const DataPiece& data) {
+  if (!status_.ok() || skip_depth_ > 0) return this;
+
+  // A scalar root is the JSON form of a well-known type.
+  if (!started_) {
+    started_ = true;
+    RenderIn(message_, nullptr, false, data);
+    if (status_.ok()) {
+      done_ = true;
+    }
+    return this;
+  }
+  if (stack_.empty()) {
+    Fail(name, "Root element must be a message.");
+    return this;
+  }
+
+  Element& element = stack_.back();
+  switch (element.kind) {
+    case Element::ANY:
+      element.any->RenderDataPiece(name, data);
+      break;
+    case Element::MAP: {
+      Message* entry = AddMapEntry(name);
+      if (entry == nullptr) break;
+      const FieldDescriptor* value = entry->GetDescriptor()->map_value();
+      // A null value leaves the value of the entry unset, but a well-known
+      // type value is rendered from it, and so is present.
+      if (data.type() == DataPiece::TYPE_NULL &&
+          value->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE) {
+        const TypeRenderer* type_renderer =
+            FindTypeRenderer(value->message_type()->full_name());
+        if (type_renderer != nullptr) {
+          Status status = (*type_renderer)(
+              this, entry->GetReflection()->MutableMessage(entry, value),
+              data);
+          if (!status.ok()) Fail(name, status.message());
+        }
+        break;
+      }
+      RenderIn(entry, value, false, data);
+      break;
+    }
+    case Element::LIST:
+      RenderIn(element.message, element.field, true, data);
+      break;
+    case Element::MESSAGE: {
+      Message* message = element.message;
+      const FieldDescriptor* field = Lookup(name);
+      if (field == nullptr) break;
+      if (data.type() == DataPiece::TYPE_NULL && IgnoresNull(field)) break;
+      if (ValidOneof(*message, field, name)) {
+        RenderIn(message, field, field->is_repeated(), data);
+      }
+      break;
+    }
+  }
+  return this;
+}
+
+void ReflectionObjectWriter::StartObjectIn(Message* message,
+                                           const FieldDescriptor* field,
+                                           bool add) {
+  if (field != nullptr) {
+    if (field->is_map() && !add) {
+      Push(Element::MAP, message, field);
+      return;
+    }
+    if (field->cpp_type() != FieldDescriptor::CPPTYPE_MESSAGE) {
+      Fail(field->name(), "Cannot start an object for a non-message field.");
+      return;
+    }
+    const Reflection* reflection = message->GetReflection();
+    message = add ? reflection->AddMessage(message, field)
+                  : reflection->MutableMessage(message, field);
+  }
+
+  const std::string& type_name = message->GetDescriptor()->full_name();
+  if (type_name == kStructType) {
+    // The object holds the entries of the "fields" map of the Struct.
+    Push(Element::MAP, message, message->GetDescriptor()->FindFieldByNumber(1));
+  } else if (type_name == kStructValueType) {
+    // The only object a google.protobuf.Value holds is a Struct, in its
+    // "struct_value" field.
+    Message* struct_value = message->GetReflection()->MutableMessage(
+        message, message->GetDescriptor()->FindFieldByNumber(5));
+    Push(Element::MAP, struct_value,
+         struct_value->GetDescriptor()->FindFieldByNumber(1));
+  } else if (type_name == kAnyType) {
+    Push(Element::ANY, message, nullptr);
+  } else if (type_name == kStructListValueType && field == nullptr) {
+    Fail(kStructListValueType, "Cannot start root message with ListValue.");
+  } else {
+    Push(Element::MESSAGE, message, nullptr);
+  }
+}
+
+void ReflectionObjectWriter::StartListIn(Message* message,
+                                         const FieldDescriptor* field,
+                                         bool add) {
+  const Reflection* reflection = message->GetReflection();
+  const Descriptor* type =
+      field == nullptr ? message->GetDescriptor() : field->message_type();
+  bool holds_lists = type != nullptr &&
+                     (type->full_name() == kStructValueType ||
+                      type->full_name() == kStructListValueType);
+  // A list nested in the list of a repeated field adds to the same field, as
+  // with the stream writer, unless the elements of the field are lists.
+  if (field != nullptr && field->is_repeated() && !(add && holds_lists)) {
+    if (field->is_map()) {
+      Fail(field->name(), "Cannot bind a list to map.");
+      return;
+    }
+    Push(Element::LIST, message, field);
+    return;
+  }
+
+  // Otherwise the list is the JSON form of a google.protobuf.ListValue, or of
+  // a google.protobuf.Value holding one.
+  if (!holds_lists) {
+    Fail(field == nullptr ? "" : field->name(),
+         "Proto field is not repeating, cannot start list.");
+    return;
+  }
+  if (field != nullptr) {
+    message = add ? reflection->AddMessage(message, field)
+                  : reflection->MutableMessage(message, field);
+  }
+  if (type->full_name() == kStructValueType) {
+    message = message->GetReflection()->MutableMessage(
+        message, type->FindFieldByNumber(6));
+  }
+  Push(Element::LIST, message,
+       message->GetDescriptor()->FindFieldByNumber(1));
+}
+
+void ReflectionObjectWriter::RenderIn(Message* message,
+                                      const FieldDescriptor* field, bool add,
+                                      const DataPiece& data) {
+  if (field == nullptr) {
+    const std::string& type_name = message->GetDescriptor()->full_name();
+    const TypeRenderer* type_renderer = FindTypeRenderer(type_name);
+    if (type_renderer == nullptr) {
+      Fail("", "Root element must be a message.");
+      return;
+    }
+    Status status = (*type_renderer)(this, message, data);
+    if (!status.ok()) Fail(type_name, status.message());
+    return;
+  }
+
+  if (data.type() == DataPiece::TYPE_NULL && IgnoresNull(field)) return;
+
+  if (field->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE) {
+    const TypeRenderer* type_renderer =
+        FindTypeRenderer(field->message_type()->full_name());
+    if (type_renderer == nullptr) {
+      Fail(field->name(),
+           StrCat("invalid value ", data.ValueAsStringOrDefault(""),
+                        " for type ", field->message_type()->full_name()));
+      return;
+    }
+    const Reflection* reflection = message->GetReflection();
+    Status status = (*type_renderer)(
+        this,
+        add ? reflection->AddMessage(message, field)
+            : reflection->MutableMessage(message, field),
+        data);
+    if (!status.ok()) Fail(field->name(), status.message());
+    return;
+  }
+
+  Status status = RenderPrimitive(message, field, add, data);
+  if (!status.ok()) Fail(field->name(), status.message());
+}
+
+Message* ReflectionObjectWriter::AddMapEntry(StringPiece key) {
+  Element& element = stack_.back();
+  if (element.map_keys == nullptr) {
+    element.map_keys.reset(new std::unordered_set<std::string>);
+  }
+  if (!InsertIfNotPresent(element.map_keys.get(), std::string(key))) {
+    Fail(key, StrCat("Repeated map key: '", key, "' is already set."));
+    return nullptr;
+  }
+  Message* entry = element.message->GetReflection()->AddMessage(
+      element.message, element.field);
+  Status status =
+      RenderPrimitive(entry, entry->GetDescriptor()->map_key(), false,
+                      DataPiece(key, use_strict_base64_decoding()));
+  if (!status.ok()) {
+    Fail(key, status.message());
+    return nullptr;
+  }
+  return entry;
+}
+
+const FieldDescriptor* ReflectionObjectWriter::Lookup(StringPiece name) {
+  if (name.empty()) {
+    Fail(name, "Proto fields must have a name.");
+    return nullptr;
+  }
+  // Like the TypeInfo of the stream writer, match the JSON names first and
+  // then the proto names. The lower camel case name of a field is its JSON
+  // name unless the proto name or json_name option say otherwise.
+  const Descriptor* descriptor = stack_.back().message->GetDescriptor();
+  const std::string key(name);
+  const FieldDescriptor* field = descriptor->FindFieldByCamelcaseName(key);
+  if (field == nullptr || field->json_name() != key) {
+    field = nullptr;
+    for (int i = 0; i < descriptor->field_count(); ++i) {
+      if (descriptor->field(i)->json_name() == key) {
+        field = descriptor->field(i);
+        break;
+      }
+    }
+    if (field == nullptr) {
+      field = descriptor->FindFieldByName(key);
+    }
+  }
+  if (field == nullptr) {
+    if (!options_.ignore_unknown_fields) {
+      Fail(name, "Cannot find field.");
+    }
+    return nullptr;
+  }
+  if (field->type() == FieldDescriptor::TYPE_GROUP) {
+    Fail(name, "Groups are not supported.");
+    return nullptr;
+  }
+  return field;
+}
+
+bool ReflectionObjectWriter::ValidOneof(const Message& message,
+                                        const FieldDescriptor* field,
+                                        StringPiece name) {
+  const OneofDescriptor* oneof = field->containing_oneof();
+  if (oneof == nullptr) return true;
+  const Element& element = stack_.back();
+  if (message.GetReflection()->HasOneof(message, oneof) ||
+      (element.ignored_oneofs != nullptr &&
+       element.ignored_oneofs->count(oneof) > 0)) {
+    Fail("oneof", StrCat("oneof field '", oneof->name(),
+                               "' is already set. Cannot set '", name, "'"));
+    return false;
+  }
+  return true;
+}
+
+Status ReflectionObjectWriter::RenderPrimitive(Message* message,
+                                               const FieldDescriptor* field,
+                                               bool add,
+                                               const DataPiece& data) {
+  const Reflection* reflection = message->GetReflection();
+  switch (field->cpp_type()) {
+    case FieldDescriptor::CPPTYPE_INT32: {
+      StatusOr<int32> i32 = data.ToInt32();
+      if (!i32.ok()) return i32.status();
+      if (add) {
+        reflection->AddInt32(message, field, i32.value());
+      } else {
+        reflection->SetInt32(message, field, i32.value());
+      }
+      break;
+    }
+    case FieldDescriptor::CPPTYPE_INT64: {
+      StatusOr<int64> i64 = data.ToInt64();
+      if (!i64.ok()) return i64.status();
+      if (add) {
+        reflection->AddInt64(message, field, i64.value());
+      } else {
+        reflection->SetInt64(message, field, i64.value());
+      }
+      break;
+    }
+    case FieldDescriptor::CPPTYPE_UINT32: {
+      StatusOr<uint32> u32 = data.ToUint32();
+      if (!u32.ok()) return u32.status();
+      if (add) {
+        reflection->AddUInt32(message, field, u32.value());
+      } else {
+        reflection->SetUInt32(message, field, u32.value());
+      }
+      break;
+    }
+    case FieldDescriptor::CPPTYPE_UINT64: {
+      StatusOr<uint64> u64 = data.ToUint64();
+      if (!u64.ok()) return u64.status();
+      if (add) {
+        reflection->AddUInt64(message, field, u64.value());
+      } else {
+        reflection->SetUInt64(message, field, u64.value());
+      }
+      break;
+    }
+    case FieldDescriptor::CPPTYPE_DOUBLE: {
+      StatusOr<double> d = data.ToDouble();
+      if (!d.ok()) return d.status();
+      if (add) {
+        reflection->AddDouble(message, field, d.value());
+      } else {
+        reflection->SetDouble(message, field, d.value());
+      }
+      break;
+    }
+    case FieldDescriptor::CPPTYPE_FLOAT: {
+      StatusOr<float> f = data.ToFloat();
+      if (!f.ok()) return f.status();
+      if (add) {
+        reflection->AddFloat(message, field, f.value());
+      } else {
+        reflection->SetFloat(message, field, f.value());
+      }
+      break;
+    }
+    case FieldDescriptor::CPPTYPE_BOOL: {
+      StatusOr<bool> b = data.ToBool();
+      if (!b.ok()) return b.status();
+      if (add) {
+        reflection->AddBool(message, field, b.value());
+      } else {
+        reflection->SetBool(message, field, b.value());
+      }
+      break;
+    }
+    case FieldDescriptor::CPPTYPE_ENUM: {
+      int value = 0;
+      bool is_unknown = false;
+      Status status = ToEnum(field->enum_type(), data, &value, &is_unknown);
+      if (!status.ok()) return status;
+      if (is_unknown) {
+        // The stream writer counts the ignored value as the one set in its
+        // oneof.
+        if (field->containing_oneof() != nullptr) {
+          Element& element = stack_.back();
+          if (element.ignored_oneofs == nullptr) {
+            element.ignored_oneofs.reset(
+                new std::unordered_set<const OneofDescriptor*>);
+          }
+          element.ignored_oneofs->insert(field->containing_oneof());
+        }
+        break;
+      }
+      if (add) {
+        reflection->AddEnumValue(message, field, value);
+      } else {
+        reflection->SetEnumValue(message, field, value);
+      }
+      break;
+    }
+    case FieldDescriptor::CPPTYPE_STRING: {
+      StatusOr<std::string> s = field->type() == FieldDescriptor::TYPE_BYTES
+                                    ? data.ToBytes()
+                                    : data.ToString();
+      if (!s.ok()) return s.status();
+      if (add) {
+        reflection->AddString(message, field, s.value());
+      } else {
+        reflection->SetString(message, field, s.value());
+      }
+      break;
+    }
+    default:
+      return Status(INVALID_ARGUMENT, data.ValueAsStringOrDefault(""));
+  }
+  return Status();
+}
+
+Status ReflectionObjectWriter::ToEnum(const EnumDescriptor* enum_type,
+                                      const DataPiece& data, int* value,
+                                      bool* is_unknown) const {
+  // Only google.protobuf.NullValue fields get here with a null.
+  if (data.type() == DataPiece::TYPE_NULL) {
+    *value = 0;
+    return Status();
+  }
+  if (data.type() != DataPiece::TYPE_STRING) {
+    // Numbers are kept even if the enum does not declare them.
+    StatusOr<int32> i32 = data.ToInt32();
+    if (!i32.ok()) return i32.status();
+    *value = i32.value();
+    return Status();
+  }
+
+  // First try the given value as a name.
+  std::string enum_name = std::string(data.str());
+  const EnumValueDescriptor* enum_value = enum_type->FindValueByName(enum_name);
+  if (enum_value == nullptr) {
+    // Check if int version of enum is sent as string.
+    StatusOr<int32> i32 = data.ToInt32();
+    if (i32.ok()) {
+      enum_value = enum_type->FindValueByNumber(i32.value());
+    }
+  }
+  if (enum_value == nullptr && options_.case_insensitive_enum_parsing) {
+    for (std::string::iterator it = enum_name.begin(); it != enum_name.end();
+         ++it) {
+      *it = *it == '-' ? '_' : ascii_toupper(*it);
+    }
+    enum_value = enum_type->FindValueByName(enum_name);
+  }
+  if (enum_value != nullptr) {
+    *value = enum_value->number();
+    return Status();
+  }
+  if (options_.ignore_unknown_enum_values) {
+    *is_unknown = true;
+    return Status();
+  }
+  return Status(INVALID_ARGUMENT, data.ValueAsStringOrDefault(
+                                      "Cannot find enum with given value."));
+}
+
+void ReflectionObjectWriter::Push(Element::Kind kind, Message* message,
+                                  const FieldDescriptor* field) {
+  stack_.emplace_back(kind, message, field);
+  if (kind == Element::ANY) {
+    stack_.back().any.reset(new AnyWriter(this, message));
+  }
+}
+
+void ReflectionObjectWriter::Pop() {
+  stack_.pop_back();
+  if (stack_.empty()) {
+    // Like parsing the output of the stream writer, the message must have
+    // all its required fields.
+    if (!message_->IsInitialized()) {
+      Fail("", StrCat("missing required fields in ",
+                            message_->GetDescriptor()->full_name()));
+      return;
+    }
+    done_ = true;
+  }
+}
+
+void ReflectionObjectWriter::Fail(StringPiece name, StringPiece message) {
+  if (!status_.ok()) return;
+  status_ = Status(INVALID_ARGUMENT,
+                   name.empty() ? std::string(message)
+                                : StrCat(name, ": ", message));
+}
+
+Message* ReflectionObjectWriter::NewMessageOfType(
+    const std::string& type_name) {
+  const DescriptorPool* pool = message_->GetDescriptor()->file()->pool();
+  const Descriptor* descriptor = pool->FindMessageTypeByName(type_name);
+  if (descriptor == nullptr) return nullptr;
+  if (pool == DescriptorPool::generated_pool()) {
+    return MessageFactory::generated_factory()
+        ->GetPrototype(descriptor)
+        ->New();
+  }
+  if (dynamic_factory_ == nullptr) {
+    dynamic_factory_.reset(new DynamicMessageFactory(pool));
+  }
+  return dynamic_factory_->GetPrototype(descriptor)->New();
+}
+
+Status ReflectionObjectWriter::RenderTimestamp(ReflectionObjectWriter* ow,
+                                               Message* message,
+                                               const DataPiece& data) {
+  if (data.type() == DataPiece::TYPE_NULL) return Status();
+  if (data.type() != DataPiece::TYPE_STRING) {
+    return Status(INVALID_ARGUMENT,
+                  StrCat("Invalid data type for timestamp, value is ",
+                               data.ValueAsStringOrDefault("")));
+  }
+
+  StringPiece value(data.str());
+
+  int64 seconds;
+  int32 nanos;
+  if (!::google::protobuf::internal::ParseTime(value.ToString(), &seconds,
+                                               &nanos)) {
+    return Status(INVALID_ARGUMENT, StrCat("Invalid time format: ", value));
+  }
+
+  const Reflection* reflection = message->GetReflection();
+  const Descriptor* descriptor = message->GetDescriptor();
+  reflection->SetInt64(message, descriptor->FindFieldByNumber(1), seconds);
+  reflection->SetInt32(message, descriptor->FindFieldByNumber(2), nanos);
+  return Status();
+}
+
+Status ReflectionObjectWriter::RenderDuration(ReflectionObjectWriter* ow,
+                                              Message* message,
+                                              const DataPiece& data) {
+  if (data.type() == DataPiece::TYPE_NULL) return Status();
+  if (data.type() != DataPiece::TYPE_STRING) {
+    return Status(INVALID_ARGUMENT,
+                  StrCat("Invalid data type for duration, value is ",
+                               data.ValueAsStringOrDefault("")));
+  }
+
+  int64 seconds;
+  int32 nanos;
+  Status status = ParseDuration(data.str(), &seconds, &nanos);
+  if (!status.ok()) {
+    return status;
+  }
+
+  const Reflection* reflection = message->GetReflection();
+  const Descriptor* descriptor = message->GetDescriptor();
+  reflection->SetInt64(message, descriptor->FindFieldByNumber(1), seconds);
+  reflection->SetInt32(message, descriptor->FindFieldByNumber(2), nanos);
+  return Status();
+}
+
+Status ReflectionObjectWriter::RenderFieldMask(ReflectionObjectWriter* ow,
+                                               Message* message,
+                                               const DataPiece& data) {
+  if (data.type() == DataPiece::TYPE_NULL) return Status();
+  if (data.type() != DataPiece::TYPE_STRING) {
+    return Status(INVALID_ARGUMENT,
+                  StrCat("Invalid data type for field mask, value is ",
+                               data.ValueAsStringOrDefault("")));
+  }
+
+  return DecodeCompactFieldMaskPaths(
+      data.str(),
+      std::bind(&AddFieldMaskPath, message,
+                message->GetDescriptor()->FindFieldByNumber(1), _1));
+}
+
+Status ReflectionObjectWriter::RenderWrapper(ReflectionObjectWriter* ow,
+                                             Message* message,
+                                             const DataPiece& data) {
+  if (data.type() == DataPiece::TYPE_NULL) return Status();
+  return ow->RenderPrimitive(message,
+                             message->GetDescriptor()->FindFieldByNumber(1),
+                             false, data);
+}
+
+Status ReflectionObjectWriter::RenderStructValue(ReflectionObjectWriter* ow,
+                                                 Message* message,
+                                                 const DataPiece& data) {
+  // The fields of google.protobuf.Value by number: null_value = 1,
+  // number_value = 2, string_value = 3 and bool_value = 4.
+  int field_number;
+  switch (data.type()) {
+    case DataPiece::TYPE_INT32:
+    case DataPiece::TYPE_UINT32:
+    case DataPiece::TYPE_INT64:
+    case DataPiece::TYPE_UINT64:
+    case DataPiece::TYPE_FLOAT:
+    case DataPiece::TYPE_DOUBLE:
+      field_number = 2;
+      break;
+    case DataPiece::TYPE_STRING:
+      field_number = 3;
+      break;
+    case DataPiece::TYPE_BOOL:
+      field_number = 4;
+      break;
+    case DataPiece::TYPE_NULL:
+      field_number = 1;
+      break;
+    default:
+      return Status(INVALID_ARGUMENT,
+                    "Invalid struct data type. Only number, string, boolean or "
+                    "null values are supported.");
+  }
+  return ow->RenderPrimitive(
+      message, message->GetDescriptor()->FindFieldByNumber(field_number),
+      false, data);
+}
+
+// Map of functions that are responsible for rendering well known type
+// represented by the key.
+std::unordered_map<std::string, ReflectionObjectWriter::TypeRenderer>*
+    ReflectionObjectWriter::renderers_ = nullptr;
+PROTOBUF_NAMESPACE_ID::internal::once_flag reflection_writer_renderers_init_;
+
+void ReflectionObjectWriter::InitRendererMap() {
+  renderers_ = new std::unordered_map<std::string,
+                                      ReflectionObjectWriter::TypeRenderer>();
+  (*renderers_)["google.protobuf.Timestamp"] =
+      &ReflectionObjectWriter::RenderTimestamp;
+  (*renderers_)["google.protobuf.Duration"] =
+      &ReflectionObjectWriter::RenderDuration;
+  (*renderers_)["google.protobuf.FieldMask"] =
+      &ReflectionObjectWriter::RenderFieldMask;
+  (*renderers_)["google.protobuf.DoubleValue"] =
+      &ReflectionObjectWriter::RenderWrapper;
+  (*renderers_)["google.protobuf.FloatValue"] =
+      &ReflectionObjectWriter::RenderWrapper;
+  (*renderers_)["google.protobuf.Int64Value"] =
+      &ReflectionObjectWriter::RenderWrapper;
+  (*renderers_)["google.protobuf.UInt64Value"] =
+      &ReflectionObjectWriter::RenderWrapper;
+  (*renderers_)["google.protobuf.Int32Value"] =
+      &ReflectionObjectWriter::RenderWrapper;
+  (*renderers_)["google.protobuf.UInt32Value"] =
+      &ReflectionObjectWriter::RenderWrapper;
+  (*renderers_)["google.protobuf.BoolValue"] =
+      &ReflectionObjectWriter::RenderWrapper;
+  (*renderers_)["google.protobuf.StringValue"] =
+      &ReflectionObjectWriter::RenderWrapper;
+  (*renderers_)["google.protobuf.BytesValue"] =
+      &ReflectionObjectWriter::RenderWrapper;
+  (*renderers_)["google.protobuf.Value"] =
+      &ReflectionObjectWriter::RenderStructValue;
+  ::google::protobuf::internal::OnShutdown(&DeleteRendererMap);
+}
+
+void ReflectionObjectWriter::DeleteRendererMap() {
+  delete ReflectionObjectWriter::renderers_;
+  renderers_ = nullptr;
+}
+
+ReflectionObjectWriter::TypeRenderer*
+ReflectionObjectWriter::FindTypeRenderer(const std::string& type_name) {
+  PROTOBUF_NAMESPACE_ID::internal::call_once(reflection_writer_renderers_init_,
+                                             InitRendererMap);
+  return FindOrNull(*renderers_, type_name);
+}
+
+}  // namespace converter
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
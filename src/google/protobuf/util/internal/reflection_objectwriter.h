@@ -0,0 +1,328 @@
+// Protocol Buffers - Google's data interchange format
+// Copyright 2008 Google Inc.  All rights reserved.
+// https://developers.google.com/protocol-buffers/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+//     * Neither the name of Google Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from
+// this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef GOOGLE_PROTOBUF_UTIL_CONVERTER_REFLECTION_OBJECTWRITER_H__
+#define GOOGLE_PROTOBUF_UTIL_CONVERTER_REFLECTION_OBJECTWRITER_H__
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <google/protobuf/stubs/common.h>
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/dynamic_message.h>
+#include <google/protobuf/message.h>
+#include <google/protobuf/util/internal/datapiece.h>
+#include <google/protobuf/util/internal/object_writer.h>
+#include <google/protobuf/stubs/strutil.h>
+#include <google/protobuf/stubs/status.h>
+
+
+#include <google/protobuf/port_def.inc>
+
+namespace google {
+namespace protobuf {
+namespace util {
+namespace converter {
+
+// An ObjectWriter that sets the fields of a Message through its Reflection.
+// It accepts the same events as a ProtoStreamObjectWriter for the message's
+// type, including the special JSON forms of the well-known types, but builds
+// the message in place instead of encoding it to the wire format first.
+// Sub-messages are created on the arena of the message, if it has one.
+//
+// The first error stops the writer: later events are ignored and status()
+// returns the error. Errors carry no location, and inputs that the stream
+// writer would handle in an unusual way (objects for scalar fields, groups)
+// are reported as errors too. Callers that need the stream writer's exact
+// diagnostics should rerun such inputs through ProtoStreamObjectWriter.
+//
+// Sample usage:
+//   ReflectionObjectWriter ow(&message, "type.googleapis.com",
+//                             ReflectionObjectWriter::Options::Defaults());
+//   JsonStreamParser parser(&ow);
+//   ... parser.Parse(json), parser.FinishParse() ...
+//   if (!ow.status().ok()) { ... }
+class PROTOBUF_EXPORT ReflectionObjectWriter : public ObjectWriter {
+ public:
+  // Options that control ReflectionObjectWriter's behavior.
+  struct PROTOBUF_EXPORT Options {
+    // If true, unknown fields and their values are skipped instead of
+    // reported as errors.
+    bool ignore_unknown_fields;
+
+    // If true, unknown enum names leave the field unset instead of being
+    // reported as errors.
+    bool ignore_unknown_enum_values;
+
+    // If true, enum names that fail to match are retried in UPPER_CASE.
+    bool case_insensitive_enum_parsing;
+
+    Options()
+        : ignore_unknown_fields(false),
+          ignore_unknown_enum_values(false),
+          case_insensitive_enum_parsing(false) {}
+
+    // Default instance of Options with all options set to defaults.
+    static const Options& Defaults() {
+      static Options defaults;
+      return defaults;
+    }
+  };
+
+  // The message is written to as events arrive and is not cleared first. The
+  // type_url_prefix is the one Any messages must use, without the trailing
+  // '/'. The types they hold are looked up in the DescriptorPool of message.
+  ReflectionObjectWriter(Message* message, const std::string& type_url_prefix,
+                         const Options& options);
+  ~ReflectionObjectWriter() override;
+
+  // ObjectWriter methods.
+  ReflectionObjectWriter* StartObject(StringPiece name) override;
+  ReflectionObjectWriter* EndObject() override;
+  ReflectionObjectWriter* StartList(StringPiece name) override;
+  ReflectionObjectWriter* EndList() override;
+  ReflectionObjectWriter* RenderBool(StringPiece name, bool value) override {
+    return RenderDataPiece(name, DataPiece(value));
+  }
+  ReflectionObjectWriter* RenderInt32(StringPiece name,
+                                      int32 value) override {
+    return RenderDataPiece(name, DataPiece(value));
+  }
+  ReflectionObjectWriter* RenderUint32(StringPiece name,
+                                       uint32 value) override {
+    return RenderDataPiece(name, DataPiece(value));
+  }
+  ReflectionObjectWriter* RenderInt64(StringPiece name,
+                                      int64 value) override {
+    return RenderDataPiece(name, DataPiece(value));
+  }
+  ReflectionObjectWriter* RenderUint64(StringPiece name,
+                                       uint64 value) override {
+    return RenderDataPiece(name, DataPiece(value));
+  }
+  ReflectionObjectWriter* RenderDouble(StringPiece name,
+                                       double value) override {
+    return RenderDataPiece(name, DataPiece(value));
+  }
+  ReflectionObjectWriter* RenderFloat(StringPiece name,
+                                      float value) override {
+    return RenderDataPiece(name, DataPiece(value));
+  }
+  ReflectionObjectWriter* RenderString(StringPiece name,
+                                       StringPiece value) override {
+    return RenderDataPiece(name,
+                           DataPiece(value, use_strict_base64_decoding()));
+  }
+  ReflectionObjectWriter* RenderBytes(StringPiece name,
+                                      StringPiece value) override {
+    return RenderDataPiece(
+        name, DataPiece(value, false, use_strict_base64_decoding()));
+  }
+  ReflectionObjectWriter* RenderNull(StringPiece name) override {
+    return RenderDataPiece(name, DataPiece::NullData());
+  }
+
+  // Renders a DataPiece 'value' into the field with the given name, or into
+  // the next element if the current element is a list.
+  ReflectionObjectWriter* RenderDataPiece(StringPiece name,
+                                          const DataPiece& data);
+
+  // When true, we finished writing the root message.
+  bool done() override { return done_; }
+
+  // Returns the first error found, or OK.
+  const util::Status& status() const { return status_; }
+
+ private:
+  class AnyWriter;
+
+  // Sets the fields of a well-known type from its JSON scalar form.
+  typedef util::Status (*TypeRenderer)(ReflectionObjectWriter*, Message*,
+                                         const DataPiece&);
+
+  // An object or list being written. A MESSAGE sets the fields of message, a
+  // MAP adds entries to the map field of message, a LIST adds elements to
+  // the repeated field of message, and an ANY collects the events of an Any
+  // message until its type is known.
+  struct Element {
+    enum Kind { MESSAGE, MAP, LIST, ANY };
+
+    // Defined where AnyWriter is complete.
+    Element(Kind kind, Message* message, const FieldDescriptor* field);
+    Element(Element&& other);
+    ~Element();
+
+    Kind kind;
+    Message* message;
+    const FieldDescriptor* field;
+    // Keys already seen, for a MAP.
+    std::unique_ptr<std::unordered_set<std::string>> map_keys;
+    // Oneofs of a MESSAGE which were given an ignored enum value. Like the
+    // stream writer, they count as set although the message has none of
+    // their fields.
+    std::unique_ptr<std::unordered_set<const OneofDescriptor*>>
+        ignored_oneofs;
+    // The Any writer, for an ANY.
+    std::unique_ptr<AnyWriter> any;
+  };
+
+  // Constructor for the writer of the message held in an Any. Shares the
+  // options and message factory of the parent.
+  ReflectionObjectWriter(Message* message, ReflectionObjectWriter* parent);
+
+  // Starts an object in field of message, or in message itself if field is
+  // null. If add is true, the object is a new element of the repeated field.
+  void StartObjectIn(Message* message, const FieldDescriptor* field,
+                     bool add);
+
+  // Starts a list in field of message, or in message itself if field is
+  // null. If add is true, the list is a new element of the repeated field.
+  void StartListIn(Message* message, const FieldDescriptor* field, bool add);
+
+  // Renders data into field of message, or into message itself if field is
+  // null. If add is true, data is a new element of the repeated field.
+  void RenderIn(Message* message, const FieldDescriptor* field, bool add,
+                const DataPiece& data);
+
+  // Adds an entry with the given key to the map field of the top element and
+  // returns it, or returns null on a repeated or invalid key.
+  Message* AddMapEntry(StringPiece key);
+
+  // Looks up the field with the given JSON or proto name in the top
+  // element. Returns null, after recording an error unless unknown fields are
+  // ignored, if there is no such field.
+  const FieldDescriptor* Lookup(StringPiece name);
+
+  // Checks that field, if it is part of a oneof, is the first field of the
+  // oneof set in message, the message of the top element.
+  bool ValidOneof(const Message& message, const FieldDescriptor* field,
+                  StringPiece name);
+
+  // Sets the primitive field of message to data, or adds data to it if add is
+  // true.
+  util::Status RenderPrimitive(Message* message,
+                                 const FieldDescriptor* field, bool add,
+                                 const DataPiece& data);
+
+  // Converts data to the number of a value of enum_type. Sets *is_unknown
+  // and returns OK for names that are not found when unknown enum values are
+  // ignored.
+  util::Status ToEnum(const EnumDescriptor* enum_type, const DataPiece& data,
+                        int* value, bool* is_unknown) const;
+
+  // Pushes an element of the given kind for message and field, with a new
+  // AnyWriter for an ANY.
+  void Push(Element::Kind kind, Message* message,
+            const FieldDescriptor* field);
+
+  // Pops the top element, finishing the root message if it was the last.
+  void Pop();
+
+  // Records error as the status of this writer, if it is the first one.
+  void Fail(StringPiece name, StringPiece message);
+
+  // Returns a new message of the type with the given name from the pool of
+  // the root message, or null if the pool has no such type.
+  Message* NewMessageOfType(const std::string& type_name);
+
+  // Renders a google.protobuf.Timestamp from its JSON string form.
+  static util::Status RenderTimestamp(ReflectionObjectWriter* ow,
+                                        Message* message,
+                                        const DataPiece& data);
+
+  // Renders a google.protobuf.Duration from its JSON string form.
+  static util::Status RenderDuration(ReflectionObjectWriter* ow,
+                                       Message* message,
+                                       const DataPiece& data);
+
+  // Renders a google.protobuf.FieldMask from its JSON string form.
+  static util::Status RenderFieldMask(ReflectionObjectWriter* ow,
+                                        Message* message,
+                                        const DataPiece& data);
+
+  // Renders the wrapper types of google/protobuf/wrappers.proto from their
+  // value.
+  static util::Status RenderWrapper(ReflectionObjectWriter* ow,
+                                      Message* message,
+                                      const DataPiece& data);
+
+  // Renders a google.protobuf.Value from a JSON scalar.
+  static util::Status RenderStructValue(ReflectionObjectWriter* ow,
+                                          Message* message,
+                                          const DataPiece& data);
+
+  static std::unordered_map<std::string, TypeRenderer>* renderers_;
+  static void InitRendererMap();
+  static void DeleteRendererMap();
+  static TypeRenderer* FindTypeRenderer(const std::string& type_name);
+
+  // The message to write.
+  Message* const message_;
+
+  // Prefix of the type URLs of Any messages.
+  const std::string type_url_prefix_;
+
+  const Options options_;
+
+  // The writer of the root message, which owns dynamic_factory_. Points to
+  // this writer except for the writers of messages held in Any fields.
+  ReflectionObjectWriter* const root_;
+
+  // Makes the messages held in Any fields when message_ is not from the
+  // generated pool. Created on first use.
+  std::unique_ptr<DynamicMessageFactory> dynamic_factory_;
+
+  // The elements being written, innermost last.
+  std::vector<Element> stack_;
+
+  // Number of enclosing objects and lists being skipped as unknown fields.
+  int skip_depth_;
+
+  // Whether the root message has been started, and finished.
+  bool started_;
+  bool done_;
+
+  // The first error found.
+  util::Status status_;
+
+  GOOGLE_DISALLOW_IMPLICIT_CONSTRUCTORS(ReflectionObjectWriter);
+};
+
+}  // namespace converter
+}  // namespace util
+}  // namespace protobuf
+}  // namespace google
+
+#include <google/protobuf/port_undef.inc>
+
+#endif  // GOOGLE_PROTOBUF_UTIL_CONVERTER_REFLECTION_OBJECTWRITER_H__
@@ -30,15 +30,18 @@
 
 #include <google/protobuf/util/internal/type_info.h>
 
-#include <map>
-#include <set>
+#include <memory>
+#include <unordered_map>
+#include <vector>
 
 #include <google/protobuf/stubs/common.h>
 #include <google/protobuf/type.pb.h>
+#include <google/protobuf/published_lookup_table.h>
 #include <google/protobuf/util/internal/utility.h>
 #include <google/protobuf/stubs/status.h>
 #include <google/protobuf/stubs/strutil.h>
 #include <google/protobuf/stubs/map_util.h>
+#include <google/protobuf/stubs/mutex.h>
 #include <google/protobuf/stubs/status.h>
 #include <google/protobuf/stubs/statusor.h>
 
@@ -48,35 +51,20 @@ namespace util {
 namespace converter {
 
 namespace {
-// A TypeInfo that looks up information provided by a TypeResolver.
+// A TypeInfo that looks up information provided by a TypeResolver. Types and
+// enums are resolved once and kept for the life of the TypeInfo, and the
+// fields of a type are indexed by name when the type is resolved. What has
+// been looked up is read without a lock, so one instance can be shared by
+// several threads; a mutex only serializes the lookups of new types.
 class TypeInfoForTypeResolver : public TypeInfo {
  public:
   explicit TypeInfoForTypeResolver(TypeResolver* type_resolver)
       : type_resolver_(type_resolver) {}
 
-  virtual ~TypeInfoForTypeResolver() {
-    DeleteCachedTypes(&cached_types_);
-    DeleteCachedTypes(&cached_enums_);
-  }
-
   util::StatusOr<const google::protobuf::Type*> ResolveTypeUrl(
       StringPiece type_url) const override {
-    std::map<StringPiece, StatusOrType>::iterator it =
-        cached_types_.find(type_url);
-    if (it != cached_types_.end()) {
-      return it->second;
-    }
-    // Stores the string value so it can be referenced using StringPiece in the
-    // cached_types_ map.
-    const std::string& string_type_url =
-        *string_storage_.insert(std::string(type_url)).first;
-    std::unique_ptr<google::protobuf::Type> type(new google::protobuf::Type());
-    util::Status status =
-        type_resolver_->ResolveMessageType(string_type_url, type.get());
-    StatusOrType result =
-        status.ok() ? StatusOrType(type.release()) : StatusOrType(status);
-    cached_types_[string_type_url] = result;
-    return result;
+    const StatusOrType* result = cached_types_.Find(type_url);
+    return result != nullptr ? *result : ResolveNewTypeUrl(type_url);
   }
 
   const google::protobuf::Type* GetTypeByTypeUrl(
@@ -87,88 +75,116 @@ class TypeInfoForTypeResolver : public TypeInfo {
 
   const google::protobuf::Enum* GetEnumByTypeUrl(
       StringPiece type_url) const override {
-    std::map<StringPiece, StatusOrEnum>::iterator it =
-        cached_enums_.find(type_url);
-    if (it != cached_enums_.end()) {
-      return it->second.ok() ? it->second.value() : NULL;
-    }
-    // Stores the string value so it can be referenced using StringPiece in the
-    // cached_enums_ map.
-    const std::string& string_type_url =
-        *string_storage_.insert(std::string(type_url)).first;
-    std::unique_ptr<google::protobuf::Enum> enum_type(
-        new google::protobuf::Enum());
-    util::Status status =
-        type_resolver_->ResolveEnumType(string_type_url, enum_type.get());
+    const StatusOrEnum* cached = cached_enums_.Find(type_url);
     StatusOrEnum result =
-        status.ok() ? StatusOrEnum(enum_type.release()) : StatusOrEnum(status);
-    cached_enums_[string_type_url] = result;
+        cached != nullptr ? *cached : ResolveNewEnumTypeUrl(type_url);
     return result.ok() ? result.value() : NULL;
   }
 
   const google::protobuf::Field* FindField(
       const google::protobuf::Type* type,
       StringPiece camel_case_name) const override {
-    std::map<const google::protobuf::Type*, CamelCaseNameTable>::const_iterator
-        it = indexed_types_.find(type);
-    const CamelCaseNameTable& camel_case_name_table =
-        (it == indexed_types_.end())
-            ? PopulateNameLookupTable(type, &indexed_types_[type])
-            : it->second;
-    StringPiece name = FindWithDefault(
-        camel_case_name_table, camel_case_name, StringPiece());
-    if (name.empty()) {
-      // Didn't find a mapping. Use whatever provided.
-      name = camel_case_name;
+    const FieldTable* const* field_table = field_tables_.Find(type);
+    if (field_table == nullptr) {
+      // A type which this TypeInfo did not resolve.
+      MutexLock lock(&mutex_);
+      field_table = field_tables_.Find(type);
+      if (field_table == nullptr) {
+        field_table = field_tables_.Insert(type, NewFieldTable(type));
+      }
     }
-    return FindFieldInTypeOrNull(type, name);
+    return FindWithDefault(**field_table, camel_case_name, nullptr);
   }
 
  private:
   typedef util::StatusOr<const google::protobuf::Type*> StatusOrType;
   typedef util::StatusOr<const google::protobuf::Enum*> StatusOrEnum;
-  typedef std::map<StringPiece, StringPiece> CamelCaseNameTable;
-
-  template <typename T>
-  static void DeleteCachedTypes(std::map<StringPiece, T>* cached_types) {
-    for (typename std::map<StringPiece, T>::iterator it =
-             cached_types->begin();
-         it != cached_types->end(); ++it) {
-      if (it->second.ok()) {
-        delete it->second.value();
-      }
+  // Maps the JSON names and then the proto names of the fields of a type to
+  // the fields. A JSON name wins over a proto name that is the same.
+  typedef std::unordered_map<StringPiece, const google::protobuf::Field*,
+                             hash<StringPiece>>
+      FieldTable;
+
+  StatusOrType ResolveNewTypeUrl(StringPiece type_url) const {
+    MutexLock lock(&mutex_);
+    const StatusOrType* cached = cached_types_.Find(type_url);
+    if (cached != nullptr) {
+      return *cached;
     }
+    std::unique_ptr<google::protobuf::Type> type(new google::protobuf::Type());
+    util::Status status = type_resolver_->ResolveMessageType(
+        std::string(type_url), type.get());
+    if (!status.ok()) {
+      return *cached_types_.Insert(type_url, StatusOrType(status));
+    }
+    // The field table is published before the type, so that readers which
+    // find the type also find its fields.
+    field_tables_.Insert(type.get(), NewFieldTable(type.get()));
+    owned_types_.push_back(std::move(type));
+    return *cached_types_.Insert(type_url,
+                                 StatusOrType(owned_types_.back().get()));
   }
 
-  const CamelCaseNameTable& PopulateNameLookupTable(
-      const google::protobuf::Type* type,
-      CamelCaseNameTable* camel_case_name_table) const {
+  StatusOrEnum ResolveNewEnumTypeUrl(StringPiece type_url) const {
+    MutexLock lock(&mutex_);
+    const StatusOrEnum* cached = cached_enums_.Find(type_url);
+    if (cached != nullptr) {
+      return *cached;
+    }
+    std::unique_ptr<google::protobuf::Enum> enum_type(
+        new google::protobuf::Enum());
+    util::Status status = type_resolver_->ResolveEnumType(
+        std::string(type_url), enum_type.get());
+    if (!status.ok()) {
+      return *cached_enums_.Insert(type_url, StatusOrEnum(status));
+    }
+    owned_enums_.push_back(std::move(enum_type));
+    return *cached_enums_.Insert(type_url,
+                                 StatusOrEnum(owned_enums_.back().get()));
+  }
+
+  // Returns a new field table for type, owned by this TypeInfo.
+  const FieldTable* NewFieldTable(const google::protobuf::Type* type) const {
+    owned_field_tables_.emplace_back(new FieldTable);
+    FieldTable* field_table = owned_field_tables_.back().get();
     for (int i = 0; i < type->fields_size(); ++i) {
       const google::protobuf::Field& field = type->fields(i);
-      StringPiece name = field.name();
-      StringPiece camel_case_name = field.json_name();
-      const StringPiece* existing = InsertOrReturnExisting(
-          camel_case_name_table, camel_case_name, name);
-      if (existing && *existing != name) {
-        GOOGLE_LOG(WARNING) << "Field '" << name << "' and '" << *existing
-                     << "' map to the same camel case name '" << camel_case_name
-                     << "'.";
+      const google::protobuf::Field** existing =
+          InsertOrReturnExisting(field_table, field.json_name(), &field);
+      if (existing && (*existing)->name() != field.name()) {
+        GOOGLE_LOG(WARNING) << "Field '" << field.name() << "' and '"
+                     << (*existing)->name()
+                     << "' map to the same camel case name '"
+                     << field.json_name() << "'.";
       }
     }
-    return *camel_case_name_table;
+    for (int i = 0; i < type->fields_size(); ++i) {
+      const google::protobuf::Field& field = type->fields(i);
+      InsertIfNotPresent(field_table, field.name(), &field);
+    }
+    return field_table;
   }
 
   TypeResolver* type_resolver_;
 
-  // Stores string values that will be referenced by StringPieces in
-  // cached_types_, cached_enums_.
-  mutable std::set<std::string> string_storage_;
-
-  mutable std::map<StringPiece, StatusOrType> cached_types_;
-  mutable std::map<StringPiece, StatusOrEnum> cached_enums_;
-
-  mutable std::map<const google::protobuf::Type*, CamelCaseNameTable>
-      indexed_types_;
+  // Serializes the lookups of new types and enums, and guards the storage
+  // below. The published tables are read without it.
+  mutable Mutex mutex_;
+
+  mutable std::vector<std::unique_ptr<google::protobuf::Type>> owned_types_;
+  mutable std::vector<std::unique_ptr<google::protobuf::Enum>> owned_enums_;
+  mutable std::vector<std::unique_ptr<FieldTable>> owned_field_tables_;
+
+  mutable google::protobuf::internal::PublishedLookupTable<
+      std::string, StatusOrType, hash<StringPiece>>
+      cached_types_;
+  mutable google::protobuf::internal::PublishedLookupTable<
+      std::string, StatusOrEnum, hash<StringPiece>>
+      cached_enums_;
+  mutable google::protobuf::internal::PublishedLookupTable<
+      const google::protobuf::Type*, const FieldTable*,
+      std::hash<const google::protobuf::Type*>>
+      field_tables_;
 };
 }  // namespace
 
@@ -45,8 +45,9 @@ namespace google {
 namespace protobuf {
 namespace util {
 namespace converter {
-// Internal helper class for type resolving. Note that this class is not
-// thread-safe and should only be accessed in one thread.
+// Internal helper class for type resolving. The TypeInfo returned by
+// NewTypeInfo() may be shared by several threads, and resolves each type only
+// once for all of them.
 class PROTOBUF_EXPORT TypeInfo {
  public:
   TypeInfo() {}
@@ -80,7 +81,9 @@ class PROTOBUF_EXPORT TypeInfo {
       StringPiece camel_case_name) const = 0;
 
   // Creates a TypeInfo object that looks up type information from a
-  // TypeResolver. Caller takes ownership of the returned pointer.
+  // TypeResolver. Caller takes ownership of the returned pointer. The
+  // TypeInfo caches what it looks up and is thread-safe, provided that
+  // type_resolver is.
   static TypeInfo* NewTypeInfo(TypeResolver* type_resolver);
 
  private:
@@ -173,6 +173,16 @@ bool IsMessageSetWireFormat(const google::protobuf::Type& type);
 PROTOBUF_EXPORT std::string DoubleAsString(double value);
 PROTOBUF_EXPORT std::string FloatAsString(float value);
 
+// Formats the nanos of a Timestamp or Duration as a fraction of a second with
+// 3, 6 or 9 digits, e.g. ".500". Returns an empty string for 0 nanos unless
+// with_trailing_zeros is true.
+PROTOBUF_EXPORT std::string FormatNanos(uint32 nanos, bool with_trailing_zeros);
+
+// Parses the JSON form of a google.protobuf.Duration, e.g. "-1.5s", into its
+// seconds and nanos.
+PROTOBUF_EXPORT util::Status ParseDuration(StringPiece value, int64* seconds,
+                                           int32* nanos);
+
 // Convert from int32, int64, uint32, uint64, double or float to string.
 template <typename T>
 std::string ValueAsString(T value) {
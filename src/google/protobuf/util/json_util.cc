@@ -40,6 +40,9 @@
 #include <google/protobuf/util/internal/json_stream_parser.h>
 #include <google/protobuf/util/internal/protostream_objectsource.h>
 #include <google/protobuf/util/internal/protostream_objectwriter.h>
+#include <google/protobuf/util/internal/reflection_objectsource.h>
+#include <google/protobuf/util/internal/reflection_objectwriter.h>
+#include <google/protobuf/util/internal/type_info.h>
 #include <google/protobuf/util/type_resolver.h>
 #include <google/protobuf/util/type_resolver_util.h>
 #include <google/protobuf/stubs/bytestream.h>
@@ -170,6 +173,7 @@ class StatusErrorListener : public converter::ErrorListener {
 
   GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(StatusErrorListener);
 };
+
 }  // namespace
 
 util::Status JsonToBinaryStream(TypeResolver* resolver,
@@ -217,6 +221,7 @@ util::Status JsonToBinaryString(TypeResolver* resolver,
 namespace {
 const char* kTypeUrlPrefix = "type.googleapis.com";
 TypeResolver* generated_type_resolver_ = NULL;
+converter::TypeInfo* generated_type_info_ = NULL;
 PROTOBUF_NAMESPACE_ID::internal::once_flag generated_type_resolver_init_;
 
 std::string GetTypeUrl(const Message& message) {
@@ -224,56 +229,95 @@ std::string GetTypeUrl(const Message& message) {
          message.GetDescriptor()->full_name();
 }
 
-void DeleteGeneratedTypeResolver() { delete generated_type_resolver_; }
+void DeleteGeneratedTypeResolver() {
+  delete generated_type_info_;
+  delete generated_type_resolver_;
+}
 
 void InitGeneratedTypeResolver() {
   generated_type_resolver_ = NewTypeResolverForDescriptorPool(
       kTypeUrlPrefix, DescriptorPool::generated_pool());
+  generated_type_info_ =
+      converter::TypeInfo::NewTypeInfo(generated_type_resolver_);
   ::google::protobuf::internal::OnShutdown(&DeleteGeneratedTypeResolver);
 }
 
-TypeResolver* GetGeneratedTypeResolver() {
+// Returns the TypeInfo for the generated pool. It is shared by all calls and
+// threads, so each generated type is converted to a google::protobuf::Type
+// and indexed only once per process.
+const converter::TypeInfo* GetGeneratedTypeInfo() {
   PROTOBUF_NAMESPACE_ID::internal::call_once(generated_type_resolver_init_,
                                              InitGeneratedTypeResolver);
-  return generated_type_resolver_;
+  return generated_type_info_;
 }
+
 }  // namespace
 
 util::Status MessageToJsonString(const Message& message, std::string* output,
                                    const JsonOptions& options) {
+  // The message is walked with its reflection rather than serialized and
+  // parsed back by a ProtoStreamObjectSource, which renders the same JSON.
+  converter::ReflectionObjectSource message_source(message, kTypeUrlPrefix);
+  message_source.set_use_ints_for_enums(options.always_print_enums_as_ints);
+  message_source.set_preserve_proto_field_names(
+      options.preserve_proto_field_names);
+  io::StringOutputStream output_stream(output);
+  io::CodedOutputStream out_stream(&output_stream);
+  converter::JsonObjectWriter json_writer(options.add_whitespace ? " " : "",
+                                          &out_stream);
+  if (!options.always_print_primitive_fields) {
+    return message_source.WriteTo(&json_writer);
+  }
+
+  // Only the DefaultValueObjectWriter needs the google::protobuf::Types. They
+  // are kept for the generated pool, and looked up for this call for others.
   const DescriptorPool* pool = message.GetDescriptor()->file()->pool();
-  TypeResolver* resolver =
-      pool == DescriptorPool::generated_pool()
-          ? GetGeneratedTypeResolver()
-          : NewTypeResolverForDescriptorPool(kTypeUrlPrefix, pool);
-  util::Status result =
-      BinaryToJsonString(resolver, GetTypeUrl(message),
-                         message.SerializeAsString(), output, options);
-  if (pool != DescriptorPool::generated_pool()) {
-    delete resolver;
+  std::unique_ptr<TypeResolver> resolver;
+  std::unique_ptr<converter::TypeInfo> owned_typeinfo;
+  const converter::TypeInfo* typeinfo;
+  if (pool == DescriptorPool::generated_pool()) {
+    typeinfo = GetGeneratedTypeInfo();
+  } else {
+    resolver.reset(NewTypeResolverForDescriptorPool(kTypeUrlPrefix, pool));
+    owned_typeinfo.reset(converter::TypeInfo::NewTypeInfo(resolver.get()));
+    typeinfo = owned_typeinfo.get();
+  }
+  util::StatusOr<const google::protobuf::Type*> type =
+      typeinfo->ResolveTypeUrl(GetTypeUrl(message));
+  if (!type.ok()) {
+    return type.status();
   }
-  return result;
+  converter::DefaultValueObjectWriter default_value_writer(
+      typeinfo, *type.value(), &json_writer);
+  default_value_writer.set_preserve_proto_field_names(
+      options.preserve_proto_field_names);
+  default_value_writer.set_print_enums_as_ints(
+      options.always_print_enums_as_ints);
+  return message_source.WriteTo(&default_value_writer);
 }
 
 util::Status JsonStringToMessage(StringPiece input, Message* message,
                                    const JsonParseOptions& options) {
-  const DescriptorPool* pool = message->GetDescriptor()->file()->pool();
-  TypeResolver* resolver =
-      pool == DescriptorPool::generated_pool()
-          ? GetGeneratedTypeResolver()
-          : NewTypeResolverForDescriptorPool(kTypeUrlPrefix, pool);
-  std::string binary;
-  util::Status result = JsonToBinaryString(resolver, GetTypeUrl(*message),
-                                             input, &binary, options);
-  if (result.ok() && !message->ParseFromString(binary)) {
-    result =
-        util::Status(util::error::INVALID_ARGUMENT,
-                       "JSON transcoder produced invalid protobuf output.");
-  }
-  if (pool != DescriptorPool::generated_pool()) {
-    delete resolver;
-  }
-  return result;
+  // The fields are set through reflection rather than encoded by a
+  // ProtoStreamObjectWriter and parsed back. They are set on a new message on
+  // the same arena, so that message is left as it is if the input turns out
+  // to be invalid, and swapping the result in is shallow.
+  std::unique_ptr<Message> owned_parsed;
+  Message* parsed = message->New(message->GetArena());
+  if (message->GetArena() == nullptr) owned_parsed.reset(parsed);
+  converter::ReflectionObjectWriter::Options writer_options;
+  writer_options.ignore_unknown_fields = options.ignore_unknown_fields;
+  writer_options.ignore_unknown_enum_values = options.ignore_unknown_fields;
+  writer_options.case_insensitive_enum_parsing =
+      options.case_insensitive_enum_parsing;
+  converter::ReflectionObjectWriter message_writer(parsed, kTypeUrlPrefix,
+                                                   writer_options);
+  converter::JsonStreamParser parser(&message_writer);
+  RETURN_IF_ERROR(parser.Parse(input));
+  RETURN_IF_ERROR(parser.FinishParse());
+  RETURN_IF_ERROR(message_writer.status());
+  message->GetReflection()->Swap(message, parsed);
+  return util::Status();
 }
 
 }  // namespace util
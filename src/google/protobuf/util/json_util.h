@@ -89,9 +89,10 @@ struct JsonPrintOptions {
 // DEPRECATED. Use JsonPrintOptions instead.
 typedef JsonPrintOptions JsonOptions;
 
-// Converts from protobuf message to JSON and appends it to |output|. This is a
-// simple wrapper of BinaryToJsonString(). It will use the DescriptorPool of the
-// passed-in message to resolve Any types.
+// Converts from protobuf message to JSON and appends it to |output|. The
+// output is the same as BinaryToJsonString() gives for the serialized message,
+// but the message is read through its reflection instead. It will use the
+// DescriptorPool of the passed-in message to resolve Any types.
 PROTOBUF_EXPORT util::Status MessageToJsonString(const Message& message,
                                                    std::string* output,
                                                    const JsonOptions& options);
@@ -101,9 +102,15 @@ inline util::Status MessageToJsonString(const Message& message,
   return MessageToJsonString(message, output, JsonOptions());
 }
 
-// Converts from JSON to protobuf message. This is a simple wrapper of
-// JsonStringToBinary(). It will use the DescriptorPool of the passed-in
-// message to resolve Any types.
+// Converts from JSON to protobuf message. The result is the same as parsing
+// the output of JsonToBinaryString() gives, but the fields are set through
+// reflection instead of being encoded and parsed back. It will use the
+// DescriptorPool of the passed-in message to resolve Any types.
+//
+// The same inputs are rejected. JSON syntax errors get the same status as
+// from JsonToBinaryString(). Other errors are INVALID_ARGUMENT too, but their
+// message only names the offending field or type, without its path in the
+// input, and is worded differently. The message is left unchanged on errors.
 PROTOBUF_EXPORT util::Status JsonStringToMessage(
     StringPiece input, Message* message, const JsonParseOptions& options);
 
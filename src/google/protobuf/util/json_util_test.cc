@@ -32,7 +32,10 @@
 
 #include <list>
 #include <string>
+#include <thread>
+#include <vector>
 
+#include <google/protobuf/arena.h>
 #include <google/protobuf/io/zero_copy_stream.h>
 #include <google/protobuf/io/zero_copy_stream_impl.h>
 #include <google/protobuf/descriptor_database.h>
@@ -40,6 +43,8 @@
 #include <google/protobuf/util/internal/testdata/maps.pb.h>
 #include <google/protobuf/util/json_format.pb.h>
 #include <google/protobuf/util/json_format_proto3.pb.h>
+#include <google/protobuf/util/field_comparator.h>
+#include <google/protobuf/util/message_differencer.h>
 #include <google/protobuf/util/type_resolver.h>
 #include <google/protobuf/util/type_resolver_util.h>
 #include <gtest/gtest.h>
@@ -186,6 +191,24 @@ TEST_F(JsonUtilTest, TestDefaultValues) {
       ToJson(m, options));
 }
 
+TEST_F(JsonUtilTest, TestDefaultValuesOfRepeatedCalls) {
+  // The types of generated messages are resolved once and then reused by
+  // every call that prints default values.
+  TestMessage m;
+  m.mutable_message_value();
+  JsonPrintOptions options;
+  options.always_print_primitive_fields = true;
+  const std::string json = ToJson(m, options);
+  EXPECT_NE(std::string::npos, json.find("\"messageValue\":{\"value\":0}"));
+  EXPECT_EQ(json, ToJson(m, options));
+
+  options.preserve_proto_field_names = true;
+  const std::string proto_names_json = ToJson(m, options);
+  EXPECT_NE(std::string::npos,
+            proto_names_json.find("\"message_value\":{\"value\":0}"));
+  EXPECT_EQ(proto_names_json, ToJson(m, options));
+}
+
 TEST_F(JsonUtilTest, TestPreserveProtoFieldNames) {
   TestMessage m;
   m.mutable_message_value();
@@ -317,6 +340,23 @@ TEST_F(JsonUtilTest, TestParseErrors) {
   EXPECT_FALSE(FromJson("{\"int32Value\":2147483648}", &m, options));
 }
 
+TEST_F(JsonUtilTest, TestParseIntoArenaMessage) {
+  Arena arena;
+  TestMessage* m = Arena::CreateMessage<TestMessage>(&arena);
+  m->set_int32_value(1);
+  ASSERT_TRUE(FromJson("{\"messageValue\":{\"value\":2}}", m));
+  EXPECT_EQ(0, m->int32_value());
+  EXPECT_EQ(2, m->message_value().value());
+  EXPECT_EQ(&arena, m->message_value().GetArena());
+
+  // The message is left as it is if the input is invalid, and the error is
+  // the one of the reflection writer.
+  util::Status status = JsonStringToMessage("{\"int32Value\":\"x\"}", m);
+  EXPECT_EQ(util::error::INVALID_ARGUMENT, status.code());
+  EXPECT_NE(std::string::npos, status.message().find("int32_value"));
+  EXPECT_EQ(2, m->message_value().value());
+}
+
 TEST_F(JsonUtilTest, TestDynamicMessage) {
   // Some random message but good enough to test the wrapper functions.
   std::string input =
@@ -357,6 +397,297 @@ TEST_F(JsonUtilTest, TestDynamicMessage) {
   EXPECT_EQ(ToJson(generated, options), ToJson(*message, options));
 }
 
+TEST_F(JsonUtilTest, TestPrintPrimitiveFieldsOfDynamicMessage) {
+  DescriptorPoolDatabase database(*DescriptorPool::generated_pool());
+  DescriptorPool pool(&database);
+  DynamicMessageFactory factory;
+  std::unique_ptr<Message> message(
+      factory.GetPrototype(pool.FindMessageTypeByName("proto3.TestMessage"))
+          ->New());
+  ASSERT_TRUE(
+      JsonStringToMessage("{\"messageValue\":{}}", message.get()).ok());
+  JsonPrintOptions options;
+  options.always_print_primitive_fields = true;
+  std::string output;
+  ASSERT_TRUE(MessageToJsonString(*message, &output, options).ok());
+  EXPECT_NE(std::string::npos, output.find("\"messageValue\":{\"value\":0}"));
+
+  TestMessage generated;
+  generated.mutable_message_value();
+  EXPECT_EQ(ToJson(generated, options), output);
+}
+
+TEST_F(JsonUtilTest, TestPrintPrimitiveFieldsFromThreads) {
+  // The types of the generated pool are looked up once and shared by all
+  // the threads.
+  TestMessage message;
+  message.mutable_message_value();
+  message.add_repeated_message_value();
+  JsonPrintOptions options;
+  options.always_print_primitive_fields = true;
+  const std::string expected = ToJson(message, options);
+  std::vector<std::string> outputs(4);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < outputs.size(); ++i) {
+    threads.emplace_back([&, i] {
+      for (int j = 0; j < 16; ++j) {
+        outputs[i].clear();
+        EXPECT_TRUE(MessageToJsonString(message, &outputs[i], options).ok());
+      }
+    });
+  }
+  for (std::thread& thread : threads) thread.join();
+  for (const std::string& output : outputs) EXPECT_EQ(expected, output);
+}
+
+// MessageToJsonString walks the message with reflection; it must produce
+// exactly what the binary stream converter produces for the same input.
+TEST_F(JsonUtilTest, TestReflectionMatchesBinaryConverter) {
+  resolver_.reset(NewTypeResolverForDescriptorPool(
+      "type.googleapis.com", DescriptorPool::generated_pool()));
+  struct {
+    const Descriptor* descriptor;
+    const char* json;
+  } kCases[] = {
+      {TestMessage::descriptor(),
+       "{\"boolValue\":true,\"int32Value\":-7,\"int64Value\":\"-123456789012\","
+       "\"uint32Value\":42,\"uint64Value\":\"18446744073709551615\","
+       "\"floatValue\":1.5,\"doubleValue\":-0.25,\"stringValue\":\"a\\\"b\","
+       "\"bytesValue\":\"AAEC\",\"enumValue\":\"BAR\","
+       "\"messageValue\":{\"value\":3},"
+       "\"repeatedBoolValue\":[true,false],\"repeatedInt64Value\":[\"1\"],"
+       "\"repeatedFloatValue\":[\"NaN\",\"Infinity\",0.1],"
+       "\"repeatedEnumValue\":[\"FOO\",\"BAR\"],"
+       "\"repeatedMessageValue\":[{},{\"value\":4}]}"},
+      {proto3::TestOneof::descriptor(), "{\"oneofNullValue\":null}"},
+      {proto3::TestNestedMap::descriptor(),
+       "{\"boolMap\":{\"true\":1,\"false\":2},\"int64Map\":{\"-5\":1},"
+       "\"uint64Map\":{\"7\":0},\"stringMap\":{\"x\":1},"
+       "\"mapMap\":{\"a\":{\"int32Map\":{\"1\":2}}}}"},
+      {proto3::TestWrapper::descriptor(),
+       "{\"boolValue\":false,\"int64Value\":\"5\",\"floatValue\":2.5,"
+       "\"bytesValue\":\"AQ==\",\"repeatedStringValue\":[\"s\",\"\"]}"},
+      {proto3::TestTimestamp::descriptor(),
+       "{\"value\":\"1970-01-01T00:00:00.010Z\","
+       "\"repeatedValue\":[\"2020-02-29T12:34:56.000001Z\"]}"},
+      {proto3::TestDuration::descriptor(),
+       "{\"value\":\"-1.5s\",\"repeatedValue\":[\"0s\",\"3.000000001s\"]}"},
+      {proto3::TestFieldMask::descriptor(),
+       "{\"value\":\"fooBar,baz.quxQuux\"}"},
+      {proto3::TestStruct::descriptor(),
+       "{\"value\":{\"n\":null,\"b\":true,\"s\":\"x\",\"d\":1.25,"
+       "\"l\":[1,\"2\",{\"k\":[]}],\"o\":{}},\"repeatedValue\":[{}]}"},
+      {proto3::TestValue::descriptor(),
+       "{\"value\":null,\"repeatedValue\":[1,\"a\",[],{}]}"},
+      {proto3::TestListValue::descriptor(),
+       "{\"value\":[1,[2]],\"repeatedValue\":[[]]}"},
+      {TestAny::descriptor(),
+       "{\"value\":{\"@type\":\"type.googleapis.com/proto3.TestMessage\","
+       "\"int32Value\":5,\"messageValue\":{\"value\":6}},"
+       "\"repeatedValue\":["
+       "{\"@type\":\"type.googleapis.com/google.protobuf.Duration\","
+       "\"value\":\"1s\"},"
+       "{\"@type\":\"type.googleapis.com/google.protobuf.Any\","
+       "\"value\":{\"@type\":\"type.googleapis.com/google.protobuf.Struct\","
+       "\"value\":{\"a\":1}}}]}"},
+  };
+
+  DescriptorPoolDatabase database(*DescriptorPool::generated_pool());
+  DescriptorPool pool(&database);
+  DynamicMessageFactory factory;
+  for (const auto& test_case : kCases) {
+    SCOPED_TRACE(test_case.json);
+    std::unique_ptr<Message> generated(
+        MessageFactory::generated_factory()
+            ->GetPrototype(test_case.descriptor)
+            ->New());
+    // Parse the wire format, so that maps iterate in the order they are
+    // serialized in. Maps set through reflection keep their insertion order.
+    std::string binary;
+    ASSERT_TRUE(JsonToBinaryString(resolver_.get(),
+                                   "type.googleapis.com/" +
+                                       test_case.descriptor->full_name(),
+                                   test_case.json, &binary)
+                    .ok());
+    ASSERT_TRUE(generated->ParseFromString(binary));
+    std::unique_ptr<Message> dynamic(
+        factory
+            .GetPrototype(
+                pool.FindMessageTypeByName(test_case.descriptor->full_name()))
+            ->New());
+    ASSERT_TRUE(dynamic->ParseFromString(generated->SerializeAsString()));
+
+    for (int i = 0; i < 16; ++i) {
+      JsonPrintOptions options;
+      options.add_whitespace = i & 1;
+      options.always_print_primitive_fields = i & 2;
+      options.always_print_enums_as_ints = i & 4;
+      options.preserve_proto_field_names = i & 8;
+      std::string expected;
+      ASSERT_TRUE(BinaryToJsonString(resolver_.get(),
+                                     "type.googleapis.com/" +
+                                         test_case.descriptor->full_name(),
+                                     generated->SerializeAsString(), &expected,
+                                     options)
+                      .ok());
+      EXPECT_EQ(expected, ToJson(*generated, options));
+      EXPECT_EQ(expected, ToJson(*dynamic, options));
+    }
+  }
+}
+
+// JsonStringToMessage sets the fields with reflection; it must give the same
+// message, or the same error, as parsing the binary stream converter's output.
+TEST_F(JsonUtilTest, TestReflectionParserMatchesBinaryConverter) {
+  resolver_.reset(NewTypeResolverForDescriptorPool(
+      "type.googleapis.com", DescriptorPool::generated_pool()));
+  struct {
+    const Descriptor* descriptor;
+    const char* json;
+  } kCases[] = {
+      {TestMessage::descriptor(),
+       "{\"boolValue\":true,\"int32Value\":\"-7\",\"int64Value\":-123456789012,"
+       "\"uint32Value\":42.0,\"uint64_value\":\"18446744073709551615\","
+       "\"floatValue\":\"1.5\",\"doubleValue\":-0.25,\"stringValue\":\"a\\\"b\","
+       "\"bytesValue\":\"AAEC\",\"enumValue\":1,"
+       "\"messageValue\":{\"value\":3},\"messageValue\":{\"value\":null},"
+       "\"repeatedBoolValue\":[true,false],\"repeatedInt64Value\":[\"1\"],"
+       "\"repeatedFloatValue\":[\"NaN\",\"-Infinity\",0.1],"
+       "\"repeatedBytesValue\":[\"-_8=\",\"\"],"
+       "\"repeatedEnumValue\":[\"FOO\",\"BAR\",7],"
+       "\"repeatedMessageValue\":[{},{\"value\":4}],"
+       "\"repeatedInt32Value\":5,\"repeatedMessageValue\":{\"value\":5},"
+       "\"stringValue\":null}"},
+      {TestMessage::descriptor(), "{\"repeatedInt32Value\":[[1,2],[3]]}"},
+      {TestMessage::descriptor(), "{\"int32Value\":1.5}"},
+      {TestMessage::descriptor(), "{\"int32Value\":\"x\"}"},
+      {TestMessage::descriptor(), "{\"uint32Value\":-1}"},
+      {TestMessage::descriptor(), "{\"enumValue\":\"QUX\"}"},
+      {TestMessage::descriptor(), "{\"enumValue\":\"bar\"}"},
+      {TestMessage::descriptor(), "{\"bytesValue\":\"!!\"}"},
+      {TestMessage::descriptor(), "{\"unknown\":{\"a\":[1,{}]},\"b\":1}"},
+      {TestMessage::descriptor(), "{\"messageValue\":1}"},
+      {TestMessage::descriptor(), "{\"int32Value\":{}}"},
+      {TestMessage::descriptor(), "{\"int32Value\":[]}"},
+      {TestMessage::descriptor(), "{\"int32Value\":1"},
+      {TestMessage::descriptor(), "[]"},
+      {TestMessage::descriptor(), "1"},
+      {TestOneof::descriptor(), "{\"oneofNullValue\":null}"},
+      {TestOneof::descriptor(), "{\"oneofInt32Value\":null,\"oneofStringValue\":\"\"}"},
+      {TestOneof::descriptor(), "{\"oneofInt32Value\":1,\"oneofStringValue\":\"\"}"},
+      {TestOneof::descriptor(), "{\"oneofEnumValue\":\"QUX\"}"},
+      {TestOneof::descriptor(),
+       "{\"oneofEnumValue\":\"QUX\",\"oneofInt32Value\":1}"},
+      {proto3::TestNestedMap::descriptor(),
+       "{\"boolMap\":{\"true\":1,\"false\":2},\"int64Map\":{\"-5\":1},"
+       "\"uint64Map\":{\"7\":null},\"stringMap\":{\"x\":1},"
+       "\"mapMap\":{\"a\":{\"int32Map\":{\"1\":2}},\"b\":null}}"},
+      {proto3::TestNestedMap::descriptor(), "{\"int64Map\":{\"1\":1,\"1\":2}}"},
+      {proto3::TestNestedMap::descriptor(), "{\"int64Map\":{\"x\":1}}"},
+      {proto3::TestNestedMap::descriptor(), "{\"boolMap\":[]}"},
+      {proto3::TestWrapper::descriptor(),
+       "{\"boolValue\":false,\"int64Value\":\"5\",\"floatValue\":null,"
+       "\"bytesValue\":\"AQ==\",\"repeatedStringValue\":[\"s\",\"\"]}"},
+      {proto3::TestTimestamp::descriptor(),
+       "{\"value\":\"1970-01-01T00:00:00.010Z\","
+       "\"repeatedValue\":[\"2020-02-29T12:34:56.000001+01:00\"]}"},
+      {proto3::TestTimestamp::descriptor(), "{\"value\":\"yesterday\"}"},
+      {proto3::TestDuration::descriptor(),
+       "{\"value\":\"-1.5s\",\"repeatedValue\":[\"0s\",\"3.000000001s\"]}"},
+      {proto3::TestDuration::descriptor(), "{\"value\":\"1m\"}"},
+      {proto3::TestFieldMask::descriptor(),
+       "{\"value\":\"fooBar,baz.quxQuux\"}"},
+      {proto3::TestStruct::descriptor(),
+       "{\"value\":{\"n\":null,\"b\":true,\"s\":\"x\",\"d\":1.25,"
+       "\"l\":[1,\"2\",{\"k\":[]},null],\"o\":{}},\"repeatedValue\":[{}]}"},
+      {proto3::TestValue::descriptor(),
+       "{\"value\":null,\"repeatedValue\":[1,\"a\",[],{},null]}"},
+      {proto3::TestListValue::descriptor(),
+       "{\"value\":[1,[2]],\"repeatedValue\":[[]]}"},
+      {TestAny::descriptor(),
+       "{\"value\":{\"int32Value\":5,"
+       "\"@type\":\"type.googleapis.com/proto3.TestMessage\","
+       "\"messageValue\":{\"value\":6}},"
+       "\"repeatedValue\":[{},"
+       "{\"@type\":\"type.googleapis.com/google.protobuf.Duration\","
+       "\"value\":\"1s\"},"
+       "{\"@type\":\"type.googleapis.com/google.protobuf.Any\","
+       "\"value\":{\"@type\":\"type.googleapis.com/google.protobuf.Struct\","
+       "\"value\":{\"a\":1}}}]}"},
+      {TestAny::descriptor(), "{\"value\":{\"int32Value\":5}}"},
+      {TestAny::descriptor(), "{\"value\":{\"@type\":\"foo/proto3.Nope\"}}"},
+      {TestAny::descriptor(),
+       "{\"value\":{\"@type\":\"type.googleapis.com/google.protobuf.Value\","
+       "\"other\":1}}"},
+      {protobuf_unittest::TestNumbers::descriptor(),
+       "{\"a\":\"WARNING\",\"b\":null,\"c\":1e10,\"e\":\"1e400\"}"},
+      {protobuf_unittest::TestNumbers::descriptor(), "{\"a\":7}"},
+      {protobuf_unittest::TestCamelCase::descriptor(),
+       "{\"normalField\":\"a\",\"CAPITALFIELD\":1,\"CamelCaseField\":2}"},
+      {protobuf_unittest::TestCamelCase::descriptor(),
+       "{\"normal_field\":\"a\",\"CAPITAL_FIELD\":1,\"camelCaseField\":2}"},
+      {protobuf_unittest::TestLargeInt::descriptor(), "{\"a\":1}"},
+      {protobuf_unittest::TestFlagsAndStrings::descriptor(),
+       "{\"A\":1,\"repeatedgroup\":[{\"f\":\"x\"}]}"},
+      {proto3::TestCustomJsonName::descriptor(), "{\"@value\":1}"},
+  };
+
+  DescriptorPoolDatabase database(*DescriptorPool::generated_pool());
+  DescriptorPool pool(&database);
+  DynamicMessageFactory factory;
+  DefaultFieldComparator comparator;
+  comparator.set_treat_nan_as_equal(true);
+  std::string differences;
+  MessageDifferencer differencer;
+  differencer.set_field_comparator(&comparator);
+  differencer.ReportDifferencesToString(&differences);
+  for (const auto& test_case : kCases) {
+    SCOPED_TRACE(test_case.json);
+    for (int i = 0; i < 4; ++i) {
+      JsonParseOptions options;
+      options.ignore_unknown_fields = i & 1;
+      options.case_insensitive_enum_parsing = i & 2;
+      std::unique_ptr<Message> expected(
+          MessageFactory::generated_factory()
+              ->GetPrototype(test_case.descriptor)
+              ->New());
+      std::string binary;
+      util::Status expected_status = JsonToBinaryString(
+          resolver_.get(),
+          "type.googleapis.com/" + test_case.descriptor->full_name(),
+          test_case.json, &binary, options);
+      if (expected_status.ok() && !expected->ParseFromString(binary)) {
+        expected_status =
+            util::Status(util::error::INVALID_ARGUMENT,
+                         "JSON transcoder produced invalid protobuf output.");
+      }
+
+      // The reflection writer reports errors without their location in the
+      // input, so only the outcome is compared.
+      std::unique_ptr<Message> generated(expected->New());
+      util::Status status =
+          JsonStringToMessage(test_case.json, generated.get(), options);
+      EXPECT_EQ(expected_status.code(), status.code()) << status;
+      if (!status.ok()) expected->Clear();
+      differences.clear();
+      EXPECT_TRUE(differencer.Compare(*expected, *generated)) << differences;
+
+      std::unique_ptr<Message> dynamic(
+          factory
+              .GetPrototype(
+                  pool.FindMessageTypeByName(test_case.descriptor->full_name()))
+              ->New());
+      status = JsonStringToMessage(test_case.json, dynamic.get(), options);
+      EXPECT_EQ(expected_status.code(), status.code()) << status;
+      generated->Clear();
+      ASSERT_TRUE(generated->ParsePartialFromString(
+          dynamic->SerializePartialAsString()));
+      differences.clear();
+      EXPECT_TRUE(differencer.Compare(*expected, *generated)) << differences;
+    }
+  }
+}
+
 TEST_F(JsonUtilTest, TestParsingUnknownAnyFields) {
   std::string input =
       "{\n"
@@ -194,6 +194,11 @@ bool WireFormat::ReadPackedEnumPreserveUnknowns(io::CodedInputStream* input,
 uint8* WireFormat::InternalSerializeUnknownFieldsToArray(
     const UnknownFieldSet& unknown_fields, uint8* target,
     io::EpsCopyOutputStream* stream) {
+  if (!unknown_fields.raw_.empty()) {
+    return stream->WriteRaw(unknown_fields.raw_.data(),
+                            static_cast<int>(unknown_fields.raw_.size()),
+                            target);
+  }
   for (int i = 0; i < unknown_fields.field_count(); i++) {
     const UnknownField& field = unknown_fields.field(i);
 
@@ -267,6 +272,7 @@ uint8* WireFormat::InternalSerializeUnknownMessageSetItemsToArray(
 
 size_t WireFormat::ComputeUnknownFieldsSize(
     const UnknownFieldSet& unknown_fields) {
+  if (!unknown_fields.raw_.empty()) return unknown_fields.raw_.size();
   size_t size = 0;
   for (int i = 0; i < unknown_fields.field_count(); i++) {
     const UnknownField& field = unknown_fields.field(i);
@@ -170,6 +170,112 @@ TEST(WireFormatTest, ParseUnpackedFromPacked) {
   TestUtil::ExpectUnpackedFieldsSet(dest);
 }
 
+TEST(WireFormatTest, ParseLongPackedVarints) {
+  // Long runs of mixed size varints exercise the block decoder as well as
+  // its fallback at buffer boundaries.
+  unittest::TestPackedTypes source;
+  for (int i = 0; i < 1000; i++) {
+    int shift = (i * 7) % 64;
+    uint64 value =
+        (i % 3 == 0) ? i % 128 : (uint64{0x9E3779B97F4A7C15} >> shift);
+    source.add_packed_int32(static_cast<int32>(i % 5 == 0 ? -value : value));
+    source.add_packed_int64(static_cast<int64>(i % 5 == 0 ? -value : value));
+    source.add_packed_uint32(static_cast<uint32>(value));
+    source.add_packed_uint64(value);
+    source.add_packed_sint32(static_cast<int32>(i % 2 == 0 ? -value : value));
+    source.add_packed_sint64(static_cast<int64>(i % 2 == 0 ? -value : value));
+    source.add_packed_bool(i % 3 == 0);
+    source.add_packed_enum(i % 2 == 0 ? unittest::FOREIGN_FOO
+                                      : unittest::FOREIGN_BAZ);
+  }
+  std::string data = source.SerializeAsString();
+
+  unittest::TestPackedTypes flat_dest;
+  ASSERT_TRUE(flat_dest.ParseFromString(data));
+  EXPECT_EQ(source.DebugString(), flat_dest.DebugString());
+
+  for (int block_size : {1, 7, 16, 17, 100}) {
+    unittest::TestPackedTypes dest;
+    io::ArrayInputStream raw_input(data.data(), data.size(), block_size);
+    ASSERT_TRUE(dest.ParseFromZeroCopyStream(&raw_input)) << block_size;
+    EXPECT_EQ(source.DebugString(), dest.DebugString()) << block_size;
+  }
+
+  // Truncating the payload must fail the parse rather than read past it.
+  unittest::TestPackedTypes truncated;
+  EXPECT_FALSE(truncated.ParseFromArray(data.data(), data.size() - 1));
+}
+
+TEST(WireFormatTest, ParsePackedVarintsReservesExactly) {
+  unittest::TestPackedTypes source;
+  for (int i = 0; i < 1000; i++) {
+    source.add_packed_int32(i % 3 == 0 ? i : -i);
+    source.add_packed_uint64(uint64{1} << (i % 64));
+  }
+  std::string data = source.SerializeAsString();
+
+  unittest::TestPackedTypes dest;
+  ASSERT_TRUE(dest.ParseFromString(data));
+  EXPECT_EQ(1000, dest.packed_int32().Capacity());
+  EXPECT_EQ(1000, dest.packed_uint64().Capacity());
+
+  // Parsing into the cleared message reuses the arrays.
+  const int32* int32_data = dest.packed_int32().data();
+  ASSERT_TRUE(dest.ParseFromString(data));
+  EXPECT_EQ(int32_data, dest.packed_int32().data());
+  EXPECT_EQ(source.DebugString(), dest.DebugString());
+}
+
+TEST(WireFormatTest, SerializeLongPackedVarints) {
+  // Runs of single byte elements mixed with large and negative values, so
+  // that both the narrowing and the general encoding loop are used, across
+  // output buffers of various sizes.
+  unittest::TestPackedTypes message;
+  std::string int32_payload;
+  std::string sint64_payload;
+  {
+    io::StringOutputStream int32_output(&int32_payload);
+    io::CodedOutputStream int32_coded(&int32_output);
+    io::StringOutputStream sint64_output(&sint64_payload);
+    io::CodedOutputStream sint64_coded(&sint64_output);
+    for (int i = 0; i < 1000; i++) {
+      int64 value = (i % 50 < 40) ? i % 100 : (int64{1} << (i % 63)) - i;
+      message.add_packed_int32(static_cast<int32>(i % 7 == 6 ? -value : value));
+      message.add_packed_sint64(i % 3 == 2 ? -value : value);
+      int32_coded.WriteVarint64(static_cast<int64>(message.packed_int32(i)));
+      sint64_coded.WriteVarint64(
+          WireFormatLite::ZigZagEncode64(message.packed_sint64(i)));
+    }
+  }
+  std::string expected;
+  {
+    io::StringOutputStream raw_output(&expected);
+    io::CodedOutputStream output(&raw_output);
+    output.WriteTag(WireFormatLite::MakeTag(
+        unittest::TestPackedTypes::kPackedInt32FieldNumber,
+        WireFormatLite::WIRETYPE_LENGTH_DELIMITED));
+    output.WriteVarint32(int32_payload.size());
+    output.WriteString(int32_payload);
+    output.WriteTag(WireFormatLite::MakeTag(
+        unittest::TestPackedTypes::kPackedSint64FieldNumber,
+        WireFormatLite::WIRETYPE_LENGTH_DELIMITED));
+    output.WriteVarint32(sint64_payload.size());
+    output.WriteString(sint64_payload);
+  }
+
+  EXPECT_EQ(expected, message.SerializeAsString());
+  for (int block_size : {1, 7, 16, 17, 100}) {
+    std::string buffer(expected.size(), '\0');
+    {
+      io::ArrayOutputStream raw_output(&buffer[0], buffer.size(), block_size);
+      io::CodedOutputStream output(&raw_output);
+      message.SerializeWithCachedSizes(&output);
+      ASSERT_FALSE(output.HadError()) << block_size;
+    }
+    EXPECT_EQ(expected, buffer) << block_size;
+  }
+}
+
 TEST(WireFormatTest, ParsePackedExtensions) {
   unittest::TestPackedExtensions source, dest;
   std::string data;
@@ -49,6 +49,15 @@ build_cpp_tcmalloc() {
   PPROF_PATH=/usr/bin/google-pprof HEAPCHECK=strict ./protobuf-test
 }
 
+build_cpp_map_swiss_table() {
+  # Map fields use the open addressing hash table of map.h when
+  # PROTOBUF_MAP_SWISS_TABLE is defined.  The library and the tests must agree
+  # on it, so everything is rebuilt with it.
+  internal_build_cpp
+  ./configure CXXFLAGS="-std=c++11 -DPROTOBUF_MAP_SWISS_TABLE" && make clean
+  make check -j$(nproc) || (cat src/test-suite.log; false)
+}
+
 build_cpp_distcheck() {
   grep -q -- "-Og" src/Makefile.am &&
     echo "The -Og flag is incompatible with Clang versions older than 4.0." &&
@@ -780,6 +789,7 @@ if [ "$#" -ne 1 ]; then
   echo "
 Usage: $0 { cpp |
             cpp_distcheck |
+            cpp_map_swiss_table |
             csharp |
             java_jdk7 |
             java_oracle7 |